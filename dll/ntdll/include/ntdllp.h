@@ -8,8 +8,8 @@
 
 #pragma once
 
-#define LDR_HASH_TABLE_ENTRIES 32
-#define LDR_GET_HASH_ENTRY(x) (RtlUpcaseUnicodeChar((x)) & (LDR_HASH_TABLE_ENTRIES - 1))
+#define LDR_HASH_TABLE_ENTRIES 128
+#define LDR_GET_HASH_ENTRY(x) ((x) & (LDR_HASH_TABLE_ENTRIES - 1))
 
 /* LdrpUpdateLoadCount2 flags */
 #define LDRP_UPDATE_REFCOUNT   0x01
@@ -29,6 +29,17 @@ typedef struct _LDRP_TLS_DATA
     IMAGE_TLS_DIRECTORY TlsDirectory;
 } LDRP_TLS_DATA, *PLDRP_TLS_DATA;
 
+/* Loader-private data kept behind every entry from LdrpAllocateDataTableEntry */
+typedef struct _LDRP_DATA_TABLE_ENTRY
+{
+    LDR_DATA_TABLE_ENTRY Entry;
+    ULONG BaseNameHashValue;
+    PVOID ExportNameCache;
+} LDRP_DATA_TABLE_ENTRY, *PLDRP_DATA_TABLE_ENTRY;
+
+#define LdrpGetPrivateEntry(LdrEntry) \
+    CONTAINING_RECORD((LdrEntry), LDRP_DATA_TABLE_ENTRY, Entry)
+
 typedef
 NTSTATUS
 (NTAPI* PLDR_APP_COMPAT_DLL_REDIRECTION_CALLBACK_FUNCTION)(
@@ -83,7 +94,7 @@ VOID NTAPI LdrpEnsureLoaderLockIsHeld(VOID);
 /* ldrpe.c */
 NTSTATUS
 NTAPI
-LdrpSnapThunk(IN PVOID ExportBase,
+LdrpSnapThunk(IN PLDR_DATA_TABLE_ENTRY ExportLdrEntry,
               IN PVOID ImportBase,
               IN PIMAGE_THUNK_DATA OriginalThunk,
               IN OUT PIMAGE_THUNK_DATA Thunk,
@@ -96,6 +107,9 @@ NTSTATUS NTAPI
 LdrpWalkImportDescriptor(IN LPWSTR DllPath OPTIONAL,
                          IN PLDR_DATA_TABLE_ENTRY LdrEntry);
 
+VOID NTAPI
+LdrpFreeExportNameCache(IN PLDR_DATA_TABLE_ENTRY LdrEntry);
+
 /* libsupp.c */
 NTSYSAPI
 NTSTATUS
@@ -121,6 +135,9 @@ LdrpGetProcedureAddress(
 PLDR_DATA_TABLE_ENTRY NTAPI
 LdrpAllocateDataTableEntry(IN PVOID BaseAddress);
 
+ULONG NTAPI
+LdrpHashDllName(IN PCUNICODE_STRING DllName);
+
 VOID NTAPI
 LdrpInsertMemoryTableEntry(IN PLDR_DATA_TABLE_ENTRY LdrEntry);
 
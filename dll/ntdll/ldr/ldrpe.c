@@ -18,6 +18,15 @@
 PLDR_MANIFEST_PROBER_ROUTINE LdrpManifestProberRoutine;
 ULONG LdrpNormalSnap;
 
+/* Export name lookup table of a module, built the first time a hint misses */
+typedef struct _LDRP_EXPORT_NAME_CACHE
+{
+    ULONG Mask;
+    ULONG Slots[ANYSIZE_ARRAY]; /* Name table index + 1, zero if free */
+} LDRP_EXPORT_NAME_CACHE, *PLDRP_EXPORT_NAME_CACHE;
+
+#define LDRP_EXPORT_NAME_CACHE_MIN_NAMES 16
+
 /* FUNCTIONS *****************************************************************/
 
 
@@ -161,7 +170,7 @@ LdrpSnapIAT(IN PLDR_DATA_TABLE_ENTRY ExportLdrEntry,
             /* Snap the thunk */
             _SEH2_TRY
             {
-                Status = LdrpSnapThunk(ExportLdrEntry->DllBase,
+                Status = LdrpSnapThunk(ExportLdrEntry,
                                        ImportLdrEntry->DllBase,
                                        OriginalThunk,
                                        FirstThunk,
@@ -217,7 +226,7 @@ LdrpSnapIAT(IN PLDR_DATA_TABLE_ENTRY ExportLdrEntry,
             /* Snap the Thunk */
             _SEH2_TRY
             {
-                Status = LdrpSnapThunk(ExportLdrEntry->DllBase,
+                Status = LdrpSnapThunk(ExportLdrEntry,
                                        ImportLdrEntry->DllBase,
                                        OriginalThunk,
                                        FirstThunk,
@@ -665,6 +674,102 @@ LdrpNameToOrdinal(IN LPSTR ImportName,
     return OrdinalTable[Next];
 }
 
+static
+ULONG
+LdrpHashExportName(IN LPCSTR Name)
+{
+    ULONG HashValue = 0;
+
+    while (*Name) HashValue = HashValue * 65599 + (UCHAR)*Name++;
+
+    /* Fold the high bits in, only the low ones pick the slot */
+    return HashValue ^ (HashValue >> 16);
+}
+
+static
+PLDRP_EXPORT_NAME_CACHE
+LdrpBuildExportNameCache(IN PVOID ExportBase,
+                         IN ULONG NumberOfNames,
+                         IN PULONG NameTable)
+{
+    PLDRP_EXPORT_NAME_CACHE Cache;
+    ULONG Size, i, j;
+
+    /* Keep the table at most half full */
+    if (NumberOfNames > MAXUSHORT) return NULL;
+    for (Size = 32; Size < NumberOfNames * 2; Size <<= 1);
+
+    Cache = RtlAllocateHeap(LdrpHeap,
+                            HEAP_ZERO_MEMORY,
+                            FIELD_OFFSET(LDRP_EXPORT_NAME_CACHE, Slots[Size]));
+    if (!Cache) return NULL;
+    Cache->Mask = Size - 1;
+
+    /* Insert every name with linear probing */
+    for (i = 0; i < NumberOfNames; i++)
+    {
+        j = LdrpHashExportName((LPSTR)((ULONG_PTR)ExportBase + NameTable[i])) & Cache->Mask;
+        while (Cache->Slots[j]) j = (j + 1) & Cache->Mask;
+        Cache->Slots[j] = i + 1;
+    }
+
+    return Cache;
+}
+
+static
+USHORT
+LdrpLookupExportName(IN PLDR_DATA_TABLE_ENTRY ExportLdrEntry,
+                     IN LPSTR ImportName,
+                     IN ULONG NumberOfNames,
+                     IN PULONG NameTable,
+                     IN PUSHORT OrdinalTable)
+{
+    PLDRP_DATA_TABLE_ENTRY PrivateEntry = LdrpGetPrivateEntry(ExportLdrEntry);
+    PLDRP_EXPORT_NAME_CACHE Cache = PrivateEntry->ExportNameCache;
+    PVOID ExportBase = ExportLdrEntry->DllBase;
+    ULONG i, Index;
+
+    /* Build the cache on first use, small export tables don't need one */
+    if (!Cache && (NumberOfNames >= LDRP_EXPORT_NAME_CACHE_MIN_NAMES))
+    {
+        Cache = LdrpBuildExportNameCache(ExportBase, NumberOfNames, NameTable);
+        PrivateEntry->ExportNameCache = Cache;
+    }
+
+    /* Without one, use the binary search */
+    if (!Cache)
+    {
+        return LdrpNameToOrdinal(ImportName,
+                                 NumberOfNames,
+                                 ExportBase,
+                                 NameTable,
+                                 OrdinalTable);
+    }
+
+    /* Probe until we find the name or a free slot */
+    for (i = LdrpHashExportName(ImportName) & Cache->Mask;
+         (Index = Cache->Slots[i]) != 0;
+         i = (i + 1) & Cache->Mask)
+    {
+        if (!strcmp(ImportName, (PCHAR)((ULONG_PTR)ExportBase + NameTable[Index - 1])))
+            return OrdinalTable[Index - 1];
+    }
+
+    return -1;
+}
+
+VOID
+NTAPI
+LdrpFreeExportNameCache(IN PLDR_DATA_TABLE_ENTRY LdrEntry)
+{
+    PLDRP_DATA_TABLE_ENTRY PrivateEntry = LdrpGetPrivateEntry(LdrEntry);
+
+    if (!PrivateEntry->ExportNameCache) return;
+
+    RtlFreeHeap(LdrpHeap, 0, PrivateEntry->ExportNameCache);
+    PrivateEntry->ExportNameCache = NULL;
+}
+
 NTSTATUS
 NTAPI
 LdrpWalkImportDescriptor(IN LPWSTR DllPath OPTIONAL,
@@ -934,7 +1039,7 @@ done:
 
 NTSTATUS
 NTAPI
-LdrpSnapThunk(IN PVOID ExportBase,
+LdrpSnapThunk(IN PLDR_DATA_TABLE_ENTRY ExportLdrEntry,
               IN PVOID ImportBase,
               IN PIMAGE_THUNK_DATA OriginalThunk,
               IN OUT PIMAGE_THUNK_DATA Thunk,
@@ -943,6 +1048,7 @@ LdrpSnapThunk(IN PVOID ExportBase,
               IN BOOLEAN Static,
               IN LPSTR DllName)
 {
+    PVOID ExportBase = ExportLdrEntry->DllBase;
     BOOLEAN IsOrdinal;
     USHORT Ordinal;
     ULONG OriginalOrdinal = 0;
@@ -999,12 +1105,12 @@ LdrpSnapThunk(IN PVOID ExportBase,
         }
         else
         {
-            /* Well bummer, hint didn't work, do it the long way */
-            Ordinal = LdrpNameToOrdinal(ImportName,
-                                        ExportDirectory->NumberOfNames,
-                                        ExportBase,
-                                        NameTable,
-                                        OrdinalTable);
+            /* Well bummer, hint didn't work, look it up by name */
+            Ordinal = LdrpLookupExportName(ExportLdrEntry,
+                                           ImportName,
+                                           ExportDirectory->NumberOfNames,
+                                           NameTable,
+                                           OrdinalTable);
         }
     }
 
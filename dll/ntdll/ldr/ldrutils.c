@@ -1527,6 +1527,7 @@ PLDR_DATA_TABLE_ENTRY
 NTAPI
 LdrpAllocateDataTableEntry(IN PVOID BaseAddress)
 {
+    PLDRP_DATA_TABLE_ENTRY PrivateEntry;
     PLDR_DATA_TABLE_ENTRY LdrEntry = NULL;
     PIMAGE_NT_HEADERS NtHeader;
 
@@ -1536,15 +1537,16 @@ LdrpAllocateDataTableEntry(IN PVOID BaseAddress)
 
     if (NtHeader)
     {
-        /* Allocate an entry */
-        LdrEntry = RtlAllocateHeap(LdrpHeap,
-                                   HEAP_ZERO_MEMORY,
-                                   sizeof(LDR_DATA_TABLE_ENTRY));
+        /* Allocate an entry, along with our private data */
+        PrivateEntry = RtlAllocateHeap(LdrpHeap,
+                                       HEAP_ZERO_MEMORY,
+                                       sizeof(LDRP_DATA_TABLE_ENTRY));
 
         /* Make sure we got one */
-        if (LdrEntry)
+        if (PrivateEntry)
         {
             /* Set it up */
+            LdrEntry = &PrivateEntry->Entry;
             LdrEntry->DllBase = BaseAddress;
             LdrEntry->SizeOfImage = NtHeader->OptionalHeader.SizeOfImage;
             LdrEntry->TimeDateStamp = NtHeader->FileHeader.TimeDateStamp;
@@ -1556,6 +1558,22 @@ LdrpAllocateDataTableEntry(IN PVOID BaseAddress)
     return LdrEntry;
 }
 
+ULONG
+NTAPI
+LdrpHashDllName(IN PCUNICODE_STRING DllName)
+{
+    ULONG HashValue = 0;
+    USHORT i;
+
+    /* Hash the whole name, upcased the same way lookups compare it */
+    for (i = 0; i < DllName->Length / sizeof(WCHAR); i++)
+    {
+        HashValue = HashValue * 65599 + RtlUpcaseUnicodeChar(DllName->Buffer[i]);
+    }
+
+    return HashValue;
+}
+
 VOID
 NTAPI
 LdrpInsertMemoryTableEntry(IN PLDR_DATA_TABLE_ENTRY LdrEntry)
@@ -1564,7 +1582,8 @@ LdrpInsertMemoryTableEntry(IN PLDR_DATA_TABLE_ENTRY LdrEntry)
     ULONG i;
 
     /* Insert into hash table */
-    i = LDR_GET_HASH_ENTRY(LdrEntry->BaseDllName.Buffer[0]);
+    LdrpGetPrivateEntry(LdrEntry)->BaseNameHashValue = LdrpHashDllName(&LdrEntry->BaseDllName);
+    i = LDR_GET_HASH_ENTRY(LdrpGetPrivateEntry(LdrEntry)->BaseNameHashValue);
     InsertTailList(&LdrpHashTable[i], &LdrEntry->HashLinks);
 
     /* Insert into other lists */
@@ -1591,8 +1610,11 @@ LdrpFinalizeAndDeallocateDataTableEntry(IN PLDR_DATA_TABLE_ENTRY Entry)
     /* Release the full dll name string */
     if (Entry->FullDllName.Buffer) LdrpFreeUnicodeString(&Entry->FullDllName);
 
+    /* Release the export name lookup cache */
+    LdrpFreeExportNameCache(Entry);
+
     /* Finally free the entry's memory */
-    RtlFreeHeap(LdrpHeap, 0, Entry);
+    RtlFreeHeap(LdrpHeap, 0, LdrpGetPrivateEntry(Entry));
 }
 
 BOOLEAN
@@ -1961,7 +1983,7 @@ LdrpCheckForLoadedDll(IN PWSTR DllPath,
                       IN BOOLEAN RedirectedDll,
                       OUT PLDR_DATA_TABLE_ENTRY *LdrEntry)
 {
-    ULONG HashIndex;
+    ULONG HashValue;
     PLIST_ENTRY ListHead, ListEntry;
     PLDR_DATA_TABLE_ENTRY CurEntry;
     BOOLEAN FullPath = FALSE;
@@ -1990,19 +2012,20 @@ lookinhash:
     {
         /* FIXME: if we get redirected dll it means that we also get a full path so we need to find its filename for the hash lookup */
 
-        /* Get hash index */
-        HashIndex = LDR_GET_HASH_ENTRY(DllName->Buffer[0]);
+        /* Get the hash of the whole name */
+        HashValue = LdrpHashDllName(DllName);
 
         /* Traverse that list */
-        ListHead = &LdrpHashTable[HashIndex];
+        ListHead = &LdrpHashTable[LDR_GET_HASH_ENTRY(HashValue)];
         ListEntry = ListHead->Flink;
         while (ListEntry != ListHead)
         {
             /* Get the current entry */
             CurEntry = CONTAINING_RECORD(ListEntry, LDR_DATA_TABLE_ENTRY, HashLinks);
 
-            /* Check base name of that module */
-            if (RtlEqualUnicodeString(DllName, &CurEntry->BaseDllName, TRUE))
+            /* Check base name of that module, the hash rules out most of them */
+            if ((LdrpGetPrivateEntry(CurEntry)->BaseNameHashValue == HashValue) &&
+                RtlEqualUnicodeString(DllName, &CurEntry->BaseDllName, TRUE))
             {
                 /* It matches, return it */
                 *LdrEntry = CurEntry;
@@ -2343,7 +2366,7 @@ LdrpGetProcedureAddress(
         }
 
         /* Now get the thunk */
-        Status = LdrpSnapThunk(LdrEntry->DllBase,
+        Status = LdrpSnapThunk(LdrEntry,
                                ImageBase,
                                &Thunk,
                                &Thunk,
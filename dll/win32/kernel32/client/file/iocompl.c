@@ -184,6 +184,65 @@ GetQueuedCompletionStatus(IN HANDLE CompletionHandle,
     return TRUE;
 }
 
+#if (DLL_EXPORT_VERSION >= _WIN32_WINNT_VISTA)
+/*
+ * @implemented
+ */
+BOOL
+WINAPI
+GetQueuedCompletionStatusEx(IN HANDLE CompletionPort,
+                            OUT LPOVERLAPPED_ENTRY lpCompletionPortEntries,
+                            IN ULONG ulCount,
+                            OUT PULONG ulNumEntriesRemoved,
+                            IN DWORD dwMilliseconds,
+                            IN BOOL fAlertable)
+{
+    NTSTATUS Status;
+    LARGE_INTEGER Time;
+    PLARGE_INTEGER TimePtr;
+
+    /* An OVERLAPPED_ENTRY has the layout of the native completion information */
+    C_ASSERT(sizeof(OVERLAPPED_ENTRY) == sizeof(FILE_IO_COMPLETION_INFORMATION));
+
+    /* Convert the timeout and then call the native API */
+    TimePtr = BaseFormatTimeOut(&Time, dwMilliseconds);
+    Status = NtRemoveIoCompletionEx(CompletionPort,
+                                    (PFILE_IO_COMPLETION_INFORMATION)lpCompletionPortEntries,
+                                    ulCount,
+                                    ulNumEntriesRemoved,
+                                    TimePtr,
+                                    fAlertable ? TRUE : FALSE);
+    if (!(NT_SUCCESS(Status)) || (Status == STATUS_TIMEOUT) || (Status == STATUS_USER_APC))
+    {
+        /* Nothing was dequeued */
+        *ulNumEntriesRemoved = 0;
+
+        /* Check what kind of error we got */
+        if (Status == STATUS_TIMEOUT)
+        {
+            /* Timeout error is set directly since there's no conversion */
+            SetLastError(WAIT_TIMEOUT);
+        }
+        else if (Status == STATUS_USER_APC)
+        {
+            /* An APC was delivered during an alertable wait */
+            SetLastError(WAIT_IO_COMPLETION);
+        }
+        else
+        {
+            /* Any other error gets converted */
+            BaseSetLastNTError(Status);
+        }
+
+        /* This is a failure case */
+        return FALSE;
+    }
+
+    /* Unlike GetQueuedCompletionStatus, per-packet errors are left to the caller */
+    return TRUE;
+}
+#endif
+
 /*
  * @implemented
  */
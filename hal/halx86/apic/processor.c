@@ -13,6 +13,7 @@
 
 KAFFINITY HalpActiveProcessors;
 KAFFINITY HalpDefaultInterruptAffinity;
+volatile KAFFINITY HalpHaltedProcessors;
 
 /* PRIVATE FUNCTIONS *********************************************************/
 
@@ -45,9 +46,17 @@ VOID
 NTAPI
 HalProcessorIdle(VOID)
 {
+    ULONG Number = KeGetCurrentProcessorNumber();
+
+    /* Halted processors don't need the clock IPI, the kernel catches up on wake */
+    InterlockedBitTestAndSetAffinity(&HalpHaltedProcessors, Number);
+
     /* Enable interrupts and halt the processor */
     _enable();
     __halt();
+
+    /* Something woke us up, take clock ticks again */
+    InterlockedBitTestAndResetAffinity(&HalpHaltedProcessors, Number);
 }
 
 /* EOF */
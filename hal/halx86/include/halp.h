@@ -613,6 +613,7 @@ extern PADDRESS_USAGE HalpAddressUsageList;
 extern LARGE_INTEGER HalpPerfCounter;
 
 extern KAFFINITY HalpActiveProcessors;
+extern volatile KAFFINITY HalpHaltedProcessors;
 
 extern BOOLEAN HalDisableFirmwareMapper;
 extern PWCHAR HalHardwareIdString;
@@ -39,6 +39,10 @@ FASTCALL
 HalpBroadcastClockIpi(
     _In_ UCHAR Vector)
 {
-    /* Send a clock IPI to all processors */
-    HalpBroadcastIpiSpecifyVector(Vector, FALSE);
+    KAFFINITY TargetSet;
+
+    /* Send a clock IPI to all other processors that aren't halted */
+    TargetSet = HalpActiveProcessors & ~HalpHaltedProcessors;
+    TargetSet &= ~KeGetCurrentPrcb()->SetMember;
+    if (TargetSet) HalRequestIpiSpecifyVector(TargetSet, Vector);
 }
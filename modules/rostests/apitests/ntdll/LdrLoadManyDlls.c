@@ -0,0 +1,252 @@
+/*
+ * PROJECT:     ReactOS API tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for loader lookups in a process with many DLLs
+ */
+
+#include "precomp.h"
+
+#define DLL_COUNT      200
+#define LOOKUP_ROUNDS  2
+
+static WCHAR DllDirectory[MAX_PATH];
+static HMODULE Modules[DLL_COUNT];
+
+static
+BOOL
+WriteDllCopy(
+    _In_ PCWSTR Path,
+    _In_ PVOID Data,
+    _In_ DWORD Size)
+{
+    HANDLE File;
+    DWORD Written;
+    BOOL Success;
+
+    File = CreateFileW(Path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (File == INVALID_HANDLE_VALUE)
+        return FALSE;
+    Success = WriteFile(File, Data, Size, &Written, NULL) && (Written == Size);
+    CloseHandle(File);
+    return Success;
+}
+
+static
+VOID
+GetDllPath(
+    _In_ ULONG Index,
+    _Out_writes_(MAX_PATH) PWSTR Path)
+{
+    StringCchPrintfW(Path, MAX_PATH, L"%s\\ldr%03lu.dll", DllDirectory, Index);
+}
+
+/* Writes DLL_COUNT copies of the empty test DLL, each under its own name */
+static
+BOOL
+CreateDlls(VOID)
+{
+    WCHAR Path[MAX_PATH];
+    HRSRC Resource;
+    PVOID Data;
+    DWORD Size;
+    ULONG i;
+
+    Resource = FindResourceW(NULL, MAKEINTRESOURCEW(102), MAKEINTRESOURCEW(10));
+    if (!Resource)
+        return FALSE;
+    Size = SizeofResource(NULL, Resource);
+    Data = LockResource(LoadResource(NULL, Resource));
+    if (!Size || !Data)
+        return FALSE;
+
+    GetTempPathW(RTL_NUMBER_OF(Path), Path);
+    StringCchPrintfW(DllDirectory, RTL_NUMBER_OF(DllDirectory), L"%sldrmany%lu", Path, GetCurrentProcessId());
+    if (!CreateDirectoryW(DllDirectory, NULL))
+        return FALSE;
+
+    for (i = 0; i < DLL_COUNT; i++)
+    {
+        GetDllPath(i, Path);
+        if (!WriteDllCopy(Path, Data, Size))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static
+VOID
+DeleteDlls(VOID)
+{
+    WCHAR Path[MAX_PATH];
+    ULONG i;
+
+    for (i = 0; i < DLL_COUNT; i++)
+    {
+        GetDllPath(i, Path);
+        DeleteFileW(Path);
+    }
+    RemoveDirectoryW(DllDirectory);
+}
+
+static
+ULONGLONG
+Rate(
+    _In_ ULONG Count,
+    _In_ PLARGE_INTEGER Start,
+    _In_ PLARGE_INTEGER End,
+    _In_ PLARGE_INTEGER Frequency)
+{
+    if (End->QuadPart == Start->QuadPart)
+        return 0;
+    return (ULONGLONG)Count * Frequency->QuadPart / (End->QuadPart - Start->QuadPart);
+}
+
+static
+VOID
+TestModuleLookups(VOID)
+{
+    LARGE_INTEGER Start, End, Frequency;
+    WCHAR Name[16];
+    UNICODE_STRING DllName;
+    PVOID Handle;
+    NTSTATUS Status;
+    ULONG i, Round, Failed = 0;
+
+    /* Names are matched case-insensitively */
+    StringCchPrintfW(Name, RTL_NUMBER_OF(Name), L"LDR%03lu.DLL", 7UL);
+    RtlInitUnicodeString(&DllName, Name);
+    Handle = NULL;
+    Status = LdrGetDllHandle(NULL, NULL, &DllName, &Handle);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok_ptr(Handle, Modules[7]);
+
+    /* Names that aren't loaded aren't found */
+    StringCchPrintfW(Name, RTL_NUMBER_OF(Name), L"ldr%03lu.dll", (ULONG)DLL_COUNT);
+    RtlInitUnicodeString(&DllName, Name);
+    Status = LdrGetDllHandle(NULL, NULL, &DllName, &Handle);
+    ok_ntstatus(Status, STATUS_DLL_NOT_FOUND);
+
+    NtQueryPerformanceCounter(&Start, &Frequency);
+    for (Round = 0; Round < LOOKUP_ROUNDS; Round++)
+    {
+        for (i = 0; i < DLL_COUNT; i++)
+        {
+            StringCchPrintfW(Name, RTL_NUMBER_OF(Name), L"ldr%03lu.dll", i);
+            RtlInitUnicodeString(&DllName, Name);
+            Status = LdrGetDllHandle(NULL, NULL, &DllName, &Handle);
+            if (!NT_SUCCESS(Status) || Handle != Modules[i])
+                Failed++;
+        }
+    }
+    NtQueryPerformanceCounter(&End, NULL);
+
+    ok(Failed == 0, "%lu module lookups failed\n", Failed);
+    trace("%u modules: %I64u handle lookups/s\n", DLL_COUNT,
+          Rate(DLL_COUNT * LOOKUP_ROUNDS, &Start, &End, &Frequency));
+}
+
+/* Looks up every export of a module by name, which never matches the hint */
+static
+VOID
+TestExportLookups(
+    _In_ PCWSTR ModuleName)
+{
+    LARGE_INTEGER Start, End, Frequency;
+    PIMAGE_EXPORT_DIRECTORY ExportDirectory;
+    PULONG NameTable, FunctionTable;
+    PUSHORT OrdinalTable;
+    ANSI_STRING Name;
+    PVOID Base, Address;
+    ULONG ExportSize, Rva, i, Round, Failed = 0, Lookups = 0;
+    NTSTATUS Status;
+
+    Base = GetModuleHandleW(ModuleName);
+    ExportDirectory = RtlImageDirectoryEntryToData(Base, TRUE, IMAGE_DIRECTORY_ENTRY_EXPORT, &ExportSize);
+    if (!ExportDirectory)
+    {
+        skip("%ls has no exports\n", ModuleName);
+        return;
+    }
+    NameTable = (PULONG)((ULONG_PTR)Base + ExportDirectory->AddressOfNames);
+    OrdinalTable = (PUSHORT)((ULONG_PTR)Base + ExportDirectory->AddressOfNameOrdinals);
+    FunctionTable = (PULONG)((ULONG_PTR)Base + ExportDirectory->AddressOfFunctions);
+
+    /* The second round is answered from the cached name lookups */
+    NtQueryPerformanceCounter(&Start, &Frequency);
+    for (Round = 0; Round < LOOKUP_ROUNDS; Round++)
+    {
+        for (i = 0; i < ExportDirectory->NumberOfNames; i++)
+        {
+            RtlInitAnsiString(&Name, (PCHAR)((ULONG_PTR)Base + NameTable[i]));
+            Status = LdrGetProcedureAddress(Base, &Name, 0, &Address);
+            Lookups++;
+            if (!NT_SUCCESS(Status))
+            {
+                Failed++;
+                continue;
+            }
+
+            /* Forwarders resolve into other modules, check the rest */
+            Rva = FunctionTable[OrdinalTable[i]];
+            if ((Rva < (ULONG_PTR)ExportDirectory - (ULONG_PTR)Base) ||
+                (Rva >= (ULONG_PTR)ExportDirectory - (ULONG_PTR)Base + ExportSize))
+            {
+                if (Address != (PVOID)((ULONG_PTR)Base + Rva))
+                    Failed++;
+            }
+        }
+    }
+    NtQueryPerformanceCounter(&End, NULL);
+
+    ok(Failed == 0, "%lu of %lu export lookups in %ls failed\n", Failed, Lookups, ModuleName);
+
+    /* Unknown names still fail */
+    RtlInitAnsiString(&Name, "NoSuchExportInThisModule");
+    Status = LdrGetProcedureAddress(Base, &Name, 0, &Address);
+    ok_ntstatus(Status, STATUS_PROCEDURE_NOT_FOUND);
+
+    trace("%ls: %lu names, %I64u export lookups/s\n", ModuleName,
+          ExportDirectory->NumberOfNames, Rate(Lookups, &Start, &End, &Frequency));
+}
+
+START_TEST(LdrLoadManyDlls)
+{
+    LARGE_INTEGER Start, End, Frequency;
+    WCHAR Path[MAX_PATH];
+    ULONG i, Loaded = 0;
+
+    TestExportLookups(L"ntdll.dll");
+    TestExportLookups(L"kernel32.dll");
+
+    if (!CreateDlls())
+    {
+        skip("Failed to create the test DLLs, error %lu\n", GetLastError());
+        DeleteDlls();
+        return;
+    }
+
+    /* Every copy loads as a module of its own, trace how loading scales with the list */
+    NtQueryPerformanceCounter(&Start, &Frequency);
+    for (i = 0; i < DLL_COUNT; i++)
+    {
+        GetDllPath(i, Path);
+        Modules[i] = LoadLibraryW(Path);
+        if (!Modules[i])
+            break;
+        Loaded++;
+    }
+    NtQueryPerformanceCounter(&End, NULL);
+
+    ok_dec(Loaded, DLL_COUNT);
+    trace("%lu modules: %I64u loads/s\n", Loaded, Rate(Loaded, &Start, &End, &Frequency));
+
+    if (Loaded == DLL_COUNT)
+        TestModuleLookups();
+
+    for (i = 0; i < Loaded; i++)
+    {
+        FreeLibrary(Modules[i]);
+    }
+    DeleteDlls();
+}
@@ -744,6 +744,177 @@ CheckSomeDefaultAddresses(VOID)
 #endif
 }
 
+static
+ULONGLONG
+TimeRandomAccess(
+    PUCHAR Buffer,
+    SIZE_T Size,
+    ULONG Accesses)
+{
+    LARGE_INTEGER Start, Stop, Frequency;
+    ULONG Seed = 0x12345678;
+    ULONG i;
+
+    NtQueryPerformanceCounter(&Start, &Frequency);
+    for (i = 0; i < Accesses; i++)
+    {
+        /* Touch one byte in a pseudo-random page so every access is a new TLB lookup */
+        Seed = Seed * 1103515245 + 12345;
+        Buffer[((SIZE_T)Seed * PAGE_SIZE + (i & (PAGE_SIZE - 1))) % Size]++;
+    }
+    NtQueryPerformanceCounter(&Stop, NULL);
+
+    return (Stop.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart;
+}
+
+static
+VOID
+CheckLargePages(VOID)
+{
+    NTSTATUS Status;
+    BOOLEAN OldPrivilege;
+    SIZE_T LargePageMinimum, Size, FreeSize;
+    PVOID LargeBase, SmallBase, FreeBase;
+    MEMORY_BASIC_INFORMATION MemoryInfo;
+    SIZE_T Offset;
+    ULONG Mismatches;
+    ULONGLONG LargeTime, SmallTime;
+    const ULONG Accesses = 256 * 1024;
+
+    LargePageMinimum = SharedUserData->LargePageMinimum;
+    if (LargePageMinimum == 0)
+    {
+        skip("Large pages are not supported\n");
+        return;
+    }
+
+    Status = RtlAdjustPrivilege(SE_LOCK_MEMORY_PRIVILEGE, TRUE, FALSE, &OldPrivilege);
+    if (!NT_SUCCESS(Status))
+    {
+        skip("Cannot acquire SeLockMemoryPrivilege\n");
+        return;
+    }
+
+    /* Large pages can't be reserved without committing them */
+    LargeBase = NULL;
+    Size = LargePageMinimum;
+    Status = NtAllocateVirtualMemory(NtCurrentProcess(),
+                                     &LargeBase,
+                                     0,
+                                     &Size,
+                                     MEM_RESERVE | MEM_LARGE_PAGES,
+                                     PAGE_READWRITE);
+    ok_ntstatus(Status, STATUS_INVALID_PARAMETER);
+
+    /* The size must be a multiple of the large page size */
+    LargeBase = NULL;
+    Size = LargePageMinimum + PAGE_SIZE;
+    Status = NtAllocateVirtualMemory(NtCurrentProcess(),
+                                     &LargeBase,
+                                     0,
+                                     &Size,
+                                     MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                                     PAGE_READWRITE);
+    ok_ntstatus(Status, STATUS_INVALID_PARAMETER);
+
+    /* Large pages cannot be guarded or uncached */
+    LargeBase = NULL;
+    Size = LargePageMinimum;
+    Status = NtAllocateVirtualMemory(NtCurrentProcess(),
+                                     &LargeBase,
+                                     0,
+                                     &Size,
+                                     MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                                     PAGE_READWRITE | PAGE_GUARD);
+    ok_ntstatus(Status, STATUS_INVALID_PAGE_PROTECTION);
+
+    LargeBase = NULL;
+    Size = 8 * LargePageMinimum;
+    Status = NtAllocateVirtualMemory(NtCurrentProcess(),
+                                     &LargeBase,
+                                     0,
+                                     &Size,
+                                     MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                                     PAGE_READWRITE);
+    if (Status == STATUS_INSUFFICIENT_RESOURCES || Status == STATUS_NO_MEMORY)
+    {
+        skip("Not enough contiguous physical memory for large pages\n");
+        RtlAdjustPrivilege(SE_LOCK_MEMORY_PRIVILEGE, OldPrivilege, FALSE, &OldPrivilege);
+        return;
+    }
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlAdjustPrivilege(SE_LOCK_MEMORY_PRIVILEGE, OldPrivilege, FALSE, &OldPrivilege);
+        return;
+    }
+    ok(((ULONG_PTR)LargeBase & (LargePageMinimum - 1)) == 0, "LargeBase = %p\n", LargeBase);
+    ok_eq_size(Size, 8 * LargePageMinimum);
+
+    /* The whole region is committed up front and zeroed */
+    Status = NtQueryVirtualMemory(NtCurrentProcess(),
+                                  LargeBase,
+                                  MemoryBasicInformation,
+                                  &MemoryInfo,
+                                  sizeof(MemoryInfo),
+                                  NULL);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok_hex(MemoryInfo.State, MEM_COMMIT);
+    ok_hex(MemoryInfo.Protect, PAGE_READWRITE);
+    ok_eq_size(MemoryInfo.RegionSize, Size);
+    ok_hex(*(PULONG)LargeBase, 0);
+    ok_hex(*(PULONG)((ULONG_PTR)LargeBase + Size - sizeof(ULONG)), 0);
+
+    /* Large page regions can only be released as a whole */
+    FreeBase = LargeBase;
+    FreeSize = LargePageMinimum;
+    Status = NtFreeVirtualMemory(NtCurrentProcess(), &FreeBase, &FreeSize, MEM_RELEASE);
+    ok_ntstatus(Status, STATUS_UNABLE_TO_FREE_VM);
+
+    /* Every small page within the large ones is backed by its own memory */
+    for (Offset = 0; Offset < Size; Offset += PAGE_SIZE)
+    {
+        *(PSIZE_T)((ULONG_PTR)LargeBase + Offset) = Offset;
+    }
+    Mismatches = 0;
+    for (Offset = 0; Offset < Size; Offset += PAGE_SIZE)
+    {
+        if (*(PSIZE_T)((ULONG_PTR)LargeBase + Offset) != Offset)
+            Mismatches++;
+    }
+    ok(Mismatches == 0, "%lu pages did not keep their contents\n", Mismatches);
+
+    /* Compare random access over the same amount of small pages */
+    SmallBase = NULL;
+    Status = NtAllocateVirtualMemory(NtCurrentProcess(),
+                                     &SmallBase,
+                                     0,
+                                     &Size,
+                                     MEM_RESERVE | MEM_COMMIT,
+                                     PAGE_READWRITE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (NT_SUCCESS(Status))
+    {
+        /* Fault the small pages in first, so only TLB misses are measured */
+        RtlFillMemory(SmallBase, Size, 0);
+
+        LargeTime = TimeRandomAccess(LargeBase, Size, Accesses);
+        SmallTime = TimeRandomAccess(SmallBase, Size, Accesses);
+        trace("%lu random accesses over %Iu KB: %I64u us with large pages, %I64u us with small pages\n",
+              Accesses, Size / 1024, LargeTime, SmallTime);
+
+        FreeSize = 0;
+        Status = NtFreeVirtualMemory(NtCurrentProcess(), &SmallBase, &FreeSize, MEM_RELEASE);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+    }
+
+    FreeSize = 0;
+    Status = NtFreeVirtualMemory(NtCurrentProcess(), &LargeBase, &FreeSize, MEM_RELEASE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+    RtlAdjustPrivilege(SE_LOCK_MEMORY_PRIVILEGE, OldPrivilege, FALSE, &OldPrivilege);
+}
+
 #define RUNS 32
 
 START_TEST(NtAllocateVirtualMemory)
@@ -755,6 +926,7 @@ START_TEST(NtAllocateVirtualMemory)
     CheckAlignment();
     CheckAdjacentVADs();
     CheckSomeDefaultAddresses();
+    CheckLargePages();
 
     Size1 = 32;
     Mem1 = Allocate(Size1);
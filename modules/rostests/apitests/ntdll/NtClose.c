@@ -0,0 +1,176 @@
+/*
+ * PROJECT:     ReactOS API tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for NtClose
+ */
+
+#include "precomp.h"
+
+#define CHURN_COUNT 10000
+#define MAX_THREADS 4
+#define BATCH_SIZE  64
+
+typedef struct _CHURN_CONTEXT
+{
+    HANDLE Event;
+    HANDLE Start;
+    ULONG Failed;
+} CHURN_CONTEXT, *PCHURN_CONTEXT;
+
+static
+DWORD
+WINAPI
+ChurnThread(
+    _In_ PVOID Context)
+{
+    PCHURN_CONTEXT Churn = Context;
+    HANDLE Handles[BATCH_SIZE];
+    NTSTATUS Status;
+    ULONG i, j;
+
+    NtWaitForSingleObject(Churn->Start, FALSE, NULL);
+    for (i = 0; i < CHURN_COUNT; i += BATCH_SIZE)
+    {
+        /* Hold a batch open and free it in reverse order */
+        for (j = 0; j < BATCH_SIZE; j++)
+        {
+            Status = NtDuplicateObject(NtCurrentProcess(), Churn->Event,
+                                       NtCurrentProcess(), &Handles[j],
+                                       0, 0, DUPLICATE_SAME_ACCESS);
+            if (!NT_SUCCESS(Status))
+            {
+                Churn->Failed++;
+                Handles[j] = NULL;
+            }
+        }
+        for (j = BATCH_SIZE; j-- > 0;)
+        {
+            if (Handles[j] && !NT_SUCCESS(NtClose(Handles[j])))
+                Churn->Failed++;
+        }
+    }
+
+    return 0;
+}
+
+static
+VOID
+TestBasic(
+    _In_ HANDLE Event)
+{
+    HANDLE Handles[BATCH_SIZE];
+    NTSTATUS Status;
+    ULONG i, j;
+
+    /* Handles that are open at the same time are all different */
+    for (i = 0; i < BATCH_SIZE; i++)
+    {
+        Status = NtDuplicateObject(NtCurrentProcess(), Event,
+                                   NtCurrentProcess(), &Handles[i],
+                                   0, 0, DUPLICATE_SAME_ACCESS);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+        for (j = 0; j < i; j++)
+        {
+            ok(Handles[i] != Handles[j], "Handle %p returned twice\n", Handles[i]);
+        }
+    }
+
+    /* A closed handle can't be closed again */
+    for (i = 0; i < BATCH_SIZE; i++)
+    {
+        Status = NtClose(Handles[i]);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+    }
+    Status = NtClose(Handles[0]);
+    ok_ntstatus(Status, STATUS_INVALID_HANDLE);
+
+    /* Freed handles get reused rather than growing the table */
+    Status = NtDuplicateObject(NtCurrentProcess(), Event,
+                               NtCurrentProcess(), &Handles[1],
+                               0, 0, DUPLICATE_SAME_ACCESS);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    for (i = 0; i < BATCH_SIZE; i++)
+    {
+        if (Handles[i] == Handles[1])
+            break;
+    }
+    ok(i < BATCH_SIZE, "Handle %p is not one of the freed ones\n", Handles[1]);
+    NtClose(Handles[1]);
+}
+
+/* Runs Threads concurrent open/close loops and returns handle pairs per second */
+static
+ULONGLONG
+TimeChurn(
+    _In_ HANDLE Event,
+    _In_ ULONG Threads)
+{
+    CHURN_CONTEXT Churn[MAX_THREADS];
+    HANDLE Thread[MAX_THREADS];
+    LARGE_INTEGER Start, End, Frequency;
+    HANDLE StartEvent;
+    NTSTATUS Status;
+    ULONG i;
+
+    Status = NtCreateEvent(&StartEvent, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return 0;
+    for (i = 0; i < Threads; i++)
+    {
+        Churn[i].Event = Event;
+        Churn[i].Start = StartEvent;
+        Churn[i].Failed = 0;
+        Thread[i] = CreateThread(NULL, 0, ChurnThread, &Churn[i], 0, NULL);
+        ok(Thread[i] != NULL, "CreateThread failed with %lu\n", GetLastError());
+    }
+
+    NtQueryPerformanceCounter(&Start, &Frequency);
+    NtSetEvent(StartEvent, NULL);
+    WaitForMultipleObjects(Threads, Thread, TRUE, INFINITE);
+    NtQueryPerformanceCounter(&End, NULL);
+
+    for (i = 0; i < Threads; i++)
+    {
+        ok(Churn[i].Failed == 0, "Thread %lu: %lu failures\n", i, Churn[i].Failed);
+        CloseHandle(Thread[i]);
+    }
+    NtClose(StartEvent);
+
+    if (End.QuadPart == Start.QuadPart)
+        return 0;
+    return (ULONGLONG)Threads * CHURN_COUNT * Frequency.QuadPart / (End.QuadPart - Start.QuadPart);
+}
+
+START_TEST(NtClose)
+{
+    SYSTEM_INFO SystemInfo;
+    ULONGLONG Single, Rate;
+    HANDLE Event;
+    NTSTATUS Status;
+    ULONG Threads;
+
+    Status = NtCreateEvent(&Event, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+    {
+        skip("Failed to create event\n");
+        return;
+    }
+
+    TestBasic(Event);
+
+    /* Concurrent handle churn in one process doesn't fail or corrupt the table, trace how it scales */
+    GetSystemInfo(&SystemInfo);
+    Single = 0;
+    for (Threads = 1; Threads <= max(2, min(SystemInfo.dwNumberOfProcessors, MAX_THREADS)); Threads++)
+    {
+        Rate = TimeChurn(Event, Threads);
+        if (Threads == 1) Single = Rate;
+        trace("%lu thread(s): %I64u open/close pairs/s (%I64u%% of %lu x single)\n",
+              Threads, Rate, Single ? Rate * 100 / (Single * Threads) : 0, Threads);
+    }
+    TestBasic(Event);
+
+    NtClose(Event);
+}
@@ -0,0 +1,313 @@
+/*
+ * PROJECT:     ReactOS API tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for NtFlushKey
+ */
+
+#include "precomp.h"
+
+#define VALUE_COUNT 64
+#define VALUE_SIZE  1024
+#define ROUND_COUNT 32
+
+typedef struct _FLUSHER
+{
+    HANDLE KeyHandle;
+    volatile LONG Stop;
+    LONG Flushes;
+    LONG Failures;
+} FLUSHER, *PFLUSHER;
+
+static UNICODE_STRING HiveFileName;
+static UNICODE_STRING HiveKeyName = RTL_CONSTANT_STRING(L"\\Registry\\Machine\\FlushKeyTest");
+
+static
+NTSTATUS
+SetTestValue(
+    _In_ HANDLE KeyHandle,
+    _In_ ULONG Index,
+    _In_ UCHAR Fill)
+{
+    UCHAR Data[VALUE_SIZE];
+    WCHAR Name[16];
+    UNICODE_STRING ValueName;
+
+    StringCchPrintfW(Name, RTL_NUMBER_OF(Name), L"Value%lu", Index);
+    RtlInitUnicodeString(&ValueName, Name);
+    RtlFillMemory(Data, sizeof(Data), Fill);
+    return NtSetValueKey(KeyHandle, &ValueName, 0, REG_BINARY, Data, sizeof(Data));
+}
+
+static
+BOOLEAN
+CheckTestValue(
+    _In_ HANDLE KeyHandle,
+    _In_ ULONG Index,
+    _In_ UCHAR Fill)
+{
+    UCHAR Buffer[FIELD_OFFSET(KEY_VALUE_PARTIAL_INFORMATION, Data) + VALUE_SIZE];
+    PKEY_VALUE_PARTIAL_INFORMATION Info = (PVOID)Buffer;
+    WCHAR Name[16];
+    UNICODE_STRING ValueName;
+    ULONG ResultLength, i;
+    NTSTATUS Status;
+
+    StringCchPrintfW(Name, RTL_NUMBER_OF(Name), L"Value%lu", Index);
+    RtlInitUnicodeString(&ValueName, Name);
+    Status = NtQueryValueKey(KeyHandle, &ValueName, KeyValuePartialInformation, Info, sizeof(Buffer), &ResultLength);
+    if (!NT_SUCCESS(Status) || Info->DataLength != VALUE_SIZE)
+        return FALSE;
+
+    for (i = 0; i < VALUE_SIZE; i++)
+    {
+        if (Info->Data[i] != Fill)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static
+ULONG
+CountBadValues(
+    _In_ HANDLE KeyHandle,
+    _In_ UCHAR Fill)
+{
+    ULONG i, Failed = 0;
+
+    for (i = 0; i < VALUE_COUNT; i++)
+    {
+        if (!CheckTestValue(KeyHandle, i, Fill))
+            Failed++;
+    }
+
+    return Failed;
+}
+
+/* Saves an empty key to the hive file, so that it can be loaded as a hive of its own */
+static
+NTSTATUS
+CreateHiveFile(VOID)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+    WCHAR Buffer[64];
+    UNICODE_STRING KeyName;
+    HANDLE ProtoHandle, FileHandle;
+    NTSTATUS Status;
+
+    StringCchPrintfW(Buffer, RTL_NUMBER_OF(Buffer), L"\\Registry\\Machine\\SYSTEM\\$$$FLUSHKEY%lu.HIV", GetCurrentProcessId());
+    RtlInitUnicodeString(&KeyName, Buffer);
+    InitializeObjectAttributes(&ObjectAttributes, &KeyName, OBJ_CASE_INSENSITIVE, NULL, NULL);
+    Status = NtCreateKey(&ProtoHandle, KEY_ALL_ACCESS, &ObjectAttributes, 0, NULL, REG_OPTION_NON_VOLATILE, NULL);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    InitializeObjectAttributes(&ObjectAttributes, &HiveFileName, OBJ_CASE_INSENSITIVE, NULL, NULL);
+    Status = NtCreateFile(&FileHandle,
+                          FILE_GENERIC_WRITE,
+                          &ObjectAttributes,
+                          &IoStatusBlock,
+                          NULL,
+                          FILE_ATTRIBUTE_NORMAL,
+                          0,
+                          FILE_OVERWRITE_IF,
+                          FILE_SYNCHRONOUS_IO_NONALERT | FILE_NON_DIRECTORY_FILE,
+                          NULL,
+                          0);
+    if (NT_SUCCESS(Status))
+    {
+        Status = NtSaveKeyEx(ProtoHandle, FileHandle, REG_LATEST_FORMAT);
+        NtClose(FileHandle);
+    }
+
+    NtDeleteKey(ProtoHandle);
+    NtClose(ProtoHandle);
+    return Status;
+}
+
+static
+NTSTATUS
+LoadHive(
+    _Out_ PHANDLE KeyHandle)
+{
+    OBJECT_ATTRIBUTES KeyObjectAttributes, FileObjectAttributes;
+    NTSTATUS Status;
+
+    InitializeObjectAttributes(&KeyObjectAttributes, &HiveKeyName, OBJ_CASE_INSENSITIVE, NULL, NULL);
+    InitializeObjectAttributes(&FileObjectAttributes, &HiveFileName, OBJ_CASE_INSENSITIVE, NULL, NULL);
+    Status = NtLoadKey(&KeyObjectAttributes, &FileObjectAttributes);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    Status = NtOpenKey(KeyHandle, KEY_ALL_ACCESS, &KeyObjectAttributes);
+    if (!NT_SUCCESS(Status))
+        NtUnloadKey(&KeyObjectAttributes);
+    return Status;
+}
+
+static
+NTSTATUS
+UnloadHive(
+    _In_ HANDLE KeyHandle)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+
+    NtClose(KeyHandle);
+    InitializeObjectAttributes(&ObjectAttributes, &HiveKeyName, OBJ_CASE_INSENSITIVE, NULL, NULL);
+    return NtUnloadKey(&ObjectAttributes);
+}
+
+static
+DWORD
+WINAPI
+FlushThread(
+    _In_ PVOID Context)
+{
+    PFLUSHER Flusher = Context;
+
+    while (!Flusher->Stop)
+    {
+        if (NT_SUCCESS(NtFlushKey(Flusher->KeyHandle)))
+            InterlockedIncrement(&Flusher->Flushes);
+        else
+            InterlockedIncrement(&Flusher->Failures);
+    }
+
+    return 0;
+}
+
+/* Keeps writing values while another thread flushes the hive, then checks what reached the disk */
+static
+VOID
+TestWritesWhileFlushing(VOID)
+{
+    FLUSHER Flusher;
+    HANDLE KeyHandle, Thread;
+    ULONG i, Round, Failed = 0;
+    UCHAR Fill = 0;
+    NTSTATUS Status;
+
+    Status = LoadHive(&KeyHandle);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+
+    /* Flushing a clean hive works as well */
+    Status = NtFlushKey(KeyHandle);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Status = NtFlushKey(KeyHandle);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+    RtlZeroMemory(&Flusher, sizeof(Flusher));
+    Flusher.KeyHandle = KeyHandle;
+    Thread = CreateThread(NULL, 0, FlushThread, &Flusher, 0, NULL);
+    ok(Thread != NULL, "CreateThread failed with %lu\n", GetLastError());
+    if (!Thread)
+    {
+        UnloadHive(KeyHandle);
+        return;
+    }
+
+    for (Round = 0; Round < ROUND_COUNT; Round++)
+    {
+        Fill++;
+        for (i = 0; i < VALUE_COUNT; i++)
+        {
+            if (!NT_SUCCESS(SetTestValue(KeyHandle, i, Fill)))
+                Failed++;
+        }
+    }
+
+    InterlockedExchange(&Flusher.Stop, TRUE);
+    WaitForSingleObject(Thread, INFINITE);
+    CloseHandle(Thread);
+
+    ok(Failed == 0, "%lu writes failed\n", Failed);
+    ok(Flusher.Failures == 0, "%ld flushes failed\n", Flusher.Failures);
+    ok(Flusher.Flushes != 0, "The hive was never flushed\n");
+
+    /* After a final flush the values hold the last round of writes */
+    Status = NtFlushKey(KeyHandle);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok_dec(CountBadValues(KeyHandle, Fill), 0);
+
+    /* And that is also what the hive file holds, no older snapshot overwrote it */
+    Status = UnloadHive(KeyHandle);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+    Status = LoadHive(&KeyHandle);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+    ok_dec(CountBadValues(KeyHandle, Fill), 0);
+
+    /* Writes which were never flushed explicitly still make it through the unload */
+    Fill++;
+    for (i = 0, Failed = 0; i < VALUE_COUNT; i++)
+    {
+        if (!NT_SUCCESS(SetTestValue(KeyHandle, i, Fill)))
+            Failed++;
+    }
+    ok(Failed == 0, "%lu writes failed\n", Failed);
+    Status = UnloadHive(KeyHandle);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+    Status = LoadHive(&KeyHandle);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+    ok_dec(CountBadValues(KeyHandle, Fill), 0);
+
+    Status = UnloadHive(KeyHandle);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+}
+
+START_TEST(NtFlushKey)
+{
+    BOOLEAN PrivilegeSet[2] = { FALSE, FALSE };
+    WCHAR HivePath[MAX_PATH], LogPath[MAX_PATH];
+    NTSTATUS Status;
+
+    /* Invalid handles are rejected */
+    Status = NtFlushKey(NULL);
+    ok_ntstatus(Status, STATUS_INVALID_HANDLE);
+
+    Status = RtlAdjustPrivilege(SE_RESTORE_PRIVILEGE, TRUE, FALSE, &PrivilegeSet[0]);
+    if (!NT_SUCCESS(Status))
+    {
+        skip("RtlAdjustPrivilege(SE_RESTORE_PRIVILEGE) failed (Status 0x%08lx)\n", Status);
+        return;
+    }
+    Status = RtlAdjustPrivilege(SE_BACKUP_PRIVILEGE, TRUE, FALSE, &PrivilegeSet[1]);
+    if (!NT_SUCCESS(Status))
+    {
+        skip("RtlAdjustPrivilege(SE_BACKUP_PRIVILEGE) failed (Status 0x%08lx)\n", Status);
+        RtlAdjustPrivilege(SE_RESTORE_PRIVILEGE, PrivilegeSet[0], FALSE, &PrivilegeSet[0]);
+        return;
+    }
+
+    GetTempPathW(RTL_NUMBER_OF(LogPath), LogPath);
+    StringCchPrintfW(HivePath, RTL_NUMBER_OF(HivePath), L"%sflushkey%lu.hiv", LogPath, GetCurrentProcessId());
+    StringCchPrintfW(LogPath, RTL_NUMBER_OF(LogPath), L"%s.LOG", HivePath);
+    if (!RtlDosPathNameToNtPathName_U(HivePath, &HiveFileName, NULL, NULL))
+    {
+        skip("Failed to convert %ls\n", HivePath);
+        goto Cleanup;
+    }
+
+    Status = CreateHiveFile();
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (NT_SUCCESS(Status))
+        TestWritesWhileFlushing();
+
+    ok(DeleteFileW(HivePath), "DeleteFileW failed with %lu\n", GetLastError());
+    DeleteFileW(LogPath);
+    RtlFreeUnicodeString(&HiveFileName);
+
+Cleanup:
+    RtlAdjustPrivilege(SE_BACKUP_PRIVILEGE, PrivilegeSet[1], FALSE, &PrivilegeSet[1]);
+    RtlAdjustPrivilege(SE_RESTORE_PRIVILEGE, PrivilegeSet[0], FALSE, &PrivilegeSet[0]);
+}
@@ -0,0 +1,419 @@
+/*
+ * PROJECT:     ReactOS API tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for NtLoadKey with a large hive
+ */
+
+#include "precomp.h"
+
+#define KEY_COUNT   2000
+#define VALUE_SIZE  256
+
+/* Hive base block layout, see sdk/lib/cmlib/hivedata.h */
+#define HIVE_BLOCK_SIZE         0x1000
+#define HIVE_SEQUENCE1          (0x04 / sizeof(ULONG))
+#define HIVE_SEQUENCE2          (0x08 / sizeof(ULONG))
+#define HIVE_CHECKSUM           (0x1FC / sizeof(ULONG))
+
+static UNICODE_STRING HiveFileName;
+static WCHAR HivePath[MAX_PATH];
+
+/* Opens or creates the key Format names for Index, relative to RootHandle if given */
+static
+NTSTATUS
+OpenSubKey(
+    _Out_ PHANDLE KeyHandle,
+    _In_opt_ HANDLE RootHandle,
+    _In_ PCWSTR Format,
+    _In_ ULONG Index,
+    _In_ BOOLEAN Create)
+{
+    WCHAR Buffer[128];
+    UNICODE_STRING KeyName;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+
+    StringCchPrintfW(Buffer, RTL_NUMBER_OF(Buffer), Format, Index);
+    RtlInitUnicodeString(&KeyName, Buffer);
+    InitializeObjectAttributes(&ObjectAttributes, &KeyName, OBJ_CASE_INSENSITIVE, RootHandle, NULL);
+    if (!Create)
+        return NtOpenKey(KeyHandle, KEY_ALL_ACCESS, &ObjectAttributes);
+    return NtCreateKey(KeyHandle, KEY_ALL_ACCESS, &ObjectAttributes, 0, NULL, REG_OPTION_NON_VOLATILE, NULL);
+}
+
+static
+VOID
+FillValue(
+    _Out_writes_(VALUE_SIZE) PUCHAR Data,
+    _In_ ULONG Index)
+{
+    ULONG i;
+
+    for (i = 0; i < VALUE_SIZE; i++)
+    {
+        Data[i] = (UCHAR)(Index + i);
+    }
+}
+
+static
+NTSTATUS
+SetDataValue(
+    _In_ HANDLE KeyHandle,
+    _In_ PUCHAR Data)
+{
+    UNICODE_STRING ValueName = RTL_CONSTANT_STRING(L"Data");
+
+    return NtSetValueKey(KeyHandle, &ValueName, 0, REG_BINARY, Data, VALUE_SIZE);
+}
+
+static
+BOOLEAN
+CheckDataValue(
+    _In_ ULONG Index,
+    _In_ PUCHAR Expected)
+{
+    UNICODE_STRING ValueName = RTL_CONSTANT_STRING(L"Data");
+    UCHAR Buffer[FIELD_OFFSET(KEY_VALUE_PARTIAL_INFORMATION, Data) + VALUE_SIZE];
+    PKEY_VALUE_PARTIAL_INFORMATION Info = (PVOID)Buffer;
+    HANDLE KeyHandle;
+    ULONG ResultLength;
+    NTSTATUS Status;
+
+    Status = OpenSubKey(&KeyHandle, NULL, L"\\Registry\\Machine\\LoadKeyTest\\Key%lu", Index, FALSE);
+    if (!NT_SUCCESS(Status))
+        return FALSE;
+    Status = NtQueryValueKey(KeyHandle, &ValueName, KeyValuePartialInformation, Info, sizeof(Buffer), &ResultLength);
+    NtClose(KeyHandle);
+
+    return NT_SUCCESS(Status) &&
+           (Info->DataLength == VALUE_SIZE) &&
+           (RtlCompareMemory(Info->Data, Expected, VALUE_SIZE) == VALUE_SIZE);
+}
+
+/* Builds a hive with KEY_COUNT keys of one value each and saves it to the hive file */
+static
+NTSTATUS
+CreateHiveFile(VOID)
+{
+    UCHAR Data[VALUE_SIZE];
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+    HANDLE ProtoHandle, KeyHandle, FileHandle;
+    NTSTATUS Status;
+    ULONG i, Created;
+
+    Status = OpenSubKey(&ProtoHandle, NULL, L"\\Registry\\Machine\\SYSTEM\\$$$LOADKEY%lu.HIV", GetCurrentProcessId(), TRUE);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    for (Created = 0; Created < KEY_COUNT; Created++)
+    {
+        Status = OpenSubKey(&KeyHandle, ProtoHandle, L"Key%lu", Created, TRUE);
+        if (!NT_SUCCESS(Status))
+            break;
+
+        FillValue(Data, Created);
+        Status = SetDataValue(KeyHandle, Data);
+        NtClose(KeyHandle);
+        if (!NT_SUCCESS(Status))
+            break;
+    }
+
+    if (NT_SUCCESS(Status))
+    {
+        InitializeObjectAttributes(&ObjectAttributes, &HiveFileName, OBJ_CASE_INSENSITIVE, NULL, NULL);
+        Status = NtCreateFile(&FileHandle,
+                              FILE_GENERIC_WRITE,
+                              &ObjectAttributes,
+                              &IoStatusBlock,
+                              NULL,
+                              FILE_ATTRIBUTE_NORMAL,
+                              0,
+                              FILE_OVERWRITE_IF,
+                              FILE_SYNCHRONOUS_IO_NONALERT | FILE_NON_DIRECTORY_FILE,
+                              NULL,
+                              0);
+        if (NT_SUCCESS(Status))
+        {
+            Status = NtSaveKeyEx(ProtoHandle, FileHandle, REG_LATEST_FORMAT);
+            NtClose(FileHandle);
+        }
+    }
+
+    /* The keys were only needed for saving */
+    for (i = 0; i < Created; i++)
+    {
+        if (NT_SUCCESS(OpenSubKey(&KeyHandle, ProtoHandle, L"Key%lu", i, FALSE)))
+        {
+            NtDeleteKey(KeyHandle);
+            NtClose(KeyHandle);
+        }
+    }
+    NtDeleteKey(ProtoHandle);
+    NtClose(ProtoHandle);
+
+    return Status;
+}
+
+static
+NTSTATUS
+LoadHive(VOID)
+{
+    UNICODE_STRING KeyName = RTL_CONSTANT_STRING(L"\\Registry\\Machine\\LoadKeyTest");
+    OBJECT_ATTRIBUTES KeyObjectAttributes, FileObjectAttributes;
+
+    InitializeObjectAttributes(&KeyObjectAttributes, &KeyName, OBJ_CASE_INSENSITIVE, NULL, NULL);
+    InitializeObjectAttributes(&FileObjectAttributes, &HiveFileName, OBJ_CASE_INSENSITIVE, NULL, NULL);
+    return NtLoadKey(&KeyObjectAttributes, &FileObjectAttributes);
+}
+
+static
+NTSTATUS
+UnloadHive(VOID)
+{
+    UNICODE_STRING KeyName = RTL_CONSTANT_STRING(L"\\Registry\\Machine\\LoadKeyTest");
+    OBJECT_ATTRIBUTES ObjectAttributes;
+
+    InitializeObjectAttributes(&ObjectAttributes, &KeyName, OBJ_CASE_INSENSITIVE, NULL, NULL);
+    return NtUnloadKey(&ObjectAttributes);
+}
+
+static
+LONG
+GetPagedPoolPages(VOID)
+{
+    SYSTEM_PERFORMANCE_INFORMATION PerformanceInformation;
+    NTSTATUS Status;
+
+    Status = NtQuerySystemInformation(SystemPerformanceInformation,
+                                      &PerformanceInformation,
+                                      sizeof(PerformanceInformation),
+                                      NULL);
+    return NT_SUCCESS(Status) ? (LONG)PerformanceInformation.PagedPoolPages : 0;
+}
+
+static
+ULONGLONG
+ElapsedMicroseconds(
+    _In_ PLARGE_INTEGER Start,
+    _In_ PLARGE_INTEGER End,
+    _In_ PLARGE_INTEGER Frequency)
+{
+    if (Frequency->QuadPart == 0)
+        return 0;
+    return (ULONGLONG)(End->QuadPart - Start->QuadPart) * 1000000 / Frequency->QuadPart;
+}
+
+static
+VOID
+TestLargeHive(VOID)
+{
+    LARGE_INTEGER Start, End, Frequency;
+    UCHAR Data[VALUE_SIZE];
+    HANDLE KeyHandle;
+    LONG PagesBefore, PagesAfter;
+    ULONG i, Failed = 0;
+    NTSTATUS Status;
+
+    /* Loading costs about the hive size in paged pool, the bins are kept only once */
+    PagesBefore = GetPagedPoolPages();
+    NtQueryPerformanceCounter(&Start, &Frequency);
+    Status = LoadHive();
+    NtQueryPerformanceCounter(&End, NULL);
+    PagesAfter = GetPagedPoolPages();
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+    trace("Load: %I64u us, paged pool %+ld KB\n",
+          ElapsedMicroseconds(&Start, &End, &Frequency),
+          (PagesAfter - PagesBefore) * (LONG)(PAGE_SIZE / 1024));
+
+    /* Every value reads back as it was saved */
+    NtQueryPerformanceCounter(&Start, &Frequency);
+    for (i = 0; i < KEY_COUNT; i++)
+    {
+        FillValue(Data, i);
+        if (!CheckDataValue(i, Data))
+            Failed++;
+    }
+    NtQueryPerformanceCounter(&End, NULL);
+    ok(Failed == 0, "%lu of %u values didn't read back\n", Failed, KEY_COUNT);
+    trace("Read %u values: %I64u us\n", KEY_COUNT, ElapsedMicroseconds(&Start, &End, &Frequency));
+
+    /* Changes are flushed to the file and survive a reload */
+    Status = OpenSubKey(&KeyHandle, NULL, L"\\Registry\\Machine\\LoadKeyTest\\Key%lu", 7, FALSE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (NT_SUCCESS(Status))
+    {
+        RtlFillMemory(Data, sizeof(Data), 0xAA);
+        Status = SetDataValue(KeyHandle, Data);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+        Status = NtFlushKey(KeyHandle);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+        NtClose(KeyHandle);
+    }
+
+    Status = UnloadHive();
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Status = LoadHive();
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+
+    RtlFillMemory(Data, sizeof(Data), 0xAA);
+    ok(CheckDataValue(7, Data), "Changed value didn't survive the reload\n");
+    FillValue(Data, 8);
+    ok(CheckDataValue(8, Data), "Unchanged value didn't survive the reload\n");
+    FillValue(Data, KEY_COUNT - 1);
+    ok(CheckDataValue(KEY_COUNT - 1, Data), "Last value didn't survive the reload\n");
+
+    Status = UnloadHive();
+    ok_ntstatus(Status, STATUS_SUCCESS);
+}
+
+/* Reads or writes the base block of the hive file */
+static
+BOOLEAN
+AccessHiveHeader(
+    _In_ PCWSTR Path,
+    _Inout_updates_(HIVE_BLOCK_SIZE / sizeof(ULONG)) PULONG Header,
+    _In_ BOOLEAN Write)
+{
+    HANDLE FileHandle;
+    DWORD Transferred;
+    BOOL Success;
+
+    FileHandle = CreateFileW(Path,
+                             Write ? GENERIC_WRITE : GENERIC_READ,
+                             0,
+                             NULL,
+                             OPEN_EXISTING,
+                             FILE_FLAG_WRITE_THROUGH,
+                             NULL);
+    if (FileHandle == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    if (Write)
+        Success = WriteFile(FileHandle, Header, HIVE_BLOCK_SIZE, &Transferred, NULL) && FlushFileBuffers(FileHandle);
+    else
+        Success = ReadFile(FileHandle, Header, HIVE_BLOCK_SIZE, &Transferred, NULL);
+    CloseHandle(FileHandle);
+
+    return Success && (Transferred == HIVE_BLOCK_SIZE);
+}
+
+/*
+ * Recreates what is on disk when a flush is killed after the log was written
+ * but before the primary bins were: the primary still holds the old bins, and
+ * only its first sequence number was bumped. The change must come back from
+ * the log. This only works if changes never reach the primary ahead of a flush.
+ */
+static
+VOID
+TestInterruptedFlush(VOID)
+{
+    WCHAR BackupPath[MAX_PATH];
+    ULONG Header[HIVE_BLOCK_SIZE / sizeof(ULONG)];
+    UCHAR Data[VALUE_SIZE];
+    HANDLE KeyHandle;
+    ULONG i, CheckSum;
+    NTSTATUS Status;
+
+    StringCchPrintfW(BackupPath, RTL_NUMBER_OF(BackupPath), L"%s.bak", HivePath);
+    ok(CopyFileW(HivePath, BackupPath, FALSE), "CopyFileW failed with %lu\n", GetLastError());
+
+    Status = LoadHive();
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        goto Cleanup;
+
+    Status = OpenSubKey(&KeyHandle, NULL, L"\\Registry\\Machine\\LoadKeyTest\\Key%lu", 7, FALSE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (NT_SUCCESS(Status))
+    {
+        RtlFillMemory(Data, sizeof(Data), 0x55);
+        Status = SetDataValue(KeyHandle, Data);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+        Status = NtFlushKey(KeyHandle);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+        NtClose(KeyHandle);
+    }
+
+    Status = UnloadHive();
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+    /* Put the old bins back under the new header, with the second sequence not yet written */
+    ok(AccessHiveHeader(HivePath, Header, FALSE), "Failed to read the hive header\n");
+    ok(CopyFileW(BackupPath, HivePath, FALSE), "CopyFileW failed with %lu\n", GetLastError());
+    Header[HIVE_SEQUENCE2] = Header[HIVE_SEQUENCE1] - 1;
+    for (i = 0, CheckSum = 0; i < HIVE_CHECKSUM; i++)
+        CheckSum ^= Header[i];
+    Header[HIVE_CHECKSUM] = (CheckSum == 0) ? 1 : (CheckSum == (ULONG)-1) ? (ULONG)-2 : CheckSum;
+    ok(AccessHiveHeader(HivePath, Header, TRUE), "Failed to write the hive header\n");
+
+#if defined(_M_AMD64)
+    skip("Hive recovery from the log is not supported on this architecture\n");
+#else
+    Status = LoadHive();
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        goto Cleanup;
+
+    RtlFillMemory(Data, sizeof(Data), 0x55);
+    ok(CheckDataValue(7, Data), "Changed value wasn't recovered from the log\n");
+    FillValue(Data, 8);
+    ok(CheckDataValue(8, Data), "Unchanged value didn't survive the recovery\n");
+
+    Status = UnloadHive();
+    ok_ntstatus(Status, STATUS_SUCCESS);
+#endif
+
+Cleanup:
+    DeleteFileW(BackupPath);
+}
+
+START_TEST(NtLoadKey)
+{
+    BOOLEAN PrivilegeSet[2] = { FALSE, FALSE };
+    WCHAR LogPath[MAX_PATH];
+    NTSTATUS Status;
+
+    Status = RtlAdjustPrivilege(SE_RESTORE_PRIVILEGE, TRUE, FALSE, &PrivilegeSet[0]);
+    if (!NT_SUCCESS(Status))
+    {
+        skip("RtlAdjustPrivilege(SE_RESTORE_PRIVILEGE) failed (Status 0x%08lx)\n", Status);
+        return;
+    }
+    Status = RtlAdjustPrivilege(SE_BACKUP_PRIVILEGE, TRUE, FALSE, &PrivilegeSet[1]);
+    if (!NT_SUCCESS(Status))
+    {
+        skip("RtlAdjustPrivilege(SE_BACKUP_PRIVILEGE) failed (Status 0x%08lx)\n", Status);
+        RtlAdjustPrivilege(SE_RESTORE_PRIVILEGE, PrivilegeSet[0], FALSE, &PrivilegeSet[0]);
+        return;
+    }
+
+    GetTempPathW(RTL_NUMBER_OF(LogPath), LogPath);
+    StringCchPrintfW(HivePath, RTL_NUMBER_OF(HivePath), L"%sloadkey%lu.hiv", LogPath, GetCurrentProcessId());
+    StringCchPrintfW(LogPath, RTL_NUMBER_OF(LogPath), L"%s.LOG", HivePath);
+    if (!RtlDosPathNameToNtPathName_U(HivePath, &HiveFileName, NULL, NULL))
+    {
+        skip("Failed to convert %ls\n", HivePath);
+        goto Cleanup;
+    }
+
+    Status = CreateHiveFile();
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (NT_SUCCESS(Status))
+    {
+        TestLargeHive();
+        TestInterruptedFlush();
+    }
+
+    /* The hive file is released once the hive is unloaded */
+    ok(DeleteFileW(HivePath), "DeleteFileW failed with %lu\n", GetLastError());
+    DeleteFileW(LogPath);
+    RtlFreeUnicodeString(&HiveFileName);
+
+Cleanup:
+    RtlAdjustPrivilege(SE_BACKUP_PRIVILEGE, PrivilegeSet[1], FALSE, &PrivilegeSet[1]);
+    RtlAdjustPrivilege(SE_RESTORE_PRIVILEGE, PrivilegeSet[0], FALSE, &PrivilegeSet[0]);
+}
@@ -2012,6 +2012,114 @@ Test_Truncate(VOID)
     ok(Success == TRUE, "DeleteFileW failed with %lu\n", GetLastError());
 }
 
+/*
+ * Map one page file backed section into many processes and touch all pages,
+ * so that each page ends up with one reverse mapping per process, then time
+ * how long it takes to tear the views down again.
+ */
+#define MANY_PROCESSES_COUNT 64
+#define MANY_PROCESSES_PAGES 16
+
+static void
+Test_ManyProcesses(VOID)
+{
+    static HANDLE ProcessHandles[MANY_PROCESSES_COUNT];
+    static PVOID BaseAddresses[MANY_PROCESSES_COUNT];
+    WCHAR ModuleName[MAX_PATH];
+    STARTUPINFOW StartupInfo = { sizeof(StartupInfo) };
+    PROCESS_INFORMATION ProcessInfo;
+    LARGE_INTEGER MaximumSize, Frequency, Start, Stop;
+    NTSTATUS Status;
+    HANDLE SectionHandle;
+    SIZE_T ViewSize, BytesRead;
+    ULONG Count, Mapped, i, j;
+    UCHAR Buffer;
+
+    if (!GetModuleFileNameW(NULL, ModuleName, _countof(ModuleName)))
+    {
+        skip("GetModuleFileNameW failed with %lu\n", GetLastError());
+        return;
+    }
+
+    MaximumSize.QuadPart = MANY_PROCESSES_PAGES * PAGE_SIZE;
+    Status = NtCreateSection(&SectionHandle,
+                             SECTION_ALL_ACCESS,
+                             NULL,
+                             &MaximumSize,
+                             PAGE_READWRITE,
+                             SEC_COMMIT,
+                             NULL);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+
+    /* Suspended copies of ourselves are enough, they never run */
+    for (Count = 0; Count < MANY_PROCESSES_COUNT; Count++)
+    {
+        if (!CreateProcessW(ModuleName, NULL, NULL, NULL, FALSE, CREATE_SUSPENDED,
+                            NULL, NULL, &StartupInfo, &ProcessInfo))
+        {
+            break;
+        }
+        CloseHandle(ProcessInfo.hThread);
+        ProcessHandles[Count] = ProcessInfo.hProcess;
+    }
+    ok(Count != 0, "CreateProcessW failed with %lu\n", GetLastError());
+
+    for (Mapped = 0; Mapped < Count; Mapped++)
+    {
+        BaseAddresses[Mapped] = NULL;
+        ViewSize = 0;
+        Status = NtMapViewOfSection(SectionHandle,
+                                    ProcessHandles[Mapped],
+                                    &BaseAddresses[Mapped],
+                                    0,
+                                    0,
+                                    NULL,
+                                    &ViewSize,
+                                    ViewUnmap,
+                                    0,
+                                    PAGE_READWRITE);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+        if (!NT_SUCCESS(Status))
+            break;
+
+        /* Fault every page in, which adds a reverse mapping for it */
+        for (j = 0; j < MANY_PROCESSES_PAGES; j++)
+        {
+            Status = NtReadVirtualMemory(ProcessHandles[Mapped],
+                                         (PUCHAR)BaseAddresses[Mapped] + j * PAGE_SIZE,
+                                         &Buffer,
+                                         sizeof(Buffer),
+                                         &BytesRead);
+            ok_ntstatus(Status, STATUS_SUCCESS);
+        }
+    }
+
+    NtQueryPerformanceCounter(&Start, &Frequency);
+    for (i = 0; i < Mapped; i++)
+    {
+        Status = NtUnmapViewOfSection(ProcessHandles[i], BaseAddresses[i]);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+    }
+    NtQueryPerformanceCounter(&Stop, NULL);
+
+    if (Mapped != 0 && Frequency.QuadPart != 0)
+    {
+        trace("Unmapped %lu views of %u pages in %I64u us\n",
+              Mapped,
+              MANY_PROCESSES_PAGES,
+              (Stop.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart);
+    }
+
+    for (i = 0; i < Count; i++)
+    {
+        TerminateProcess(ProcessHandles[i], 0);
+        CloseHandle(ProcessHandles[i]);
+    }
+    NtClose(SectionHandle);
+}
+
 START_TEST(NtMapViewOfSection)
 {
     Test_PageFileSection();
@@ -2024,4 +2132,5 @@ START_TEST(NtMapViewOfSection)
     Test_RawSize(2);
     Test_EmptyFile();
     Test_Truncate();
+    Test_ManyProcesses();
 }
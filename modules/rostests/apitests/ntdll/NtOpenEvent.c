@@ -0,0 +1,160 @@
+/*
+ * PROJECT:     ReactOS API tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for NtOpenEvent
+ */
+
+#include "precomp.h"
+
+#define MAX_EVENTS 20000
+
+static HANDLE Events[MAX_EVENTS];
+
+static
+NTSTATUS
+OpenEventByIndex(
+    _In_ HANDLE Directory,
+    _In_ ULONG Index,
+    _Out_ PHANDLE Handle)
+{
+    WCHAR Buffer[32];
+    UNICODE_STRING Name;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+
+    StringCbPrintfW(Buffer, sizeof(Buffer), L"Event%lu", Index);
+    RtlInitUnicodeString(&Name, Buffer);
+    InitializeObjectAttributes(&ObjectAttributes, &Name, 0, Directory, NULL);
+    return NtOpenEvent(Handle, EVENT_ALL_ACCESS, &ObjectAttributes);
+}
+
+static
+ULONG
+CreateEvents(
+    _In_ HANDLE Directory,
+    _In_ ULONG First,
+    _In_ ULONG Count)
+{
+    WCHAR Buffer[32];
+    UNICODE_STRING Name;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    NTSTATUS Status;
+    ULONG i;
+
+    for (i = First; i < First + Count; i++)
+    {
+        StringCbPrintfW(Buffer, sizeof(Buffer), L"Event%lu", i);
+        RtlInitUnicodeString(&Name, Buffer);
+        InitializeObjectAttributes(&ObjectAttributes, &Name, 0, Directory, NULL);
+        Status = NtCreateEvent(&Events[i], EVENT_ALL_ACCESS, &ObjectAttributes, NotificationEvent, FALSE);
+        if (!NT_SUCCESS(Status))
+        {
+            ok_ntstatus(Status, STATUS_SUCCESS);
+            break;
+        }
+    }
+
+    return i;
+}
+
+static
+ULONG
+CountDirectoryEntries(
+    _In_ HANDLE Directory)
+{
+    UCHAR Buffer[0x200];
+    ULONG Context = 0, Count = 0, ReturnLength;
+    NTSTATUS Status;
+
+    while (TRUE)
+    {
+        Status = NtQueryDirectoryObject(Directory, Buffer, sizeof(Buffer), TRUE, FALSE, &Context, &ReturnLength);
+        if (Status != STATUS_SUCCESS)
+            break;
+        Count++;
+    }
+    ok_ntstatus(Status, STATUS_NO_MORE_ENTRIES);
+
+    return Count;
+}
+
+/* Reopens every event created so far by name, and checks it is the same event */
+static
+ULONG
+CountBadEvents(
+    _In_ HANDLE Directory,
+    _In_ ULONG Created)
+{
+    EVENT_BASIC_INFORMATION Info;
+    HANDLE Handle;
+    NTSTATUS Status;
+    ULONG i, Failed = 0;
+
+    for (i = 0; i < Created; i++)
+    {
+        Status = OpenEventByIndex(Directory, i, &Handle);
+        if (!NT_SUCCESS(Status))
+        {
+            Failed++;
+            continue;
+        }
+
+        /* Signal it through the new handle, and look at it through the old one */
+        NtSetEvent(Handle, NULL);
+        Status = NtQueryEvent(Events[i], EventBasicInformation, &Info, sizeof(Info), NULL);
+        if (!NT_SUCCESS(Status) || Info.EventState != 1)
+            Failed++;
+        NtResetEvent(Events[i], NULL);
+        NtClose(Handle);
+    }
+
+    return Failed;
+}
+
+START_TEST(NtOpenEvent)
+{
+    /* Each step takes the directory past one more hash table size */
+    static const ULONG Sizes[] = { 100, 500, 2000, 8000, MAX_EVENTS };
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    HANDLE Directory, Handle;
+    NTSTATUS Status;
+    ULONG Created = 0, i;
+
+    InitializeObjectAttributes(&ObjectAttributes, NULL, 0, NULL, NULL);
+    Status = NtCreateDirectoryObject(&Directory, DIRECTORY_ALL_ACCESS, &ObjectAttributes);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+    {
+        skip("Failed to create directory\n");
+        return;
+    }
+
+    /* Every event must still be found after the directory grows */
+    for (i = 0; i < RTL_NUMBER_OF(Sizes); i++)
+    {
+        Created = CreateEvents(Directory, Created, Sizes[i] - Created);
+        ok_dec(Created, Sizes[i]);
+        if (Created != Sizes[i])
+            break;
+
+        /* Enumerating is quadratic, only do it while it's cheap */
+        if (Created <= 2000)
+            ok_dec(CountDirectoryEntries(Directory), Created);
+
+        ok_dec(CountBadEvents(Directory, Created), 0);
+    }
+
+    /* Names that were never created aren't found */
+    Status = OpenEventByIndex(Directory, MAX_EVENTS, &Handle);
+    ok_ntstatus(Status, STATUS_OBJECT_NAME_NOT_FOUND);
+
+    /* Closing the last handle removes the name from the directory */
+    for (i = 0; i < Created; i++)
+    {
+        NtClose(Events[i]);
+    }
+    Status = OpenEventByIndex(Directory, 0, &Handle);
+    ok_ntstatus(Status, STATUS_OBJECT_NAME_NOT_FOUND);
+    ok_dec(CountDirectoryEntries(Directory), 0);
+
+    NtClose(Directory);
+}
@@ -7,6 +7,126 @@
 
 #include "precomp.h"
 
+static
+void
+Test_MemoryListInformation(void)
+{
+    NTSTATUS Status;
+    SYSTEM_MEMORY_LIST_INFORMATION MemoryList;
+    SYSTEM_MEMORY_LIST_INFORMATION_EX MemoryListEx;
+    ULONG ReturnLength;
+
+    ReturnLength = 0x55555555;
+    Status = NtQuerySystemInformation(SystemMemoryListInformation, &MemoryList, sizeof(MemoryList) - 1, &ReturnLength);
+    if (Status == STATUS_INVALID_INFO_CLASS)
+    {
+        skip("SystemMemoryListInformation is not supported\n");
+        return;
+    }
+    ok_hex(Status, STATUS_INFO_LENGTH_MISMATCH);
+    ok_long(ReturnLength, sizeof(MemoryList));
+
+    RtlFillMemory(&MemoryList, sizeof(MemoryList), 0x55);
+    ReturnLength = 0x55555555;
+    Status = NtQuerySystemInformation(SystemMemoryListInformation, &MemoryList, sizeof(MemoryList), &ReturnLength);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok_long(ReturnLength, sizeof(MemoryList));
+    ok(MemoryList.ZeroPageCount != (SIZE_T)0x5555555555555555ULL, "ZeroPageCount not set\n");
+    ok(MemoryList.FreePageCount != (SIZE_T)0x5555555555555555ULL, "FreePageCount not set\n");
+    ok_size_t(MemoryList.BadPageCount, 0);
+
+    /* ReactOS also reports the zeroing threads' work when there is room for it */
+    RtlFillMemory(&MemoryListEx, sizeof(MemoryListEx), 0x55);
+    ReturnLength = 0x55555555;
+    Status = NtQuerySystemInformation(SystemMemoryListInformation, &MemoryListEx, sizeof(MemoryListEx), &ReturnLength);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (ReturnLength == sizeof(MemoryListEx))
+    {
+        ok(MemoryListEx.BackgroundZeroedPageCount != (SIZE_T)0x5555555555555555ULL, "BackgroundZeroedPageCount not set\n");
+    }
+    else
+    {
+        ok_long(ReturnLength, sizeof(MemoryList));
+    }
+}
+
+static
+void
+Test_LookasideInformation(void)
+{
+    NTSTATUS Status;
+    SYSTEM_LOOKASIDE_INFORMATION Lookaside[256];
+    ULONG ReturnLength, Count, i;
+
+    ReturnLength = 0x55555555;
+    Status = NtQuerySystemInformation(SystemLookasideInformation, Lookaside, sizeof(Lookaside), &ReturnLength);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+    ok(ReturnLength % sizeof(Lookaside[0]) == 0, "ReturnLength = %lu\n", ReturnLength);
+    Count = ReturnLength / sizeof(Lookaside[0]);
+    ok(Count > 0, "No lookaside lists\n");
+
+    for (i = 0; i < Count; i++)
+    {
+        ok(Lookaside[i].CurrentDepth <= Lookaside[i].MaximumDepth,
+           "List %lu: depth %u above maximum %u\n", i, Lookaside[i].CurrentDepth, Lookaside[i].MaximumDepth);
+        if (Lookaside[i].TotalAllocates == 0)
+            continue;
+        trace("List %3lu: tag %.4s, size %4lu, depth %3u/%3u, %lu allocations, %lu%% hits\n",
+              i, (PCHAR)&Lookaside[i].Tag, Lookaside[i].Size,
+              Lookaside[i].CurrentDepth, Lookaside[i].MaximumDepth,
+              Lookaside[i].TotalAllocates,
+              (ULONG)(((ULONGLONG)Lookaside[i].TotalAllocates - min(Lookaside[i].AllocateMisses, Lookaside[i].TotalAllocates)) * 100 /
+                      Lookaside[i].TotalAllocates));
+    }
+}
+
+static
+void
+Test_ProcessorWakeups(void)
+{
+    NTSTATUS Status;
+    SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION Before[64], After[64];
+    LARGE_INTEGER Start, End, Frequency;
+    ULONGLONG Elapsed, Busy;
+    ULONG ReturnLength, Count, i;
+
+    Status = NtQuerySystemInformation(SystemProcessorPerformanceInformation, Before, sizeof(Before), &ReturnLength);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+    NtQueryPerformanceCounter(&Start, &Frequency);
+    Count = ReturnLength / sizeof(Before[0]);
+
+    /* Leave the processors idle for a while */
+    Sleep(2000);
+
+    Status = NtQuerySystemInformation(SystemProcessorPerformanceInformation, After, sizeof(After), &ReturnLength);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+    NtQueryPerformanceCounter(&End, NULL);
+    Elapsed = (End.QuadPart - Start.QuadPart) * 10000000 / Frequency.QuadPart;
+
+    for (i = 0; i < Count; i++)
+    {
+        /* Ticks slept through while idle must still be accounted for */
+        Busy = (After[i].KernelTime.QuadPart - Before[i].KernelTime.QuadPart) +
+               (After[i].UserTime.QuadPart - Before[i].UserTime.QuadPart);
+        ok(Busy >= Elapsed * 8 / 10, "Processor %lu: %I64u of %I64u accounted\n", i, Busy, Elapsed);
+
+        /* Idle time is part of the kernel time */
+        ok(After[i].IdleTime.QuadPart - Before[i].IdleTime.QuadPart <=
+           After[i].KernelTime.QuadPart - Before[i].KernelTime.QuadPart,
+           "Processor %lu: more idle than kernel time\n", i);
+
+        trace("Processor %2lu: %I64u wakeups/s, %I64u%% idle\n", i,
+              (ULONGLONG)(After[i].InterruptCount - Before[i].InterruptCount) * 10000000 / Elapsed,
+              Busy ? (After[i].IdleTime.QuadPart - Before[i].IdleTime.QuadPart) * 100 / Busy : 0);
+    }
+}
+
 START_TEST(NtQuerySystemInformation)
 {
     NTSTATUS Status;
@@ -16,4 +136,8 @@ START_TEST(NtQuerySystemInformation)
 
     Status = NtQuerySystemInformation(0x80000000, NULL, 0, NULL);
     ok_hex(Status, STATUS_INVALID_INFO_CLASS);
+
+    Test_MemoryListInformation();
+    Test_LookasideInformation();
+    Test_ProcessorWakeups();
 }
@@ -38,6 +38,160 @@ SizeOfMdl(VOID)
     return Is64BitSystem() ? 48 : 28;
 }
 
+#define RANDOM_FILE_PAGES   2048
+#define RANDOM_READS        4096
+
+/* Reads pages of the file in a random order and returns how many did not hold their own index */
+static
+ULONG
+ReadRandomPages(
+    HANDLE FileHandle,
+    PULONG Buffer)
+{
+    NTSTATUS Status;
+    IO_STATUS_BLOCK IoStatus;
+    LARGE_INTEGER ByteOffset;
+    ULONG Seed = 0x5eed;
+    ULONG i, Page, Failed = 0;
+
+    for (i = 0; i < RANDOM_READS; i++)
+    {
+        Page = RtlRandom(&Seed) % RANDOM_FILE_PAGES;
+        ByteOffset.QuadPart = (ULONGLONG)Page * PAGE_SIZE;
+        Status = NtReadFile(FileHandle,
+                            NULL,
+                            NULL,
+                            NULL,
+                            &IoStatus,
+                            Buffer,
+                            PAGE_SIZE,
+                            &ByteOffset,
+                            NULL);
+        if (!NT_SUCCESS(Status) ||
+            (IoStatus.Information != PAGE_SIZE) ||
+            (Buffer[0] != Page) ||
+            (Buffer[PAGE_SIZE / sizeof(ULONG) - 1] != ~Page))
+        {
+            Failed++;
+        }
+    }
+
+    return Failed;
+}
+
+static
+NTSTATUS
+WriteFilePage(
+    HANDLE FileHandle,
+    ULONG Page,
+    ULONG Value,
+    PULONG Buffer)
+{
+    IO_STATUS_BLOCK IoStatus;
+    LARGE_INTEGER ByteOffset;
+
+    RtlZeroMemory(Buffer, PAGE_SIZE);
+    Buffer[0] = Value;
+    Buffer[PAGE_SIZE / sizeof(ULONG) - 1] = ~Value;
+    ByteOffset.QuadPart = (ULONGLONG)Page * PAGE_SIZE;
+    return NtWriteFile(FileHandle,
+                       NULL,
+                       NULL,
+                       NULL,
+                       &IoStatus,
+                       Buffer,
+                       PAGE_SIZE,
+                       &ByteOffset,
+                       NULL);
+}
+
+static
+VOID
+TestRandomCachedReads(VOID)
+{
+    NTSTATUS Status;
+    HANDLE FileHandle;
+    UNICODE_STRING FileName;
+    WCHAR TempPath[MAX_PATH], FilePath[MAX_PATH];
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatus;
+    LARGE_INTEGER ByteOffset;
+    FILE_DISPOSITION_INFORMATION DispositionInfo;
+    ULONG Buffer[PAGE_SIZE / sizeof(ULONG)];
+    ULONG Page, Failed;
+
+    GetTempPathW(RTL_NUMBER_OF(TempPath), TempPath);
+    StringCchPrintfW(FilePath, RTL_NUMBER_OF(FilePath), L"%sNtReadFile-random%lu.bin", TempPath, GetCurrentProcessId());
+    if (!RtlDosPathNameToNtPathName_U(FilePath, &FileName, NULL, NULL))
+    {
+        skip("Failed to convert %ls\n", FilePath);
+        return;
+    }
+
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &FileName,
+                               OBJ_CASE_INSENSITIVE,
+                               NULL,
+                               NULL);
+    Status = NtCreateFile(&FileHandle,
+                          FILE_READ_DATA | FILE_WRITE_DATA | DELETE | SYNCHRONIZE,
+                          &ObjectAttributes,
+                          &IoStatus,
+                          NULL,
+                          0,
+                          0,
+                          FILE_SUPERSEDE,
+                          FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT |
+                                                    FILE_RANDOM_ACCESS,
+                          NULL,
+                          0);
+    RtlFreeUnicodeString(&FileName);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+
+    /* Every page holds its own index, and the file spans a few dozen cache views */
+    for (Page = 0, Failed = 0; Page < RANDOM_FILE_PAGES; Page++)
+    {
+        if (!NT_SUCCESS(WriteFilePage(FileHandle, Page, Page, Buffer)))
+            Failed++;
+    }
+    ok_dec(Failed, 0);
+
+    /* The first pass maps the views out of order, the second finds them again */
+    ok_dec(ReadRandomPages(FileHandle, Buffer), 0);
+    ok_dec(ReadRandomPages(FileHandle, Buffer), 0);
+
+    /* A write through one view is seen by a read through the same view */
+    Page = RANDOM_FILE_PAGES / 2 + 1;
+    Status = WriteFilePage(FileHandle, Page, 0xfeedf00d, Buffer);
+    ok_hex(Status, STATUS_SUCCESS);
+    RtlZeroMemory(Buffer, sizeof(Buffer));
+    ByteOffset.QuadPart = (ULONGLONG)Page * PAGE_SIZE;
+    Status = NtReadFile(FileHandle,
+                        NULL,
+                        NULL,
+                        NULL,
+                        &IoStatus,
+                        Buffer,
+                        PAGE_SIZE,
+                        &ByteOffset,
+                        NULL);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok_hex(Buffer[0], 0xfeedf00d);
+    ok_hex(Buffer[PAGE_SIZE / sizeof(ULONG) - 1], ~0xfeedf00d);
+
+    DispositionInfo.DeleteFile = TRUE;
+    Status = NtSetInformationFile(FileHandle,
+                                  &IoStatus,
+                                  &DispositionInfo,
+                                  sizeof(DispositionInfo),
+                                  FileDispositionInformation);
+    ok_hex(Status, STATUS_SUCCESS);
+    Status = NtClose(FileHandle);
+    ok_hex(Status, STATUS_SUCCESS);
+}
+
 START_TEST(NtReadFile)
 {
     NTSTATUS Status;
@@ -237,4 +391,6 @@ START_TEST(NtReadFile)
                                  &BufferSize,
                                  MEM_RELEASE);
     ok_hex(Status, STATUS_SUCCESS);
+
+    TestRandomCachedReads();
 }
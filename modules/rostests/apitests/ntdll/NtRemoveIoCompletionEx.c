@@ -0,0 +1,173 @@
+/*
+ * PROJECT:     ReactOS API tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for NtRemoveIoCompletionEx
+ */
+
+#include "precomp.h"
+
+#define PACKET_COUNT 10000
+
+static NTSTATUS (NTAPI *pNtRemoveIoCompletionEx)(HANDLE, PFILE_IO_COMPLETION_INFORMATION, ULONG, PULONG, PLARGE_INTEGER, BOOLEAN);
+
+static
+DWORD
+WINAPI
+PostPackets(
+    _In_ PVOID Context)
+{
+    HANDLE Port = Context;
+    ULONG_PTR i;
+
+    for (i = 0; i < PACKET_COUNT; i++)
+    {
+        NtSetIoCompletion(Port, (PVOID)i, NULL, STATUS_SUCCESS, i);
+    }
+
+    return 0;
+}
+
+static
+VOID
+TestBasic(
+    _In_ HANDLE Port)
+{
+    FILE_IO_COMPLETION_INFORMATION Entries[8];
+    LARGE_INTEGER Timeout;
+    ULONG Removed;
+    ULONG_PTR i;
+    NTSTATUS Status;
+
+    /* Empty port: the wait times out */
+    Timeout.QuadPart = 0;
+    Removed = 0xdeadbeef;
+    Status = pNtRemoveIoCompletionEx(Port, Entries, RTL_NUMBER_OF(Entries), &Removed, &Timeout, FALSE);
+    ok_ntstatus(Status, STATUS_TIMEOUT);
+    ok_hex(Removed, 0);
+
+    /* Zero entries is rejected */
+    Status = pNtRemoveIoCompletionEx(Port, Entries, 0, &Removed, &Timeout, FALSE);
+    ok_ntstatus(Status, STATUS_INVALID_PARAMETER);
+
+    /* Post five, ask for eight: get five, in order */
+    for (i = 0; i < 5; i++)
+    {
+        Status = NtSetIoCompletion(Port, (PVOID)(i + 1), (PVOID)(i + 10), STATUS_SUCCESS, i + 100);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+    }
+    Removed = 0;
+    Status = pNtRemoveIoCompletionEx(Port, Entries, RTL_NUMBER_OF(Entries), &Removed, &Timeout, FALSE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok_hex(Removed, 5);
+    for (i = 0; i < Removed; i++)
+    {
+        ok(Entries[i].KeyContext == (PVOID)(i + 1), "Entry %Iu: KeyContext = %p\n", i, Entries[i].KeyContext);
+        ok(Entries[i].ApcContext == (PVOID)(i + 10), "Entry %Iu: ApcContext = %p\n", i, Entries[i].ApcContext);
+        ok_ntstatus(Entries[i].IoStatusBlock.Status, STATUS_SUCCESS);
+        ok_eq_size(Entries[i].IoStatusBlock.Information, i + 100);
+    }
+
+    /* Post three, ask for two: the third stays queued */
+    for (i = 0; i < 3; i++)
+    {
+        NtSetIoCompletion(Port, (PVOID)i, NULL, STATUS_SUCCESS, 0);
+    }
+    Status = pNtRemoveIoCompletionEx(Port, Entries, 2, &Removed, &Timeout, FALSE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok_hex(Removed, 2);
+    Status = pNtRemoveIoCompletionEx(Port, Entries, RTL_NUMBER_OF(Entries), &Removed, &Timeout, FALSE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok_hex(Removed, 1);
+    ok(Entries[0].KeyContext == (PVOID)2, "KeyContext = %p\n", Entries[0].KeyContext);
+}
+
+/* Drains packets posted by another thread in batches, and returns completions per second */
+static
+ULONGLONG
+TimeConcurrentPost(
+    _In_ HANDLE Port,
+    _In_ ULONG BatchSize)
+{
+    FILE_IO_COMPLETION_INFORMATION Entries[64];
+    LARGE_INTEGER Start, End, Frequency;
+    ULONG Removed, Total, Calls, Failed, j;
+    HANDLE Thread;
+    NTSTATUS Status;
+
+    Thread = CreateThread(NULL, 0, PostPackets, Port, 0, NULL);
+    if (!Thread)
+    {
+        skip("CreateThread failed with %lu\n", GetLastError());
+        return 0;
+    }
+
+    /* They must arrive whole and in order */
+    NtQueryPerformanceCounter(&Start, &Frequency);
+    for (Total = 0, Calls = 0, Failed = 0; Total < PACKET_COUNT; Total += Removed, Calls++)
+    {
+        Status = pNtRemoveIoCompletionEx(Port, Entries, BatchSize, &Removed, NULL, FALSE);
+        if (Status != STATUS_SUCCESS)
+        {
+            ok_ntstatus(Status, STATUS_SUCCESS);
+            break;
+        }
+        if (Removed == 0 || Removed > BatchSize)
+        {
+            ok(0, "Batch %lu: removed %lu\n", BatchSize, Removed);
+            break;
+        }
+        for (j = 0; j < Removed; j++)
+        {
+            if ((Entries[j].KeyContext != (PVOID)(ULONG_PTR)(Total + j)) ||
+                (Entries[j].IoStatusBlock.Information != Total + j))
+            {
+                Failed++;
+            }
+        }
+    }
+    NtQueryPerformanceCounter(&End, NULL);
+
+    WaitForSingleObject(Thread, INFINITE);
+    CloseHandle(Thread);
+
+    ok_hex(Total, PACKET_COUNT);
+    ok(Failed == 0, "Batch %lu: %lu packets out of order\n", BatchSize, Failed);
+    trace("Batch %2lu: %lu completions in %lu calls\n", BatchSize, Total, Calls);
+
+    if (End.QuadPart == Start.QuadPart)
+        return 0;
+    return Total * (ULONGLONG)Frequency.QuadPart / (End.QuadPart - Start.QuadPart);
+}
+
+START_TEST(NtRemoveIoCompletionEx)
+{
+    static const ULONG BatchSizes[] = { 1, 16, 64 };
+    HANDLE Port;
+    NTSTATUS Status;
+    ULONG i;
+
+    pNtRemoveIoCompletionEx = (PVOID)GetProcAddress(GetModuleHandleW(L"ntdll.dll"),
+                                                    "NtRemoveIoCompletionEx");
+    if (!pNtRemoveIoCompletionEx)
+    {
+        win_skip("NtRemoveIoCompletionEx (NT >= 6.0 API) not available\n");
+        return;
+    }
+
+    Status = NtCreateIoCompletion(&Port, IO_COMPLETION_ALL_ACCESS, NULL, 1);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+    {
+        skip("Failed to create completion port\n");
+        return;
+    }
+
+    TestBasic(Port);
+
+    for (i = 0; i < RTL_NUMBER_OF(BatchSizes); i++)
+    {
+        trace("Batch %2lu: %I64u completions/s\n", BatchSizes[i], TimeConcurrentPost(Port, BatchSizes[i]));
+    }
+
+    NtClose(Port);
+}
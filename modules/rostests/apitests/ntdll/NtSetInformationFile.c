@@ -7,6 +7,129 @@
 
 #include "precomp.h"
 
+static
+NTSTATUS
+WriteByte(
+    _In_ HANDLE FileHandle,
+    _Out_ PIO_STATUS_BLOCK IoStatus)
+{
+    static UCHAR Data = 0x55;
+    LARGE_INTEGER ByteOffset;
+    NTSTATUS Status;
+
+    ByteOffset.QuadPart = 0;
+    Status = NtWriteFile(FileHandle, NULL, NULL, NULL, IoStatus, &Data, sizeof(Data), &ByteOffset, NULL);
+    if (Status == STATUS_PENDING)
+    {
+        /* The request went asynchronous, let it finish */
+        NtWaitForSingleObject(FileHandle, FALSE, NULL);
+    }
+
+    return Status;
+}
+
+static
+VOID
+TestCompletionNotificationModes(VOID)
+{
+    FILE_IO_COMPLETION_NOTIFICATION_INFORMATION NotificationInfo;
+    FILE_COMPLETION_INFORMATION CompletionInfo;
+    WCHAR TempPath[MAX_PATH], FilePath[MAX_PATH];
+    UNICODE_STRING FileName;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatus, PacketIoStatus;
+    HANDLE FileHandle, Port;
+    PVOID Key, Context;
+    LARGE_INTEGER Timeout;
+    NTSTATUS Status;
+
+    Timeout.QuadPart = 0;
+
+    GetTempPathW(RTL_NUMBER_OF(TempPath), TempPath);
+    StringCchPrintfW(FilePath, RTL_NUMBER_OF(FilePath), L"%sNtSetInformationFile%lu.bin", TempPath, GetCurrentProcessId());
+    if (!RtlDosPathNameToNtPathName_U(FilePath, &FileName, NULL, NULL))
+    {
+        skip("Failed to convert %ls\n", FilePath);
+        return;
+    }
+
+    /* An asynchronous handle, so that completions go through the port and the file object event */
+    InitializeObjectAttributes(&ObjectAttributes, &FileName, OBJ_CASE_INSENSITIVE, NULL, NULL);
+    Status = NtCreateFile(&FileHandle,
+                          FILE_READ_DATA | FILE_WRITE_DATA | DELETE | SYNCHRONIZE,
+                          &ObjectAttributes,
+                          &IoStatus,
+                          NULL,
+                          0,
+                          0,
+                          FILE_SUPERSEDE,
+                          FILE_NON_DIRECTORY_FILE | FILE_DELETE_ON_CLOSE,
+                          NULL,
+                          0);
+    RtlFreeUnicodeString(&FileName);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+
+    Status = NtCreateIoCompletion(&Port, IO_COMPLETION_ALL_ACCESS, NULL, 0);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+    {
+        NtClose(FileHandle);
+        return;
+    }
+
+    CompletionInfo.Port = Port;
+    CompletionInfo.Key = (PVOID)0x1234;
+    Status = NtSetInformationFile(FileHandle, &IoStatus, &CompletionInfo, sizeof(CompletionInfo), FileCompletionInformation);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+    /* By default every completion queues a packet and signals the handle */
+    Status = WriteByte(FileHandle, &IoStatus);
+    ok(NT_SUCCESS(Status), "Status = 0x%lx\n", Status);
+    Status = NtRemoveIoCompletion(Port, &Key, &Context, &PacketIoStatus, &Timeout);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok_ptr(Key, (PVOID)0x1234);
+    Status = NtWaitForSingleObject(FileHandle, FALSE, &Timeout);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+    /* Unknown modes are refused */
+    NotificationInfo.Flags = 0x80000000;
+    Status = NtSetInformationFile(FileHandle, &IoStatus, &NotificationInfo, sizeof(NotificationInfo), FileIoCompletionNotificationInformation);
+    ok_ntstatus(Status, STATUS_INVALID_PARAMETER);
+
+    NotificationInfo.Flags = FILE_SKIP_COMPLETION_PORT_ON_SUCCESS | FILE_SKIP_SET_EVENT_ON_HANDLE;
+    Status = NtSetInformationFile(FileHandle, &IoStatus, &NotificationInfo, sizeof(NotificationInfo), FileIoCompletionNotificationInformation);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    NotificationInfo.Flags = 0;
+    Status = NtQueryInformationFile(FileHandle, &IoStatus, &NotificationInfo, sizeof(NotificationInfo), FileIoCompletionNotificationInformation);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok_hex(NotificationInfo.Flags, FILE_SKIP_COMPLETION_PORT_ON_SUCCESS | FILE_SKIP_SET_EVENT_ON_HANDLE);
+
+    /* Now a synchronous success queues nothing and leaves the handle alone */
+    Status = WriteByte(FileHandle, &IoStatus);
+    if (Status == STATUS_PENDING)
+    {
+        /* Pending requests still complete through the port */
+        Status = NtRemoveIoCompletion(Port, &Key, &Context, &PacketIoStatus, &Timeout);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+        skip("The write did not complete synchronously\n");
+    }
+    else
+    {
+        ok_ntstatus(Status, STATUS_SUCCESS);
+        ok_ntstatus(IoStatus.Status, STATUS_SUCCESS);
+        ok_size_t(IoStatus.Information, 1);
+        Status = NtRemoveIoCompletion(Port, &Key, &Context, &PacketIoStatus, &Timeout);
+        ok_ntstatus(Status, STATUS_TIMEOUT);
+        Status = NtWaitForSingleObject(FileHandle, FALSE, &Timeout);
+        ok_ntstatus(Status, STATUS_TIMEOUT);
+    }
+
+    NtClose(FileHandle);
+    NtClose(Port);
+}
+
 START_TEST(NtSetInformationFile)
 {
     NTSTATUS Status;
@@ -16,4 +139,6 @@ START_TEST(NtSetInformationFile)
 
     Status = NtSetInformationFile(NULL, NULL, NULL, 0, 0x80000000);
     ok(Status == STATUS_INVALID_INFO_CLASS, "Status = %lx\n", Status);
+
+    TestCompletionNotificationModes();
 }
@@ -0,0 +1,233 @@
+/*
+ * PROJECT:     ReactOS API tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for NtSignalAndWaitForSingleObject
+ */
+
+#include "precomp.h"
+
+#define ROUND_TRIPS 2000
+#define MAX_PAIRS   8
+#define MAX_SPINNERS 8
+
+typedef struct _PING_PONG
+{
+    HANDLE Ping;
+    HANDLE Pong;
+    HANDLE Thread;
+    volatile LONG Turn;
+    LONG Errors;
+} PING_PONG, *PPING_PONG;
+
+typedef struct _SPINNER
+{
+    volatile LONG *Started;
+    LONG Count;
+    ULONG Processor;
+} SPINNER, *PSPINNER;
+
+/* Takes the turn, which must be Expected, and hands it over */
+static
+VOID
+TakeTurn(
+    _In_ PPING_PONG Pair,
+    _In_ LONG Expected)
+{
+    if (InterlockedIncrement(&Pair->Turn) != Expected + 1)
+        Pair->Errors++;
+}
+
+static
+DWORD
+WINAPI
+PongThread(
+    _In_ PVOID Context)
+{
+    PPING_PONG Pair = Context;
+    NTSTATUS Status;
+    ULONG i;
+
+    if (NtWaitForSingleObject(Pair->Ping, FALSE, NULL) != STATUS_SUCCESS)
+        Pair->Errors++;
+    for (i = 0; i < ROUND_TRIPS - 1; i++)
+    {
+        TakeTurn(Pair, 2 * i + 1);
+        Status = NtSignalAndWaitForSingleObject(Pair->Pong, Pair->Ping, FALSE, NULL);
+        if (Status != STATUS_SUCCESS)
+            Pair->Errors++;
+    }
+    TakeTurn(Pair, 2 * i + 1);
+    NtSetEvent(Pair->Pong, NULL);
+
+    return 0;
+}
+
+static
+DWORD
+WINAPI
+PingThread(
+    _In_ PVOID Context)
+{
+    PPING_PONG Pair = Context;
+    NTSTATUS Status;
+    ULONG i;
+
+    for (i = 0; i < ROUND_TRIPS; i++)
+    {
+        TakeTurn(Pair, 2 * i);
+        Status = NtSignalAndWaitForSingleObject(Pair->Ping, Pair->Pong, FALSE, NULL);
+        if (Status != STATUS_SUCCESS)
+            Pair->Errors++;
+    }
+
+    return 0;
+}
+
+static
+DWORD
+WINAPI
+SpinThread(
+    _In_ PVOID Context)
+{
+    PSPINNER Spinner = Context;
+    ULONG Spins;
+
+    /* Wait until everybody is runnable, then see where we get to run */
+    InterlockedIncrement(Spinner->Started);
+    for (Spins = 0; (*Spinner->Started < Spinner->Count) && (Spins < 100000000); Spins++)
+        YieldProcessor();
+    Spinner->Processor = NtGetCurrentProcessorNumber();
+    for (Spins = 0; Spins < 10000000; Spins++)
+        YieldProcessor();
+
+    return 0;
+}
+
+static
+VOID
+TestBasic(VOID)
+{
+    HANDLE Signal, Wait;
+    LARGE_INTEGER Timeout;
+    NTSTATUS Status;
+
+    Status = NtCreateEvent(&Signal, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Status = NtCreateEvent(&Wait, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+    /* The signal happens even when the wait times out */
+    Timeout.QuadPart = -10000;
+    Status = NtSignalAndWaitForSingleObject(Signal, Wait, FALSE, &Timeout);
+    ok_ntstatus(Status, STATUS_TIMEOUT);
+    Status = NtWaitForSingleObject(Signal, FALSE, &Timeout);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+    /* A signaled wait object is satisfied right away */
+    NtSetEvent(Wait, NULL);
+    Status = NtSignalAndWaitForSingleObject(Signal, Wait, FALSE, &Timeout);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+    NtClose(Wait);
+    NtClose(Signal);
+}
+
+/* Runs Pairs independent ping-pongs at once, the turns must strictly alternate */
+static
+VOID
+TestPingPong(
+    _In_ ULONG Pairs)
+{
+    PING_PONG Pair[MAX_PAIRS];
+    HANDLE Ping[MAX_PAIRS];
+    DWORD Wait;
+    ULONG i;
+
+    for (i = 0; i < Pairs; i++)
+    {
+        RtlZeroMemory(&Pair[i], sizeof(Pair[i]));
+        NtCreateEvent(&Pair[i].Ping, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
+        NtCreateEvent(&Pair[i].Pong, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
+        Pair[i].Thread = CreateThread(NULL, 0, PongThread, &Pair[i], 0, NULL);
+        Ping[i] = CreateThread(NULL, 0, PingThread, &Pair[i], CREATE_SUSPENDED, NULL);
+        ok(Pair[i].Thread != NULL && Ping[i] != NULL, "CreateThread failed with %lu\n", GetLastError());
+    }
+
+    for (i = 0; i < Pairs; i++)
+    {
+        ResumeThread(Ping[i]);
+    }
+
+    /* No wake-up may get lost, whichever processor the threads end up on */
+    Wait = WaitForMultipleObjects(Pairs, Ping, TRUE, 60 * 1000);
+    ok(Wait == WAIT_OBJECT_0, "%lu pair(s): wait returned %lu\n", Pairs, Wait);
+
+    for (i = 0; i < Pairs; i++)
+    {
+        WaitForSingleObject(Pair[i].Thread, INFINITE);
+        ok(Pair[i].Errors == 0, "%lu pair(s), pair %lu: %ld errors\n", Pairs, i, Pair[i].Errors);
+        ok(Pair[i].Turn == 2 * ROUND_TRIPS, "%lu pair(s), pair %lu: %ld turns\n", Pairs, i, Pair[i].Turn);
+        CloseHandle(Pair[i].Thread);
+        CloseHandle(Ping[i]);
+        NtClose(Pair[i].Ping);
+        NtClose(Pair[i].Pong);
+    }
+}
+
+/* Threads made ready on one processor must not all stay there while others idle */
+static
+VOID
+TestSpreading(
+    _In_ ULONG Count)
+{
+    SPINNER Spinner[MAX_SPINNERS];
+    HANDLE Thread[MAX_SPINNERS];
+    volatile LONG Started = 0;
+    ULONG_PTR Seen = 0;
+    ULONG i, Distinct = 0;
+
+    for (i = 0; i < Count; i++)
+    {
+        Spinner[i].Started = &Started;
+        Spinner[i].Count = Count;
+        Spinner[i].Processor = MAXULONG;
+        Thread[i] = CreateThread(NULL, 0, SpinThread, &Spinner[i], CREATE_SUSPENDED, NULL);
+        ok(Thread[i] != NULL, "CreateThread failed with %lu\n", GetLastError());
+        SetThreadIdealProcessor(Thread[i], 0);
+    }
+    for (i = 0; i < Count; i++)
+    {
+        ResumeThread(Thread[i]);
+    }
+    WaitForMultipleObjects(Count, Thread, TRUE, INFINITE);
+
+    for (i = 0; i < Count; i++)
+    {
+        CloseHandle(Thread[i]);
+        if ((Spinner[i].Processor < sizeof(Seen) * 8) && !(Seen & ((ULONG_PTR)1 << Spinner[i].Processor)))
+        {
+            Seen |= (ULONG_PTR)1 << Spinner[i].Processor;
+            Distinct++;
+        }
+    }
+    ok(Distinct > 1, "%lu threads all ran on one processor\n", Count);
+}
+
+START_TEST(NtSignalAndWaitForSingleObject)
+{
+    SYSTEM_INFO SystemInfo;
+    ULONG Pairs;
+
+    TestBasic();
+
+    GetSystemInfo(&SystemInfo);
+    for (Pairs = 1; Pairs <= min(SystemInfo.dwNumberOfProcessors, MAX_PAIRS); Pairs++)
+    {
+        TestPingPong(Pairs);
+    }
+
+    if (SystemInfo.dwNumberOfProcessors > 1)
+        TestSpreading(min(SystemInfo.dwNumberOfProcessors, MAX_SPINNERS));
+    else
+        skip("Spreading needs more than one processor\n");
+}
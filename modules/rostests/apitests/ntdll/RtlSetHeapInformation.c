@@ -0,0 +1,313 @@
+/*
+ * PROJECT:     ReactOS API tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for RtlSetHeapInformation and the low fragmentation heap
+ */
+
+#include "precomp.h"
+
+#define LFH_HEAP        2
+#define CHURN_COUNT     20000
+#define LIVE_BLOCKS     256
+#define CHURN_THREADS   4
+
+typedef struct _CHURN_CONTEXT
+{
+    HANDLE Heap;
+    HANDLE Start;
+    ULONG Seed;
+    ULONG Failed;
+    SIZE_T LiveBytes;
+    PVOID Blocks[LIVE_BLOCKS];
+} CHURN_CONTEXT, *PCHURN_CONTEXT;
+
+static
+ULONG
+QueryFrontEnd(
+    _In_ HANDLE Heap)
+{
+    ULONG FrontEnd = 0xdeadbeef;
+    NTSTATUS Status;
+
+    Status = RtlQueryHeapInformation(Heap, HeapCompatibilityInformation, &FrontEnd, sizeof(FrontEnd), NULL);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    return FrontEnd;
+}
+
+static
+NTSTATUS
+EnableFrontEnd(
+    _In_ HANDLE Heap)
+{
+    ULONG FrontEnd = LFH_HEAP;
+
+    return RtlSetHeapInformation(Heap, HeapCompatibilityInformation, &FrontEnd, sizeof(FrontEnd));
+}
+
+static
+SIZE_T
+QueryPrivateBytes(VOID)
+{
+    VM_COUNTERS Counters;
+    NTSTATUS Status;
+
+    Status = NtQueryInformationProcess(NtCurrentProcess(), ProcessVmCounters, &Counters, sizeof(Counters), NULL);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    return NT_SUCCESS(Status) ? Counters.PagefileUsage : 0;
+}
+
+static
+VOID
+TestBasic(VOID)
+{
+    PUCHAR Block, Blocks[64];
+    HANDLE Heap;
+    NTSTATUS Status;
+    ULONG i, j;
+
+    /* Serialized growable heaps can turn it on, and it stays on */
+    Heap = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, NULL);
+    ok(Heap != NULL, "RtlCreateHeap failed\n");
+    if (!Heap)
+        return;
+    Status = EnableFrontEnd(Heap);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok_dec(QueryFrontEnd(Heap), LFH_HEAP);
+    Status = EnableFrontEnd(Heap);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+    /* Small blocks behave as before */
+    for (i = 0; i < RTL_NUMBER_OF(Blocks); i++)
+    {
+        Blocks[i] = RtlAllocateHeap(Heap, HEAP_ZERO_MEMORY, i + 1);
+        ok(Blocks[i] != NULL, "Allocation %lu failed\n", i);
+        if (!Blocks[i])
+            continue;
+        ok_size_t(RtlSizeHeap(Heap, 0, Blocks[i]), i + 1);
+        ok(RtlValidateHeap(Heap, 0, Blocks[i]) == TRUE, "Block %lu is not valid\n", i);
+        for (j = 0; j <= i; j++)
+        {
+            if (Blocks[i][j] != 0)
+            {
+                ok(0, "Block %lu is not zeroed at %lu\n", i, j);
+                break;
+            }
+        }
+        RtlFillMemory(Blocks[i], i + 1, (UCHAR)i);
+    }
+    for (i = 0; i < RTL_NUMBER_OF(Blocks); i++)
+    {
+        for (j = 0; j < i; j++)
+        {
+            ok(Blocks[i] != Blocks[j], "Blocks %lu and %lu are both %p\n", i, j, Blocks[i]);
+        }
+    }
+
+    /* Growing moves the contents along */
+    Block = RtlReAllocateHeap(Heap, HEAP_ZERO_MEMORY, Blocks[10], 300);
+    ok(Block != NULL, "RtlReAllocateHeap failed\n");
+    if (Block)
+    {
+        ok_size_t(RtlSizeHeap(Heap, 0, Block), 300);
+        ok_hex(Block[0], 10);
+        ok_hex(Block[10], 10);
+        ok_hex(Block[11], 0);
+        ok_hex(Block[299], 0);
+        Blocks[10] = Block;
+    }
+
+    /* Shrinking keeps it where it is */
+    Block = RtlReAllocateHeap(Heap, 0, Blocks[20], 2);
+    ok(Block != NULL, "RtlReAllocateHeap failed\n");
+    if (Block)
+    {
+        ok_size_t(RtlSizeHeap(Heap, 0, Block), 2);
+        ok_hex(Block[1], 20);
+        Blocks[20] = Block;
+    }
+    ok(RtlValidateHeap(Heap, 0, Blocks[10]) == TRUE, "Grown block is not valid\n");
+    ok(RtlValidateHeap(Heap, 0, Blocks[20]) == TRUE, "Shrunk block is not valid\n");
+    ok(RtlValidateHeap(Heap, 0, NULL) == TRUE, "Heap is corrupted\n");
+
+    for (i = 0; i < RTL_NUMBER_OF(Blocks); i++)
+    {
+        ok(RtlFreeHeap(Heap, 0, Blocks[i]) == TRUE, "RtlFreeHeap failed for block %lu\n", i);
+    }
+    ok(RtlValidateHeap(Heap, 0, NULL) == TRUE, "Heap is corrupted\n");
+    RtlDestroyHeap(Heap);
+
+    /* Unserialized and fixed size heaps can't have it */
+    Heap = RtlCreateHeap(HEAP_GROWABLE | HEAP_NO_SERIALIZE, NULL, 0, 0, NULL, NULL);
+    ok(Heap != NULL, "RtlCreateHeap failed\n");
+    if (Heap)
+    {
+        Status = EnableFrontEnd(Heap);
+        ok(!NT_SUCCESS(Status), "Status = 0x%lx\n", Status);
+        ok_dec(QueryFrontEnd(Heap), 0);
+        RtlDestroyHeap(Heap);
+    }
+    Heap = RtlCreateHeap(0, NULL, 0x100000, 0, NULL, NULL);
+    ok(Heap != NULL, "RtlCreateHeap failed\n");
+    if (Heap)
+    {
+        Status = EnableFrontEnd(Heap);
+        ok(!NT_SUCCESS(Status), "Status = 0x%lx\n", Status);
+        ok_dec(QueryFrontEnd(Heap), 0);
+        RtlDestroyHeap(Heap);
+    }
+}
+
+static
+DWORD
+WINAPI
+ChurnThread(
+    _In_ PVOID Context)
+{
+    PCHURN_CONTEXT Churn = Context;
+    ULONG i, Slot;
+    SIZE_T Size;
+
+    NtWaitForSingleObject(Churn->Start, FALSE, NULL);
+    for (i = 0; i < CHURN_COUNT; i++)
+    {
+        /* Replace a random live block with one of a random small size */
+        Slot = RtlRandom(&Churn->Seed) % LIVE_BLOCKS;
+        if (Churn->Blocks[Slot])
+            RtlFreeHeap(Churn->Heap, 0, Churn->Blocks[Slot]);
+        Size = 8 + RtlRandom(&Churn->Seed) % 504;
+        Churn->Blocks[Slot] = RtlAllocateHeap(Churn->Heap, 0, Size);
+        if (!Churn->Blocks[Slot])
+            Churn->Failed++;
+    }
+
+    /* Leave the working set allocated so the heap's footprint can be measured */
+    Churn->LiveBytes = 0;
+    for (Slot = 0; Slot < LIVE_BLOCKS; Slot++)
+    {
+        if (Churn->Blocks[Slot])
+            Churn->LiveBytes += RtlSizeHeap(Churn->Heap, 0, Churn->Blocks[Slot]);
+    }
+
+    return 0;
+}
+
+/* Runs Threads churn loops on a fresh heap and returns allocations per second */
+static
+ULONGLONG
+TimeChurn(
+    _In_ ULONG Threads,
+    _In_ BOOLEAN FrontEnd,
+    _Out_ PSIZE_T LiveBytes,
+    _Out_ PSIZE_T HeapBytes)
+{
+    static CHURN_CONTEXT Churn[CHURN_THREADS];
+    HANDLE Thread[CHURN_THREADS];
+    LARGE_INTEGER Start, End, Frequency;
+    HANDLE Heap, StartEvent;
+    SIZE_T PrivateBytes;
+    NTSTATUS Status;
+    ULONG i, Slot;
+
+    *LiveBytes = *HeapBytes = 0;
+
+    /* The back end is measured on a fixed size heap, which never gets a front end */
+    PrivateBytes = QueryPrivateBytes();
+    if (FrontEnd)
+    {
+        Heap = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, NULL);
+        ok(Heap != NULL, "RtlCreateHeap failed\n");
+        if (!Heap)
+            return 0;
+        Status = EnableFrontEnd(Heap);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+    }
+    else
+    {
+        Heap = RtlCreateHeap(0, NULL, 64 * 1024 * 1024, 0, NULL, NULL);
+        ok(Heap != NULL, "RtlCreateHeap failed\n");
+        if (!Heap)
+            return 0;
+    }
+
+    Status = NtCreateEvent(&StartEvent, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlDestroyHeap(Heap);
+        return 0;
+    }
+    for (i = 0; i < Threads; i++)
+    {
+        RtlZeroMemory(&Churn[i], sizeof(Churn[i]));
+        Churn[i].Heap = Heap;
+        Churn[i].Start = StartEvent;
+        Churn[i].Seed = i + 1;
+        Thread[i] = CreateThread(NULL, 0, ChurnThread, &Churn[i], 0, NULL);
+        ok(Thread[i] != NULL, "CreateThread failed with %lu\n", GetLastError());
+    }
+
+    NtQueryPerformanceCounter(&Start, &Frequency);
+    NtSetEvent(StartEvent, NULL);
+    for (i = 0; i < Threads; i++)
+    {
+        if (Thread[i])
+            WaitForSingleObject(Thread[i], INFINITE);
+    }
+    NtQueryPerformanceCounter(&End, NULL);
+
+    for (i = 0; i < Threads; i++)
+    {
+        if (!Thread[i])
+            continue;
+        CloseHandle(Thread[i]);
+        ok(Churn[i].Failed == 0, "Thread %lu: %lu failed allocations\n", i, Churn[i].Failed);
+        *LiveBytes += Churn[i].LiveBytes;
+    }
+    *HeapBytes = QueryPrivateBytes() - PrivateBytes;
+    ok(RtlValidateHeap(Heap, 0, NULL) == TRUE, "Heap is corrupted\n");
+
+    /* Every surviving block is still owned by the heap */
+    for (i = 0; i < Threads; i++)
+    {
+        for (Slot = 0; Slot < LIVE_BLOCKS; Slot++)
+        {
+            if (!Churn[i].Blocks[Slot])
+                continue;
+            ok(RtlValidateHeap(Heap, 0, Churn[i].Blocks[Slot]) == TRUE,
+               "Thread %lu: block %lu is not valid\n", i, Slot);
+            ok(RtlFreeHeap(Heap, 0, Churn[i].Blocks[Slot]) == TRUE,
+               "Thread %lu: RtlFreeHeap failed for block %lu\n", i, Slot);
+        }
+    }
+    ok(RtlValidateHeap(Heap, 0, NULL) == TRUE, "Heap is corrupted\n");
+
+    NtClose(StartEvent);
+    RtlDestroyHeap(Heap);
+
+    if (End.QuadPart == Start.QuadPart)
+        return 0;
+    return (ULONGLONG)Threads * CHURN_COUNT * Frequency.QuadPart / (End.QuadPart - Start.QuadPart);
+}
+
+START_TEST(RtlSetHeapInformation)
+{
+    static const PCSTR Names[] = { "back end ", "front end" };
+    SYSTEM_INFO SystemInfo;
+    SIZE_T LiveBytes, HeapBytes;
+    ULONGLONG Rate;
+    ULONG Threads, i;
+
+    TestBasic();
+
+    /* Concurrent small block churn keeps the heap consistent, trace its rate and footprint */
+    GetSystemInfo(&SystemInfo);
+    for (Threads = 1; Threads <= max(2, min(SystemInfo.dwNumberOfProcessors, CHURN_THREADS)); Threads++)
+    {
+        for (i = 0; i < RTL_NUMBER_OF(Names); i++)
+        {
+            Rate = TimeChurn(Threads, i != 0, &LiveBytes, &HeapBytes);
+            trace("%lu thread(s), %s: %I64u allocations/s, %Iu KB committed for %Iu KB live\n",
+                  Threads, Names[i], Rate, HeapBytes / 1024, LiveBytes / 1024);
+        }
+    }
+}
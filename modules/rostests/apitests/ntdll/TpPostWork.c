@@ -0,0 +1,263 @@
+/*
+ * PROJECT:     ReactOS API tests
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Test for TpPostWork
+ */
+
+#include "precomp.h"
+
+#define POSTS_PER_THREAD 5000
+#define MAX_WORKERS      4
+
+static NTSTATUS (WINAPI *pTpAllocPool)(TP_POOL **, PVOID);
+static VOID (WINAPI *pTpReleasePool)(TP_POOL *);
+static VOID (WINAPI *pTpSetPoolMaxThreads)(TP_POOL *, DWORD);
+static BOOL (WINAPI *pTpSetPoolMinThreads)(TP_POOL *, DWORD);
+static NTSTATUS (WINAPI *pTpAllocWork)(TP_WORK **, PTP_WORK_CALLBACK, PVOID, TP_CALLBACK_ENVIRON *);
+static VOID (WINAPI *pTpPostWork)(TP_WORK *);
+static VOID (WINAPI *pTpWaitForWork)(TP_WORK *, BOOL);
+static VOID (WINAPI *pTpReleaseWork)(TP_WORK *);
+
+typedef struct _POSTER
+{
+    TP_WORK *Work;
+    HANDLE Start;
+} POSTER, *PPOSTER;
+
+typedef struct _BLOCKING_WORK
+{
+    HANDLE Event;
+    LONG Calls;
+    LONG TimedOut;
+} BLOCKING_WORK, *PBLOCKING_WORK;
+
+static
+VOID
+NTAPI
+CountCallback(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _Inout_opt_ PVOID Context,
+    _Inout_ PTP_WORK Work)
+{
+    InterlockedIncrement(Context);
+}
+
+static
+VOID
+NTAPI
+BlockingCallback(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _Inout_opt_ PVOID Context,
+    _Inout_ PTP_WORK Work)
+{
+    PBLOCKING_WORK Blocking = Context;
+    LARGE_INTEGER Timeout;
+
+    /* The first call can only return once the second one ran */
+    if (InterlockedIncrement(&Blocking->Calls) == 1)
+    {
+        Timeout.QuadPart = -10000LL * 10000;
+        if (NtWaitForSingleObject(Blocking->Event, FALSE, &Timeout) == STATUS_TIMEOUT)
+            InterlockedIncrement(&Blocking->TimedOut);
+    }
+    else
+    {
+        NtSetEvent(Blocking->Event, NULL);
+    }
+}
+
+static
+DWORD
+WINAPI
+PostThread(
+    _In_ PVOID Context)
+{
+    PPOSTER Poster = Context;
+    ULONG i;
+
+    WaitForSingleObject(Poster->Start, INFINITE);
+    for (i = 0; i < POSTS_PER_THREAD; i++)
+    {
+        pTpPostWork(Poster->Work);
+    }
+
+    return 0;
+}
+
+static
+TP_WORK *
+AllocWork(
+    _In_ TP_POOL *Pool,
+    _In_ PTP_WORK_CALLBACK Callback,
+    _In_ PVOID Context)
+{
+    TP_CALLBACK_ENVIRON Environment;
+    TP_WORK *Work = NULL;
+    NTSTATUS Status;
+
+    RtlZeroMemory(&Environment, sizeof(Environment));
+    Environment.Version = 1;
+    Environment.Pool = Pool;
+    Status = pTpAllocWork(&Work, Callback, Context, &Environment);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    return NT_SUCCESS(Status) ? Work : NULL;
+}
+
+static
+VOID
+TestBasic(VOID)
+{
+    BLOCKING_WORK Blocking;
+    TP_POOL *Pool = NULL;
+    TP_WORK *Work;
+    LONG Count;
+    ULONG i;
+    NTSTATUS Status;
+
+    Status = pTpAllocPool(&Pool, NULL);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+
+    /* Every post runs the callback once */
+    Count = 0;
+    Work = AllocWork(Pool, CountCallback, &Count);
+    if (Work)
+    {
+        for (i = 0; i < 1000; i++)
+        {
+            pTpPostWork(Work);
+        }
+        pTpWaitForWork(Work, FALSE);
+        ok_dec(Count, 1000);
+
+        /* Cancelled posts don't run, and later ones still do */
+        Count = 0;
+        for (i = 0; i < 1000; i++)
+        {
+            pTpPostWork(Work);
+        }
+        pTpWaitForWork(Work, TRUE);
+        ok(Count <= 1000, "Count = %ld\n", Count);
+        Count = 0;
+        pTpPostWork(Work);
+        pTpWaitForWork(Work, FALSE);
+        ok_dec(Count, 1);
+
+        pTpReleaseWork(Work);
+    }
+
+    /* A blocked callback doesn't starve the pool, even on a single processor */
+    pTpSetPoolMaxThreads(Pool, 2);
+    RtlZeroMemory(&Blocking, sizeof(Blocking));
+    Status = NtCreateEvent(&Blocking.Event, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Work = AllocWork(Pool, BlockingCallback, &Blocking);
+    if (Work)
+    {
+        pTpPostWork(Work);
+        pTpPostWork(Work);
+        pTpWaitForWork(Work, FALSE);
+        ok_dec(Blocking.Calls, 2);
+        ok_dec(Blocking.TimedOut, 0);
+        pTpReleaseWork(Work);
+    }
+    NtClose(Blocking.Event);
+
+    pTpReleasePool(Pool);
+}
+
+/* Posts from Workers threads into a pool with as many workers, and returns callbacks per second */
+static
+ULONGLONG
+TimePostWork(
+    _In_ ULONG Workers)
+{
+    POSTER Poster;
+    HANDLE Threads[MAX_WORKERS];
+    LARGE_INTEGER Start, End, Frequency;
+    TP_POOL *Pool = NULL;
+    LONG Count = 0;
+    ULONG i;
+    NTSTATUS Status;
+
+    Status = pTpAllocPool(&Pool, NULL);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return 0;
+    pTpSetPoolMaxThreads(Pool, Workers);
+    pTpSetPoolMinThreads(Pool, Workers);
+
+    Poster.Work = AllocWork(Pool, CountCallback, &Count);
+    Poster.Start = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (!Poster.Work || !Poster.Start)
+    {
+        skip("Failed to set up the work item\n");
+        if (Poster.Work) pTpReleaseWork(Poster.Work);
+        if (Poster.Start) CloseHandle(Poster.Start);
+        pTpReleasePool(Pool);
+        return 0;
+    }
+
+    for (i = 0; i < Workers; i++)
+    {
+        Threads[i] = CreateThread(NULL, 0, PostThread, &Poster, 0, NULL);
+        ok(Threads[i] != NULL, "CreateThread failed with %lu\n", GetLastError());
+    }
+
+    NtQueryPerformanceCounter(&Start, &Frequency);
+    SetEvent(Poster.Start);
+    WaitForMultipleObjects(Workers, Threads, TRUE, INFINITE);
+    pTpWaitForWork(Poster.Work, FALSE);
+    NtQueryPerformanceCounter(&End, NULL);
+
+    ok_dec(Count, Workers * POSTS_PER_THREAD);
+
+    for (i = 0; i < Workers; i++)
+    {
+        CloseHandle(Threads[i]);
+    }
+    CloseHandle(Poster.Start);
+    pTpReleaseWork(Poster.Work);
+    pTpReleasePool(Pool);
+
+    if (End.QuadPart == Start.QuadPart)
+        return 0;
+    return (ULONGLONG)Count * Frequency.QuadPart / (End.QuadPart - Start.QuadPart);
+}
+
+START_TEST(TpPostWork)
+{
+    HMODULE Ntdll = GetModuleHandleW(L"ntdll.dll");
+    SYSTEM_INFO SystemInfo;
+    ULONGLONG Single, Rate;
+    ULONG Workers;
+
+    pTpAllocPool = (PVOID)GetProcAddress(Ntdll, "TpAllocPool");
+    pTpReleasePool = (PVOID)GetProcAddress(Ntdll, "TpReleasePool");
+    pTpSetPoolMaxThreads = (PVOID)GetProcAddress(Ntdll, "TpSetPoolMaxThreads");
+    pTpSetPoolMinThreads = (PVOID)GetProcAddress(Ntdll, "TpSetPoolMinThreads");
+    pTpAllocWork = (PVOID)GetProcAddress(Ntdll, "TpAllocWork");
+    pTpPostWork = (PVOID)GetProcAddress(Ntdll, "TpPostWork");
+    pTpWaitForWork = (PVOID)GetProcAddress(Ntdll, "TpWaitForWork");
+    pTpReleaseWork = (PVOID)GetProcAddress(Ntdll, "TpReleaseWork");
+    if (!pTpAllocPool || !pTpReleasePool || !pTpSetPoolMaxThreads || !pTpSetPoolMinThreads ||
+        !pTpAllocWork || !pTpPostWork || !pTpWaitForWork || !pTpReleaseWork)
+    {
+        win_skip("Thread pool (NT >= 6.0 API) not available\n");
+        return;
+    }
+
+    TestBasic();
+
+    /* Concurrent posters don't lose or duplicate callbacks, trace how that scales */
+    GetSystemInfo(&SystemInfo);
+    Single = 0;
+    for (Workers = 1; Workers <= max(2, min(SystemInfo.dwNumberOfProcessors, MAX_WORKERS)); Workers++)
+    {
+        Rate = TimePostWork(Workers);
+        if (Workers == 1) Single = Rate;
+        trace("%lu worker(s): %I64u callbacks/s (%I64u%% of %lu x single)\n",
+              Workers, Rate, Single ? Rate * 100 / (Single * Workers) : 0, Workers);
+    }
+}
@@ -257,10 +257,261 @@ TestBigPoolExpansion(VOID)
     }
 }
 
+#define STRESS_ROUNDS       16
+#define STRESS_BLOCKS       1024
+#define STRESS_MAX_THREADS  8
+
+typedef struct _POOL_STRESS_THREAD
+{
+    HANDLE Handle;
+    KAFFINITY Affinity;
+    BOOLEAN Free;
+    PVOID *Blocks;
+    PKEVENT StartEvent;
+} POOL_STRESS_THREAD, *PPOOL_STRESS_THREAD;
+
+static
+VOID
+NTAPI
+PoolStressThread(
+    _In_ PVOID Context)
+{
+    PPOOL_STRESS_THREAD Thread = Context;
+    ULONG i;
+
+    KeSetSystemAffinityThread(Thread->Affinity);
+    KeWaitForSingleObject(Thread->StartEvent, Executive, KernelMode, FALSE, NULL);
+
+    /* Small blocks of both pools, the sizes the lookaside lists cover */
+    for (i = 0; i < STRESS_BLOCKS; i++)
+    {
+        if (!Thread->Free)
+        {
+            Thread->Blocks[i] = ExAllocatePoolWithTag((i & 1) ? PagedPool : NonPagedPool,
+                                                      8 + (i % 32) * 8,
+                                                      'SPmK');
+        }
+        else if (Thread->Blocks[i])
+        {
+            ExFreePoolWithTag(Thread->Blocks[i], 'SPmK');
+            Thread->Blocks[i] = NULL;
+        }
+    }
+
+    KeRevertToUserAffinityThread();
+    PsTerminateSystemThread(STATUS_SUCCESS);
+}
+
+/* Runs the stress threads side by side, waits for all of them and
+ * returns the blocks allocated or freed per second */
+static
+ULONGLONG
+RunPoolStressThreads(
+    _In_ PPOOL_STRESS_THREAD Threads,
+    _In_ ULONG ThreadCount)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    LARGE_INTEGER Start, End, Frequency;
+    KEVENT StartEvent;
+    NTSTATUS Status;
+    ULONG i, Started;
+
+    KeInitializeEvent(&StartEvent, NotificationEvent, FALSE);
+    InitializeObjectAttributes(&ObjectAttributes, NULL, OBJ_KERNEL_HANDLE, NULL, NULL);
+    for (i = 0, Started = 0; i < ThreadCount; i++)
+    {
+        Threads[i].StartEvent = &StartEvent;
+        Status = PsCreateSystemThread(&Threads[i].Handle, SYNCHRONIZE, &ObjectAttributes, NULL, NULL, PoolStressThread, &Threads[i]);
+        ok_eq_hex(Status, STATUS_SUCCESS);
+        if (!NT_SUCCESS(Status)) break;
+        Started++;
+    }
+
+    Start = KeQueryPerformanceCounter(&Frequency);
+    KeSetEvent(&StartEvent, IO_NO_INCREMENT, FALSE);
+    for (i = 0; i < Started; i++)
+    {
+        ZwWaitForSingleObject(Threads[i].Handle, FALSE, NULL);
+        ZwClose(Threads[i].Handle);
+    }
+    End = KeQueryPerformanceCounter(NULL);
+
+    if (End.QuadPart == Start.QuadPart)
+        return 0;
+    return (ULONGLONG)Started * STRESS_BLOCKS * Frequency.QuadPart / (End.QuadPart - Start.QuadPart);
+}
+
+/* Returns the totals of the stress tag, summed over all processors */
+static
+BOOLEAN
+QueryStressTag(
+    _Out_ PSYSTEM_POOLTAG Tag)
+{
+    PSYSTEM_POOLTAG_INFORMATION TagInfo;
+    ULONG Length, i;
+    NTSTATUS Status;
+    BOOLEAN Found = FALSE;
+
+    RtlZeroMemory(Tag, sizeof(*Tag));
+    Length = 64 * 1024;
+    TagInfo = ExAllocatePoolWithTag(PagedPool, Length, 'ITmK');
+    ok(TagInfo != NULL, "No memory for the tag information\n");
+    if (!TagInfo)
+        return FALSE;
+
+    Status = ZwQuerySystemInformation(SystemPoolTagInformation, TagInfo, Length, &Length);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    if (NT_SUCCESS(Status))
+    {
+        for (i = 0; i < TagInfo->Count; i++)
+        {
+            if (TagInfo->TagInfo[i].TagUlong != 'SPmK') continue;
+            *Tag = TagInfo->TagInfo[i];
+            Found = TRUE;
+            break;
+        }
+        ok(Found, "Tag not found\n");
+    }
+
+    ExFreePoolWithTag(TagInfo, 'ITmK');
+    return Found;
+}
+
+static
+VOID
+TestCrossProcessorFrees(VOID)
+{
+    POOL_STRESS_THREAD Threads[STRESS_MAX_THREADS];
+    SYSTEM_POOLTAG Tag;
+    ULONG ThreadCount, Round, i, j;
+    ULONG PagedLive, NonPagedLive;
+
+    ThreadCount = min((ULONG)KeNumberProcessors, STRESS_MAX_THREADS);
+    if (!skip(ThreadCount > 1, "Needs more than one processor\n"))
+        return;
+
+    RtlZeroMemory(Threads, sizeof(Threads));
+    for (i = 0; i < ThreadCount; i++)
+    {
+        Threads[i].Blocks = ExAllocatePoolWithTag(NonPagedPool,
+                                                  STRESS_BLOCKS * sizeof(PVOID),
+                                                  'BSmK');
+        ok(Threads[i].Blocks != NULL, "No memory for the block array\n");
+        if (!Threads[i].Blocks)
+        {
+            ThreadCount = i;
+            break;
+        }
+    }
+
+    for (Round = 0; Round < STRESS_ROUNDS && ThreadCount > 1; Round++)
+    {
+        /* Every processor allocates a batch */
+        for (i = 0; i < ThreadCount; i++)
+        {
+            Threads[i].Affinity = (KAFFINITY)1 << i;
+            Threads[i].Free = FALSE;
+        }
+        RunPoolStressThreads(Threads, ThreadCount);
+
+        /* The summed counters must show every block which is still out */
+        PagedLive = NonPagedLive = 0;
+        for (i = 0; i < ThreadCount; i++)
+        {
+            for (j = 0; j < STRESS_BLOCKS; j++)
+            {
+                if (!Threads[i].Blocks[j]) continue;
+                if (j & 1) PagedLive++;
+                else NonPagedLive++;
+            }
+        }
+        if (QueryStressTag(&Tag))
+        {
+            ok_eq_ulong(Tag.PagedAllocs - Tag.PagedFrees, PagedLive);
+            ok_eq_ulong(Tag.NonPagedAllocs - Tag.NonPagedFrees, NonPagedLive);
+        }
+
+        /* And another processor frees it, a different one every round */
+        for (i = 0; i < ThreadCount; i++)
+        {
+            Threads[i].Affinity = (KAFFINITY)1 << ((i + 1 + Round % (ThreadCount - 1)) % ThreadCount);
+            Threads[i].Free = TRUE;
+        }
+        RunPoolStressThreads(Threads, ThreadCount);
+
+        /* Each processor's table is now off, but the totals balance out */
+        if (QueryStressTag(&Tag))
+        {
+            ok_eq_ulong(Tag.PagedAllocs, Tag.PagedFrees);
+            ok_eq_ulong(Tag.NonPagedAllocs, Tag.NonPagedFrees);
+            ok_eq_size(Tag.PagedUsed, (SIZE_T)0);
+            ok_eq_size(Tag.NonPagedUsed, (SIZE_T)0);
+        }
+    }
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+        ExFreePoolWithTag(Threads[i].Blocks, 'BSmK');
+    }
+}
+
+static
+VOID
+TestPoolScaling(VOID)
+{
+    POOL_STRESS_THREAD Threads[STRESS_MAX_THREADS];
+    ULONGLONG Single, Rate, FreeRate;
+    ULONG MaxThreads, ThreadCount, i;
+
+    MaxThreads = min((ULONG)KeNumberProcessors, STRESS_MAX_THREADS);
+    RtlZeroMemory(Threads, sizeof(Threads));
+    for (i = 0; i < MaxThreads; i++)
+    {
+        Threads[i].Blocks = ExAllocatePoolWithTag(NonPagedPool,
+                                                  STRESS_BLOCKS * sizeof(PVOID),
+                                                  'BSmK');
+        ok(Threads[i].Blocks != NULL, "No memory for the block array\n");
+        if (!Threads[i].Blocks)
+        {
+            MaxThreads = i;
+            break;
+        }
+    }
+
+    /* Only a trace, each processor allocates and frees a single batch */
+    Single = 0;
+    for (ThreadCount = 1; ThreadCount <= MaxThreads; ThreadCount++)
+    {
+        for (i = 0; i < ThreadCount; i++)
+        {
+            Threads[i].Affinity = (KAFFINITY)1 << i;
+            Threads[i].Free = FALSE;
+        }
+        Rate = RunPoolStressThreads(Threads, ThreadCount);
+
+        for (i = 0; i < ThreadCount; i++)
+        {
+            Threads[i].Free = TRUE;
+        }
+        FreeRate = RunPoolStressThreads(Threads, ThreadCount);
+
+        if (ThreadCount == 1) Single = Rate;
+        trace("%lu processor(s): %I64u allocations/s (%I64u%% of %lu x single), %I64u frees/s\n",
+              ThreadCount, Rate, Single ? Rate * 100 / (Single * ThreadCount) : 0, ThreadCount, FreeRate);
+    }
+
+    for (i = 0; i < MaxThreads; i++)
+    {
+        ExFreePoolWithTag(Threads[i].Blocks, 'BSmK');
+    }
+}
+
 START_TEST(ExPools)
 {
     PoolsTest();
     TestPoolTags();
     TestPoolQuota();
     TestBigPoolExpansion();
+    TestCrossProcessorFrees();
+    TestPoolScaling();
 }
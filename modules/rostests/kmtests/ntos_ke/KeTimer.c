@@ -47,6 +47,65 @@ TestTimerFunctional(
     CheckTimer(Timer, TimerNotificationObject + Type, 0L, FALSE, OriginalIrql, (PVOID *)NULL, 0);
 }
 
+static
+BOOLEAN
+(NTAPI
+*pKeSetCoalescableTimer)(
+    _Inout_ PKTIMER Timer,
+    _In_ LARGE_INTEGER DueTime,
+    _In_ ULONG Period,
+    _In_ ULONG TolerableDelay,
+    _In_opt_ PKDPC Dpc);
+
+static
+VOID
+TestCoalescableTimer(VOID)
+{
+    KTIMER Timer;
+    LARGE_INTEGER DueTime, Timeout;
+    NTSTATUS Status;
+    BOOLEAN Inserted;
+
+    pKeSetCoalescableTimer = KmtGetSystemRoutineAddress(L"KeSetCoalescableTimer");
+    if (!skip(pKeSetCoalescableTimer != NULL, "KeSetCoalescableTimer unavailable\n"))
+        return;
+
+    KeInitializeTimerEx(&Timer, SynchronizationTimer);
+    Timeout.QuadPart = -10 * 1000 * 1000;
+
+    /* A one-shot timer with some slack still expires, and only once */
+    DueTime.QuadPart = -10 * 1000;
+    Inserted = pKeSetCoalescableTimer(&Timer, DueTime, 0, 100, NULL);
+    ok_bool_false(Inserted, "KeSetCoalescableTimer returned");
+    ok_eq_uint(Timer.Header.Coalescable, 1);
+    Status = KeWaitForSingleObject(&Timer, Executive, KernelMode, FALSE, &Timeout);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    ok_bool_false(KeCancelTimer(&Timer), "KeCancelTimer returned");
+
+    /* A periodic timer keeps firing */
+    Inserted = pKeSetCoalescableTimer(&Timer, DueTime, 20, 50, NULL);
+    ok_bool_false(Inserted, "KeSetCoalescableTimer returned");
+    Status = KeWaitForSingleObject(&Timer, Executive, KernelMode, FALSE, &Timeout);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    Status = KeWaitForSingleObject(&Timer, Executive, KernelMode, FALSE, &Timeout);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    ok_bool_true(KeCancelTimer(&Timer), "KeCancelTimer returned");
+
+    /* A delay shorter than a clock tick leaves the timer alone */
+    Inserted = pKeSetCoalescableTimer(&Timer, DueTime, 0, 0, NULL);
+    ok_bool_false(Inserted, "KeSetCoalescableTimer returned");
+    ok_eq_uint(Timer.Header.Coalescable, 0);
+    Status = KeWaitForSingleObject(&Timer, Executive, KernelMode, FALSE, &Timeout);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+
+    /* KeSetTimerEx drops the tolerable delay again */
+    pKeSetCoalescableTimer(&Timer, DueTime, 0, 100, NULL);
+    KeSetTimerEx(&Timer, DueTime, 0, NULL);
+    ok_eq_uint(Timer.Header.Coalescable, 0);
+    Status = KeWaitForSingleObject(&Timer, Executive, KernelMode, FALSE, &Timeout);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+}
+
 START_TEST(KeTimer)
 {
     KTIMER Timer;
@@ -67,4 +126,6 @@ START_TEST(KeTimer)
 
     ok_irql(PASSIVE_LEVEL);
     KmtSetIrql(PASSIVE_LEVEL);
+
+    TestCoalescableTimer();
 }
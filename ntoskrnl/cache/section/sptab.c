@@ -378,7 +378,7 @@ MmGetSectionAssociation(PFN_NUMBER Page,
     PMM_SECTION_SEGMENT Segment = NULL;
     PCACHE_SECTION_PAGE_TABLE PageTable;
 
-    KIRQL OldIrql = MiAcquirePfnLock();
+    KIRQL OldIrql = MiAcquireRmapLock(Page);
 
     PageTable = MmGetSegmentRmap(Page, &RawOffset);
     if (PageTable)
@@ -390,7 +390,7 @@ MmGetSectionAssociation(PFN_NUMBER Page,
         InterlockedIncrement64(Segment->ReferenceCount);
     }
 
-    MiReleasePfnLock(OldIrql);
+    MiReleaseRmapLock(Page, OldIrql);
 
     return Segment;
 }
@@ -68,7 +68,6 @@ back into any address spaces required in the normal way.
 #define DPRINTC DPRINT
 
 extern KEVENT MmWaitPageEvent;
-extern FAST_MUTEX RmapListLock;
 extern PMMWSL MmWorkingSetList;
 
 FAST_MUTEX MiGlobalPageOperation;
@@ -356,6 +355,7 @@ MmpPageOutPhysicalAddress(PFN_NUMBER Page)
     PEPROCESS Process = NULL;
     NTSTATUS Status = STATUS_SUCCESS;
     MM_REQUIRED_RESOURCES Resources = { 0 };
+    KIRQL OldIrql;
 
     DPRINTC("Page out %x (ref ct %x)\n", Page, MmGetReferenceCountPageWithoutLock(Page));
 
@@ -390,7 +390,7 @@ MmpPageOutPhysicalAddress(PFN_NUMBER Page)
     Dirty = MmIsDirtyPageRmap(Page);
 
     DPRINTC("Trying to unmap all instances of %x\n", Page);
-    ExAcquireFastMutex(&RmapListLock);
+    OldIrql = MiAcquireRmapLock(Page);
     entry = MmGetRmapListHeadPage(Page);
 
     // Entry and Segment might be null here in the case that the page
@@ -399,7 +399,7 @@ MmpPageOutPhysicalAddress(PFN_NUMBER Page)
     {
         Status = STATUS_UNSUCCESSFUL;
         DPRINT1("Page %x is in transit\n", Page);
-        ExReleaseFastMutex(&RmapListLock);
+        MiReleaseRmapLock(Page, OldIrql);
         goto bail;
     }
 
@@ -422,7 +422,7 @@ MmpPageOutPhysicalAddress(PFN_NUMBER Page)
             if (PspIsProcessExiting(Process))
             {
                 DPRINT("bail\n");
-                ExReleaseFastMutex(&RmapListLock);
+                MiReleaseRmapLock(Page, OldIrql);
                 goto bail;
             }
             ObReferenceObject(Process);
@@ -433,7 +433,7 @@ MmpPageOutPhysicalAddress(PFN_NUMBER Page)
         {
             AddressSpace = MmGetKernelAddressSpace();
         }
-        ExReleaseFastMutex(&RmapListLock);
+        MiReleaseRmapLock(Page, OldIrql);
 
         RtlZeroMemory(&Resources, sizeof(Resources));
 
@@ -521,14 +521,14 @@ MmpPageOutPhysicalAddress(PFN_NUMBER Page)
             ProcRef = FALSE;
         }
 
-        ExAcquireFastMutex(&RmapListLock);
         ASSERT(!MM_IS_WAIT_PTE(MmGetPfnForProcess(Process, Address)));
+        OldIrql = MiAcquireRmapLock(Page);
         entry = MmGetRmapListHeadPage(Page);
 
         DPRINTC("Entry %p\n", entry);
     }
 
-    ExReleaseFastMutex(&RmapListLock);
+    MiReleaseRmapLock(Page, OldIrql);
 
 bail:
     DPRINTC("BAIL %x\n", Status);
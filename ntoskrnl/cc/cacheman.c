@@ -149,8 +149,51 @@ CcRemapBcb (
     return 0;
 }
 
+VOID
+CcRosDiscardReadAhead(
+    IN PROS_PRIVATE_CACHE_MAP PrivateCacheMap)
+{
+    /* Whatever the reader didn't consume by now was read for nothing */
+    if (PrivateCacheMap->ReadAheadEnd.QuadPart > PrivateCacheMap->ReadAheadStart.QuadPart)
+    {
+        InterlockedExchangeAdd((PLONG)&CcReadAheadWastedPages,
+                               (LONG)BYTES_TO_PAGES(PrivateCacheMap->ReadAheadEnd.QuadPart -
+                                                    PrivateCacheMap->ReadAheadStart.QuadPart));
+    }
+
+    PrivateCacheMap->ReadAheadStart.QuadPart = 0;
+    PrivateCacheMap->ReadAheadEnd.QuadPart = 0;
+}
+
+static
+VOID
+CcRosConsumeReadAhead(
+    IN PROS_PRIVATE_CACHE_MAP PrivateCacheMap,
+    IN LONGLONG FileOffset,
+    IN LONGLONG ReadEnd)
+{
+    LONGLONG HitStart, HitEnd;
+
+    HitStart = ROUND_DOWN(max(FileOffset, PrivateCacheMap->ReadAheadStart.QuadPart), PAGE_SIZE);
+    HitEnd = ROUND_UP(min(ReadEnd, PrivateCacheMap->ReadAheadEnd.QuadPart), PAGE_SIZE);
+    if (HitEnd <= HitStart)
+    {
+        return;
+    }
+
+    /* Pages the reader jumped over won't be read anymore */
+    if (HitStart > PrivateCacheMap->ReadAheadStart.QuadPart)
+    {
+        InterlockedExchangeAdd((PLONG)&CcReadAheadWastedPages,
+                               (LONG)BYTES_TO_PAGES(HitStart - PrivateCacheMap->ReadAheadStart.QuadPart));
+    }
+
+    InterlockedExchangeAdd((PLONG)&CcReadAheadHitPages, (LONG)BYTES_TO_PAGES(HitEnd - HitStart));
+    PrivateCacheMap->ReadAheadStart.QuadPart = min(HitEnd, PrivateCacheMap->ReadAheadEnd.QuadPart);
+}
+
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
@@ -161,62 +204,141 @@ CcScheduleReadAhead (
 	)
 {
     KIRQL OldIrql;
-    LARGE_INTEGER NewOffset;
+    LONGLONG ReadEnd, Stride, NewOffset, NewEnd;
     PROS_SHARED_CACHE_MAP SharedCacheMap;
-    PPRIVATE_CACHE_MAP PrivateCacheMap;
+    PROS_PRIVATE_CACHE_MAP PrivateCacheMap;
+    ULONG Previous, Slot, i;
+    BOOLEAN Sequential, Strided;
 
     SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
     PrivateCacheMap = FileObject->PrivateCacheMap;
 
     /* If file isn't cached, or if read ahead is disabled, this is no op */
     if (SharedCacheMap == NULL || PrivateCacheMap == NULL ||
-        BooleanFlagOn(SharedCacheMap->Flags, READAHEAD_DISABLED))
+        BooleanFlagOn(SharedCacheMap->Flags, READAHEAD_DISABLED) || Length == 0)
     {
         return;
     }
 
-    /* Round read length with read ahead mask */
-    Length = ROUND_UP(Length, PrivateCacheMap->ReadAheadMask + 1);
-    /* Compute the offset we'll reach */
-    NewOffset.QuadPart = FileOffset->QuadPart + Length;
+    ReadEnd = FileOffset->QuadPart + Length;
 
     /* Lock read ahead spin lock */
     KeAcquireSpinLock(&PrivateCacheMap->ReadAheadSpinLock, &OldIrql);
-    /* Easy case: the file is sequentially read */
-    if (BooleanFlagOn(FileObject->Flags, FO_SEQUENTIAL_ONLY))
+
+    /* The file system may report a read we already saw through CcCopyRead */
+    Previous = (PrivateCacheMap->ReadHistoryIndex + CC_READ_HISTORY_DEPTH - 1) % CC_READ_HISTORY_DEPTH;
+    if (PrivateCacheMap->ReadHistoryCount != 0 &&
+        PrivateCacheMap->ReadHistoryOffset[Previous].QuadPart == FileOffset->QuadPart &&
+        PrivateCacheMap->ReadHistoryLength[Previous] == Length)
+    {
+        KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
+        return;
+    }
+
+    /* Account for what previous read ahead saved us */
+    CcRosConsumeReadAhead(PrivateCacheMap, FileOffset->QuadPart, ReadEnd);
+
+    /* Sequential: we start about where the previous read stopped */
+    if (PrivateCacheMap->ReadHistoryCount == 0)
+    {
+        Sequential = BooleanFlagOn(FileObject->Flags, FO_SEQUENTIAL_ONLY);
+    }
+    else
     {
-        /* If we went backward, this is no go! */
-        if (NewOffset.QuadPart < PrivateCacheMap->ReadAheadOffset[1].QuadPart)
+        Sequential = (FileOffset->QuadPart >= PrivateCacheMap->ReadHistoryOffset[Previous].QuadPart &&
+                      FileOffset->QuadPart <= PrivateCacheMap->ReadHistoryOffset[Previous].QuadPart +
+                                              PrivateCacheMap->ReadHistoryLength[Previous] +
+                                              PrivateCacheMap->ReadAheadMask);
+    }
+
+    /* Strided: the whole history moves by the same step, larger than the reads */
+    Stride = 0;
+    Strided = FALSE;
+    if (!Sequential && PrivateCacheMap->ReadHistoryCount >= CC_READ_HISTORY_DEPTH - 1)
+    {
+        Stride = FileOffset->QuadPart - PrivateCacheMap->ReadHistoryOffset[Previous].QuadPart;
+        Strided = (Stride > (LONGLONG)Length || -Stride > (LONGLONG)Length);
+        Slot = Previous;
+        for (i = 0; Strided && i < CC_READ_HISTORY_DEPTH - 2; i++)
         {
-            KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
-            return;
+            Previous = (Slot + CC_READ_HISTORY_DEPTH - 1) % CC_READ_HISTORY_DEPTH;
+            if (PrivateCacheMap->ReadHistoryOffset[Slot].QuadPart -
+                PrivateCacheMap->ReadHistoryOffset[Previous].QuadPart != Stride)
+            {
+                Strided = FALSE;
+            }
+            Slot = Previous;
         }
+    }
 
-        /* FIXME: hackish, but will do the job for now */
-        PrivateCacheMap->ReadAheadOffset[1].QuadPart = NewOffset.QuadPart;
-        PrivateCacheMap->ReadAheadLength[1] = Length;
+    /* And remember this read */
+    Slot = PrivateCacheMap->ReadHistoryIndex;
+    PrivateCacheMap->ReadHistoryOffset[Slot].QuadPart = FileOffset->QuadPart;
+    PrivateCacheMap->ReadHistoryLength[Slot] = Length;
+    PrivateCacheMap->ReadHistoryIndex = (Slot + 1) % CC_READ_HISTORY_DEPTH;
+    if (PrivateCacheMap->ReadHistoryCount < CC_READ_HISTORY_DEPTH)
+    {
+        PrivateCacheMap->ReadHistoryCount++;
     }
-    /* Other cases: try to find some logic in that mess... */
-    else
+    PrivateCacheMap->FileOffset1.QuadPart = PrivateCacheMap->FileOffset2.QuadPart;
+    PrivateCacheMap->BeyondLastByte1.QuadPart = PrivateCacheMap->BeyondLastByte2.QuadPart;
+    PrivateCacheMap->FileOffset2.QuadPart = FileOffset->QuadPart;
+    PrivateCacheMap->BeyondLastByte2.QuadPart = ReadEnd;
+
+    if (Sequential)
     {
-        /* Let's check if we always read the same way (like going down in the file)
-         * and pretend it's enough for now
-         */
-        if (PrivateCacheMap->FileOffset2.QuadPart >= PrivateCacheMap->FileOffset1.QuadPart &&
-            FileOffset->QuadPart >= PrivateCacheMap->FileOffset2.QuadPart)
+        /* Stay a window ahead of the reader, refill once half of it was consumed */
+        if (PrivateCacheMap->ReadAheadEnd.QuadPart - ReadEnd >= PrivateCacheMap->ReadAheadWindow / 2)
         {
-            /* FIXME: hackish, but will do the job for now */
-            PrivateCacheMap->ReadAheadOffset[1].QuadPart = NewOffset.QuadPart;
-            PrivateCacheMap->ReadAheadLength[1] = Length;
+            KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
+            return;
         }
-        else
+
+        NewOffset = max(PrivateCacheMap->ReadAheadEnd.QuadPart, ROUND_DOWN(ReadEnd, PAGE_SIZE));
+        NewEnd = ROUND_UP(ReadEnd + PrivateCacheMap->ReadAheadWindow, PrivateCacheMap->ReadAheadMask + 1);
+
+        /* The longer the stream, the further we go */
+        PrivateCacheMap->ReadAheadWindow = min(PrivateCacheMap->ReadAheadWindow * 2, CC_READ_AHEAD_MAX_WINDOW);
+    }
+    else if (Strided && FileOffset->QuadPart + Stride >= 0)
+    {
+        /* Bring in the next step only, unless we already did */
+        NewOffset = ROUND_DOWN(FileOffset->QuadPart + Stride, PAGE_SIZE);
+        NewEnd = ROUND_UP(FileOffset->QuadPart + Stride + Length, PrivateCacheMap->ReadAheadMask + 1);
+        if (NewOffset >= PrivateCacheMap->ReadAheadStart.QuadPart &&
+            NewEnd <= PrivateCacheMap->ReadAheadEnd.QuadPart)
         {
-            /* FIXME: handle the other cases */
             KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
-            UNIMPLEMENTED_ONCE;
             return;
         }
     }
+    else
+    {
+        /* No pattern: forget about the stream, and start over small */
+        CcRosDiscardReadAhead(PrivateCacheMap);
+        PrivateCacheMap->ReadAheadWindow = CC_READ_AHEAD_MIN_WINDOW;
+        KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
+        return;
+    }
+
+    /* Don't read past the end of the file */
+    NewEnd = min(NewEnd, ROUND_UP(SharedCacheMap->FileSize.QuadPart, PAGE_SIZE));
+    if (NewOffset >= NewEnd)
+    {
+        KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
+        return;
+    }
+
+    /* If we're not extending the previous range, whatever is left of it is lost */
+    if (NewOffset != PrivateCacheMap->ReadAheadEnd.QuadPart)
+    {
+        CcRosDiscardReadAhead(PrivateCacheMap);
+        PrivateCacheMap->ReadAheadStart.QuadPart = NewOffset;
+    }
+    PrivateCacheMap->ReadAheadEnd.QuadPart = NewEnd;
+
+    PrivateCacheMap->ReadAheadOffset[1].QuadPart = NewOffset;
+    PrivateCacheMap->ReadAheadLength[1] = (ULONG)(NewEnd - NewOffset);
 
     /* If read ahead isn't active yet */
     if (!PrivateCacheMap->Flags.ReadAheadActive)
@@ -249,9 +371,13 @@ CcScheduleReadAhead (
         /* Fail path: lock again, and revert read ahead active */
         KeAcquireSpinLock(&PrivateCacheMap->ReadAheadSpinLock, &OldIrql);
         InterlockedAnd((volatile long *)&PrivateCacheMap->UlongFlags, ~PRIVATE_CACHE_MAP_READ_AHEAD_ACTIVE);
+
+        /* Nothing will be read, so don't count it as read ahead */
+        PrivateCacheMap->ReadAheadEnd.QuadPart = max(PrivateCacheMap->ReadAheadStart.QuadPart,
+                                                     PrivateCacheMap->ReadAheadOffset[1].QuadPart);
     }
 
-    /* Done (fail) */
+    /* Done (fail, or the running read ahead will pick up the new range) */
     KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
 }
 
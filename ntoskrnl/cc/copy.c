@@ -43,6 +43,15 @@ ULONG CcFastReadResourceMiss;
 ULONG CcDataPages = 0;
 ULONG CcDataFlushes = 0;
 
+/* Read ahead counters:
+ * - Number of read ahead requests sent down
+ * - Pages read ahead that were read afterwards
+ * - Pages read ahead that never were
+ */
+ULONG CcReadAheadIos = 0;
+ULONG CcReadAheadHitPages = 0;
+ULONG CcReadAheadWastedPages = 0;
+
 /* FUNCTIONS *****************************************************************/
 
 VOID
@@ -136,8 +145,10 @@ CcPerformReadAhead(
     PROS_SHARED_CACHE_MAP SharedCacheMap;
     PROS_VACB Vacb;
     ULONG PartialLength;
-    ULONG Length;
-    PPRIVATE_CACHE_MAP PrivateCacheMap;
+    ULONG Length = 0;
+    PROS_PRIVATE_CACHE_MAP PrivateCacheMap;
+    LARGE_INTEGER ReadAheadOffset;
+    ULONG ReadAheadLength;
     BOOLEAN Locked;
     BOOLEAN Success;
 
@@ -162,8 +173,8 @@ CcPerformReadAhead(
     else
     {
         KeAcquireSpinLockAtDpcLevel(&PrivateCacheMap->ReadAheadSpinLock);
-        CurrentOffset = PrivateCacheMap->ReadAheadOffset[1].QuadPart;
-        Length = PrivateCacheMap->ReadAheadLength[1];
+        ReadAheadOffset.QuadPart = PrivateCacheMap->ReadAheadOffset[1].QuadPart;
+        ReadAheadLength = PrivateCacheMap->ReadAheadLength[1];
         KeReleaseSpinLockFromDpcLevel(&PrivateCacheMap->ReadAheadSpinLock);
     }
     KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
@@ -180,6 +191,10 @@ CcPerformReadAhead(
     /* Remember it's locked */
     Locked = TRUE;
 
+NextRange:
+    CurrentOffset = ReadAheadOffset.QuadPart;
+    Length = ReadAheadLength;
+
     /* Don't read past the end of the file */
     if (CurrentOffset >= SharedCacheMap->FileSize.QuadPart)
     {
@@ -192,7 +207,8 @@ CcPerformReadAhead(
 
     /* Next of the algorithm will lock like CcCopyData with the slight
      * difference that we don't copy data back to an user-backed buffer
-     * We just bring data into Cc
+     * We just bring data into Cc. With a large window, this spans several
+     * VACBs, all of them read from this worker while the reader goes on.
      */
     PartialLength = CurrentOffset % VACB_MAPPING_GRANULARITY;
     if (PartialLength != 0)
@@ -207,6 +223,7 @@ CcPerformReadAhead(
             goto Clear;
         }
 
+        InterlockedIncrement((PLONG)&CcReadAheadIos);
         _SEH2_TRY
         {
             Success = CcRosEnsureVacbResident(Vacb, TRUE, FALSE,
@@ -244,6 +261,7 @@ CcPerformReadAhead(
             goto Clear;
         }
 
+        InterlockedIncrement((PLONG)&CcReadAheadIos);
         _SEH2_TRY
         {
             Success = CcRosEnsureVacbResident(Vacb, TRUE, FALSE, 0, PartialLength);
@@ -273,8 +291,21 @@ Clear:
     PrivateCacheMap = FileObject->PrivateCacheMap;
     if (PrivateCacheMap != NULL)
     {
-        /* Mark read ahead as unactive */
         KeAcquireSpinLockAtDpcLevel(&PrivateCacheMap->ReadAheadSpinLock);
+
+        /* If the reader moved the window while we were busy, go on with it */
+        if (Locked && Length == 0 &&
+            (PrivateCacheMap->ReadAheadOffset[1].QuadPart != ReadAheadOffset.QuadPart ||
+             PrivateCacheMap->ReadAheadLength[1] != ReadAheadLength))
+        {
+            ReadAheadOffset.QuadPart = PrivateCacheMap->ReadAheadOffset[1].QuadPart;
+            ReadAheadLength = PrivateCacheMap->ReadAheadLength[1];
+            KeReleaseSpinLockFromDpcLevel(&PrivateCacheMap->ReadAheadSpinLock);
+            KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
+            goto NextRange;
+        }
+
+        /* Mark read ahead as unactive */
         InterlockedAnd((volatile long *)&PrivateCacheMap->UlongFlags, ~PRIVATE_CACHE_MAP_READ_AHEAD_ACTIVE);
         KeReleaseSpinLockFromDpcLevel(&PrivateCacheMap->ReadAheadSpinLock);
     }
@@ -559,28 +590,14 @@ CcCopyRead (
     IoStatus->Status = STATUS_SUCCESS;
     IoStatus->Information = ReadLength;
 
-#if 0
-    /* If that was a successful sync read operation, let's handle read ahead */
-    if (Length == 0 && Wait)
+    /* If that was a successful read, let read ahead know about it, it'll
+     * figure out whether we're going anywhere predictable
+     */
+    if (ReadLength != 0 && FileObject->PrivateCacheMap != NULL &&
+        !BooleanFlagOn(FileObject->Flags, FO_RANDOM_ACCESS))
     {
-        PPRIVATE_CACHE_MAP PrivateCacheMap = FileObject->PrivateCacheMap;
-
-        /* If file isn't random access and next read may get us cross VACB boundary,
-         * schedule next read
-         */
-        if (!BooleanFlagOn(FileObject->Flags, FO_RANDOM_ACCESS) &&
-            (CurrentOffset - 1) / VACB_MAPPING_GRANULARITY != (CurrentOffset + ReadLength - 1) / VACB_MAPPING_GRANULARITY)
-        {
-            CcScheduleReadAhead(FileObject, FileOffset, ReadLength);
-        }
-
-        /* And update read history in private cache map */
-        PrivateCacheMap->FileOffset1.QuadPart = PrivateCacheMap->FileOffset2.QuadPart;
-        PrivateCacheMap->BeyondLastByte1.QuadPart = PrivateCacheMap->BeyondLastByte2.QuadPart;
-        PrivateCacheMap->FileOffset2.QuadPart = FileOffset->QuadPart;
-        PrivateCacheMap->BeyondLastByte2.QuadPart = FileOffset->QuadPart + ReadLength;
+        CcScheduleReadAhead(FileObject, FileOffset, ReadLength);
     }
-#endif
 
     return TRUE;
 }
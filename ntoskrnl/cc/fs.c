@@ -161,7 +161,7 @@ CcPurgeCacheSection (
     IN BOOLEAN UninitializeCacheMaps)
 {
     PROS_SHARED_CACHE_MAP SharedCacheMap;
-    PPRIVATE_CACHE_MAP PrivateCacheMap;
+    PROS_PRIVATE_CACHE_MAP PrivateCacheMap;
     LONGLONG StartOffset;
     LONGLONG EndOffset;
     LIST_ENTRY FreeList;
@@ -197,7 +197,7 @@ CcPurgeCacheSection (
              * This list is not empty, grab the
              * private cache map.
              */
-            PrivateCacheMap = CONTAINING_RECORD(SharedCacheMap->PrivateList.Flink, PRIVATE_CACHE_MAP, PrivateLinks);
+            PrivateCacheMap = CONTAINING_RECORD(SharedCacheMap->PrivateList.Flink, ROS_PRIVATE_CACHE_MAP, PrivateLinks);
 
             /* Unintialize the private cache now */
             CcUninitializeCacheMap(PrivateCacheMap->FileObject, NULL, NULL);
@@ -261,7 +261,7 @@ CcPurgeCacheSection (
         {
             CcRosUnmarkDirtyVacb(Vacb, FALSE);
         }
-        RemoveEntryList(&Vacb->CacheMapVacbListEntry);
+        CcRosUnlinkVacb(Vacb);
         InsertHeadList(&FreeList, &Vacb->CacheMapVacbListEntry);
     }
     KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
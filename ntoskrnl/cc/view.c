@@ -297,6 +297,7 @@ CcRosDeleteFileCache (
         ObDereferenceObject(SharedCacheMap->Section);
     ObDereferenceObject(SharedCacheMap->FileObject);
 
+    CcRosFreeVacbIndex(SharedCacheMap);
     ExFreeToNPagedLookasideList(&SharedCacheMapLookasideList, SharedCacheMap);
 
     /* Acquire the lock again for our caller */
@@ -537,7 +538,7 @@ retry:
             ASSERT(!current->MappedCount);
             ASSERT(Refs == 1);
 
-            RemoveEntryList(&current->CacheMapVacbListEntry);
+            CcRosUnlinkVacb(current);
             RemoveEntryList(&current->VacbLruListEntry);
             InitializeListHead(&current->VacbLruListEntry);
             InsertHeadList(&FreeList, &current->CacheMapVacbListEntry);
@@ -619,14 +620,141 @@ CcRosReleaseVacb (
     return STATUS_SUCCESS;
 }
 
+/*
+ * The VACBs of a cache map are indexed by view (file offset divided by
+ * VACB_MAPPING_GRANULARITY) in a two level table: VacbIndex points to leaves
+ * of VACB_INDEX_LEAF_SIZE slots, allocated when a view in their range gets
+ * mapped. This keeps lookups constant time, whatever the size of the file,
+ * without paying for the views of a huge file that were never touched.
+ * Must be called with the cache map lock held.
+ */
+static
+PROS_VACB *
+CcRosGetVacbSlot (
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    LONGLONG FileOffset,
+    BOOLEAN Create)
+{
+    ULONGLONG View;
+    ULONG Leaf, NewSize;
+    PROS_VACB **NewIndex;
+
+    View = FileOffset / VACB_MAPPING_GRANULARITY;
+    Leaf = (ULONG)(View >> VACB_INDEX_LEAF_SHIFT);
+
+    if (Leaf >= SharedCacheMap->VacbIndexSize)
+    {
+        if (!Create)
+            return NULL;
+
+        /* Grow the top level, it only holds one pointer per leaf */
+        NewSize = max(Leaf + 1, SharedCacheMap->VacbIndexSize * 2);
+        NewIndex = ExAllocatePoolWithTag(NonPagedPool, NewSize * sizeof(PROS_VACB *), TAG_VACB_INDEX);
+        if (!NewIndex)
+            return NULL;
+
+        RtlZeroMemory(NewIndex, NewSize * sizeof(PROS_VACB *));
+        if (SharedCacheMap->VacbIndex)
+        {
+            RtlCopyMemory(NewIndex, SharedCacheMap->VacbIndex, SharedCacheMap->VacbIndexSize * sizeof(PROS_VACB *));
+            ExFreePoolWithTag(SharedCacheMap->VacbIndex, TAG_VACB_INDEX);
+        }
+        SharedCacheMap->VacbIndex = NewIndex;
+        SharedCacheMap->VacbIndexSize = NewSize;
+    }
+
+    if (SharedCacheMap->VacbIndex[Leaf] == NULL)
+    {
+        if (!Create)
+            return NULL;
+
+        SharedCacheMap->VacbIndex[Leaf] = ExAllocatePoolWithTag(NonPagedPool,
+                                                                VACB_INDEX_LEAF_SIZE * sizeof(PROS_VACB),
+                                                                TAG_VACB_INDEX);
+        if (!SharedCacheMap->VacbIndex[Leaf])
+            return NULL;
+
+        RtlZeroMemory(SharedCacheMap->VacbIndex[Leaf], VACB_INDEX_LEAF_SIZE * sizeof(PROS_VACB));
+    }
+
+    return &SharedCacheMap->VacbIndex[Leaf][View & (VACB_INDEX_LEAF_SIZE - 1)];
+}
+
+/* Closest VACB before the given view, to keep the VACB list sorted.
+ * Reads are mostly sequential, so that's usually the previous slot.
+ */
+static
+PROS_VACB
+CcRosFindPreviousVacb (
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    ULONGLONG View)
+{
+    ULONG Leaf;
+    PROS_VACB Vacb;
+
+    while (View-- > 0)
+    {
+        Leaf = (ULONG)(View >> VACB_INDEX_LEAF_SHIFT);
+        ASSERT(Leaf < SharedCacheMap->VacbIndexSize);
+
+        /* Skip the whole leaf if nothing was ever mapped there */
+        if (SharedCacheMap->VacbIndex[Leaf] == NULL)
+        {
+            View = (ULONGLONG)Leaf << VACB_INDEX_LEAF_SHIFT;
+            continue;
+        }
+
+        Vacb = SharedCacheMap->VacbIndex[Leaf][View & (VACB_INDEX_LEAF_SIZE - 1)];
+        if (Vacb)
+            return Vacb;
+    }
+
+    return NULL;
+}
+
+static
+VOID
+CcRosFreeVacbIndex (
+    PROS_SHARED_CACHE_MAP SharedCacheMap)
+{
+    ULONG Leaf;
+
+    if (!SharedCacheMap->VacbIndex)
+        return;
+
+    for (Leaf = 0; Leaf < SharedCacheMap->VacbIndexSize; Leaf++)
+    {
+        if (SharedCacheMap->VacbIndex[Leaf])
+            ExFreePoolWithTag(SharedCacheMap->VacbIndex[Leaf], TAG_VACB_INDEX);
+    }
+
+    ExFreePoolWithTag(SharedCacheMap->VacbIndex, TAG_VACB_INDEX);
+    SharedCacheMap->VacbIndex = NULL;
+    SharedCacheMap->VacbIndexSize = 0;
+}
+
+/* Takes the VACB out of its cache map. Cache map lock must be held. */
+VOID
+CcRosUnlinkVacb (
+    PROS_VACB Vacb)
+{
+    PROS_VACB *Slot;
+
+    Slot = CcRosGetVacbSlot(Vacb->SharedCacheMap, Vacb->FileOffset.QuadPart, FALSE);
+    ASSERT(Slot != NULL && *Slot == Vacb);
+    *Slot = NULL;
+
+    RemoveEntryList(&Vacb->CacheMapVacbListEntry);
+}
+
 /* Returns with VACB Lock Held! */
 PROS_VACB
 CcRosLookupVacb (
     PROS_SHARED_CACHE_MAP SharedCacheMap,
     LONGLONG FileOffset)
 {
-    PLIST_ENTRY current_entry;
-    PROS_VACB current;
+    PROS_VACB *Slot;
+    PROS_VACB current = NULL;
     KIRQL oldIrql;
 
     ASSERT(SharedCacheMap);
@@ -634,33 +762,24 @@ CcRosLookupVacb (
     DPRINT("CcRosLookupVacb(SharedCacheMap 0x%p, FileOffset %I64u)\n",
            SharedCacheMap, FileOffset);
 
-    oldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
-    KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
+    /* VACBs only leave the index with the cache map lock held, after
+     * checking their reference count, so we don't need the master lock
+     */
+    KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &oldIrql);
 
-    current_entry = SharedCacheMap->CacheMapVacbListHead.Flink;
-    while (current_entry != &SharedCacheMap->CacheMapVacbListHead)
+    Slot = CcRosGetVacbSlot(SharedCacheMap, FileOffset, FALSE);
+    if (Slot && *Slot)
     {
-        current = CONTAINING_RECORD(current_entry,
-                                    ROS_VACB,
-                                    CacheMapVacbListEntry);
-        if (IsPointInRange(current->FileOffset.QuadPart,
-                           VACB_MAPPING_GRANULARITY,
-                           FileOffset))
-        {
-            CcRosVacbIncRefCount(current);
-            KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
-            KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
-            return current;
-        }
-        if (current->FileOffset.QuadPart > FileOffset)
-            break;
-        current_entry = current_entry->Flink;
+        current = *Slot;
+        ASSERT(IsPointInRange(current->FileOffset.QuadPart,
+                              VACB_MAPPING_GRANULARITY,
+                              FileOffset));
+        CcRosVacbIncRefCount(current);
     }
 
-    KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
-    KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
+    KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, oldIrql);
 
-    return NULL;
+    return current;
 }
 
 VOID
@@ -766,7 +885,7 @@ CcRosFreeOneUnusedVacb(
             ASSERT(Refs == 1);
 
             /* Reset it, this is the one we want to free */
-            RemoveEntryList(&current->CacheMapVacbListEntry);
+            CcRosUnlinkVacb(current);
             InitializeListHead(&current->CacheMapVacbListEntry);
             RemoveEntryList(&current->VacbLruListEntry);
             InitializeListHead(&current->VacbLruListEntry);
@@ -802,7 +921,7 @@ CcRosCreateVacb (
 {
     PROS_VACB current;
     PROS_VACB previous;
-    PLIST_ENTRY current_entry;
+    PROS_VACB *Slot;
     NTSTATUS Status;
     KIRQL oldIrql;
     ULONG Refs;
@@ -867,50 +986,46 @@ CcRosCreateVacb (
      * our newly created VACB and return the existing one.
      */
     KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
-    current_entry = SharedCacheMap->CacheMapVacbListHead.Flink;
-    previous = NULL;
-    while (current_entry != &SharedCacheMap->CacheMapVacbListHead)
+    Slot = CcRosGetVacbSlot(SharedCacheMap, FileOffset, TRUE);
+    if (Slot == NULL || *Slot != NULL)
     {
-        current = CONTAINING_RECORD(current_entry,
-                                    ROS_VACB,
-                                    CacheMapVacbListEntry);
-        if (IsPointInRange(current->FileOffset.QuadPart,
-                           VACB_MAPPING_GRANULARITY,
-                           FileOffset))
+        current = Slot ? *Slot : NULL;
+        if (current)
         {
             CcRosVacbIncRefCount(current);
-            KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
+        }
+        KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
 #if DBG
-            if (SharedCacheMap->Trace)
-            {
-                DPRINT1("CacheMap 0x%p: deleting newly created VACB 0x%p ( found existing one 0x%p )\n",
-                        SharedCacheMap,
-                        (*Vacb),
-                        current);
-            }
+        if (SharedCacheMap->Trace && current)
+        {
+            DPRINT1("CacheMap 0x%p: deleting newly created VACB 0x%p ( found existing one 0x%p )\n",
+                    SharedCacheMap,
+                    (*Vacb),
+                    current);
+        }
 #endif
-            KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
+        KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
 
-            Refs = CcRosVacbDecRefCount(*Vacb);
-            ASSERT(Refs == 0);
+        Refs = CcRosVacbDecRefCount(*Vacb);
+        ASSERT(Refs == 0);
 
-            *Vacb = current;
-            return STATUS_SUCCESS;
-        }
-        if (current->FileOffset.QuadPart < FileOffset)
+        /* No existing VACB and no memory to index a new one */
+        if (!current)
         {
-            ASSERT(previous == NULL ||
-                   previous->FileOffset.QuadPart < current->FileOffset.QuadPart);
-            previous = current;
+            *Vacb = NULL;
+            return STATUS_INSUFFICIENT_RESOURCES;
         }
-        if (current->FileOffset.QuadPart > FileOffset)
-            break;
-        current_entry = current_entry->Flink;
+
+        *Vacb = current;
+        return STATUS_SUCCESS;
     }
     /* There was no existing VACB. */
     current = *Vacb;
+    *Slot = current;
+    previous = CcRosFindPreviousVacb(SharedCacheMap, current->FileOffset.QuadPart / VACB_MAPPING_GRANULARITY);
     if (previous)
     {
+        ASSERT(previous->FileOffset.QuadPart < current->FileOffset.QuadPart);
         InsertHeadList(&previous->CacheMapVacbListEntry, &current->CacheMapVacbListEntry);
     }
     else
@@ -1235,7 +1350,7 @@ CcRosReleaseFileCache (
  */
 {
     KIRQL OldIrql;
-    PPRIVATE_CACHE_MAP PrivateMap;
+    PROS_PRIVATE_CACHE_MAP PrivateMap;
     PROS_SHARED_CACHE_MAP SharedCacheMap;
 
     OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
@@ -1259,6 +1374,9 @@ CcRosReleaseFileCache (
             RemoveEntryList(&PrivateMap->PrivateLinks);
             KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
 
+            /* Whatever was read ahead for this handle won't be read anymore */
+            CcRosDiscardReadAhead(PrivateMap);
+
             /* And free it. */
             if (PrivateMap != &SharedCacheMap->PrivateCacheMap)
             {
@@ -1362,12 +1480,12 @@ CcRosInitializeFileCache (
 
     if (FileObject->PrivateCacheMap == NULL)
     {
-        PPRIVATE_CACHE_MAP PrivateMap;
+        PROS_PRIVATE_CACHE_MAP PrivateMap;
 
         /* Allocate the private cache map for this handle */
         if (SharedCacheMap->PrivateCacheMap.NodeTypeCode != 0)
         {
-            PrivateMap = ExAllocatePoolWithTag(NonPagedPool, sizeof(PRIVATE_CACHE_MAP), TAG_PRIVATE_CACHE_MAP);
+            PrivateMap = ExAllocatePoolWithTag(NonPagedPool, sizeof(ROS_PRIVATE_CACHE_MAP), TAG_PRIVATE_CACHE_MAP);
         }
         else
         {
@@ -1391,9 +1509,10 @@ CcRosInitializeFileCache (
         }
 
         /* Initialize it */
-        RtlZeroMemory(PrivateMap, sizeof(PRIVATE_CACHE_MAP));
+        RtlZeroMemory(PrivateMap, sizeof(ROS_PRIVATE_CACHE_MAP));
         PrivateMap->NodeTypeCode = NODE_TYPE_PRIVATE_MAP;
         PrivateMap->ReadAheadMask = PAGE_SIZE - 1;
+        PrivateMap->ReadAheadWindow = CC_READ_AHEAD_MIN_WINDOW;
         PrivateMap->FileObject = FileObject;
         KeInitializeSpinLock(&PrivateMap->ReadAheadSpinLock);
 
@@ -1569,6 +1688,9 @@ ExpKdbgExtFileCache(ULONG Argc, PCHAR Argv[])
         KdbpPrint("%p\t%d\t%d\t%wZ%S\n", SharedCacheMap, Mapped, Dirty, FileName, Extra);
     }
 
+    KdbpPrint("\nRead ahead: %lu I/Os, %lu pages hit, %lu pages wasted\n",
+              CcReadAheadIos, CcReadAheadHitPages, CcReadAheadWastedPages);
+
     return TRUE;
 }
 
@@ -82,7 +82,7 @@ CmpDoFlushAll(IN BOOLEAN ForceFlush)
 {
     PLIST_ENTRY NextEntry;
     PCMHIVE Hive;
-    NTSTATUS Status;
+    BOOLEAN WillShrink;
     BOOLEAN Result = TRUE;
 
     /* Make sure that the registry isn't read-only now */
@@ -112,13 +112,15 @@ CmpDoFlushAll(IN BOOLEAN ForceFlush)
             }
 
             /* Only sync if we are forced to or if it won't cause a hive shrink */
-            if (ForceFlush || !HvHiveWillShrink(&Hive->Hive))
-            {
-                /* Do the sync */
-                Status = HvSyncHive(&Hive->Hive);
+            WillShrink = !ForceFlush && HvHiveWillShrink(&Hive->Hive);
+
+            /* Release the flusher lock, the flush takes it as needed */
+            CmpUnlockHiveFlusher(Hive);
 
-                /* If something failed - set the flag and continue looping */
-                if (!NT_SUCCESS(Status))
+            if (!WillShrink)
+            {
+                /* Do the sync. If something failed - set the flag and continue looping */
+                if (!CmpFlushHive(Hive))
                     Result = FALSE;
             }
             else
@@ -127,9 +129,6 @@ CmpDoFlushAll(IN BOOLEAN ForceFlush)
                 Result = FALSE;
                 CmpForceForceFlush = TRUE;
             }
-
-            /* Release the flusher lock */
-            CmpUnlockHiveFlusher(Hive);
         }
 
         /* Try the next entry */
@@ -1992,15 +1991,15 @@ CmFlushKey(IN PCM_KEY_CONTROL_BLOCK Kcb,
             KeReleaseGuardedMutex(CmHive->ViewLock);
         }
 
+        /* Release the flush lock, the flush takes it as needed */
+        CmpUnlockHiveFlusher(CmHive);
+
         /* Flush only this hive */
-        if (!HvSyncHive(Hive))
+        if (!CmpFlushHive(CmHive))
         {
             /* Fail */
             Status = STATUS_REGISTRY_IO_FAILED;
         }
-
-        /* Release the flush lock */
-        CmpUnlockHiveFlusher(CmHive);
     }
 
     /* Return the status */
@@ -2120,10 +2119,8 @@ CmLoadKey(IN POBJECT_ATTRIBUTES TargetKey,
         /* Sync the hive if necessary */
         if (Allocate)
         {
-            /* Sync it under the flusher lock */
-            CmpLockHiveFlusherExclusive(CmHive);
-            HvSyncHive(&CmHive->Hive);
-            CmpUnlockHiveFlusher(CmHive);
+            /* Sync it, ordered against the lazy flusher */
+            CmpFlushHive(CmHive);
         }
 
         /* Release the hive */
@@ -374,6 +374,20 @@ DATA_SEG("INITDATA") CM_SYSTEM_CONTROL_VECTOR CmControlVector[] =
         NULL,
         NULL
     },
+    {
+        L"Session Manager\\Memory Management",
+        L"PageFileReadCluster",
+        &MmPageFileReadCluster,
+        NULL,
+        NULL
+    },
+    {
+        L"Session Manager\\Memory Management",
+        L"BalancerReservePages",
+        &MmBalancerReservePages,
+        NULL,
+        NULL
+    },
     {
         L"Session Manager\\Memory Management",
         L"PoolTagSmallTableSize",
@@ -26,15 +26,81 @@ ULONG CmpLazyFlushHiveCount = 7;
 ULONG CmpLazyFlushCount = 1;
 LONG CmpFlushStarveWriters;
 
+/* Flush statistics, times are in 100ns units */
+ULONG CmpHiveFlushes;
+ULONGLONG CmpHiveFlushBytes;
+ULONGLONG CmpHiveFlushTime;
+ULONGLONG CmpHiveFlushMaxTime;
+ULONGLONG CmpHiveFlushLockTime;
+
 /* FUNCTIONS ******************************************************************/
 
+BOOLEAN
+NTAPI
+CmpFlushHive(IN PCMHIVE CmHive)
+{
+    HV_FLUSH_SNAPSHOT Snapshot;
+    ULONGLONG StartTime, LockTime, FlushTime, MaxTime;
+    BOOLEAN Success;
+    PAGED_CODE();
+
+    /* Flushes of a hive must hit the disk in the order they were captured */
+    ExAcquirePushLockExclusive(&CmHive->WriterLock);
+    CmHive->WriterLockOwner = KeGetCurrentThread();
+
+    /* Copy the dirty data, writers are only held off for that long */
+    StartTime = KeQueryInterruptTime();
+    CmpLockHiveFlusherExclusive(CmHive);
+    if (!HvCaptureDirtyData(&CmHive->Hive, &Snapshot))
+    {
+        /* No memory for a copy, write it in place under the lock */
+        Success = HvSyncHive(&CmHive->Hive);
+        CmpUnlockHiveFlusher(CmHive);
+        LockTime = KeQueryInterruptTime() - StartTime;
+    }
+    else
+    {
+        CmpUnlockHiveFlusher(CmHive);
+        LockTime = KeQueryInterruptTime() - StartTime;
+
+        /* Write it out while the hive keeps changing */
+        Success = HvWriteDirtyData(&CmHive->Hive, &Snapshot);
+
+        /* Update the hive header, or make the blocks dirty again if we failed */
+        CmpLockHiveFlusherExclusive(CmHive);
+        HvReleaseDirtyData(&CmHive->Hive, &Snapshot, Success);
+        CmpUnlockHiveFlusher(CmHive);
+        InterlockedExchangeAdd64((PLONG64)&CmpHiveFlushBytes, Snapshot.BytesWritten);
+    }
+
+    CmHive->WriterLockOwner = NULL;
+    ExReleasePushLock(&CmHive->WriterLock);
+
+    /* Account for it */
+    FlushTime = KeQueryInterruptTime() - StartTime;
+    InterlockedIncrement((PLONG)&CmpHiveFlushes);
+    InterlockedExchangeAdd64((PLONG64)&CmpHiveFlushTime, FlushTime);
+    InterlockedExchangeAdd64((PLONG64)&CmpHiveFlushLockTime, LockTime);
+    do
+    {
+        MaxTime = CmpHiveFlushMaxTime;
+        if (FlushTime <= MaxTime) break;
+    } while (InterlockedCompareExchange64((PLONG64)&CmpHiveFlushMaxTime,
+                                          FlushTime,
+                                          MaxTime) != (LONG64)MaxTime);
+
+    DPRINT("Flushed %wZ: %s, %I64u us, writers held off %I64u us\n",
+           &CmHive->FileFullPath, Success ? "ok" : "failed",
+           FlushTime / 10, LockTime / 10);
+    return Success;
+}
+
 BOOLEAN
 NTAPI
 CmpDoFlushNextHive(_In_  BOOLEAN ForceFlush,
                    _Out_ PBOOLEAN Error,
                    _Out_ PULONG DirtyCount)
 {
-    NTSTATUS Status;
     PLIST_ENTRY NextEntry;
     PCMHIVE CmHive;
     BOOLEAN Result;
@@ -79,12 +145,11 @@ CmpDoFlushNextHive(_In_  BOOLEAN ForceFlush,
                 /* Do the sync */
                 DPRINT("Flushing: %wZ\n", &CmHive->FileFullPath);
                 DPRINT("Handle: %p\n", CmHive->FileHandles[HFILE_TYPE_PRIMARY]);
-                Status = HvSyncHive(&CmHive->Hive);
-                if (!NT_SUCCESS(Status))
+                if (!CmpFlushHive(CmHive))
                 {
                     /* Let them know we failed */
-                    DPRINT1("Failed to flush %wZ on handle %p (status 0x%08lx)\n",
-                        &CmHive->FileFullPath,  CmHive->FileHandles[HFILE_TYPE_PRIMARY], Status);
+                    DPRINT1("Failed to flush %wZ on handle %p\n",
+                        &CmHive->FileFullPath,  CmHive->FileHandles[HFILE_TYPE_PRIMARY]);
                     *Error = TRUE;
                     Result = FALSE;
                     break;
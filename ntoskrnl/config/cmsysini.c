@@ -1273,7 +1273,7 @@ CmpLoadHiveThread(IN PVOID StartContext)
     HANDLE PrimaryHandle = NULL, AlternateHandle = NULL;
     NTSTATUS Status = STATUS_SUCCESS;
     PVOID ErrorParameters;
-    BOOLEAN HasDiverged;
+    BOOLEAN HasDiverged, Success;
     PAGED_CODE();
 
     /* Get the hive index, make sure it makes sense */
@@ -1415,7 +1415,9 @@ CmpLoadHiveThread(IN PVOID StartContext)
                 DPRINT1("FreeLdr recovered the hive (hive 0x%p)\n", CmHive);
                 RtlSetAllBits(&CmHive->Hive.DirtyVector);
                 CmHive->Hive.DirtyCount = CmHive->Hive.DirtyVector.SizeOfBitMap;
-                HvSyncHive((PHHIVE)CmHive);
+
+                /* The lazy flusher may already be running, so go through its path */
+                CmpFlushHive(CmHive);
             }
             else
             {
@@ -1432,7 +1434,15 @@ CmpLoadHiveThread(IN PVOID StartContext)
                     PrimaryDisposition == FILE_CREATED ||
                     SecondaryDisposition == FILE_CREATED)
                 {
-                    if (!HvWriteAlternateHive((PHHIVE)CmHive))
+                    /* This updates the hive header too, don't race with a flush */
+                    ExAcquirePushLockExclusive(&CmHive->WriterLock);
+                    CmHive->WriterLockOwner = KeGetCurrentThread();
+                    CmpLockHiveFlusherExclusive(CmHive);
+                    Success = HvWriteAlternateHive((PHHIVE)CmHive);
+                    CmpUnlockHiveFlusher(CmHive);
+                    CmHive->WriterLockOwner = NULL;
+                    ExReleasePushLock(&CmHive->WriterLock);
+                    if (!Success)
                     {
                         DPRINT1("Failed to write to alternate hive\n");
                         goto Exit;
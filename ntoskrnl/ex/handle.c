@@ -20,6 +20,19 @@ EX_PUSH_LOCK HandleTableListLock;
 #define SizeOfHandle(x) (sizeof(HANDLE) * (x))
 #define INDEX_TO_HANDLE_VALUE(x) ((x) << HANDLE_TAG_BITS)
 
+/* Freed handles each processor keeps aside, one cache line worth of them */
+#define FREE_HANDLE_CACHE_SLOTS (SYSTEM_CACHE_ALIGNMENT_SIZE / sizeof(ULONG))
+
+/* Handle tables are allocated with room for our private data after them */
+typedef struct _EXP_HANDLE_TABLE
+{
+    HANDLE_TABLE HandleTable;
+    PULONG FreeHandleCache;
+    ULONG FreeHandleCacheProcessors;
+} EXP_HANDLE_TABLE, *PEXP_HANDLE_TABLE;
+
+#define ExpGetPrivateHandleTable(x) CONTAINING_RECORD((x), EXP_HANDLE_TABLE, HandleTable)
+
 /* PRIVATE FUNCTIONS *********************************************************/
 
 #ifdef _WIN64
@@ -201,6 +214,7 @@ VOID
 NTAPI
 ExpFreeHandleTable(IN PHANDLE_TABLE HandleTable)
 {
+    PEXP_HANDLE_TABLE PrivateTable = ExpGetPrivateHandleTable(HandleTable);
     PEPROCESS Process = HandleTable->QuotaProcess;
     ULONG i, j;
     ULONG_PTR TableCode = HandleTable->TableCode;
@@ -265,13 +279,101 @@ ExpFreeHandleTable(IN PHANDLE_TABLE HandleTable)
                               SizeOfHandle(HIGH_LEVEL_ENTRIES));
     }
 
+    /* Free the per-processor free handle caches */
+    if (PrivateTable->FreeHandleCache)
+    {
+        ExpFreeTablePagedPool(Process,
+                              PrivateTable->FreeHandleCache,
+                              PrivateTable->FreeHandleCacheProcessors *
+                              SYSTEM_CACHE_ALIGNMENT_SIZE);
+    }
+
     /* Free the actual table and check if we need to release quota */
-    ExFreePoolWithTag(HandleTable, TAG_OBJECT_TABLE);
+    ExFreePoolWithTag(PrivateTable, TAG_OBJECT_TABLE);
     if (Process)
     {
         /* Release the quota it was taking up */
-        PsReturnProcessPagedPoolQuota(Process, sizeof(HANDLE_TABLE));
+        PsReturnProcessPagedPoolQuota(Process, sizeof(EXP_HANDLE_TABLE));
+    }
+}
+
+FORCEINLINE
+PULONG
+ExpGetFreeHandleCache(IN PHANDLE_TABLE HandleTable,
+                      IN ULONG Processor)
+{
+    PEXP_HANDLE_TABLE PrivateTable = ExpGetPrivateHandleTable(HandleTable);
+
+    /* Each processor owns one cache line of slots */
+    return &PrivateTable->FreeHandleCache[(Processor %
+                                           PrivateTable->FreeHandleCacheProcessors) *
+                                          FREE_HANDLE_CACHE_SLOTS];
+}
+
+static
+BOOLEAN
+ExpFreeHandleToCache(IN PHANDLE_TABLE HandleTable,
+                     IN EXHANDLE Handle)
+{
+    PULONG Cache;
+    ULONG i;
+
+    /* Strict FIFO tables must hand out handles in order */
+    if (!(ExpGetPrivateHandleTable(HandleTable)->FreeHandleCache) ||
+        (HandleTable->StrictFIFO))
+    {
+        return FALSE;
+    }
+
+    /* Park the handle in an empty slot of this processor's cache */
+    Cache = ExpGetFreeHandleCache(HandleTable, KeGetCurrentProcessorNumber());
+    for (i = 0; i < FREE_HANDLE_CACHE_SLOTS; i++)
+    {
+        if (!(Cache[i]) &&
+            !(InterlockedCompareExchange((PLONG)&Cache[i], Handle.AsULONG, 0)))
+        {
+            return TRUE;
+        }
+    }
+
+    /* The cache is full, use the shared free list */
+    return FALSE;
+}
+
+static
+BOOLEAN
+ExpAllocateHandleFromCache(IN PHANDLE_TABLE HandleTable,
+                           IN BOOLEAN AnyProcessor,
+                           OUT PEXHANDLE NewHandle)
+{
+    PEXP_HANDLE_TABLE PrivateTable = ExpGetPrivateHandleTable(HandleTable);
+    PULONG Cache;
+    ULONG Processor, Count, i, Value;
+
+    /* Check if this table has caches at all */
+    if (!PrivateTable->FreeHandleCache) return FALSE;
+
+    /* Start with our own processor, and look at the others only if asked to */
+    Processor = KeGetCurrentProcessorNumber();
+    Count = AnyProcessor ? PrivateTable->FreeHandleCacheProcessors : 1;
+    while (Count--)
+    {
+        Cache = ExpGetFreeHandleCache(HandleTable, Processor++);
+        for (i = 0; i < FREE_HANDLE_CACHE_SLOTS; i++)
+        {
+            /* Slots are claimed whole, so there's no ABA to worry about */
+            if (!Cache[i]) continue;
+            Value = InterlockedExchange((PLONG)&Cache[i], 0);
+            if (Value)
+            {
+                NewHandle->Value = Value;
+                return TRUE;
+            }
+        }
     }
+
+    /* Nothing cached */
+    return FALSE;
 }
 
 VOID
@@ -294,6 +396,14 @@ ExpFreeHandleTableEntry(IN PHANDLE_TABLE HandleTable,
     /* Mark the handle as free */
     Handle.TagBits = 0;
 
+    /*
+     * Try to keep it for the next allocation on this processor. Clear the
+     * entry first, once the handle is in the cache another thread can take
+     * it and fill the entry in.
+     */
+    HandleTableEntry->NextFreeTableEntry = 0;
+    if (ExpFreeHandleToCache(HandleTable, Handle)) return;
+
     /* Check if we're FIFO */
     if (!HandleTable->StrictFIFO)
     {
@@ -331,6 +441,7 @@ NTAPI
 ExpAllocateHandleTable(IN PEPROCESS Process OPTIONAL,
                        IN BOOLEAN NewTable)
 {
+    PEXP_HANDLE_TABLE PrivateTable;
     PHANDLE_TABLE HandleTable;
     PHANDLE_TABLE_ENTRY HandleTableTable, HandleEntry;
     ULONG i;
@@ -338,37 +449,38 @@ ExpAllocateHandleTable(IN PEPROCESS Process OPTIONAL,
     PAGED_CODE();
 
     /* Allocate the table */
-    HandleTable = ExAllocatePoolWithTag(PagedPool,
-                                        sizeof(HANDLE_TABLE),
-                                        TAG_OBJECT_TABLE);
-    if (!HandleTable) return NULL;
+    PrivateTable = ExAllocatePoolWithTag(PagedPool,
+                                         sizeof(EXP_HANDLE_TABLE),
+                                         TAG_OBJECT_TABLE);
+    if (!PrivateTable) return NULL;
 
     /* Check if we have a process */
     if (Process)
     {
         /* Charge quota */
-        Status = PsChargeProcessPagedPoolQuota(Process, sizeof(HANDLE_TABLE));
+        Status = PsChargeProcessPagedPoolQuota(Process, sizeof(EXP_HANDLE_TABLE));
         if (!NT_SUCCESS(Status))
         {
-            ExFreePoolWithTag(HandleTable, TAG_OBJECT_TABLE);
+            ExFreePoolWithTag(PrivateTable, TAG_OBJECT_TABLE);
             return NULL;
         }
     }
 
     /* Clear the table */
-    RtlZeroMemory(HandleTable, sizeof(HANDLE_TABLE));
+    RtlZeroMemory(PrivateTable, sizeof(EXP_HANDLE_TABLE));
+    HandleTable = &PrivateTable->HandleTable;
 
     /* Now allocate the first level structures */
     HandleTableTable = ExpAllocateTablePagedPoolNoZero(Process, PAGE_SIZE);
     if (!HandleTableTable)
     {
         /* Failed, free the table */
-        ExFreePoolWithTag(HandleTable, TAG_OBJECT_TABLE);
+        ExFreePoolWithTag(PrivateTable, TAG_OBJECT_TABLE);
 
         /* Return the quota it was taking up */
         if (Process)
         {
-            PsReturnProcessPagedPoolQuota(Process, sizeof(HANDLE_TABLE));
+            PsReturnProcessPagedPoolQuota(Process, sizeof(EXP_HANDLE_TABLE));
         }
 
         return NULL;
@@ -420,8 +532,24 @@ ExpAllocateHandleTable(IN PEPROCESS Process OPTIONAL,
         ExInitializePushLock(&HandleTable->HandleTableLock[i]);
     }
 
-    /* Initialize the contention event lock and return the lock */
+    /* Initialize the contention event lock */
     ExInitializePushLock(&HandleTable->HandleContentionEvent);
+
+    /* On MP, give each processor a cache of free handles to work from */
+    if (KeNumberProcessors > 1)
+    {
+        /* Failing this isn't fatal, the table just uses the shared list */
+        PrivateTable->FreeHandleCache =
+            ExpAllocateTablePagedPool(Process,
+                                      KeNumberProcessors *
+                                      SYSTEM_CACHE_ALIGNMENT_SIZE);
+        if (PrivateTable->FreeHandleCache)
+        {
+            PrivateTable->FreeHandleCacheProcessors = KeNumberProcessors;
+        }
+    }
+
+    /* Return the table */
     return HandleTable;
 }
 
@@ -689,6 +817,26 @@ ExpAllocateHandleTableEntry(IN PHANDLE_TABLE HandleTable,
     BOOLEAN Result;
     ULONG i;
 
+    /*
+     * Try this processor's cache of recently freed handles first. Once the
+     * shared list runs dry, take from any other processor's cache before
+     * growing the table.
+     */
+    if (ExpAllocateHandleFromCache(HandleTable,
+                                   !(HandleTable->FirstFree) &&
+                                   !(HandleTable->LastFree),
+                                   &Handle))
+    {
+        /* Lookup the entry, it's ours alone */
+        Entry = ExpLookupHandleTableEntry(HandleTable, Handle);
+        ASSERT(Entry->Object == NULL);
+
+        /* Increase the number of handles and return it */
+        InterlockedIncrement(&HandleTable->HandleCount);
+        *NewHandle = Handle;
+        return Entry;
+    }
+
     /* Start allocation loop */
     for (;;)
     {
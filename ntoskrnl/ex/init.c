@@ -662,6 +662,10 @@ BOOLEAN
 NTAPI
 ExpInitSystemPhase1(VOID)
 {
+    /* Now that all processors are up, give each its own pool caches */
+    ExpInitializeProcessorPoolLookasideLists();
+    ExpInitializeProcessorPoolTrackers();
+
     /* Initialize worker threads */
     ExpInitializeWorkerThreads();
 
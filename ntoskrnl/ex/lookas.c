@@ -23,6 +23,12 @@ LIST_ENTRY ExPoolLookasideListHead;
 GENERAL_LOOKASIDE ExpSmallNPagedPoolLookasideLists[NUMBER_POOL_LOOKASIDE_LISTS];
 GENERAL_LOOKASIDE ExpSmallPagedPoolLookasideLists[NUMBER_POOL_LOOKASIDE_LISTS];
 
+/* Depth tuning, see ExAdjustLookasideDepth */
+#define MINIMUM_LOOKASIDE_DEPTH         4
+#define MINIMUM_ALLOCATION_THRESHOLD    25
+#define MAXIMUM_DEPTH_INCREMENT         30
+#define MINIMUM_MISS_RATE               5 /* per thousand allocations */
+
 /* PRIVATE FUNCTIONS *********************************************************/
 
 CODE_SEG("INIT")
@@ -39,7 +45,7 @@ ExInitializeSystemLookasideList(IN PGENERAL_LOOKASIDE List,
     List->Tag = Tag;
     List->Type = Type;
     List->Size = Size;
-    InsertHeadList(ListHead, &List->ListEntry);
+    ExInterlockedInsertHeadList(ListHead, &List->ListEntry, &ExpNonPagedLookasideListLock);
     List->MaximumDepth = MaximumDepth;
     List->Depth = 2;
     List->Allocate = ExAllocatePoolWithTag;
@@ -83,6 +89,61 @@ ExInitPoolLookasidePointers(VOID)
     }
 }
 
+CODE_SEG("INIT")
+VOID
+NTAPI
+ExpInitializeProcessorPoolLookasideLists(VOID)
+{
+    CCHAR Cpu;
+    ULONG i;
+    PKPRCB Prcb;
+    PGENERAL_LOOKASIDE Lists;
+
+    /* Now allocate the per-processor lists, the shared ones stay the L lists */
+    for (Cpu = 0; Cpu < KeNumberProcessors; Cpu++)
+    {
+        /* Get the PRCB for this CPU */
+        Prcb = KiProcessorBlock[(int)Cpu];
+
+        /* One block holds both the non-paged and paged lists */
+        Lists = ExAllocatePoolWithTag(NonPagedPool,
+                                      2 * NUMBER_POOL_LOOKASIDE_LISTS *
+                                      sizeof(GENERAL_LOOKASIDE),
+                                      'looP');
+        if (!Lists)
+        {
+            /* Keep using the shared lists */
+            continue;
+        }
+
+        for (i = 0; i < NUMBER_POOL_LOOKASIDE_LISTS; i++)
+        {
+            /* Initialize the non-paged list */
+            ExInitializeSystemLookasideList(&Lists[i],
+                                            NonPagedPool,
+                                            (i + 1) * 8,
+                                            'looP',
+                                            256,
+                                            &ExPoolLookasideListHead);
+
+            /* Initialize the paged list */
+            ExInitializeSystemLookasideList(&Lists[NUMBER_POOL_LOOKASIDE_LISTS + i],
+                                            PagedPool,
+                                            (i + 1) * 8,
+                                            'looP',
+                                            256,
+                                            &ExPoolLookasideListHead);
+        }
+
+        /* Link them */
+        for (i = 0; i < NUMBER_POOL_LOOKASIDE_LISTS; i++)
+        {
+            Prcb->PPNPagedLookasideList[i].P = &Lists[i];
+            Prcb->PPPagedLookasideList[i].P = &Lists[NUMBER_POOL_LOOKASIDE_LISTS + i];
+        }
+    }
+}
+
 CODE_SEG("INIT")
 VOID
 NTAPI
@@ -119,6 +180,116 @@ ExpInitLookasideLists(VOID)
     }
 }
 
+static
+VOID
+ExpComputeLookasideDepth(IN PGENERAL_LOOKASIDE Lookaside,
+                         IN ULONG Allocates,
+                         IN ULONG Misses)
+{
+    ULONG Depth, MaximumDepth, MissRate, Increment;
+
+    Depth = Lookaside->Depth;
+    MaximumDepth = max(Lookaside->MaximumDepth, MINIMUM_LOOKASIDE_DEPTH);
+
+    /* Check if the list was barely used since the last scan */
+    if (Allocates < MINIMUM_ALLOCATION_THRESHOLD)
+    {
+        /* Shrink it quickly, the cached blocks are just wasted pool */
+        Depth = (Depth > MINIMUM_LOOKASIDE_DEPTH + 10) ?
+                Depth - 10 : MINIMUM_LOOKASIDE_DEPTH;
+    }
+    else
+    {
+        /* Get the miss rate in thousandths */
+        MissRate = (ULONG)(((ULONGLONG)min(Misses, Allocates) * 1000) / Allocates);
+        if (MissRate < MINIMUM_MISS_RATE)
+        {
+            /* The list is deep enough, slowly give back what isn't needed */
+            if (Depth > MINIMUM_LOOKASIDE_DEPTH) Depth--;
+        }
+        else if (Depth < MaximumDepth)
+        {
+            /* Grow in proportion to the misses and the room left */
+            Increment = ((MissRate * (MaximumDepth - Depth)) / (1000 * 2)) + 5;
+            Depth += min(Increment, MAXIMUM_DEPTH_INCREMENT);
+        }
+    }
+
+    /* Set the new depth */
+    Lookaside->Depth = (USHORT)min(max(Depth, MINIMUM_LOOKASIDE_DEPTH), MaximumDepth);
+}
+
+static
+VOID
+ExpScanGeneralLookasideList(IN PLIST_ENTRY ListHead,
+                            IN PKSPIN_LOCK Lock,
+                            IN BOOLEAN ListUsesMisses)
+{
+    PLIST_ENTRY ListEntry;
+    PGENERAL_LOOKASIDE Lookaside;
+    ULONG TotalAllocates, Allocates, Misses;
+    KIRQL OldIrql;
+
+    /* Lock the list, lists can be added or removed while we scan it */
+    KeAcquireSpinLock(Lock, &OldIrql);
+
+    /* Loop all the lookaside lists */
+    for (ListEntry = ListHead->Flink;
+         ListEntry != ListHead;
+         ListEntry = ListEntry->Flink)
+    {
+        Lookaside = CONTAINING_RECORD(ListEntry, GENERAL_LOOKASIDE, ListEntry);
+
+        /* Get the activity since the last scan, counters are updated racily */
+        TotalAllocates = Lookaside->TotalAllocates;
+        Allocates = TotalAllocates - Lookaside->LastTotalAllocates;
+        if (ListUsesMisses)
+        {
+            Misses = Lookaside->AllocateMisses - Lookaside->LastAllocateMisses;
+            Lookaside->LastAllocateMisses = Lookaside->AllocateMisses;
+        }
+        else
+        {
+            /* Pool lookaside lists count hits instead */
+            Misses = Allocates - (Lookaside->AllocateHits - Lookaside->LastAllocateHits);
+            Lookaside->LastAllocateHits = Lookaside->AllocateHits;
+        }
+        Lookaside->LastTotalAllocates = TotalAllocates;
+
+        /* Adapt the depth */
+        ExpComputeLookasideDepth(Lookaside, Allocates, Misses);
+    }
+
+    /* Release the lock */
+    KeReleaseSpinLock(Lock, OldIrql);
+}
+
+/*
+ * Called once per second by the balance set manager to resize every lookaside
+ * list, including the per-processor ones, from its miss rate since the last
+ * call.
+ */
+VOID
+NTAPI
+ExAdjustLookasideDepth(VOID)
+{
+    /* The pool and system lists are linked in under the non-paged list lock */
+    ExpScanGeneralLookasideList(&ExPoolLookasideListHead,
+                                &ExpNonPagedLookasideListLock,
+                                FALSE);
+    ExpScanGeneralLookasideList(&ExSystemLookasideListHead,
+                                &ExpNonPagedLookasideListLock,
+                                TRUE);
+
+    /* Driver lists come and go */
+    ExpScanGeneralLookasideList(&ExpNonPagedLookasideListHead,
+                                &ExpNonPagedLookasideListLock,
+                                TRUE);
+    ExpScanGeneralLookasideList(&ExpPagedLookasideListHead,
+                                &ExpPagedLookasideListLock,
+                                TRUE);
+}
+
 /* PUBLIC FUNCTIONS **********************************************************/
 
 /*
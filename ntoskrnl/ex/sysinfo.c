@@ -707,11 +707,13 @@ QSI_DEF(SystemPerformanceInformation)
     Spi->IoReadOperationCount = IoReadOperationCount;
     Spi->IoWriteOperationCount = IoWriteOperationCount;
     Spi->IoOtherOperationCount = IoOtherOperationCount;
+    Spi->DemandZeroCount = 0;
     for (i = 0; i < KeNumberProcessors; i ++)
     {
         Prcb = KiProcessorBlock[i];
         if (Prcb)
         {
+            Spi->DemandZeroCount += Prcb->MmDemandZeroCount;
             Spi->IoReadTransferCount.QuadPart += Prcb->IoReadTransferCount.QuadPart;
             Spi->IoWriteTransferCount.QuadPart += Prcb->IoWriteTransferCount.QuadPart;
             Spi->IoOtherTransferCount.QuadPart += Prcb->IoOtherTransferCount.QuadPart;
@@ -736,13 +738,12 @@ QSI_DEF(SystemPerformanceInformation)
     Spi->CopyOnWriteCount = 0; /* FIXME */
     Spi->TransitionCount = 0; /* FIXME */
     Spi->CacheTransitionCount = 0; /* FIXME */
-    Spi->DemandZeroCount = 0; /* FIXME */
-    Spi->PageReadCount = 0; /* FIXME */
-    Spi->PageReadIoCount = 0; /* FIXME */
+    Spi->PageReadCount = MiPageFileReadPageCount;
+    Spi->PageReadIoCount = MiPageFileReadIoCount;
     Spi->CacheReadCount = 0; /* FIXME */
     Spi->CacheIoCount = 0; /* FIXME */
-    Spi->DirtyPagesWriteCount = 0; /* FIXME */
-    Spi->DirtyWriteIoCount = 0; /* FIXME */
+    Spi->DirtyPagesWriteCount = MiPageFileWritePageCount;
+    Spi->DirtyWriteIoCount = MiPageFileWriteIoCount;
     Spi->MappedPagesWriteCount = 0; /* FIXME */
     Spi->MappedWriteIoCount = 0; /* FIXME */
 
@@ -802,7 +803,7 @@ QSI_DEF(SystemPerformanceInformation)
     Spi->CcMdlReadWait = 0; /* FIXME */
     Spi->CcMdlReadNoWaitMiss = 0; /* FIXME */
     Spi->CcMdlReadWaitMiss = 0; /* FIXME */
-    Spi->CcReadAheadIos = 0; /* FIXME */
+    Spi->CcReadAheadIos = CcReadAheadIos;
     Spi->CcLazyWriteIos = CcLazyWriteIos;
     Spi->CcLazyWritePages = CcLazyWritePages;
     Spi->CcDataFlushes = CcDataFlushes;
@@ -2824,6 +2825,38 @@ QSI_DEF(SystemFirmwareTableInformation)
     return Status;
 }
 
+/* Class 80 - Memory list information */
+QSI_DEF(SystemMemoryListInformation)
+{
+    PSYSTEM_MEMORY_LIST_INFORMATION Smli = (PSYSTEM_MEMORY_LIST_INFORMATION)Buffer;
+
+    *ReqSize = sizeof(SYSTEM_MEMORY_LIST_INFORMATION);
+
+    /* Check user buffer's size */
+    if (Size < sizeof(SYSTEM_MEMORY_LIST_INFORMATION))
+    {
+        return STATUS_INFO_LENGTH_MISMATCH;
+    }
+
+    /* Snapshot the PFN lists, without locking: these are only statistics */
+    RtlZeroMemory(Smli, sizeof(SYSTEM_MEMORY_LIST_INFORMATION));
+    Smli->ZeroPageCount = MmZeroedPageListHead.Total + MiGetCachedPageCount();
+    Smli->FreePageCount = MmFreePageListHead.Total;
+    Smli->ModifiedPageCount = MmModifiedPageListHead.Total;
+    Smli->ModifiedNoWritePageCount = MmModifiedNoWritePageListHead.Total;
+    /* FIXME: Standby pages are not tracked by priority yet */
+    Smli->PageCountByPriority[0] = MmStandbyPageListHead.Total;
+
+    /* Callers who know about it also get what the zeroing threads have done */
+    if (Size >= sizeof(SYSTEM_MEMORY_LIST_INFORMATION_EX))
+    {
+        *ReqSize = sizeof(SYSTEM_MEMORY_LIST_INFORMATION_EX);
+        ((PSYSTEM_MEMORY_LIST_INFORMATION_EX)Smli)->BackgroundZeroedPageCount = MiZeroedPageCount;
+    }
+
+    return STATUS_SUCCESS;
+}
+
 /* Query/Set Calls Table */
 typedef
 struct _QSSI_CALLS
@@ -2923,6 +2956,10 @@ CallQS[] =
     SI_XX(SystemWow64SharedInformationObsolete), /* FIXME: not implemented */
     SI_XX(SystemRegisterFirmwareTableInformationHandler), /* FIXME: not implemented */
     SI_QX(SystemFirmwareTableInformation),
+    SI_XX(SystemModuleInformationEx), /* FIXME: not implemented */
+    SI_XX(SystemVerifierTriageInformation), /* FIXME: not implemented */
+    SI_XX(SystemSuperfetchInformation), /* FIXME: not implemented */
+    SI_QX(SystemMemoryListInformation),
 };
 
 C_ASSERT(SystemBasicInformation == 0);
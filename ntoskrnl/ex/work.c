@@ -22,6 +22,10 @@
 /* Magic flag for dynamic worker threads */
 #define EX_DYNAMIC_WORK_THREAD                      0x80000000
 
+/* The worker thread context also holds the processor of its queue */
+#define EX_WORK_THREAD_TYPE_MASK                    0xFF
+#define EX_WORK_THREAD_PROCESSOR_SHIFT              8
+
 /* Worker thread priority increments (added to base priority) */
 #define EX_HYPERCRITICAL_QUEUE_PRIORITY_INCREMENT   7
 #define EX_CRITICAL_QUEUE_PRIORITY_INCREMENT        5
@@ -30,6 +34,15 @@
 /* The actual worker queue array */
 EX_WORK_QUEUE ExWorkerQueue[MaximumWorkQueue];
 
+/*
+ * The critical and delayed queues are per processor, so that work items run
+ * on the processor which queued them. Processor 0 uses ExWorkerQueue, and so
+ * does every processor for the hypercritical queue.
+ */
+PEX_WORK_QUEUE ExpWorkQueues[MaximumWorkQueue][MAXIMUM_PROCESSORS];
+EXP_WORK_QUEUE_COUNTERS ExpWorkQueueCounters[MaximumWorkQueue][MAXIMUM_PROCESSORS];
+ULONG ExpWorkQueueProcessors;
+
 /* Accounting of the total threads and registry hacked threads */
 ULONG ExCriticalWorkerThreads;
 ULONG ExDelayedWorkerThreads;
@@ -51,6 +64,163 @@ PETHREAD ExpLastWorkerThread;
 
 /* PRIVATE FUNCTIONS *********************************************************/
 
+/*++
+ * @name ExpDequeueWorkItem
+ *
+ *     The ExpDequeueWorkItem routine accounts for a work item removed from
+ *     the queue of a processor.
+ *
+ * @param WorkQueueType
+ *        Type of the queue the work item was removed from.
+ *
+ * @param Processor
+ *        Processor of the queue the work item was removed from.
+ *
+ * @return None.
+ *
+ * @remarks The time the item spent queued is the difference between the sum
+ *          of the dequeue times and the sum of the queue times, which is why
+ *          only the sums are kept.
+ *
+ *--*/
+FORCEINLINE
+VOID
+ExpDequeueWorkItem(IN WORK_QUEUE_TYPE WorkQueueType,
+                   IN ULONG Processor)
+{
+    InterlockedIncrement((PLONG)&ExpWorkQueues[WorkQueueType][Processor]->WorkItemsProcessed);
+    InterlockedExchangeAdd64((PLONG64)&ExpWorkQueueCounters[WorkQueueType][Processor].DequeueTimeSum,
+                             KeQueryInterruptTime());
+}
+
+/*++
+ * @name ExpIsWorkQueueIdle
+ *
+ *     The ExpIsWorkQueueIdle routine checks if a work queue has a worker
+ *     thread waiting and allowed to run a new item right away.
+ *
+ * @param Queue
+ *        The work queue to check.
+ *
+ * @return TRUE if an item inserted now would be picked up immediately.
+ *
+ * @remarks The check is done without the dispatcher lock, so it is only
+ *          a hint.
+ *
+ *--*/
+FORCEINLINE
+BOOLEAN
+ExpIsWorkQueueIdle(IN PEX_WORK_QUEUE Queue)
+{
+    return (Queue->WorkerQueue.CurrentCount < Queue->WorkerQueue.MaximumCount) &&
+           !IsListEmpty(&Queue->WorkerQueue.Header.WaitListHead);
+}
+
+/*++
+ * @name ExpSelectWorkQueue
+ *
+ *     The ExpSelectWorkQueue routine chooses the processor queue a new work
+ *     item goes to.
+ *
+ * @param WorkQueueType
+ *        Type of the queue the item is for.
+ *
+ * @return The processor whose queue should receive the item.
+ *
+ * @remarks The current processor's queue is preferred, so the item runs
+ *          with warm caches. If all its workers are busy, the item is handed
+ *          to a processor with an idle worker instead, and counted as stolen
+ *          by it.
+ *
+ *--*/
+static
+ULONG
+ExpSelectWorkQueue(IN WORK_QUEUE_TYPE WorkQueueType)
+{
+    ULONG Processor, Target, i;
+
+    /* The hypercritical queue is shared */
+    if (!ExpWorkQueues[WorkQueueType][1]) return 0;
+
+    /* Use ours if it has someone waiting for work */
+    Processor = KeGetCurrentProcessorNumber();
+    if (Processor >= ExpWorkQueueProcessors) return 0;
+    if (ExpIsWorkQueueIdle(ExpWorkQueues[WorkQueueType][Processor])) return Processor;
+
+    /* Otherwise find another processor which has */
+    for (i = 1; i < ExpWorkQueueProcessors; i++)
+    {
+        Target = (Processor + i) % ExpWorkQueueProcessors;
+        if (ExpIsWorkQueueIdle(ExpWorkQueues[WorkQueueType][Target]))
+        {
+            InterlockedIncrement(&ExpWorkQueueCounters[WorkQueueType][Target].WorkItemsStolen);
+            return Target;
+        }
+    }
+
+    /* Everybody is busy, queue it locally */
+    return Processor;
+}
+
+/*++
+ * @name ExpStealWorkItem
+ *
+ *     The ExpStealWorkItem routine takes a queued work item from the queue
+ *     of another processor.
+ *
+ * @param WorkQueueType
+ *        Type of the queues to look at.
+ *
+ * @param Processor
+ *        Processor of the calling worker thread, which has no work.
+ *
+ * @param WaitMode
+ *        Wait mode of the calling worker thread.
+ *
+ * @param SourceProcessor
+ *        Receives the processor of the queue the work item came from.
+ *
+ * @return The queue entry of the work item, or NULL if no other queue had
+ *         a backlog.
+ *
+ * @remarks Only items that are actually waiting, because all workers of
+ *          their queue are busy, are taken.
+ *
+ *--*/
+static
+PLIST_ENTRY
+ExpStealWorkItem(IN WORK_QUEUE_TYPE WorkQueueType,
+                 IN ULONG Processor,
+                 IN KPROCESSOR_MODE WaitMode,
+                 OUT PULONG SourceProcessor)
+{
+    PEX_WORK_QUEUE Queue;
+    PLIST_ENTRY QueueEntry;
+    LARGE_INTEGER NoWait;
+    ULONG Victim, i;
+
+    NoWait.QuadPart = 0;
+    for (i = 1; i < ExpWorkQueueProcessors; i++)
+    {
+        /* Peek at the backlog without the dispatcher lock */
+        Victim = (Processor + i) % ExpWorkQueueProcessors;
+        Queue = ExpWorkQueues[WorkQueueType][Victim];
+        if (IsListEmpty(&Queue->WorkerQueue.EntryListHead)) continue;
+
+        /* Try to take an item, somebody may have been faster */
+        QueueEntry = KeRemoveQueue(&Queue->WorkerQueue, WaitMode, &NoWait);
+        if ((NTSTATUS)(ULONG_PTR)QueueEntry == STATUS_TIMEOUT) continue;
+        if ((NTSTATUS)(ULONG_PTR)QueueEntry == STATUS_USER_APC) return NULL;
+
+        /* Got one */
+        InterlockedIncrement(&ExpWorkQueueCounters[WorkQueueType][Processor].WorkItemsStolen);
+        *SourceProcessor = Victim;
+        return QueueEntry;
+    }
+
+    return NULL;
+}
+
 /*++
  * @name ExpWorkerThreadEntryPoint
  *
@@ -81,7 +251,8 @@ ExpWorkerThreadEntryPoint(IN PVOID Context)
     PLIST_ENTRY QueueEntry;
     WORK_QUEUE_TYPE WorkQueueType;
     PEX_WORK_QUEUE WorkQueue;
-    LARGE_INTEGER Timeout;
+    ULONG Processor, SourceProcessor;
+    LARGE_INTEGER Timeout, NoWait;
     PLARGE_INTEGER TimeoutPointer = NULL;
     PETHREAD Thread = PsGetCurrentThread();
     KPROCESSOR_MODE WaitMode;
@@ -95,10 +266,13 @@ ExpWorkerThreadEntryPoint(IN PVOID Context)
         TimeoutPointer = &Timeout;
     }
 
-    /* Get Queue Type and Worker Queue */
+    /* Get Queue Type, Processor and Worker Queue */
     WorkQueueType = (WORK_QUEUE_TYPE)((ULONG_PTR)Context &
-                                      ~EX_DYNAMIC_WORK_THREAD);
-    WorkQueue = &ExWorkerQueue[WorkQueueType];
+                                      EX_WORK_THREAD_TYPE_MASK);
+    Processor = (ULONG)(((ULONG_PTR)Context & ~EX_DYNAMIC_WORK_THREAD) >>
+                        EX_WORK_THREAD_PROCESSOR_SHIFT);
+    WorkQueue = ExpWorkQueues[WorkQueueType][Processor];
+    NoWait.QuadPart = 0;
 
     /* Select the wait mode */
     WaitMode = (UCHAR)WorkQueue->Info.WaitMode;
@@ -137,20 +311,53 @@ ExpWorkerThreadEntryPoint(IN PVOID Context)
 ProcessLoop:
     for (;;)
     {
-        /* Wait for something to happen on the queue */
-        QueueEntry = KeRemoveQueue(&WorkQueue->WorkerQueue,
-                                   WaitMode,
-                                   TimeoutPointer);
+        /* Our own queue comes first */
+        QueueEntry = NULL;
+        SourceProcessor = Processor;
+        if (ExpWorkQueues[WorkQueueType][1])
+        {
+            /* Without waiting, since other processors may have a backlog */
+            QueueEntry = KeRemoveQueue(&WorkQueue->WorkerQueue,
+                                       WaitMode,
+                                       &NoWait);
+            if ((NTSTATUS)(ULONG_PTR)QueueEntry == STATUS_TIMEOUT)
+            {
+                /* Nothing here, help a busier processor */
+                QueueEntry = ExpStealWorkItem(WorkQueueType,
+                                              Processor,
+                                              WaitMode,
+                                              &SourceProcessor);
+            }
+        }
 
-        /* Check if we timed out and quit this loop in that case */
-        if ((NTSTATUS)(ULONG_PTR)QueueEntry == STATUS_TIMEOUT) break;
+        if (!QueueEntry)
+        {
+            /* Wait for something to happen on the queue */
+            QueueEntry = KeRemoveQueue(&WorkQueue->WorkerQueue,
+                                       WaitMode,
+                                       TimeoutPointer);
 
-        /* Increment Processed Work Items */
-        InterlockedIncrement((PLONG)&WorkQueue->WorkItemsProcessed);
+            /* Check if we timed out and quit this loop in that case */
+            if ((NTSTATUS)(ULONG_PTR)QueueEntry == STATUS_TIMEOUT) break;
+        }
 
         /* Get the Work Item */
         WorkItem = CONTAINING_RECORD(QueueEntry, WORK_QUEUE_ITEM, List);
 
+        /*
+         * KeTerminateThread queues the reaper directly, without going through
+         * ExQueueWorkItem. We can't know when, so count it as queued just now.
+         */
+        if (WorkItem == &PspReaperWorkItem)
+        {
+            InterlockedIncrement(&ExpWorkQueueCounters[WorkQueueType][SourceProcessor].WorkItemsQueued);
+            InterlockedExchangeAdd64((PLONG64)&ExpWorkQueueCounters[WorkQueueType][SourceProcessor].QueueTimeSum,
+                                     KeQueryInterruptTime());
+        }
+
+        /* Increment Processed Work Items of the queue it came from */
+        ExpDequeueWorkItem(WorkQueueType, SourceProcessor);
+
         /* Make sure nobody is trying to play smart with us */
         ASSERT((ULONG_PTR)WorkItem->WorkerRoutine > MmUserProbeAddress);
 
@@ -234,6 +441,10 @@ ProcessLoop:
  *          - CriticalWorkQueue
  *          - HyperCriticalWorkQueue
  *
+ * @param Processor
+ *        Processor whose queue the thread serves. The thread prefers to run
+ *        on that processor, but is not bound to it.
+ *
  * @param Dynamic
  *        Specifies whether or not this thread is a dynamic thread.
  *
@@ -248,6 +459,7 @@ ProcessLoop:
 VOID
 NTAPI
 ExpCreateWorkerThread(WORK_QUEUE_TYPE WorkQueueType,
+                      IN ULONG Processor,
                       IN BOOLEAN Dynamic)
 {
     PETHREAD Thread;
@@ -257,7 +469,7 @@ ExpCreateWorkerThread(WORK_QUEUE_TYPE WorkQueueType,
     NTSTATUS Status;
 
     /* Check if this is going to be a dynamic thread */
-    Context = WorkQueueType;
+    Context = WorkQueueType | (Processor << EX_WORK_THREAD_PROCESSOR_SHIFT);
 
     /* Add the dynamic mask */
     if (Dynamic) Context |= EX_DYNAMIC_WORK_THREAD;
@@ -281,7 +493,7 @@ ExpCreateWorkerThread(WORK_QUEUE_TYPE WorkQueueType,
     if (Dynamic)
     {
         /* Increase the count */
-        InterlockedIncrement(&ExWorkerQueue[WorkQueueType].DynamicThreadCount);
+        InterlockedIncrement(&ExpWorkQueues[WorkQueueType][Processor]->DynamicThreadCount);
     }
 
     /* Set the priority */
@@ -312,6 +524,9 @@ ExpCreateWorkerThread(WORK_QUEUE_TYPE WorkQueueType,
     /* Set the Priority */
     KeSetBasePriorityThread(&Thread->Tcb, Priority);
 
+    /* Keep it close to the processor whose work it runs */
+    KeSetIdealProcessorThread(&Thread->Tcb, (CCHAR)Processor);
+
     /* Dereference and close handle */
     ObDereferenceObject(Thread);
     ObCloseHandle(hThread, KernelMode);
@@ -336,30 +551,35 @@ VOID
 NTAPI
 ExpDetectWorkerThreadDeadlock(VOID)
 {
-    ULONG i;
+    ULONG i, Processor;
     PEX_WORK_QUEUE Queue;
 
-    /* Loop the 3 queues */
+    /* Loop the 3 queue types */
     for (i = 0; i < MaximumWorkQueue; i++)
     {
-        /* Get the queue */
-        Queue = &ExWorkerQueue[i];
-        ASSERT(Queue->DynamicThreadCount <= 16);
-
-        /* Check if stuff is on the queue that still is unprocessed */
-        if ((Queue->QueueDepthLastPass) &&
-            (Queue->WorkItemsProcessed == Queue->WorkItemsProcessedLastPass) &&
-            (Queue->DynamicThreadCount < 16))
+        /* And the queue of each processor */
+        for (Processor = 0; Processor < ExpWorkQueueProcessors; Processor++)
         {
-            /* Stuff is still on the queue and nobody did anything about it */
-            DPRINT1("EX: Work Queue Deadlock detected: %lu\n", i);
-            ExpCreateWorkerThread(i, TRUE);
-            DPRINT1("Dynamic threads queued %d\n", Queue->DynamicThreadCount);
-        }
+            /* Get the queue, the hypercritical one is shared */
+            Queue = ExpWorkQueues[i][Processor];
+            if (!Queue) break;
+            ASSERT(Queue->DynamicThreadCount <= 16);
+
+            /* Check if stuff is on the queue that still is unprocessed */
+            if ((Queue->QueueDepthLastPass) &&
+                (Queue->WorkItemsProcessed == Queue->WorkItemsProcessedLastPass) &&
+                (Queue->DynamicThreadCount < 16))
+            {
+                /* Stuff is still on the queue and nobody did anything about it */
+                DPRINT1("EX: Work Queue Deadlock detected: %lu on %lu\n", i, Processor);
+                ExpCreateWorkerThread(i, Processor, TRUE);
+                DPRINT1("Dynamic threads queued %d\n", Queue->DynamicThreadCount);
+            }
 
-        /* Update our data */
-        Queue->WorkItemsProcessedLastPass = Queue->WorkItemsProcessed;
-        Queue->QueueDepthLastPass = KeReadStateQueue(&Queue->WorkerQueue);
+            /* Update our data */
+            Queue->WorkItemsProcessedLastPass = Queue->WorkItemsProcessed;
+            Queue->QueueDepthLastPass = KeReadStateQueue(&Queue->WorkerQueue);
+        }
     }
 }
 
@@ -381,25 +601,30 @@ VOID
 NTAPI
 ExpCheckDynamicThreadCount(VOID)
 {
-    ULONG i;
+    ULONG i, Processor;
     PEX_WORK_QUEUE Queue;
 
-    /* Loop the 3 queues */
+    /* Loop the 3 queue types */
     for (i = 0; i < MaximumWorkQueue; i++)
     {
-        /* Get the queue */
-        Queue = &ExWorkerQueue[i];
-
-        /* Check if still need a new thread. See ExQueueWorkItem */
-        if ((Queue->Info.MakeThreadsAsNecessary) &&
-            (!IsListEmpty(&Queue->WorkerQueue.EntryListHead)) &&
-            (Queue->WorkerQueue.CurrentCount <
-             Queue->WorkerQueue.MaximumCount) &&
-            (Queue->DynamicThreadCount < 16))
+        /* And the queue of each processor */
+        for (Processor = 0; Processor < ExpWorkQueueProcessors; Processor++)
         {
-            /* Create a new thread */
-            DPRINT1("EX: Creating new dynamic thread as requested\n");
-            ExpCreateWorkerThread(i, TRUE);
+            /* Get the queue, the hypercritical one is shared */
+            Queue = ExpWorkQueues[i][Processor];
+            if (!Queue) break;
+
+            /* Check if still need a new thread. See ExQueueWorkItem */
+            if ((Queue->Info.MakeThreadsAsNecessary) &&
+                (!IsListEmpty(&Queue->WorkerQueue.EntryListHead)) &&
+                (Queue->WorkerQueue.CurrentCount <
+                 Queue->WorkerQueue.MaximumCount) &&
+                (Queue->DynamicThreadCount < 16))
+            {
+                /* Create a new thread */
+                DPRINT1("EX: Creating new dynamic thread as requested\n");
+                ExpCreateWorkerThread(i, Processor, TRUE);
+            }
         }
     }
 }
@@ -525,7 +750,8 @@ ExpInitializeWorkerThreads(VOID)
     ULONG CriticalThreads, DelayedThreads;
     HANDLE ThreadHandle;
     PETHREAD Thread;
-    ULONG i;
+    PEX_WORK_QUEUE Queues;
+    ULONG i, Processor;
     NTSTATUS Status;
 
     /* Setup the stack swap support */
@@ -553,35 +779,69 @@ ExpInitializeWorkerThreads(VOID)
         /* Clear the structure and initialize the queue */
         RtlZeroMemory(&ExWorkerQueue[WorkQueueType], sizeof(EX_WORK_QUEUE));
         KeInitializeQueue(&ExWorkerQueue[WorkQueueType].WorkerQueue, 0);
+        ExpWorkQueues[WorkQueueType][0] = &ExWorkerQueue[WorkQueueType];
     }
 
     /* Dynamic threads are only used for the critical queue */
     ExWorkerQueue[CriticalWorkQueue].Info.MakeThreadsAsNecessary = TRUE;
 
+    /* Give the other processors their own critical and delayed queues */
+    ExpWorkQueueProcessors = 1;
+    if (KeNumberProcessors > 1)
+    {
+        Queues = ExAllocatePoolWithTag(NonPagedPool,
+                                       2 * (KeNumberProcessors - 1) *
+                                       sizeof(EX_WORK_QUEUE),
+                                       'qWxE');
+        if (Queues)
+        {
+            RtlZeroMemory(Queues,
+                          2 * (KeNumberProcessors - 1) * sizeof(EX_WORK_QUEUE));
+            for (Processor = 1; Processor < (ULONG)KeNumberProcessors; Processor++)
+            {
+                KeInitializeQueue(&Queues->WorkerQueue, 0);
+                Queues->Info.MakeThreadsAsNecessary = TRUE;
+                ExpWorkQueues[CriticalWorkQueue][Processor] = Queues++;
+
+                KeInitializeQueue(&Queues->WorkerQueue, 0);
+                ExpWorkQueues[DelayedWorkQueue][Processor] = Queues++;
+            }
+            ExpWorkQueueProcessors = KeNumberProcessors;
+        }
+    }
+
     /* Initialize the balance set manager events */
     KeInitializeEvent(&ExpThreadSetManagerEvent, SynchronizationEvent, FALSE);
     KeInitializeEvent(&ExpThreadSetManagerShutdownEvent,
                       NotificationEvent,
                       FALSE);
 
-    /* Create the built-in worker threads for the critical queue */
+    /* Every processor queue needs at least one thread */
+    CriticalThreads = max(CriticalThreads, ExpWorkQueueProcessors);
+    DelayedThreads = max(DelayedThreads, ExpWorkQueueProcessors);
+
+    /* Create the built-in worker threads for the critical queues */
     for (i = 0; i < CriticalThreads; i++)
     {
         /* Create the thread */
-        ExpCreateWorkerThread(CriticalWorkQueue, FALSE);
+        ExpCreateWorkerThread(CriticalWorkQueue,
+                              i % ExpWorkQueueProcessors,
+                              FALSE);
         ExCriticalWorkerThreads++;
     }
 
-    /* Create the built-in worker threads for the delayed queue */
+    /* Create the built-in worker threads for the delayed queues */
     for (i = 0; i < DelayedThreads; i++)
     {
         /* Create the thread */
-        ExpCreateWorkerThread(DelayedWorkQueue, FALSE);
+        ExpCreateWorkerThread(DelayedWorkQueue,
+                              i % ExpWorkQueueProcessors,
+                              FALSE);
         ExDelayedWorkerThreads++;
     }
 
     /* Create the built-in worker thread for the hypercritical queue */
-    ExpCreateWorkerThread(HyperCriticalWorkQueue, FALSE);
+    ExpCreateWorkerThread(HyperCriticalWorkQueue, 0, FALSE);
 
     /* Create the balance set manager thread */
     Status = PsCreateSystemThread(&ThreadHandle,
@@ -723,7 +983,9 @@ NTAPI
 ExQueueWorkItem(IN PWORK_QUEUE_ITEM WorkItem,
                 IN WORK_QUEUE_TYPE QueueType)
 {
-    PEX_WORK_QUEUE WorkQueue = &ExWorkerQueue[QueueType];
+    PEX_WORK_QUEUE WorkQueue;
+    PEXP_WORK_QUEUE_COUNTERS Counters;
+    ULONG Processor;
     ASSERT(QueueType < MaximumWorkQueue);
     ASSERT(WorkItem->List.Flink == NULL);
 
@@ -738,6 +1000,16 @@ ExQueueWorkItem(IN PWORK_QUEUE_ITEM WorkItem,
                      0);
     }
 
+    /* Pick the queue of this processor, or of an idle one if ours is busy */
+    Processor = ExpSelectWorkQueue(QueueType);
+    WorkQueue = ExpWorkQueues[QueueType][Processor];
+
+    /* Account for it before it can be picked up */
+    Counters = &ExpWorkQueueCounters[QueueType][Processor];
+    InterlockedIncrement(&Counters->WorkItemsQueued);
+    InterlockedExchangeAdd64((PLONG64)&Counters->QueueTimeSum,
+                             KeQueryInterruptTime());
+
     /* Insert the Queue */
     KeInsertQueue(&WorkQueue->WorkerQueue, &WorkItem->List);
     ASSERT(!WorkQueue->Info.QueueDisabled);
@@ -763,4 +1035,53 @@ ExQueueWorkItem(IN PWORK_QUEUE_ITEM WorkItem,
     }
 }
 
+#if DBG && defined(KDBG)
+
+#include <kdbg/kdb.h>
+
+BOOLEAN
+ExpKdbgExtWorkQueues(ULONG Argc, PCHAR Argv[])
+{
+    static PCSTR TypeNames[MaximumWorkQueue] = { "Critical", "Delayed", "Hypercritical" };
+    PEXP_WORK_QUEUE_COUNTERS Counters;
+    PEX_WORK_QUEUE Queue;
+    ULONGLONG Now, QueueTime;
+    ULONG Type, Processor, Processed;
+    LONG Depth;
+
+    KdbpPrint("Type          CPU Workers Dynamic   Depth    Queued Processed    Stolen  Avg wait\n");
+
+    /* The counters are only statistics, read them as they are */
+    Now = KeQueryInterruptTime();
+    for (Type = 0; Type < MaximumWorkQueue; Type++)
+    {
+        for (Processor = 0; Processor < ExpWorkQueueProcessors; Processor++)
+        {
+            Queue = ExpWorkQueues[Type][Processor];
+            if (!Queue) break;
+            Counters = &ExpWorkQueueCounters[Type][Processor];
+            Processed = Queue->WorkItemsProcessed;
+
+            /*
+             * Items still queued count as waiting until now. The time sums
+             * wrap around, only their difference is meaningful.
+             */
+            Depth = max((LONG)(Counters->WorkItemsQueued - Processed), 0);
+            QueueTime = Counters->DequeueTimeSum + Depth * Now - Counters->QueueTimeSum;
+            if ((LONGLONG)QueueTime < 0) QueueTime = 0;
+
+            KdbpPrint("%-13s %3lu %7lu %7ld %7ld %9ld %9lu %9ld %6I64u us\n",
+                      TypeNames[Type], Processor, (ULONG)Queue->Info.WorkerCount,
+                      Queue->DynamicThreadCount, Depth,
+                      Counters->WorkItemsQueued, Processed,
+                      Counters->WorkItemsStolen,
+                      (Processed + Depth) ? QueueTime / 10 / (Processed + Depth) : 0);
+        }
+    }
+
+    return TRUE;
+}
+
+#endif // DBG && defined(KDBG)
+
 /* EOF */
@@ -65,6 +65,9 @@ extern ULONG CcPinReadNoWait;
 extern ULONG CcPinMappedDataCount;
 extern ULONG CcDataPages;
 extern ULONG CcDataFlushes;
+extern ULONG CcReadAheadIos;
+extern ULONG CcReadAheadHitPages;
+extern ULONG CcReadAheadWastedPages;
 
 typedef struct _PF_SCENARIO_ID
 {
@@ -167,6 +170,52 @@ typedef struct _PFSN_PREFETCHER_GLOBALS
     LONG ActivePrefetches;
 } PFSN_PREFETCHER_GLOBALS, *PPFSN_PREFETCHER_GLOBALS;
 
+//
+// Read ahead tuning
+//
+#define CC_READ_HISTORY_DEPTH       4
+#define CC_READ_AHEAD_MIN_WINDOW    (64 * 1024)
+#define CC_READ_AHEAD_MAX_WINDOW    (1024 * 1024)
+
+typedef struct _ROS_PRIVATE_CACHE_MAP
+{
+    union
+    {
+        CSHORT NodeTypeCode;
+        PRIVATE_CACHE_MAP_FLAGS Flags;
+        ULONG UlongFlags;
+    };
+    ULONG ReadAheadMask;
+    PFILE_OBJECT FileObject;
+    LARGE_INTEGER FileOffset1;
+    LARGE_INTEGER BeyondLastByte1;
+    LARGE_INTEGER FileOffset2;
+    LARGE_INTEGER BeyondLastByte2;
+    LARGE_INTEGER ReadAheadOffset[2];
+    ULONG ReadAheadLength[2];
+    KSPIN_LOCK ReadAheadSpinLock;
+    LIST_ENTRY PrivateLinks;
+    PVOID ReadAheadWorkItem;
+
+    /* ROS specific */
+    /* Last reads through this handle, oldest first from ReadHistoryIndex */
+    LARGE_INTEGER ReadHistoryOffset[CC_READ_HISTORY_DEPTH];
+    ULONG ReadHistoryLength[CC_READ_HISTORY_DEPTH];
+    ULONG ReadHistoryIndex;
+    ULONG ReadHistoryCount;
+    /* How far ahead of a sequential reader we read, grows with the stream */
+    ULONG ReadAheadWindow;
+    /* Range already read ahead that the reader didn't get to yet */
+    LARGE_INTEGER ReadAheadStart;
+    LARGE_INTEGER ReadAheadEnd;
+} ROS_PRIVATE_CACHE_MAP, *PROS_PRIVATE_CACHE_MAP;
+
+//
+// VACB index: each leaf covers VACB_INDEX_LEAF_SIZE views of the file
+//
+#define VACB_INDEX_LEAF_SHIFT       9
+#define VACB_INDEX_LEAF_SIZE        (1 << VACB_INDEX_LEAF_SHIFT)
+
 typedef struct _ROS_SHARED_CACHE_MAP
 {
     CSHORT NodeTypeCode;
@@ -187,10 +236,13 @@ typedef struct _ROS_SHARED_CACHE_MAP
     LIST_ENTRY PrivateList;
     ULONG DirtyPageThreshold;
     KSPIN_LOCK BcbSpinLock;
-    PRIVATE_CACHE_MAP PrivateCacheMap;
+    ROS_PRIVATE_CACHE_MAP PrivateCacheMap;
 
     /* ROS specific */
     LIST_ENTRY CacheMapVacbListHead;
+    /* VACBs by view, see CcRosGetVacbSlot */
+    struct _ROS_VACB ***VacbIndex;
+    ULONG VacbIndexSize;
     BOOLEAN PinAccess;
     KSPIN_LOCK CacheMapLock;
     KGUARDED_MUTEX FlushCacheLock;
@@ -351,6 +403,11 @@ CcRosLookupVacb(
     LONGLONG FileOffset
 );
 
+VOID
+CcRosUnlinkVacb(
+    PROS_VACB Vacb
+);
+
 VOID
 NTAPI
 CcInitCacheZeroPage(VOID);
@@ -438,6 +495,10 @@ VOID
 CcPerformReadAhead(
     IN PFILE_OBJECT FileObject);
 
+VOID
+CcRosDiscardReadAhead(
+    IN PROS_PRIVATE_CACHE_MAP PrivateCacheMap);
+
 NTSTATUS
 CcRosInternalFreeVacb(
     IN PROS_VACB Vacb);
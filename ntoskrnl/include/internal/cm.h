@@ -1105,6 +1105,12 @@ CmpLazyFlush(
     VOID
 );
 
+BOOLEAN
+NTAPI
+CmpFlushHive(
+    IN PCMHIVE CmHive
+);
+
 //
 // Open/Create Routines
 //
@@ -1470,6 +1476,11 @@ extern LIST_ENTRY CmiKeyObjectListHead;
 extern BOOLEAN CmpHoldLazyFlush;
 extern ULONG CmpLazyFlushIntervalInSeconds;
 extern ULONG CmpLazyFlushHiveCount;
+extern ULONG CmpHiveFlushes;
+extern ULONGLONG CmpHiveFlushBytes;
+extern ULONGLONG CmpHiveFlushTime;
+extern ULONGLONG CmpHiveFlushMaxTime;
+extern ULONGLONG CmpHiveFlushLockTime;
 extern BOOLEAN HvShutdownComplete;
 
 //
@@ -38,6 +38,22 @@ extern KSPIN_LOCK ExpPagedLookasideListLock;
 extern ULONG ExCriticalWorkerThreads;
 extern ULONG ExDelayedWorkerThreads;
 
+
+/*
+ * Accounting of the per-processor work queues (see work.c)
+ */
+typedef struct DECLSPEC_CACHEALIGN _EXP_WORK_QUEUE_COUNTERS
+{
+    LONG WorkItemsQueued;
+    LONG WorkItemsStolen;
+    ULONGLONG QueueTimeSum;
+    ULONGLONG DequeueTimeSum;
+} EXP_WORK_QUEUE_COUNTERS, *PEXP_WORK_QUEUE_COUNTERS;
+
+extern PEX_WORK_QUEUE ExpWorkQueues[MaximumWorkQueue][MAXIMUM_PROCESSORS];
+extern EXP_WORK_QUEUE_COUNTERS ExpWorkQueueCounters[MaximumWorkQueue][MAXIMUM_PROCESSORS];
+extern ULONG ExpWorkQueueProcessors;
+
 extern PVOID ExpDefaultErrorPort;
 extern PEPROCESS ExpDefaultErrorPortProcess;
 
@@ -247,6 +263,10 @@ ExInitializeSystemLookasideList(
     IN PLIST_ENTRY ListHead
 );
 
+VOID
+NTAPI
+ExAdjustLookasideDepth(VOID);
+
 CODE_SEG("INIT")
 BOOLEAN
 NTAPI
@@ -319,6 +339,16 @@ VOID
 NTAPI
 ExInitPoolLookasidePointers(VOID);
 
+CODE_SEG("INIT")
+VOID
+NTAPI
+ExpInitializeProcessorPoolLookasideLists(VOID);
+
+CODE_SEG("INIT")
+VOID
+NTAPI
+ExpInitializeProcessorPoolTrackers(VOID);
+
 /* Callback Functions ********************************************************/
 
 VOID
@@ -165,3 +165,16 @@ IopValidateOpenPacket(IN POPEN_PACKET OpenPacket)
     /* Good packet */
     return TRUE;
 }
+
+FORCEINLINE
+BOOLEAN
+IopSkipCompletionPort(IN PFILE_OBJECT FileObject,
+                      IN NTSTATUS Status)
+{
+    /*
+     * Callers that opted in with FILE_SKIP_COMPLETION_PORT_ON_SUCCESS learn
+     * about inline successes from the return value, don't queue a packet.
+     */
+    return ((FileObject->Flags & FO_SKIP_COMPLETION_PORT) &&
+            NT_SUCCESS(Status));
+}
@@ -428,6 +428,14 @@ KeUpdateRunTime(
     KIRQL Irql
 );
 
+VOID
+FASTCALL
+KiUpdateIdleRunTime(
+    IN PKPRCB Prcb,
+    IN ULONG TickCount,
+    IN ULONG KernelTime
+);
+
 VOID
 NTAPI
 KiExpireTimers(
@@ -718,6 +726,17 @@ BOOLEAN
 NTAPI
 KeRemoveQueueApc(PKAPC Apc);
 
+ULONG
+NTAPI
+KeRemoveQueueEx(
+    IN PKQUEUE Queue,
+    IN KPROCESSOR_MODE WaitMode,
+    IN BOOLEAN Alertable,
+    IN PLARGE_INTEGER Timeout OPTIONAL,
+    OUT PLIST_ENTRY *EntryArray,
+    IN ULONG Count
+);
+
 VOID
 FASTCALL
 KiActivateWaiterQueue(IN PKQUEUE Queue);
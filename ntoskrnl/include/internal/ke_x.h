@@ -944,7 +944,28 @@ KxInsertTimer(IN PKTIMER Timer,
 }
 
 //
-// Called by KeSetTimerEx and KiInsertTreeTimer to calculate Due Time
+// Called by KiComputeDueTime to round the due time of a coalescable timer
+// up to its coalescing boundary, so that timers which can tolerate a delay
+// share a hand and expire on the same clock tick.
+//
+FORCEINLINE
+VOID
+KiCoalesceDueTime(IN PKTIMER Timer)
+{
+    ULONGLONG Ticks, Mask;
+
+    /* Only timers set through KeSetCoalescableTimer get coalesced */
+    if (!Timer->Header.Coalescable) return;
+
+    /* Round up to the next multiple of the encoded tick granularity */
+    Mask = (1ULL << Timer->Header.EncodedTolerableDelay) - 1;
+    Ticks = (Timer->DueTime.QuadPart + KeMaximumIncrement - 1) / KeMaximumIncrement;
+    Ticks = (Ticks + Mask) & ~Mask;
+    Timer->DueTime.QuadPart = Ticks * KeMaximumIncrement;
+}
+
+//
+// Called by KiSetTimerEx and KiInsertTreeTimer to calculate Due Time
 // See the Windows HPI Blog for more information
 //
 FORCEINLINE
@@ -986,6 +1007,7 @@ KiComputeDueTime(IN PKTIMER Timer,
 
     /* Recalculate due time */
     Timer->DueTime.QuadPart = InterruptTime.QuadPart - DueTime.QuadPart;
+    KiCoalesceDueTime(Timer);
 
     /* Get the handle */
     *Hand = KiComputeTimerTableIndex(Timer->DueTime.QuadPart);
@@ -1240,7 +1262,7 @@ KxSetTimerForThreadWait(IN PKTIMER Timer,
     }                                                                       \
                                                                             \
     /* Set wait settings */                                                 \
-    Thread->Alertable = FALSE;                                              \
+    Thread->Alertable = Alertable;                                          \
     Thread->WaitMode = WaitMode;                                            \
     Thread->WaitReason = WrQueue;                                           \
                                                                             \
@@ -54,7 +54,7 @@ extern KSPIN_LOCK MmPfnLock;
 struct _KTRAP_FRAME;
 struct _EPROCESS;
 struct _MM_RMAP_ENTRY;
-typedef ULONG_PTR SWAPENTRY;
+typedef ULONG_PTR SWAPENTRY, *PSWAPENTRY;
 
 //
 // Pool Quota values
@@ -274,6 +274,9 @@ typedef struct _MEMORY_AREA
 typedef struct _MM_RMAP_ENTRY
 {
    struct _MM_RMAP_ENTRY* Next;
+   struct _MM_RMAP_ENTRY* Previous;
+   struct _MM_RMAP_ENTRY* HashNext;
+   PFN_NUMBER Page;
    PEPROCESS Process;
    PVOID Address;
 #if DBG
@@ -470,6 +473,14 @@ extern MMPFNLIST MmStandbyPageListHead;
 extern MMPFNLIST MmModifiedPageListHead;
 extern MMPFNLIST MmModifiedNoWritePageListHead;
 
+/* Pages zeroed by the zeroing threads since boot */
+extern ULONG MiZeroedPageCount;
+
+/* Zeroed pages held back by the per-processor page caches */
+PFN_NUMBER
+NTAPI
+MiGetCachedPageCount(VOID);
+
 typedef struct _MM_MEMORY_CONSUMER
 {
     ULONG PagesUsed;
@@ -513,6 +524,12 @@ typedef struct _MM_PAGED_POOL_INFO
 
 extern MM_MEMORY_CONSUMER MiMemoryConsumers[MC_MAXIMUM];
 
+/* Maximum number of pages written to a paging file with a single I/O */
+#define MI_PAGE_FILE_WRITE_CLUSTER 16
+
+/* Maximum number of pages read from a paging file with a single I/O */
+#define MI_PAGE_FILE_READ_CLUSTER 16
+
 /* Page file information */
 typedef struct _MMPAGING_FILE
 {
@@ -530,6 +547,23 @@ MMPAGING_FILE, *PMMPAGING_FILE;
 
 extern PMMPAGING_FILE MmPagingFile[MAX_PAGING_FILES];
 
+/* Dirty private pages waiting to be written to a paging file together */
+typedef struct _MM_PAGEOUT_CLUSTER_ENTRY
+{
+    PFN_NUMBER Page;
+    struct _EPROCESS *Process;
+    PVOID Address;
+}
+MM_PAGEOUT_CLUSTER_ENTRY, *PMM_PAGEOUT_CLUSTER_ENTRY;
+
+typedef struct _MM_PAGEOUT_CLUSTER
+{
+    ULONG Count;
+    ULONG FreedCount; /* Pages the flushes actually released */
+    MM_PAGEOUT_CLUSTER_ENTRY Entries[MI_PAGE_FILE_WRITE_CLUSTER];
+}
+MM_PAGEOUT_CLUSTER, *PMM_PAGEOUT_CLUSTER;
+
 typedef VOID
 (*PMM_ALTER_REGION_FUNC)(
     PMMSUPPORT AddressSpace,
@@ -710,10 +744,23 @@ MmInitSystem(IN ULONG Phase,
 
 /* pagefile.c ****************************************************************/
 
+extern ULONG MiPageFileWriteIoCount;
+extern ULONG MiPageFileWritePageCount;
+extern ULONG MiPageFileReadIoCount;
+extern ULONG MiPageFileReadPageCount;
+extern ULONG MmPageFileReadCluster;
+
 SWAPENTRY
 NTAPI
 MmAllocSwapPage(VOID);
 
+ULONG
+NTAPI
+MmAllocSwapPages(
+    _In_ ULONG Count,
+    _Out_writes_to_(Count, return) PSWAPENTRY SwapEntries
+);
+
 VOID
 NTAPI
 MmFreeSwapPage(SWAPENTRY Entry);
@@ -734,6 +781,21 @@ MmReadFromSwapPage(
     PFN_NUMBER Page
 );
 
+NTSTATUS
+NTAPI
+MmReadFromSwapPages(
+    _In_ SWAPENTRY SwapEntry,
+    _In_reads_(PageCount) PPFN_NUMBER Pages,
+    _In_ ULONG PageCount
+);
+
+SWAPENTRY
+NTAPI
+MmOffsetSwapEntry(
+    _In_ SWAPENTRY SwapEntry,
+    _In_ ULONG PageCount
+);
+
 NTSTATUS
 NTAPI
 MmWriteToSwapPage(
@@ -741,6 +803,14 @@ MmWriteToSwapPage(
     PFN_NUMBER Page
 );
 
+NTSTATUS
+NTAPI
+MmWriteToSwapPages(
+    _In_ SWAPENTRY SwapEntry,
+    _In_reads_(PageCount) PPFN_NUMBER Pages,
+    _In_ ULONG PageCount
+);
+
 VOID
 NTAPI
 MmShowOutOfSpaceMessagePagingFile(VOID);
@@ -933,6 +1003,12 @@ VOID
 NTAPI
 MmRebalanceMemoryConsumers(VOID);
 
+extern ULONG MmBalancerReservePages;
+extern ULONG MiBalancerLowWatermark;
+extern ULONG MiBalancerHighWatermark;
+extern ULONG MiBalancerStallCount;
+extern LONGLONG MiBalancerStallTime;
+
 /* rmap.c **************************************************************/
 #define RMAP_SEGMENT_MASK ~((ULONG_PTR)0xff)
 #define RMAP_IS_SEGMENT(x) (((ULONG_PTR)(x) & RMAP_SEGMENT_MASK) == RMAP_SEGMENT_MASK)
@@ -981,6 +1057,19 @@ NTSTATUS
 NTAPI
 MmPageOutPhysicalAddress(PFN_NUMBER Page);
 
+NTSTATUS
+NTAPI
+MmPageOutPhysicalAddressEx(
+    _In_ PFN_NUMBER Page,
+    _Inout_opt_ PMM_PAGEOUT_CLUSTER Cluster
+);
+
+VOID
+NTAPI
+MmFlushPageOutCluster(
+    _Inout_ PMM_PAGEOUT_CLUSTER Cluster
+);
+
 PMM_SECTION_SEGMENT
 NTAPI
 MmGetSectionAssociation(PFN_NUMBER Page,
@@ -1040,6 +1129,44 @@ MiReleasePfnLockFromDpcLevel(VOID)
 
 #define MI_ASSERT_PFN_LOCK_HELD() NT_ASSERT((KeGetCurrentIrql() >= DISPATCH_LEVEL) && (MmPfnLock != 0))
 
+//
+// The rmap lists are protected by a small array of spinlocks indexed by the
+// low bits of the page frame number rather than by the PFN lock, so that
+// mapping and unmapping shared pages doesn't serialize all processors.
+//
+#define MI_RMAP_LOCK_COUNT 64
+
+typedef struct DECLSPEC_CACHEALIGN _MM_RMAP_LOCK
+{
+    KSPIN_LOCK SpinLock;
+} MM_RMAP_LOCK, *PMM_RMAP_LOCK;
+
+extern MM_RMAP_LOCK MmRmapLockTable[MI_RMAP_LOCK_COUNT];
+
+#define MI_RMAP_LOCK_FOR_PAGE(Page) \
+    (&MmRmapLockTable[(Page) & (MI_RMAP_LOCK_COUNT - 1)].SpinLock)
+
+FORCEINLINE
+KIRQL
+MiAcquireRmapLock(IN PFN_NUMBER Page)
+{
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(MI_RMAP_LOCK_FOR_PAGE(Page), &OldIrql);
+    return OldIrql;
+}
+
+FORCEINLINE
+VOID
+MiReleaseRmapLock(IN PFN_NUMBER Page,
+                  IN KIRQL OldIrql)
+{
+    KeReleaseSpinLock(MI_RMAP_LOCK_FOR_PAGE(Page), OldIrql);
+}
+
+#define MI_ASSERT_RMAP_LOCK_HELD(Page) \
+    NT_ASSERT((KeGetCurrentIrql() >= DISPATCH_LEVEL) && (*MI_RMAP_LOCK_FOR_PAGE(Page) != 0))
+
 FORCEINLINE
 PMMPFN
 MiGetPfnEntry(IN PFN_NUMBER Pfn)
@@ -1105,7 +1232,8 @@ MiUnmapPageInHyperSpace(IN PEPROCESS Process,
 
 PVOID
 NTAPI
-MiMapPagesInZeroSpace(IN PMMPFN Pfn1,
+MiMapPagesInZeroSpace(IN PMMPTE ZeroingPte,
+                      IN PMMPFN Pfn1,
                       IN PFN_NUMBER NumberOfPages);
 
 VOID
@@ -1813,6 +1941,20 @@ VOID
 NTAPI
 MiInitializeWorkingSetList(_Inout_ PMMSUPPORT WorkingSet);
 
+VOID
+NTAPI
+MiCountTrimmedPages(_In_ ULONG PageCount);
+
+VOID
+NTAPI
+MiCountTrimmedPageFault(VOID);
+
+VOID
+NTAPI
+MmQueryWorkingSetTrimCounts(
+    _Out_ PULONG TrimmedPageCount,
+    _Out_ PULONG TrimmedPageFaultCount);
+
 #ifdef __cplusplus
 } // extern "C"
 
@@ -125,6 +125,23 @@ typedef struct _OBP_FIND_HANDLE_DATA
     POBJECT_HANDLE_INFORMATION HandleInformation;
 } OBP_FIND_HANDLE_DATA, *POBP_FIND_HANDLE_DATA;
 
+//
+// Directory Object Body, with the hash table growth state behind it
+//
+typedef struct _OBP_DIRECTORY
+{
+    OBJECT_DIRECTORY Directory;
+    POBJECT_DIRECTORY_ENTRY *ExtendedHashBuckets;
+    ULONG ExtendedBucketCount;
+    ULONG EntryCount;
+} OBP_DIRECTORY, *POBP_DIRECTORY;
+
+//
+// Recovers the private directory body from an object directory
+//
+#define ObpGetPrivateDirectory(x) \
+    CONTAINING_RECORD((x), OBP_DIRECTORY, Directory)
+
 //
 // Cached Security Descriptor Header
 //
@@ -191,6 +208,12 @@ ObpDeleteEntryDirectory(
     IN POBP_LOOKUP_CONTEXT Context
 );
 
+VOID
+NTAPI
+ObpDeleteDirectory(
+    IN PVOID ObjectBody
+);
+
 BOOLEAN
 NTAPI
 ObpInsertEntryDirectory(
@@ -17,6 +17,9 @@ POBJECT_TYPE IoCompletionType;
 
 GENERAL_LOOKASIDE IoCompletionPacketLookaside;
 
+/* Most packets NtRemoveIoCompletionEx hands out per call */
+#define IOP_MAX_COMPLETION_BATCH 64
+
 GENERIC_MAPPING IopCompletionMapping =
 {
     STANDARD_RIGHTS_READ | IO_COMPLETION_QUERY_STATE,
@@ -137,6 +140,48 @@ IopDeleteIoCompletion(PVOID ObjectBody)
     }
 }
 
+static
+VOID
+IopUnpackCompletionPacket(IN PLIST_ENTRY ListEntry,
+                          OUT PFILE_IO_COMPLETION_INFORMATION Completion)
+{
+    PIOP_MINI_COMPLETION_PACKET Packet;
+    PIRP Irp;
+
+    /* Get the Packet Data */
+    Packet = CONTAINING_RECORD(ListEntry,
+                               IOP_MINI_COMPLETION_PACKET,
+                               ListEntry);
+
+    /* Check if this is piggybacked on an IRP */
+    if (Packet->PacketType == IopCompletionPacketIrp)
+    {
+        /* Get the IRP */
+        Irp = CONTAINING_RECORD(ListEntry,
+                                IRP,
+                                Tail.Overlay.ListEntry);
+
+        /* Save values */
+        Completion->KeyContext = Irp->Tail.CompletionKey;
+        Completion->ApcContext = Irp->Overlay.AsynchronousParameters.UserApcContext;
+        Completion->IoStatusBlock = Irp->IoStatus;
+
+        /* Free the IRP */
+        IoFreeIrp(Irp);
+    }
+    else
+    {
+        /* Save values */
+        Completion->KeyContext = Packet->KeyContext;
+        Completion->ApcContext = Packet->ApcContext;
+        Completion->IoStatusBlock.Status = Packet->IoStatus;
+        Completion->IoStatusBlock.Information = Packet->IoStatusInformation;
+
+        /* Free the packet */
+        IopFreeMiniPacket(Packet);
+    }
+}
+
 /* PUBLIC FUNCTIONS **********************************************************/
 
 /*
@@ -450,13 +495,10 @@ NtRemoveIoCompletion(IN HANDLE IoCompletionHandle,
 {
     LARGE_INTEGER SafeTimeout;
     PKQUEUE Queue;
-    PIOP_MINI_COMPLETION_PACKET Packet;
     PLIST_ENTRY ListEntry;
     KPROCESSOR_MODE PreviousMode = ExGetPreviousMode();
     NTSTATUS Status;
-    PIRP Irp;
-    PVOID Apc, Key;
-    IO_STATUS_BLOCK IoStatus;
+    FILE_IO_COMPLETION_INFORMATION Completion;
     PAGED_CODE();
 
     /* Check if the call was from user mode */
@@ -507,46 +549,116 @@ NtRemoveIoCompletion(IN HANDLE IoCompletionHandle,
         }
         else
         {
-            /* Get the Packet Data */
-            Packet = CONTAINING_RECORD(ListEntry,
-                                       IOP_MINI_COMPLETION_PACKET,
-                                       ListEntry);
+            /* Get the values and free the packet */
+            IopUnpackCompletionPacket(ListEntry, &Completion);
 
-            /* Check if this is piggybacked on an IRP */
-            if (Packet->PacketType == IopCompletionPacketIrp)
+            /* Enter SEH to write back the values */
+            _SEH2_TRY
             {
-                /* Get the IRP */
-                Irp = CONTAINING_RECORD(ListEntry,
-                                        IRP,
-                                        Tail.Overlay.ListEntry);
-
-                /* Save values */
-                Key = Irp->Tail.CompletionKey;
-                Apc = Irp->Overlay.AsynchronousParameters.UserApcContext;
-                IoStatus = Irp->IoStatus;
-
-                /* Free the IRP */
-                IoFreeIrp(Irp);
+                /* Write the values to caller */
+                *ApcContext = Completion.ApcContext;
+                *KeyContext = Completion.KeyContext;
+                *IoStatusBlock = Completion.IoStatusBlock;
             }
-            else
+            _SEH2_EXCEPT(ExSystemExceptionFilter())
             {
-                /* Save values */
-                Key = Packet->KeyContext;
-                Apc = Packet->ApcContext;
-                IoStatus.Status = Packet->IoStatus;
-                IoStatus.Information = Packet->IoStatusInformation;
+                /* Get the exception code */
+                Status = _SEH2_GetExceptionCode();
+            }
+            _SEH2_END;
+        }
 
-                /* Free the packet */
-                IopFreeMiniPacket(Packet);
+        /* Dereference the Object */
+        ObDereferenceObject(Queue);
+    }
+
+    /* Return status */
+    return Status;
+}
+
+NTSTATUS
+NTAPI
+NtRemoveIoCompletionEx(IN HANDLE IoCompletionHandle,
+                       OUT PFILE_IO_COMPLETION_INFORMATION IoCompletionInformation,
+                       IN ULONG Count,
+                       OUT PULONG NumEntriesRemoved,
+                       IN PLARGE_INTEGER Timeout OPTIONAL,
+                       IN BOOLEAN Alertable)
+{
+    LARGE_INTEGER SafeTimeout;
+    PKQUEUE Queue;
+    PLIST_ENTRY EntryArray[IOP_MAX_COMPLETION_BATCH];
+    KPROCESSOR_MODE PreviousMode = ExGetPreviousMode();
+    NTSTATUS Status;
+    FILE_IO_COMPLETION_INFORMATION Completion;
+    ULONG Removed, i;
+    PAGED_CODE();
+
+    /* We need room for at least one entry */
+    if (Count == 0) return STATUS_INVALID_PARAMETER;
+
+    /* Callers may ask for more, they'll get what fits in one batch */
+    Count = min(Count, IOP_MAX_COMPLETION_BATCH);
+
+    /* Check if the call was from user mode */
+    if (PreviousMode != KernelMode)
+    {
+        /* Protect probes in SEH */
+        _SEH2_TRY
+        {
+            /* Probe the output array and count */
+            ProbeForWrite(IoCompletionInformation,
+                          Count * sizeof(FILE_IO_COMPLETION_INFORMATION),
+                          sizeof(PVOID));
+            ProbeForWriteUlong(NumEntriesRemoved);
+            if (Timeout)
+            {
+                /* Probe and capture the timeout */
+                SafeTimeout = ProbeForReadLargeInteger(Timeout);
+                Timeout = &SafeTimeout;
             }
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            /* Return the exception code */
+            _SEH2_YIELD(return _SEH2_GetExceptionCode());
+        }
+        _SEH2_END;
+    }
+
+    /* Open the Object */
+    Status = ObReferenceObjectByHandle(IoCompletionHandle,
+                                       IO_COMPLETION_MODIFY_STATE,
+                                       IoCompletionType,
+                                       PreviousMode,
+                                       (PVOID*)&Queue,
+                                       NULL);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* Wait for one packet, and take all the others that are ready */
+    Removed = KeRemoveQueueEx(Queue, PreviousMode, Alertable, Timeout, EntryArray, Count);
+
+    /* If we got a timeout or user_apc back, return the status */
+    if (((NTSTATUS)(ULONG_PTR)EntryArray[0] == STATUS_TIMEOUT) ||
+        ((NTSTATUS)(ULONG_PTR)EntryArray[0] == STATUS_USER_APC) ||
+        ((NTSTATUS)(ULONG_PTR)EntryArray[0] == STATUS_ALERTED))
+    {
+        Status = (NTSTATUS)(ULONG_PTR)EntryArray[0];
+        Removed = 0;
+    }
 
+    /* Packets must be freed even if the caller's buffer went away */
+    for (i = 0; i < Removed; i++)
+    {
+        /* Get the values and free the packet */
+        IopUnpackCompletionPacket(EntryArray[i], &Completion);
+
+        if (NT_SUCCESS(Status))
+        {
             /* Enter SEH to write back the values */
             _SEH2_TRY
             {
-                /* Write the values to caller */
-                *ApcContext = Apc;
-                *KeyContext = Key;
-                *IoStatusBlock = IoStatus;
+                IoCompletionInformation[i] = Completion;
             }
             _SEH2_EXCEPT(ExSystemExceptionFilter())
             {
@@ -555,10 +667,22 @@ NtRemoveIoCompletion(IN HANDLE IoCompletionHandle,
             }
             _SEH2_END;
         }
+    }
 
-        /* Dereference the Object */
-        ObDereferenceObject(Queue);
+    /* Dereference the Object */
+    ObDereferenceObject(Queue);
+
+    /* Tell the caller how many entries are valid */
+    _SEH2_TRY
+    {
+        *NumEntriesRemoved = NT_SUCCESS(Status) ? Removed : 0;
+    }
+    _SEH2_EXCEPT(ExSystemExceptionFilter())
+    {
+        /* Keep the previous failure, if any */
+        if (NT_SUCCESS(Status)) Status = _SEH2_GetExceptionCode();
     }
+    _SEH2_END;
 
     /* Return status */
     return Status;
@@ -433,10 +433,13 @@ IopDeviceFsIoControl(IN HANDLE DeviceHandle,
                     CompletionInfo = *(FileObject->CompletionContext);
                 }
 
-                /* If we had an event, signal it */
+                /* If we had an event, signal it unless the caller opted out */
                 if (Event)
                 {
-                    KeSetEvent(EventObject, IO_NO_INCREMENT, FALSE);
+                    if (!(FileObject->Flags & FO_SKIP_SET_FAST_IO))
+                    {
+                        KeSetEvent(EventObject, IO_NO_INCREMENT, FALSE);
+                    }
                     ObDereferenceObject(EventObject);
                 }
 
@@ -447,7 +450,8 @@ IopDeviceFsIoControl(IN HANDLE DeviceHandle,
                 }
 
                 /* Set completion if required */
-                if (CompletionInfo.Port != NULL && UserApcContext != NULL)
+                if (CompletionInfo.Port != NULL && UserApcContext != NULL &&
+                    !IopSkipCompletionPort(FileObject, KernelIosb.Status))
                 {
                     if (!NT_SUCCESS(IoSetIoCompletion(CompletionInfo.Port,
                                                       CompletionInfo.Key,
@@ -1028,6 +1032,24 @@ IopGetFileMode(IN PFILE_OBJECT FileObject)
     return Mode;
 }
 
+static
+ULONG
+IopGetCompletionNotificationModes(IN PFILE_OBJECT FileObject)
+{
+    ULONG Modes = 0;
+
+    if (FileObject->Flags & FO_SKIP_COMPLETION_PORT)
+        Modes |= FILE_SKIP_COMPLETION_PORT_ON_SUCCESS;
+
+    if (FileObject->Flags & FO_SKIP_SET_EVENT)
+        Modes |= FILE_SKIP_SET_EVENT_ON_HANDLE;
+
+    if (FileObject->Flags & FO_SKIP_SET_FAST_IO)
+        Modes |= FILE_SKIP_SET_USER_EVENT_ON_FAST_IO;
+
+    return Modes;
+}
+
 static
 BOOLEAN
 IopGetMountFlag(IN PDEVICE_OBJECT DeviceObject)
@@ -1886,15 +1908,19 @@ NtLockFile(IN HANDLE FileHandle,
             }
             _SEH2_END;
 
-            /* If we had an event, signal it */
+            /* If we had an event, signal it unless the caller opted out */
             if (EventHandle)
             {
-                KeSetEvent(Event, IO_NO_INCREMENT, FALSE);
+                if (!(FileObject->Flags & FO_SKIP_SET_FAST_IO))
+                {
+                    KeSetEvent(Event, IO_NO_INCREMENT, FALSE);
+                }
                 ObDereferenceObject(Event);
             }
 
             /* Set completion if required */
-            if (FileObject->CompletionContext != NULL && ApcContext != NULL)
+            if (FileObject->CompletionContext != NULL && ApcContext != NULL &&
+                !IopSkipCompletionPort(FileObject, KernelIosb.Status))
             {
                 if (!NT_SUCCESS(IoSetIoCompletion(FileObject->CompletionContext->Port,
                                                   FileObject->CompletionContext->Key,
@@ -2299,6 +2325,7 @@ NtQueryInformationFile(IN HANDLE FileHandle,
     PFILE_ACCESS_INFORMATION AccessBuffer;
     PFILE_MODE_INFORMATION ModeBuffer;
     PFILE_ALIGNMENT_INFORMATION AlignmentBuffer;
+    PFILE_IO_COMPLETION_NOTIFICATION_INFORMATION NotificationBuffer;
     PFILE_ALL_INFORMATION AllBuffer;
     PFAST_IO_DISPATCH FastIoDispatch;
     PAGED_CODE();
@@ -2566,6 +2593,13 @@ NtQueryInformationFile(IN HANDLE FileHandle,
         Irp->IoStatus.Information = sizeof(FILE_ALIGNMENT_INFORMATION);
         CallDriver = FALSE;
     }
+    else if (FileInformationClass == FileIoCompletionNotificationInformation)
+    {
+        NotificationBuffer = Irp->AssociatedIrp.SystemBuffer;
+        NotificationBuffer->Flags = IopGetCompletionNotificationModes(FileObject);
+        Irp->IoStatus.Information = sizeof(FILE_IO_COMPLETION_NOTIFICATION_INFORMATION);
+        CallDriver = FALSE;
+    }
     else if (FileInformationClass == FileAllInformation)
     {
         AllBuffer = Irp->AssociatedIrp.SystemBuffer;
@@ -2919,10 +2953,13 @@ NtReadFile(IN HANDLE FileHandle,
                 }
                 _SEH2_END;
 
-                /* Signal the completion event */
+                /* Signal the completion event unless the caller opted out */
                 if (EventObject)
                 {
-                    KeSetEvent(EventObject, 0, FALSE);
+                    if (!(FileObject->Flags & FO_SKIP_SET_FAST_IO))
+                    {
+                        KeSetEvent(EventObject, 0, FALSE);
+                    }
                     ObDereferenceObject(EventObject);
                 }
 
@@ -3113,6 +3150,8 @@ NtSetInformationFile(IN HANDLE FileHandle,
     IO_STATUS_BLOCK KernelIosb;
     PVOID Queue;
     PFILE_COMPLETION_INFORMATION CompletionInfo = FileInformation;
+    PFILE_IO_COMPLETION_NOTIFICATION_INFORMATION NotificationInfo;
+    ULONG SkipFlags;
     PIO_COMPLETION_CONTEXT Context;
     PFILE_RENAME_INFORMATION RenameInfo;
     HANDLE TargetHandle = NULL;
@@ -3375,6 +3414,43 @@ NtSetInformationFile(IN HANDLE FileHandle,
         Irp->IoStatus.Status = Status;
         Irp->IoStatus.Information = 0;
     }
+    else if (FileInformationClass == FileIoCompletionNotificationInformation)
+    {
+        /* This is only I/O manager state, no need to bother the driver */
+        NotificationInfo = Irp->AssociatedIrp.SystemBuffer;
+        if (NotificationInfo->Flags & ~(FILE_SKIP_COMPLETION_PORT_ON_SUCCESS |
+                                        FILE_SKIP_SET_EVENT_ON_HANDLE |
+                                        FILE_SKIP_SET_USER_EVENT_ON_FAST_IO))
+        {
+            /* Fail */
+            Status = STATUS_INVALID_PARAMETER;
+        }
+        else if ((NotificationInfo->Flags & FILE_SKIP_COMPLETION_PORT_ON_SUCCESS) &&
+                 (FileObject->Flags & FO_SYNCHRONOUS_IO))
+        {
+            /* Synchronous handles can't be bound to a port in the first place */
+            Status = STATUS_INVALID_PARAMETER;
+        }
+        else
+        {
+            /* Translate the modes into file object flags */
+            SkipFlags = 0;
+            if (NotificationInfo->Flags & FILE_SKIP_COMPLETION_PORT_ON_SUCCESS)
+                SkipFlags |= FO_SKIP_COMPLETION_PORT;
+            if (NotificationInfo->Flags & FILE_SKIP_SET_EVENT_ON_HANDLE)
+                SkipFlags |= FO_SKIP_SET_EVENT;
+            if (NotificationInfo->Flags & FILE_SKIP_SET_USER_EVENT_ON_FAST_IO)
+                SkipFlags |= FO_SKIP_SET_FAST_IO;
+
+            /* The modes can only be turned on, never back off */
+            InterlockedOr((PLONG)&FileObject->Flags, SkipFlags);
+            Status = STATUS_SUCCESS;
+        }
+
+        /* Set the IRP Status */
+        Irp->IoStatus.Status = Status;
+        Irp->IoStatus.Information = 0;
+    }
     else if (FileInformationClass == FileRenameInformation ||
              FileInformationClass == FileLinkInformation ||
              FileInformationClass == FileMoveClusterInformation)
@@ -3990,10 +4066,13 @@ NtWriteFile(IN HANDLE FileHandle,
                 }
                 _SEH2_END;
 
-                /* Signal the completion event */
+                /* Signal the completion event unless the caller opted out */
                 if (EventObject)
                 {
-                    KeSetEvent(EventObject, 0, FALSE);
+                    if (!(FileObject->Flags & FO_SKIP_SET_FAST_IO))
+                    {
+                        KeSetEvent(EventObject, 0, FALSE);
+                    }
                     ObDereferenceObject(EventObject);
                 }
 
@@ -332,8 +332,13 @@ IopCompleteRequest(IN PKAPC Apc,
         (Irp->PendingReturned &&
          !IsIrpSynchronous(Irp, FileObject)))
     {
-        /* Get any information we need from the FO before we kill it */
-        if ((FileObject) && (FileObject->CompletionContext))
+        /*
+         * Get any information we need from the FO before we kill it. A request
+         * that succeeded without pending may not want a completion packet.
+         */
+        if ((FileObject) && (FileObject->CompletionContext) &&
+            ((Irp->PendingReturned) ||
+             !(IopSkipCompletionPort(FileObject, Irp->IoStatus.Status))))
         {
             /* Save Completion Data */
             Port = FileObject->CompletionContext->Port;
@@ -399,8 +404,15 @@ IopCompleteRequest(IN PKAPC Apc,
         }
         else if (FileObject)
         {
-            /* Signal the file object and set the status */
-            KeSetEvent(&FileObject->Event, 0, FALSE);
+            /*
+             * Signal the file object and set the status. Nobody waits on it
+             * for an asynchronous handle that asked not to have it set.
+             */
+            if (!(FileObject->Flags & FO_SKIP_SET_EVENT) ||
+                (FileObject->Flags & FO_SYNCHRONOUS_IO))
+            {
+                KeSetEvent(&FileObject->Event, 0, FALSE);
+            }
             FileObject->FinalStatus = Irp->IoStatus.Status;
 
             /*
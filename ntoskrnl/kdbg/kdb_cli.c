@@ -89,6 +89,8 @@ BOOLEAN ExpKdbgExtFileCache(ULONG Argc, PCHAR Argv[]);
 BOOLEAN ExpKdbgExtDefWrites(ULONG Argc, PCHAR Argv[]);
 BOOLEAN ExpKdbgExtIrpFind(ULONG Argc, PCHAR Argv[]);
 BOOLEAN ExpKdbgExtHandle(ULONG Argc, PCHAR Argv[]);
+BOOLEAN ExpKdbgExtBalancer(ULONG Argc, PCHAR Argv[]);
+BOOLEAN ExpKdbgExtWorkQueues(ULONG Argc, PCHAR Argv[]);
 
 extern char __ImageBase;
 
@@ -404,6 +406,8 @@ static const struct
     { "!defwrites", "!defwrites", "Display cache write values.", ExpKdbgExtDefWrites },
     { "!irpfind", "!irpfind [Pool [startaddress [criteria data]]]", "Lists IRPs potentially matching criteria.", ExpKdbgExtIrpFind },
     { "!handle", "!handle [Handle]", "Displays info about handles.", ExpKdbgExtHandle },
+    { "!balancer", "!balancer", "Display memory balancer watermarks and stall time.", ExpKdbgExtBalancer },
+    { "!workqueues", "!workqueues", "Display per-processor work queue counters.", ExpKdbgExtWorkQueues },
 };
 
 /* FUNCTIONS *****************************************************************/
@@ -1997,6 +2001,7 @@ KdbpCmdProc(
     BOOLEAN ReferencedProcess = FALSE;
     PCHAR State, pend, str1, str2;
     ULONG_PTR ul;
+    ULONG TrimmedPages, TrimmedPageFaults;
     extern LIST_ENTRY PsActiveProcessHead;
 
     if (Argc >= 2 && _stricmp(Argv[1], "list") == 0)
@@ -2089,11 +2094,20 @@ KdbpCmdProc(
         KdbpPrint("%s"
                   "  PID:             0x%08x\n"
                   "  State:           %s (0x%x)\n"
-                  "  Image Filename:  %s\n",
+                  "  Image Filename:  %s\n"
+                  "  Working Set:     %lu pages\n",
                   (Argc < 2) ? "Current process:\n" : "",
                   Process->UniqueProcessId,
                   State, Process->Pcb.State,
-                  Process->ImageFileName);
+                  Process->ImageFileName,
+                  Process->Vm.WorkingSetSize >> PAGE_SHIFT);
+
+        /* The trimming counters are in hyperspace, so only the attached process can show them */
+        if (Process == KdbCurrentProcess)
+        {
+            MmQueryWorkingSetTrimCounts(&TrimmedPages, &TrimmedPageFaults);
+            KdbpPrint("  Trimmed pages:   %lu (%lu faulted back)\n", TrimmedPages, TrimmedPageFaults);
+        }
 
         /* Release our reference, if any */
         if (ReferencedProcess)
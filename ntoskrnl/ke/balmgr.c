@@ -176,10 +176,9 @@ KeBalanceSetManager(IN PVOID Context)
             case STATUS_WAIT_0:
 
                 /* Adjust lookaside lists */
-                //ExAdjustLookasideDepth();
+                ExAdjustLookasideDepth();
 
-                /* Call the working set manager */
-                //MmWorkingSetManager();
+                /* Working sets are aged and trimmed by the MM balancer thread */
 
                 /* FIXME: Outswap stacks */
 
@@ -261,6 +261,7 @@ KiIdleLoop(VOID)
 {
     PKPRCB Prcb = KeGetCurrentPrcb();
     PKTHREAD OldThread, NewThread;
+    ULONG TickCount, KernelTime;
 
     /* Now loop forever */
     while (TRUE)
@@ -283,6 +284,20 @@ KiIdleLoop(VOID)
             KiRetireDpcList(Prcb);
         }
 
+#ifdef CONFIG_SMP
+        /*
+         * We just went idle, see if a busy processor has work to spare.
+         * The scheduler asks for this once each time it picks the idle
+         * thread, so we don't keep polling the other processors.
+         */
+        if ((Prcb->IdleSchedule) && (KeNumberProcessors > 1))
+        {
+            _enable();
+            KiIdleSchedule(Prcb);
+            _disable();
+        }
+#endif
+
         /* Check if a new thread is scheduled for execution */
         if (Prcb->NextThread)
         {
@@ -316,7 +331,13 @@ KiIdleLoop(VOID)
         else
         {
             /* Continue staying idle. Note the HAL returns with interrupts on */
+            TickCount = KeTickCount.LowPart;
+            KernelTime = Prcb->KernelTime;
             Prcb->PowerState.IdleFunction(&Prcb->PowerState);
+
+            /* Account for the clock ticks we slept through */
+            _disable();
+            KiUpdateIdleRunTime(Prcb, TickCount, KernelTime);
         }
     }
 }
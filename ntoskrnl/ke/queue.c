@@ -231,12 +231,13 @@ KeReadStateQueue(IN PKQUEUE Queue)
 }
 
 /*
- * @implemented
+ * Waits for the first entry of the queue, or returns the status that ended the wait
  */
+static
 PLIST_ENTRY
-NTAPI
-KeRemoveQueue(IN PKQUEUE Queue,
+KiRemoveQueue(IN PKQUEUE Queue,
               IN KPROCESSOR_MODE WaitMode,
+              IN BOOLEAN Alertable,
               IN PLARGE_INTEGER Timeout OPTIONAL)
 {
     PLIST_ENTRY QueueEntry;
@@ -430,6 +431,67 @@ KeRemoveQueue(IN PKQUEUE Queue,
     return QueueEntry;
 }
 
+/*
+ * @implemented
+ */
+PLIST_ENTRY
+NTAPI
+KeRemoveQueue(IN PKQUEUE Queue,
+              IN KPROCESSOR_MODE WaitMode,
+              IN PLARGE_INTEGER Timeout OPTIONAL)
+{
+    /* Queue waits are never alertable */
+    return KiRemoveQueue(Queue, WaitMode, FALSE, Timeout);
+}
+
+/*
+ * @implemented
+ */
+ULONG
+NTAPI
+KeRemoveQueueEx(IN PKQUEUE Queue,
+                IN KPROCESSOR_MODE WaitMode,
+                IN BOOLEAN Alertable,
+                IN PLARGE_INTEGER Timeout OPTIONAL,
+                OUT PLIST_ENTRY *EntryArray,
+                IN ULONG Count)
+{
+    PLIST_ENTRY QueueEntry;
+    ULONG Removed;
+    KIRQL OldIrql;
+    ASSERT_QUEUE(Queue);
+    ASSERT(Count != 0);
+
+    /* Wait for the first entry like a single remove would */
+    QueueEntry = KiRemoveQueue(Queue, WaitMode, Alertable, Timeout);
+    EntryArray[0] = QueueEntry;
+
+    /* If the wait ended for another reason, that's all the caller gets */
+    if (((NTSTATUS)(ULONG_PTR)QueueEntry == STATUS_TIMEOUT) ||
+        ((NTSTATUS)(ULONG_PTR)QueueEntry == STATUS_USER_APC) ||
+        ((NTSTATUS)(ULONG_PTR)QueueEntry == STATUS_ALERTED))
+    {
+        return 1;
+    }
+
+    /* Now grab whatever else is already queued, this thread is active anyway */
+    Removed = 1;
+    if (Count > 1)
+    {
+        OldIrql = KiAcquireDispatcherLock();
+        while ((Removed < Count) && !IsListEmpty(&Queue->EntryListHead))
+        {
+            QueueEntry = RemoveHeadList(&Queue->EntryListHead);
+            QueueEntry->Flink = NULL;
+            Queue->Header.SignalState--;
+            EntryArray[Removed++] = QueueEntry;
+        }
+        KiReleaseDispatcherLock(OldIrql);
+    }
+
+    return Removed;
+}
+
 /*
  * @implemented
  */
@@ -15,9 +15,13 @@
 #ifdef _WIN64
 # define InterlockedOrSetMember(Destination, SetMember) \
     InterlockedOr64((PLONG64)Destination, SetMember);
+# define InterlockedAndClearMember(Destination, SetMember) \
+    InterlockedAnd64((PLONG64)Destination, ~(LONG64)(SetMember));
 #else
 # define InterlockedOrSetMember(Destination, SetMember) \
     InterlockedOr((PLONG)Destination, SetMember);
+# define InterlockedAndClearMember(Destination, SetMember) \
+    InterlockedAnd((PLONG)Destination, ~(LONG)(SetMember));
 #endif
 
 /* GLOBALS *******************************************************************/
@@ -27,13 +31,181 @@ KAFFINITY KiIdleSMTSummary;
 
 /* FUNCTIONS *****************************************************************/
 
+//
+// Marks the processor idle, and its SMT set too once all of the set is idle
+//
+FORCEINLINE
+VOID
+KiSetIdleSummary(IN PKPRCB Prcb)
+{
+    KAFFINITY SmtSet = Prcb->MultiThreadProcessorSet;
+
+    InterlockedOrSetMember(&KiIdleSummary, Prcb->SetMember);
+    if ((KiIdleSummary & SmtSet) == SmtSet)
+    {
+        InterlockedOrSetMember(&KiIdleSMTSummary, SmtSet);
+
+        /* A sibling may have picked up work meanwhile */
+        if ((KiIdleSummary & SmtSet) != SmtSet)
+        {
+            InterlockedAndClearMember(&KiIdleSMTSummary, SmtSet);
+        }
+    }
+}
+
+//
+// Marks the processor busy, its SMT set isn't entirely idle anymore either
+//
+FORCEINLINE
+VOID
+KiClearIdleSummary(IN PKPRCB Prcb)
+{
+    InterlockedAndClearMember(&KiIdleSummary, Prcb->SetMember);
+    InterlockedAndClearMember(&KiIdleSMTSummary, Prcb->MultiThreadProcessorSet);
+}
+
+#ifdef CONFIG_SMP
+//
+// Takes the highest priority thread that may run on TargetPrcb off the ready
+// lists of another processor. Both PRCB locks must be held.
+//
+static
+PKTHREAD
+KiStealReadyThread(
+    _In_ PKPRCB SourcePrcb,
+    _In_ PKPRCB TargetPrcb)
+{
+    ULONG PrioritySet;
+    LONG HighPriority;
+    PLIST_ENTRY ListHead, ListEntry;
+    PKTHREAD Thread;
+
+    /* An idle processor is about to run its own ready threads */
+    if (SourcePrcb->CurrentThread == SourcePrcb->IdleThread) return NULL;
+
+    /* Scan from the highest priority down */
+    PrioritySet = SourcePrcb->ReadySummary;
+    while (PrioritySet)
+    {
+        BitScanReverse((PULONG)&HighPriority, PrioritySet);
+        PrioritySet ^= PRIORITY_MASK(HighPriority);
+        ListHead = &SourcePrcb->DispatcherReadyListHead[HighPriority];
+        for (ListEntry = ListHead->Flink;
+             ListEntry != ListHead;
+             ListEntry = ListEntry->Flink)
+        {
+            Thread = CONTAINING_RECORD(ListEntry, KTHREAD, WaitListEntry);
+            ASSERT(Thread->NextProcessor == SourcePrcb->Number);
+
+            /* Skip threads that aren't allowed to run on the idle processor */
+            if (!(Thread->Affinity & TargetPrcb->SetMember)) continue;
+
+            /* Remove it from the list */
+            if (RemoveEntryList(&Thread->WaitListEntry))
+            {
+                /* The list is empty now, reset the ready summary */
+                SourcePrcb->ReadySummary ^= PRIORITY_MASK(HighPriority);
+            }
+
+            /* It belongs to the idle processor now */
+            Thread->NextProcessor = TargetPrcb->Number;
+            return Thread;
+        }
+    }
+
+    /* Nothing suitable */
+    return NULL;
+}
+#endif
+
+//
+// Called from the idle loop when no thread has been selected for this
+// processor. Picks up local work first and otherwise pulls a ready thread
+// from a busy processor, so that wake-ups don't queue up behind one CPU.
+//
 PKTHREAD
 FASTCALL
 KiIdleSchedule(IN PKPRCB Prcb)
 {
-    /* FIXME: TODO */
-    ASSERTMSG("SMP: Not yet implemented\n", FALSE);
-    return NULL;
+    PKTHREAD Thread = NULL;
+#ifdef CONFIG_SMP
+    PKPRCB SourcePrcb;
+    ULONG i, Processor;
+
+    /* Make sure deferred threads had a chance to land anywhere first */
+    ASSERT(KeGetCurrentIrql() == DISPATCH_LEVEL);
+    KiCheckDeferredReadyList(Prcb);
+
+    /* Check if someone already gave us work, or if we have some locally */
+    KiAcquirePrcbLock(Prcb);
+    Prcb->IdleSchedule = FALSE;
+    Thread = Prcb->NextThread;
+    if (!Thread)
+    {
+        Thread = KiSelectReadyThread(0, Prcb);
+        if (Thread)
+        {
+            /* Set it up as the next thread */
+            Thread->State = Standby;
+            Prcb->NextThread = Thread;
+        }
+    }
+    KiReleasePrcbLock(Prcb);
+
+    /* Otherwise, go round the other processors, starting after us */
+    for (i = 1; !(Thread) && (i < (ULONG)KeNumberProcessors); i++)
+    {
+        Processor = (Prcb->Number + i) % KeNumberProcessors;
+        SourcePrcb = KiProcessorBlock[Processor];
+
+        /* Lockless peek first, most processors have nothing to give */
+        if (!(SourcePrcb) || !(SourcePrcb->ReadySummary)) continue;
+
+        /* Lock both processors, always lowest number first */
+        if (SourcePrcb->Number < Prcb->Number)
+        {
+            KiAcquirePrcbLock(SourcePrcb);
+            KiAcquirePrcbLock(Prcb);
+        }
+        else
+        {
+            KiAcquirePrcbLock(Prcb);
+            KiAcquirePrcbLock(SourcePrcb);
+        }
+
+        /* Someone may have readied a thread for us meanwhile */
+        Thread = Prcb->NextThread;
+        if (!Thread)
+        {
+            /* Try to take one off the busy processor */
+            Thread = KiStealReadyThread(SourcePrcb, Prcb);
+            if (Thread)
+            {
+                /* Run it next */
+                Thread->State = Standby;
+                Prcb->NextThread = Thread;
+            }
+        }
+
+        /* Release both locks */
+        KiReleasePrcbLock(SourcePrcb);
+        KiReleasePrcbLock(Prcb);
+    }
+
+    /* We aren't idle anymore if we found something */
+    if (Thread)
+    {
+        KiClearIdleSummary(Prcb);
+
+        /* Only this processor marks itself idle, so nobody can undo this */
+        ASSERT(!(KiIdleSummary & Prcb->SetMember));
+        ASSERT((Prcb->MultiThreadProcessorSet != Prcb->SetMember) ||
+               !(KiIdleSMTSummary & Prcb->SetMember));
+    }
+#else
+    UNREFERENCED_PARAMETER(Prcb);
+#endif
+    return Thread;
 }
 
 VOID
@@ -122,8 +294,12 @@ KiSelectNextProcessor(
     /* Start with the affinity */
     PreferredSet = Thread->Affinity;
 
-    /* If we have matching idle processors, use them */
-    IdleSet = PreferredSet & KiIdleSummary;
+    /* If we have matching idle processors, use them, preferring fully idle SMT sets */
+    IdleSet = PreferredSet & KiIdleSMTSummary;
+    if (IdleSet == 0)
+    {
+        IdleSet = PreferredSet & KiIdleSummary;
+    }
     if (IdleSet != 0)
     {
         PreferredSet = IdleSet;
@@ -313,6 +489,7 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
     {
         /* Clear it and set this thread as the next one */
         KiIdleSummary = 0;
+        KiIdleSMTSummary = 0;
         Thread->State = Standby;
         Prcb->NextThread = Thread;
 
@@ -360,6 +537,14 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
             Thread->State = Standby;
             Prcb->NextThread = Thread;
 
+#ifdef CONFIG_SMP
+            /* This processor has work now, stop advertising it as idle */
+            if (NextThread == Prcb->IdleThread)
+            {
+                KiClearIdleSummary(Prcb);
+            }
+#endif
+
             /* Release the lock */
             KiReleasePrcbLock(Prcb);
 
@@ -410,7 +595,7 @@ KiSelectNextThread(IN PKPRCB Prcb)
         Thread = Prcb->IdleThread;
 
         /* Enable idle scheduling */
-        InterlockedOrSetMember(&KiIdleSummary, Prcb->SetMember);
+        KiSetIdleSummary(Prcb);
         Prcb->IdleSchedule = TRUE;
 
         /* FIXME: SMT support */
@@ -458,8 +643,9 @@ KiSwapThread(IN PKTHREAD CurrentThread,
         }
         else
         {
-            /* Set the idle summary */
-            InterlockedOrSetMember(&KiIdleSummary, Prcb->SetMember);
+            /* Set the idle summary and let the idle loop look for work */
+            KiSetIdleSummary(Prcb);
+            Prcb->IdleSchedule = TRUE;
 
             /* Schedule the idle thread */
             NextThread = Prcb->IdleThread;
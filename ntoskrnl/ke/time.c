@@ -255,3 +255,35 @@ KeUpdateRunTime(IN PKTRAP_FRAME TrapFrame,
         HalRequestSoftwareInterrupt(DISPATCH_LEVEL);
     }
 }
+
+VOID
+FASTCALL
+KiUpdateIdleRunTime(IN PKPRCB Prcb,
+                    IN ULONG TickCount,
+                    IN ULONG KernelTime)
+{
+    ULONG Elapsed, Accounted, Missed;
+
+    /*
+     * Interrupts are off, so KeUpdateRunTime can't race with us.
+     * Compare the ticks that went by with the ones it accounted.
+     */
+    Elapsed = KeTickCount.LowPart - TickCount;
+    Accounted = Prcb->KernelTime - KernelTime;
+    if (Elapsed <= Accounted) return;
+
+    /* The HAL doesn't send clock IPIs to halted processors, so catch up */
+    Missed = Elapsed - Accounted;
+    Prcb->KernelTime += Missed;
+    Prcb->IdleThread->KernelTime += Missed;
+
+    /* No DPCs were requested while halted, so decay the rate accordingly */
+    Prcb->DpcRequestRate >>= min(Missed, 31);
+
+    /* And grow the maximum queue depth back once per adjustment period */
+    Missed /= KiAdjustDpcThreshold;
+    while ((Missed--) && (Prcb->MaximumDpcQueueDepth < (LONG)KiMaximumDpcQueueDepth))
+    {
+        Prcb->MaximumDpcQueueDepth++;
+    }
+}
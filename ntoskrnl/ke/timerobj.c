@@ -14,6 +14,9 @@
 
 /* GLOBALS *******************************************************************/
 
+/* Largest granularity, in clock ticks, that coalescable timers are rounded to */
+#define KI_MAXIMUM_COALESCING_TICKS 64
+
 KTIMER_TABLE_ENTRY KiTimerTableListHead[TIMER_TABLE_SIZE];
 LARGE_INTEGER KiTimeIncrementReciprocal;
 UCHAR KiTimeIncrementShiftCount;
@@ -196,6 +199,83 @@ KiCompleteTimer(IN PKTIMER Timer,
     if (RequestInterrupt) HalRequestSoftwareInterrupt(DISPATCH_LEVEL);
 }
 
+static
+VOID
+KiEncodeTolerableDelay(IN PKTIMER Timer,
+                       IN ULONG TolerableDelay)
+{
+    ULONG Ticks, Shift = 0;
+
+    /* Assume the timer can't be coalesced */
+    Timer->Header.Coalescable = FALSE;
+    Timer->Header.EncodedTolerableDelay = 0;
+
+    /* Convert the tolerable delay to clock ticks and cap it */
+    Ticks = (ULONG)min((ULONGLONG)TolerableDelay * 10000 / KeMaximumIncrement,
+                       KI_MAXIMUM_COALESCING_TICKS);
+
+    /* Use the largest power of two ticks that fits in the delay */
+    while ((2UL << Shift) <= Ticks) Shift++;
+
+    /* Rounding to a single tick doesn't buy anything */
+    if (!Shift) return;
+    Timer->Header.Coalescable = TRUE;
+    Timer->Header.EncodedTolerableDelay = Shift;
+}
+
+static
+BOOLEAN
+KiSetTimerEx(IN OUT PKTIMER Timer,
+             IN LARGE_INTEGER DueTime,
+             IN LONG Period,
+             IN ULONG TolerableDelay,
+             IN PKDPC Dpc OPTIONAL)
+{
+    KIRQL OldIrql;
+    BOOLEAN Inserted;
+    ULONG Hand = 0;
+    BOOLEAN RequestInterrupt = FALSE;
+    ASSERT_TIMER(Timer);
+    ASSERT(KeGetCurrentIrql() <= DISPATCH_LEVEL);
+    DPRINT("KiSetTimerEx(): Timer %p, DueTime %I64d, Period %d, TolerableDelay %lu, Dpc %p\n",
+           Timer, DueTime.QuadPart, Period, TolerableDelay, Dpc);
+
+    /* Lock the Database and Raise IRQL */
+    OldIrql = KiAcquireDispatcherLock();
+
+    /* Check if it's inserted, and remove it if it is */
+    Inserted = Timer->Header.Inserted;
+    if (Inserted) KxRemoveTreeTimer(Timer);
+
+    /* Set Default Timer Data */
+    Timer->Dpc = Dpc;
+    Timer->Period = Period;
+    KiEncodeTolerableDelay(Timer, TolerableDelay);
+    if (!KiComputeDueTime(Timer, DueTime, &Hand))
+    {
+        /* Signal the timer */
+        RequestInterrupt = KiSignalTimer(Timer);
+
+        /* Release the dispatcher lock */
+        KiReleaseDispatcherLockFromSynchLevel();
+
+        /* Check if we need to do an interrupt */
+        if (RequestInterrupt) HalRequestSoftwareInterrupt(DISPATCH_LEVEL);
+    }
+    else
+    {
+        /* Insert the timer */
+        Timer->Header.SignalState = FALSE;
+        KxInsertTimer(Timer, Hand);
+    }
+
+    /* Exit the dispatcher */
+    KiExitDispatcher(OldIrql);
+
+    /* Return old state */
+    return Inserted;
+}
+
 /* PUBLIC FUNCTIONS **********************************************************/
 
 /*
@@ -296,47 +376,22 @@ KeSetTimerEx(IN OUT PKTIMER Timer,
              IN LONG Period,
              IN PKDPC Dpc OPTIONAL)
 {
-    KIRQL OldIrql;
-    BOOLEAN Inserted;
-    ULONG Hand = 0;
-    BOOLEAN RequestInterrupt = FALSE;
-    ASSERT_TIMER(Timer);
-    ASSERT(KeGetCurrentIrql() <= DISPATCH_LEVEL);
-    DPRINT("KeSetTimerEx(): Timer %p, DueTime %I64d, Period %d, Dpc %p\n",
-           Timer, DueTime.QuadPart, Period, Dpc);
-
-    /* Lock the Database and Raise IRQL */
-    OldIrql = KiAcquireDispatcherLock();
-
-    /* Check if it's inserted, and remove it if it is */
-    Inserted = Timer->Header.Inserted;
-    if (Inserted) KxRemoveTreeTimer(Timer);
-
-    /* Set Default Timer Data */
-    Timer->Dpc = Dpc;
-    Timer->Period = Period;
-    if (!KiComputeDueTime(Timer, DueTime, &Hand))
-    {
-        /* Signal the timer */
-        RequestInterrupt = KiSignalTimer(Timer);
-
-        /* Release the dispatcher lock */
-        KiReleaseDispatcherLockFromSynchLevel();
-
-        /* Check if we need to do an interrupt */
-        if (RequestInterrupt) HalRequestSoftwareInterrupt(DISPATCH_LEVEL);
-    }
-    else
-    {
-        /* Insert the timer */
-        Timer->Header.SignalState = FALSE;
-        KxInsertTimer(Timer, Hand);
-    }
-
-    /* Exit the dispatcher */
-    KiExitDispatcher(OldIrql);
+    /* Call the internal function without any tolerable delay */
+    return KiSetTimerEx(Timer, DueTime, Period, 0, Dpc);
+}
 
-    /* Return old state */
-    return Inserted;
+/*
+ * @implemented
+ */
+BOOLEAN
+NTAPI
+KeSetCoalescableTimer(IN OUT PKTIMER Timer,
+                      IN LARGE_INTEGER DueTime,
+                      IN ULONG Period,
+                      IN ULONG TolerableDelay,
+                      IN PKDPC Dpc OPTIONAL)
+{
+    /* Let the timer expire up to TolerableDelay ms late, together with others */
+    return KiSetTimerEx(Timer, DueTime, Period, TolerableDelay, Dpc);
 }
 
@@ -47,6 +47,7 @@ SIZE_T PoolTrackTableSize, PoolTrackTableMask;
 SIZE_T PoolBigPageTableSize, PoolBigPageTableHash;
 ULONG ExpBigTableExpansionFailed;
 PPOOL_TRACKER_TABLE PoolTrackTable;
+PPOOL_TRACKER_TABLE ExPoolTagTables[MAXIMUM_PROCESSORS];
 PPOOL_TRACKER_BIG_PAGES PoolBigPageTable;
 KSPIN_LOCK ExpTaggedPoolLock;
 ULONG PoolHitTag;
@@ -470,6 +471,135 @@ ExpComputePartialHashForAddress(IN PVOID BaseAddress)
     return (Result >> 24) ^ (Result >> 16) ^ (Result >> 8) ^ Result;
 }
 
+//
+// Each processor updates its own copy of the tag tracker table, so that the
+// interlocked counter updates done on every allocation and free stay in the
+// local cache. All the tables have the same size and hash, and any tag found
+// in a per-processor table is also present in the boot table (PoolTrackTable),
+// which is the one used by the boot processor. Queries add the tables up.
+//
+FORCEINLINE
+PPOOL_TRACKER_TABLE
+ExpGetPoolTrackTable(VOID)
+{
+    PPOOL_TRACKER_TABLE Table;
+
+    //
+    // Use the boot table until this processor gets its own
+    //
+    Table = ExPoolTagTables[KeGetCurrentProcessorNumber()];
+    return Table ? Table : PoolTrackTable;
+}
+
+static
+PPOOL_TRACKER_TABLE
+ExpFindPoolTrackerEntry(IN PPOOL_TRACKER_TABLE Table,
+                        IN ULONG Key,
+                        IN BOOLEAN Create)
+{
+    ULONG Hash, Index;
+    KIRQL OldIrql;
+    PPOOL_TRACKER_TABLE TableEntry;
+
+    //
+    // Compute the hash for this key, and loop all the possible buckets
+    //
+    Hash = ExpComputeHashForTag(Key, PoolTrackTableMask);
+    Index = Hash;
+    while (TRUE)
+    {
+        //
+        // Do we already have an entry for this tag?
+        //
+        TableEntry = &Table[Hash];
+        if (TableEntry->Key == Key) return TableEntry;
+
+        //
+        // We don't have an entry yet, but we've found a free bucket for it
+        //
+        if (!(TableEntry->Key) && (Hash != PoolTrackTableSize - 1))
+        {
+            if (!Create) return NULL;
+
+            //
+            // A tag must be in the boot table before any other table gets it
+            //
+            if ((Table != PoolTrackTable) &&
+                !ExpFindPoolTrackerEntry(PoolTrackTable, Key, TRUE))
+            {
+                return NULL;
+            }
+
+            //
+            // We need to hold the lock while creating a new entry, since other
+            // processors might be in this code path as well
+            //
+            ExAcquireSpinLock(&ExpTaggedPoolLock, &OldIrql);
+            if (!TableEntry->Key)
+            {
+                //
+                // We've won the race, so now create this entry in the bucket
+                //
+                TableEntry->Key = Key;
+            }
+            ExReleaseSpinLock(&ExpTaggedPoolLock, OldIrql);
+
+            //
+            // Now we force the loop to run again, and we should now end up in
+            // the code path above which returns the entry
+            //
+            continue;
+        }
+
+        //
+        // This path is hit when we don't have an entry, and the current bucket
+        // is full, so we simply try the next one
+        //
+        Hash = (Hash + 1) & PoolTrackTableMask;
+        if (Hash == Index) break;
+    }
+
+    //
+    // And finally this path is hit when all the buckets are full, and we need
+    // some expansion. This path is not yet supported in ReactOS
+    //
+    return NULL;
+}
+
+static
+VOID
+ExpSumPoolTrackerEntry(IN PPOOL_TRACKER_TABLE BootEntry,
+                       OUT PPOOL_TRACKER_TABLE Sum)
+{
+    PPOOL_TRACKER_TABLE TableEntry;
+    ULONG i;
+
+    //
+    // Start with the boot processor's counters
+    //
+    *Sum = *BootEntry;
+    if (!Sum->Key) return;
+
+    //
+    // And add the ones of every other processor which has seen this tag.
+    // Frees are not always done on the processor which did the allocation,
+    // so a single table may well show more frees than allocations.
+    //
+    for (i = 1; i < (ULONG)KeNumberProcessors; i++)
+    {
+        if (!ExPoolTagTables[i]) continue;
+        TableEntry = ExpFindPoolTrackerEntry(ExPoolTagTables[i], Sum->Key, FALSE);
+        if (!TableEntry) continue;
+
+        Sum->NonPagedAllocs += TableEntry->NonPagedAllocs;
+        Sum->NonPagedFrees += TableEntry->NonPagedFrees;
+        Sum->NonPagedBytes += TableEntry->NonPagedBytes;
+        Sum->PagedAllocs += TableEntry->PagedAllocs;
+        Sum->PagedFrees += TableEntry->PagedFrees;
+        Sum->PagedBytes += TableEntry->PagedBytes;
+    }
+}
+
 #if DBG
 /*
  * FORCEINLINE
@@ -539,8 +669,13 @@ MiDumpPoolConsumers(BOOLEAN CalledFromDbg, ULONG Tag, ULONG Mask, ULONG Flags)
     for (i = 0; i < PoolTrackTableSize; ++i)
     {
         PPOOL_TRACKER_TABLE TableEntry;
+        POOL_TRACKER_TABLE Sum;
 
-        TableEntry = &PoolTrackTable[i];
+        //
+        // Add up the counters of all processors for this tag
+        //
+        ExpSumPoolTrackerEntry(&PoolTrackTable[i], &Sum);
+        TableEntry = &Sum;
 
         //
         // We only care about tags which have allocated memory
@@ -761,9 +896,7 @@ ExpRemovePoolTracker(IN ULONG Key,
                      IN SIZE_T NumberOfBytes,
                      IN POOL_TYPE PoolType)
 {
-    ULONG Hash, Index;
-    PPOOL_TRACKER_TABLE Table, TableEntry;
-    SIZE_T TableMask, TableSize;
+    PPOOL_TRACKER_TABLE TableEntry;
 
     //
     // Remove the PROTECTED_POOL flag which is not part of the tag
@@ -777,73 +910,30 @@ ExpRemovePoolTracker(IN ULONG Key,
     if (Key == PoolHitTag) DbgBreakPoint();
 
     //
-    // Why the double indirection? Because normally this function is also used
-    // when doing session pool allocations, which has another set of tables,
-    // sizes, and masks that live in session pool. Now we don't support session
-    // pool so we only ever use the regular tables, but I'm keeping the code this
-    // way so that the day we DO support session pool, it won't require that
-    // many changes
+    // Find the entry in this processor's table. The allocation may have been
+    // tracked by another processor, in which case the entry gets created here.
     //
-    Table = PoolTrackTable;
-    TableMask = PoolTrackTableMask;
-    TableSize = PoolTrackTableSize;
-    DBG_UNREFERENCED_LOCAL_VARIABLE(TableSize);
-
-    //
-    // Compute the hash for this key, and loop all the possible buckets
-    //
-    Hash = ExpComputeHashForTag(Key, TableMask);
-    Index = Hash;
-    while (TRUE)
+    TableEntry = ExpFindPoolTrackerEntry(ExpGetPoolTrackTable(), Key, TRUE);
+    if (!TableEntry)
     {
-        //
-        // Have we found the entry for this tag? */
-        //
-        TableEntry = &Table[Hash];
-        if (TableEntry->Key == Key)
-        {
-            //
-            // Decrement the counters depending on if this was paged or nonpaged
-            // pool
-            //
-            if ((PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
-            {
-                InterlockedIncrement(&TableEntry->NonPagedFrees);
-                InterlockedExchangeAddSizeT(&TableEntry->NonPagedBytes,
-                                            -(SSIZE_T)NumberOfBytes);
-                return;
-            }
-            InterlockedIncrement(&TableEntry->PagedFrees);
-            InterlockedExchangeAddSizeT(&TableEntry->PagedBytes,
-                                        -(SSIZE_T)NumberOfBytes);
-            return;
-        }
-
-        //
-        // We should have only ended up with an empty entry if we've reached
-        // the last bucket
-        //
-        if (!TableEntry->Key)
-        {
-            DPRINT1("Empty item reached in tracker table. Hash=0x%lx, TableMask=0x%lx, Tag=0x%08lx, NumberOfBytes=%lu, PoolType=%d\n",
-                    Hash, TableMask, Key, (ULONG)NumberOfBytes, PoolType);
-            ASSERT(Hash == TableMask);
-        }
-
-        //
-        // This path is hit when we don't have an entry, and the current bucket
-        // is full, so we simply try the next one
-        //
-        Hash = (Hash + 1) & TableMask;
-        if (Hash == Index) break;
+        DPRINT1("Out of pool tag space, ignoring...\n");
+        return;
     }
 
     //
-    // And finally this path is hit when all the buckets are full, and we need
-    // some expansion. This path is not yet supported in ReactOS and so we'll
-    // ignore the tag
+    // Decrement the counters depending on if this was paged or nonpaged
+    // pool
     //
-    DPRINT1("Out of pool tag space, ignoring...\n");
+    if ((PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
+    {
+        InterlockedIncrement(&TableEntry->NonPagedFrees);
+        InterlockedExchangeAddSizeT(&TableEntry->NonPagedBytes,
+                                    -(SSIZE_T)NumberOfBytes);
+        return;
+    }
+    InterlockedIncrement(&TableEntry->PagedFrees);
+    InterlockedExchangeAddSizeT(&TableEntry->PagedBytes,
+                                -(SSIZE_T)NumberOfBytes);
 }
 
 VOID
@@ -852,10 +942,7 @@ ExpInsertPoolTracker(IN ULONG Key,
                      IN SIZE_T NumberOfBytes,
                      IN POOL_TYPE PoolType)
 {
-    ULONG Hash, Index;
-    KIRQL OldIrql;
-    PPOOL_TRACKER_TABLE Table, TableEntry;
-    SIZE_T TableMask, TableSize;
+    PPOOL_TRACKER_TABLE TableEntry;
 
     //
     // Remove the PROTECTED_POOL flag which is not part of the tag
@@ -879,88 +966,79 @@ ExpInsertPoolTracker(IN ULONG Key,
     ASSERT(!(PoolType & SESSION_POOL_MASK));
 
     //
-    // Why the double indirection? Because normally this function is also used
-    // when doing session pool allocations, which has another set of tables,
-    // sizes, and masks that live in session pool. Now we don't support session
-    // pool so we only ever use the regular tables, but I'm keeping the code this
-    // way so that the day we DO support session pool, it won't require that
-    // many changes
+    // Find or create the entry in this processor's table. Session pool would
+    // use the session's own tables here, which ReactOS doesn't support yet.
     //
-    Table = PoolTrackTable;
-    TableMask = PoolTrackTableMask;
-    TableSize = PoolTrackTableSize;
-    DBG_UNREFERENCED_LOCAL_VARIABLE(TableSize);
+    TableEntry = ExpFindPoolTrackerEntry(ExpGetPoolTrackTable(), Key, TRUE);
+    if (!TableEntry)
+    {
+        DPRINT1("Out of pool tag space, ignoring...\n");
+        return;
+    }
 
     //
-    // Compute the hash for this key, and loop all the possible buckets
+    // Increment the counters depending on if this was paged or nonpaged
+    // pool
     //
-    Hash = ExpComputeHashForTag(Key, TableMask);
-    Index = Hash;
-    while (TRUE)
+    if ((PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
     {
-        //
-        // Do we already have an entry for this tag? */
-        //
-        TableEntry = &Table[Hash];
-        if (TableEntry->Key == Key)
+        InterlockedIncrement(&TableEntry->NonPagedAllocs);
+        InterlockedExchangeAddSizeT(&TableEntry->NonPagedBytes, NumberOfBytes);
+        return;
+    }
+    InterlockedIncrement(&TableEntry->PagedAllocs);
+    InterlockedExchangeAddSizeT(&TableEntry->PagedBytes, NumberOfBytes);
+}
+
+CODE_SEG("INIT")
+VOID
+NTAPI
+ExpInitializeProcessorPoolTrackers(VOID)
+{
+    PPOOL_TRACKER_TABLE Table;
+    KIRQL OldIrql;
+    SIZE_T i;
+    CCHAR Cpu;
+
+    //
+    // The boot processor keeps using the boot table
+    //
+    ExPoolTagTables[0] = PoolTrackTable;
+
+    //
+    // Now allocate a table for each of the other processors
+    //
+    for (Cpu = 1; Cpu < KeNumberProcessors; Cpu++)
+    {
+        Table = ExAllocatePoolWithTag(NonPagedPool,
+                                      PoolTrackTableSize * sizeof(POOL_TRACKER_TABLE),
+                                      'looP');
+        if (!Table)
         {
             //
-            // Increment the counters depending on if this was paged or nonpaged
-            // pool
+            // Not fatal, this processor will just share the boot table
             //
-            if ((PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
-            {
-                InterlockedIncrement(&TableEntry->NonPagedAllocs);
-                InterlockedExchangeAddSizeT(&TableEntry->NonPagedBytes, NumberOfBytes);
-                return;
-            }
-            InterlockedIncrement(&TableEntry->PagedAllocs);
-            InterlockedExchangeAddSizeT(&TableEntry->PagedBytes, NumberOfBytes);
-            return;
+            DPRINT1("No pool tag table for processor %d\n", Cpu);
+            continue;
         }
+        RtlZeroMemory(Table, PoolTrackTableSize * sizeof(POOL_TRACKER_TABLE));
 
         //
-        // We don't have an entry yet, but we've found a free bucket for it
+        // Copy the tags from the boot table, so the hot tags seeded at init
+        // time are found on the first probe on this processor as well
         //
-        if (!(TableEntry->Key) && (Hash != PoolTrackTableSize - 1))
+        ExAcquireSpinLock(&ExpTaggedPoolLock, &OldIrql);
+        for (i = 0; i < PoolTrackTableSize; i++)
         {
-            //
-            // We need to hold the lock while creating a new entry, since other
-            // processors might be in this code path as well
-            //
-            ExAcquireSpinLock(&ExpTaggedPoolLock, &OldIrql);
-            if (!PoolTrackTable[Hash].Key)
-            {
-                //
-                // We've won the race, so now create this entry in the bucket
-                //
-                ASSERT(Table[Hash].Key == 0);
-                PoolTrackTable[Hash].Key = Key;
-                TableEntry->Key = Key;
-            }
-            ExReleaseSpinLock(&ExpTaggedPoolLock, OldIrql);
-
-            //
-            // Now we force the loop to run again, and we should now end up in
-            // the code path above which does the interlocked increments...
-            //
-            continue;
+            Table[i].Key = PoolTrackTable[i].Key;
         }
+        ExReleaseSpinLock(&ExpTaggedPoolLock, OldIrql);
 
         //
-        // This path is hit when we don't have an entry, and the current bucket
-        // is full, so we simply try the next one
+        // And publish it
         //
-        Hash = (Hash + 1) & TableMask;
-        if (Hash == Index) break;
+        InterlockedExchangePointer((PVOID*)&ExPoolTagTables[(int)Cpu], Table);
     }
-
-    //
-    // And finally this path is hit when all the buckets are full, and we need
-    // some expansion. This path is not yet supported in ReactOS and so we'll
-    // ignore the tag
-    //
-    DPRINT1("Out of pool tag space, ignoring...\n");
 }
 
 CODE_SEG("INIT")
@@ -1324,6 +1402,7 @@ ExpGetPoolTagInfoTarget(IN PKDPC Dpc,
                         IN PVOID SystemArgument2)
 {
     PPOOL_DPC_CONTEXT Context = DeferredContext;
+    SIZE_T i;
     UNREFERENCED_PARAMETER(Dpc);
     ASSERT(KeGetCurrentIrql() == DISPATCH_LEVEL);
 
@@ -1332,9 +1411,14 @@ ExpGetPoolTagInfoTarget(IN PKDPC Dpc,
     //
     if (KeSignalCallDpcSynchronize(SystemArgument2))
     {
-        RtlCopyMemory(Context->PoolTrackTable,
-                      PoolTrackTable,
-                      Context->PoolTrackTableSize * sizeof(POOL_TRACKER_TABLE));
+        for (i = 0; i < Context->PoolTrackTableSize; i++)
+        {
+            //
+            // Add up the counters of all processors, every tag is in the
+            // boot table
+            //
+            ExpSumPoolTrackerEntry(&PoolTrackTable[i], &Context->PoolTrackTable[i]);
+        }
 
         //
         // This is here because ReactOS does not yet support expansion
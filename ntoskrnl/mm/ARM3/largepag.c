@@ -25,6 +25,7 @@ WCHAR MmLargePageDriverBuffer[512] = {0};
 ULONG MmLargePageDriverBufferLength = -1;
 LIST_ENTRY MiLargePageDriverList;
 BOOLEAN MiLargePageAllDrivers;
+SIZE_T MmLargePageMinimum;
 
 /* FUNCTIONS ******************************************************************/
 
@@ -33,6 +34,11 @@ VOID
 NTAPI
 MiInitializeLargePageSupport(VOID)
 {
+#if defined(_M_IX86) || defined(_M_AMD64)
+    /* User large pages are mapped straight from the PDE, if the CPU can do it */
+    if (KeFeatureBits & KF_LARGE_PAGE) MmLargePageMinimum = PDE_MAPPED_VA;
+#endif
+
 #if _MI_PAGING_LEVELS > 2
     DPRINT1("MiInitializeLargePageSupport: PAE/x64 Not Implemented\n");
     //ASSERT(FALSE);
@@ -101,4 +107,306 @@ MiInitializeDriverLargePageList(VOID)
     }
 }
 
+BOOLEAN
+NTAPI
+MiIsLargePageProtection(IN ULONG ProtectionMask)
+{
+    /* Large pages never fault, so they can't be guard, no-access or copy-on-write */
+    switch (ProtectionMask)
+    {
+        case MM_READONLY:
+        case MM_EXECUTE:
+        case MM_EXECUTE_READ:
+        case MM_READWRITE:
+        case MM_EXECUTE_READWRITE:
+            return TRUE;
+
+        default:
+            return FALSE;
+    }
+}
+
+static
+PFN_NUMBER
+MiAllocateLargePage(IN PMMPTE PteAddress,
+                    IN ULONG ProtectionMask)
+{
+    PFN_NUMBER PageFrameIndex, i;
+    PMMPFN Pfn1;
+    KIRQL OldIrql;
+
+    /* Don't eat into the pages the balancer is trying to keep free */
+    if (MmAvailablePages < (PTE_PER_PAGE + MiBalancerLowWatermark)) return 0;
+
+    /* Find a free physical run that is naturally aligned to the large page size */
+    PageFrameIndex = MiFindContiguousPages(0,
+                                           MmHighestPhysicalPage,
+                                           PTE_PER_PAGE,
+                                           PTE_PER_PAGE,
+                                           MmCached);
+    if (!PageFrameIndex) return 0;
+
+    /* The run mixes free and zeroed pages, so wipe all of it */
+    for (i = 0; i < PTE_PER_PAGE; i++) MiZeroPhysicalPage(PageFrameIndex + i);
+
+    /* Now record who maps these pages */
+    OldIrql = MiAcquirePfnLock();
+    Pfn1 = MI_PFN_ELEMENT(PageFrameIndex);
+    for (i = 0; i < PTE_PER_PAGE; i++, Pfn1++)
+    {
+        Pfn1->PteAddress = PteAddress;
+        Pfn1->OriginalPte.u.Long = 0;
+        Pfn1->OriginalPte.u.Soft.Protection = ProtectionMask;
+        Pfn1->u3.e1.Modified = 1;
+    }
+    MiReleasePfnLock(OldIrql);
+
+    return PageFrameIndex;
+}
+
+static
+VOID
+MiFreeLargePage(IN PFN_NUMBER PageFrameIndex)
+{
+    PMMPFN Pfn1;
+    PFN_NUMBER i;
+
+    /* Make sure this is a run we handed out */
+    MI_ASSERT_PFN_LOCK_HELD();
+    Pfn1 = MI_PFN_ELEMENT(PageFrameIndex);
+    ASSERT(Pfn1->u3.e1.StartOfAllocation == 1);
+    ASSERT((Pfn1 + PTE_PER_PAGE - 1)->u3.e1.EndOfAllocation == 1);
+    Pfn1->u3.e1.StartOfAllocation = 0;
+    (Pfn1 + PTE_PER_PAGE - 1)->u3.e1.EndOfAllocation = 0;
+
+    /* Drop the mapping reference. Pages still locked for I/O go away on unlock */
+    for (i = 0; i < PTE_PER_PAGE; i++, Pfn1++)
+    {
+        ASSERT(Pfn1->u2.ShareCount == 1);
+        MI_SET_PFN_DELETED(Pfn1);
+        MiDecrementShareCount(Pfn1, PageFrameIndex + i);
+    }
+}
+
+static
+VOID
+MiWriteLargePde(IN PEPROCESS Process,
+                IN PMMPDE PointerPde,
+                IN PFN_NUMBER PageFrameIndex,
+                IN ULONG ProtectionMask)
+{
+    MMPDE TempPde;
+
+    /* The working set lock protects the page tables */
+    ASSERT(PsGetCurrentThread()->OwnsProcessWorkingSetExclusive);
+
+#if _MI_PAGING_LEVELS == 4
+    /* Make sure the upper levels exist, same order as the fault handler */
+    if (!MiPdeToPxe(PointerPde)->u.Hard.Valid)
+    {
+        MiMakeSystemAddressValid(MiPdeToPpe(PointerPde), Process);
+    }
+#endif
+#if _MI_PAGING_LEVELS >= 3
+    if (!MiPdeToPpe(PointerPde)->u.Hard.Valid)
+    {
+        MiMakeSystemAddressValid(PointerPde, Process);
+    }
+
+    /* The page directory counts its PDEs just like a page table counts PTEs */
+    MiIncrementPageTableReferences(MiPdeToPte(PointerPde));
+#endif
+
+    /* Build a user PDE that maps the whole run */
+    MI_MAKE_HARDWARE_PTE(&TempPde, PointerPde, ProtectionMask, PageFrameIndex);
+    TempPde.u.Hard.LargePage = 1;
+    if (MI_IS_PAGE_WRITEABLE(&TempPde)) MI_MAKE_DIRTY_PAGE(&TempPde);
+    MI_WRITE_VALID_PDE(PointerPde, TempPde);
+}
+
+NTSTATUS
+NTAPI
+MiMapLargePages(IN PEPROCESS Process,
+                IN PMMVAD Vad)
+{
+    PMMPDE PointerPde, LastPde;
+    PMMPTE ProtoPte = NULL;
+    PFN_NUMBER PageFrameIndex;
+    ULONG ProtectionMask;
+    PETHREAD CurrentThread = PsGetCurrentThread();
+
+    /* The VAD was aligned on large page boundaries when it was inserted */
+    ASSERT((Vad->u.VadFlags.VadType == VadLargePages) ||
+           (Vad->u.VadFlags.VadType == VadLargePageSection));
+    ASSERT((Vad->StartingVpn % PTE_PER_PAGE) == 0);
+    ASSERT(((Vad->EndingVpn + 1) % PTE_PER_PAGE) == 0);
+    ASSERT(Vad->u.VadFlags.MemCommit == 0);
+    ASSERT(Process == PsGetCurrentProcess());
+
+    PointerPde = MiAddressToPde((PVOID)(Vad->StartingVpn << PAGE_SHIFT));
+    LastPde = MiAddressToPde((PVOID)(Vad->EndingVpn << PAGE_SHIFT));
+    ProtectionMask = Vad->u.VadFlags.Protection;
+
+    /* Section views use the runs the segment already owns */
+    if (!Vad->u.VadFlags.PrivateMemory) ProtoPte = Vad->FirstPrototypePte;
+
+    while (PointerPde <= LastPde)
+    {
+        if (ProtoPte)
+        {
+            /* The prototype PTE of the first page in the run gives its base */
+            ASSERT(ProtoPte->u.Hard.Valid == 1);
+            PageFrameIndex = PFN_FROM_PTE(ProtoPte);
+            ProtoPte += PTE_PER_PAGE;
+        }
+        else
+        {
+            /* Private memory gets a new run for each PDE */
+            PageFrameIndex = MiAllocateLargePage((PMMPTE)PointerPde, ProtectionMask);
+            if (!PageFrameIndex)
+            {
+                /* Undo what we did so far and fail */
+                DPRINT1("Out of contiguous memory for large pages\n");
+                MiLockProcessWorkingSetUnsafe(Process, CurrentThread);
+                MiDeleteLargePages(Process, Vad);
+                MiUnlockProcessWorkingSetUnsafe(Process, CurrentThread);
+                return STATUS_INSUFFICIENT_RESOURCES;
+            }
+        }
+
+        /* Hook it up */
+        MiLockProcessWorkingSetUnsafe(Process, CurrentThread);
+        MiWriteLargePde(Process, PointerPde, PageFrameIndex, ProtectionMask);
+        MiUnlockProcessWorkingSetUnsafe(Process, CurrentThread);
+        PointerPde++;
+    }
+
+    /* Large pages are always committed, and from now on the VAD may be torn down */
+    if (Vad->u.VadFlags.PrivateMemory)
+    {
+        Vad->u.VadFlags.CommitCharge = Vad->EndingVpn - Vad->StartingVpn + 1;
+    }
+    Vad->u.VadFlags.MemCommit = 1;
+    return STATUS_SUCCESS;
+}
+
+VOID
+NTAPI
+MiDeleteLargePages(IN PEPROCESS Process,
+                   IN PMMVAD Vad)
+{
+    PMMPDE PointerPde, LastPde;
+    PFN_NUMBER PageFrameIndex;
+    KIRQL OldIrql;
+
+    /* The caller owns the working set */
+    ASSERT(PsGetCurrentThread()->OwnsProcessWorkingSetExclusive);
+    ASSERT(Process == PsGetCurrentProcess());
+
+    PointerPde = MiAddressToPde((PVOID)(Vad->StartingVpn << PAGE_SHIFT));
+    LastPde = MiAddressToPde((PVOID)(Vad->EndingVpn << PAGE_SHIFT));
+
+    OldIrql = MiAcquirePfnLock();
+    for (; PointerPde <= LastPde; PointerPde++)
+    {
+        /* A failed mapping may not have gotten this far */
+#if _MI_PAGING_LEVELS == 4
+        if (!MiPdeToPxe(PointerPde)->u.Hard.Valid) continue;
+#endif
+#if _MI_PAGING_LEVELS >= 3
+        if (!MiPdeToPpe(PointerPde)->u.Hard.Valid) continue;
+#endif
+        if (!PointerPde->u.Hard.Valid) continue;
+        ASSERT(MI_IS_PAGE_LARGE(PointerPde));
+
+        /* Kill the PDE and the translation for it */
+        PageFrameIndex = PFN_FROM_PTE(PointerPde);
+        MI_ERASE_PTE((PMMPTE)PointerPde);
+        KeInvalidateTlbEntry(MiPdeToAddress(PointerPde));
+
+#if _MI_PAGING_LEVELS >= 3
+        /* Let the page directory go once nothing else is in it */
+        if (MiDecrementPageTableReferences(MiPdeToPte(PointerPde)) == 0)
+        {
+            MiDeletePte(MiPdeToPpe(PointerPde), PointerPde, Process, NULL);
+#if _MI_PAGING_LEVELS == 4
+            if (MiDecrementPageTableReferences(PointerPde) == 0)
+            {
+                MiDeletePte(MiPdeToPxe(PointerPde), MiPdeToPpe(PointerPde), Process, NULL);
+            }
+#endif
+        }
+#endif
+
+        /* Section runs belong to the segment, private ones go back now */
+        if (Vad->u.VadFlags.PrivateMemory) MiFreeLargePage(PageFrameIndex);
+    }
+    MiReleasePfnLock(OldIrql);
+}
+
+NTSTATUS
+NTAPI
+MiAllocateLargePageSegment(IN PSEGMENT Segment,
+                           IN ULONG ProtectionMask)
+{
+    PMMPTE PointerPte, LastPte;
+    PFN_NUMBER PageFrameIndex, i;
+    MMPTE TempPte;
+    PAGED_CODE();
+
+    /* The segment was sized in whole large pages */
+    ASSERT((Segment->TotalNumberOfPtes % PTE_PER_PAGE) == 0);
+    PointerPte = Segment->PrototypePte;
+    LastPte = PointerPte + Segment->TotalNumberOfPtes;
+
+    while (PointerPte < LastPte)
+    {
+        /* Grab a run for this chunk of prototype PTEs */
+        PageFrameIndex = MiAllocateLargePage(PointerPte, ProtectionMask);
+        if (!PageFrameIndex)
+        {
+            DPRINT1("Out of contiguous memory for a large page section\n");
+            MiDeleteLargePageSegment(Segment);
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        /* The prototype PTEs stay valid for as long as the segment lives */
+        for (i = 0; i < PTE_PER_PAGE; i++, PointerPte++)
+        {
+            MI_MAKE_HARDWARE_PTE(&TempPte, PointerPte, ProtectionMask, PageFrameIndex + i);
+            *PointerPte = TempPte;
+        }
+    }
+
+    Segment->SegmentFlags.LargePages = 1;
+    return STATUS_SUCCESS;
+}
+
+VOID
+NTAPI
+MiDeleteLargePageSegment(IN PSEGMENT Segment)
+{
+    PMMPTE PointerPte, LastPte;
+    PFN_NUMBER PageFrameIndex;
+    KIRQL OldIrql;
+    PAGED_CODE();
+
+    PointerPte = Segment->PrototypePte;
+    LastPte = PointerPte + Segment->TotalNumberOfPtes;
+
+    /* Stop at the first chunk that never got a run */
+    while ((PointerPte < LastPte) && (PointerPte->u.Hard.Valid))
+    {
+        /* Capture the run and wipe the prototype PTEs while they're pageable */
+        PageFrameIndex = PFN_FROM_PTE(PointerPte);
+        RtlZeroMemory(PointerPte, PTE_PER_PAGE * sizeof(MMPTE));
+        PointerPte += PTE_PER_PAGE;
+
+        /* Now give it back */
+        OldIrql = MiAcquirePfnLock();
+        MiFreeLargePage(PageFrameIndex);
+        MiReleasePfnLock(OldIrql);
+    }
+}
+
 /* EOF */
@@ -1184,6 +1184,31 @@ MmProbeAndLockPages(IN PMDL Mdl,
     //
     do
     {
+        //
+        // Large pages are always resident and have no PTE of their own, so the
+        // frame comes straight from the PDE
+        //
+        if (
+#if (_MI_PAGING_LEVELS == 4)
+            (PointerPxe->u.Hard.Valid == 1) &&
+#endif
+#if (_MI_PAGING_LEVELS >= 3)
+            (PointerPpe->u.Hard.Valid == 1) &&
+#endif
+            (PointerPde->u.Hard.Valid == 1) &&
+            (MI_IS_PAGE_LARGE(PointerPde)))
+        {
+            if ((Operation != IoReadAccess) && !(MI_IS_PAGE_WRITEABLE(PointerPde)))
+            {
+                Status = STATUS_ACCESS_VIOLATION;
+                goto CleanupWithLock;
+            }
+
+            PageFrameIndex = PFN_FROM_PTE(PointerPde) +
+                             MiAddressToPteOffset(MiPteToAddress(PointerPte));
+            goto ReferencePage;
+        }
+
         //
         // Assume failure and check for non-mapped pages
         //
@@ -1334,6 +1359,7 @@ MmProbeAndLockPages(IN PMDL Mdl,
         // Grab the PFN
         //
         PageFrameIndex = PFN_FROM_PTE(PointerPte);
+ReferencePage:
         Pfn1 = MiGetPfnEntry(PageFrameIndex);
         if (Pfn1)
         {
@@ -520,6 +520,22 @@ typedef struct _MM_SESSION_SPACE
     LONG ImageLoadingCount;
 } MM_SESSION_SPACE, *PMM_SESSION_SPACE;
 
+//
+// Per-processor cache of zeroed pages, so that demand zero faults on user
+// addresses don't have to take the PFN lock. Every hit is one PFN lock
+// acquisition avoided, the cache is refilled in batches under the lock.
+//
+#define MI_PAGE_CACHE_DEPTH     16
+
+typedef struct _MI_PAGE_CACHE
+{
+    ULONG Count;
+    ULONG Hits;         // Pages of the wanted color taken without the PFN lock
+    ULONG ColorMisses;  // Pages of another color taken without the PFN lock
+    ULONG Refills;      // Batches taken from the zeroed lists
+    PFN_NUMBER Pages[MI_PAGE_CACHE_DEPTH];
+} MI_PAGE_CACHE, *PMI_PAGE_CACHE;
+
 extern PMM_SESSION_SPACE MmSessionSpace;
 extern MMPTE HyperTemplatePte;
 extern MMPDE ValidKernelPde;
@@ -547,6 +563,7 @@ extern WCHAR MmVerifyDriverBuffer[512];
 extern WCHAR MmLargePageDriverBuffer[512];
 extern LIST_ENTRY MiLargePageDriverList;
 extern BOOLEAN MiLargePageAllDrivers;
+extern SIZE_T MmLargePageMinimum;
 extern ULONG MmVerifyDriverBufferLength;
 extern ULONG MmLargePageDriverBufferLength;
 extern SIZE_T MmSizeOfNonPagedPoolInBytes;
@@ -636,6 +653,7 @@ extern PFN_NUMBER MmSystemPageDirectory[PPE_PER_PAGE];
 extern PMMPTE MmSharedUserDataPte;
 extern LIST_ENTRY MmProcessList;
 extern KEVENT MmZeroingPageEvent;
+extern MI_PAGE_CACHE MiPageCache[MAXIMUM_PROCESSORS];
 extern ULONG MmSystemPageColor;
 extern ULONG MmProcessColorSeed;
 extern PMMWSL MmWorkingSetList;
@@ -2064,6 +2082,32 @@ MiInitializePfn(
     IN BOOLEAN Modified
 );
 
+VOID
+NTAPI
+MiInitializeCachedPfn(
+    IN PFN_NUMBER PageFrameIndex,
+    IN PMMPTE PointerPte,
+    IN BOOLEAN Modified
+);
+
+PFN_NUMBER
+NTAPI
+MiRemovePageFromCache(
+    IN ULONG Color
+);
+
+VOID
+NTAPI
+MiRefillPageCache(
+    VOID
+);
+
+VOID
+NTAPI
+MiFlushPageCaches(
+    VOID
+);
+
 NTSTATUS
 NTAPI
 MiInitializeAndChargePfn(
@@ -2096,6 +2140,13 @@ MiDecrementShareCount(
     IN PFN_NUMBER PageFrameIndex
 );
 
+PFN_NUMBER
+NTAPI
+MiRemovePageByColor(
+    IN PFN_NUMBER PageIndex,
+    IN ULONG Color
+);
+
 PFN_NUMBER
 NTAPI
 MiRemoveAnyPage(
@@ -2162,6 +2213,39 @@ MiSyncCachedRanges(
     VOID
 );
 
+BOOLEAN
+NTAPI
+MiIsLargePageProtection(
+    IN ULONG ProtectionMask
+);
+
+NTSTATUS
+NTAPI
+MiMapLargePages(
+    IN PEPROCESS Process,
+    IN PMMVAD Vad
+);
+
+VOID
+NTAPI
+MiDeleteLargePages(
+    IN PEPROCESS Process,
+    IN PMMVAD Vad
+);
+
+NTSTATUS
+NTAPI
+MiAllocateLargePageSegment(
+    IN PSEGMENT Segment,
+    IN ULONG ProtectionMask
+);
+
+VOID
+NTAPI
+MiDeleteLargePageSegment(
+    IN PSEGMENT Segment
+);
+
 BOOLEAN
 NTAPI
 MiIsPfnInUse(
@@ -1566,6 +1566,12 @@ MmDumpArmPfnDatabase(IN BOOLEAN StatusOnly)
     DbgPrint("Free:                 %5d pages\t[%6d KB]\n", FreePages,    (FreePages      << PAGE_SHIFT) / 1024);
     DbgPrint("Other:                %5d pages\t[%6d KB]\n", OtherPages,   (OtherPages     << PAGE_SHIFT) / 1024);
     DbgPrint("-----------------------------------------\n");
+    for (i = 0; i < (ULONG)KeNumberProcessors; i++)
+    {
+        DbgPrint("Page cache %2lu:        %5lu pages\t[%lu hits, %lu color misses, %lu refills]\n",
+                 i, MiPageCache[i].Count, MiPageCache[i].Hits, MiPageCache[i].ColorMisses, MiPageCache[i].Refills);
+    }
+    DbgPrint("-----------------------------------------\n");
 #if MI_TRACE_PFNS
     OtherPages = UsageBucket[MI_USAGE_BOOT_DRIVER];
     DbgPrint("Boot Images:          %5d pages\t[%6d KB]\n", OtherPages,   (OtherPages     << PAGE_SHIFT) / 1024);
@@ -2461,7 +2467,7 @@ MmArmInitSystem(IN ULONG Phase,
         /* Now setup the shared user data fields */
         ASSERT(SharedUserData->NumberOfPhysicalPages == 0);
         SharedUserData->NumberOfPhysicalPages = MmNumberOfPhysicalPages;
-        SharedUserData->LargePageMinimum = 0;
+        SharedUserData->LargePageMinimum = MmLargePageMinimum;
 
         /* Check for workstation (Wi for WinNT) */
         if (MmProductType == '\0i\0W')
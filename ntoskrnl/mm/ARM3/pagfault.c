@@ -644,6 +644,29 @@ MiResolveDemandZeroFault(IN PVOID Address,
         Color = 0xFFFFFFFF;
     }
 
+    /* For user PTEs, try to get a zeroed page from this processor's cache */
+    if ((Color != 0xFFFFFFFF) && (PointerPte <= MiHighestUserPte))
+    {
+        KIRQL CacheIrql;
+
+        KeRaiseIrql(DISPATCH_LEVEL, &CacheIrql);
+        PageFrameNumber = MiRemovePageFromCache(Color);
+        if (PageFrameNumber)
+        {
+            /* Got one, and the PFN lock was never needed */
+            MiInitializeCachedPfn(PageFrameNumber, PointerPte, TRUE);
+            KeGetCurrentPrcb()->MmDemandZeroCount++;
+        }
+        KeLowerIrql(CacheIrql);
+
+        if (PageFrameNumber)
+        {
+            Process->NumberOfPrivatePages++;
+            NeedZero = FALSE;
+            goto MakePteValid;
+        }
+    }
+
     /* Check if the PFN database should be acquired */
     if (OldIrql == MM_NOIRQL)
     {
@@ -717,6 +740,9 @@ MiResolveDemandZeroFault(IN PVOID Address,
     /* Do we have the lock? */
     if (HaveLock)
     {
+        /* Stock up this processor's cache for the next faults, while we have the lock */
+        if (PointerPte <= MiHighestUserPte) MiRefillPageCache();
+
         /* Release it */
         MiReleasePfnLock(OldIrql);
 
@@ -727,6 +753,8 @@ MiResolveDemandZeroFault(IN PVOID Address,
     /* Zero the page if need be */
     if (NeedZero) MiZeroPfn(PageFrameNumber);
 
+MakePteValid:
+
     /* Fault on user PDE, or fault on user PTE? */
     if (PointerPte <= MiHighestUserPte)
     {
@@ -1023,6 +1051,13 @@ MiResolveTransitionFault(IN BOOLEAN StoreInstruction,
     /* One more transition fault! */
     InterlockedIncrement(&KeGetCurrentPrcb()->MmTransitionCount);
 
+    /*
+     * For private user pages, this means the page was trimmed from our working set.
+     * Shared prototype pages may have been trimmed from somebody else's, don't count them.
+     */
+    if ((FaultingAddress <= MM_HIGHEST_USER_ADDRESS) && (Pfn1->u3.e1.PrototypePte == 0))
+        MiCountTrimmedPageFault();
+
     /* This is from ARM3 -- Windows normally handles this here */
     ASSERT(Pfn1->u4.InPageError == 0);
 
@@ -2262,10 +2297,22 @@ UserFault:
         ASSERT(KeAreAllApcsDisabled() == TRUE);
         ASSERT(PointerPde->u.Hard.Valid == 1);
     }
-    else
+    else if (MI_IS_PAGE_LARGE(PointerPde))
     {
-        /* Not yet implemented in ReactOS */
-        ASSERT(MI_IS_PAGE_LARGE(PointerPde) == FALSE);
+        /*
+         * Large pages are mapped up front and never trimmed, so the mapping
+         * is already there: this is either a stale TB entry, which is
+         * resolved now, or an access the protection doesn't allow.
+         */
+        Status = STATUS_SUCCESS;
+        if ((MI_IS_WRITE_ACCESS(FaultCode) && !MI_IS_PAGE_WRITEABLE(PointerPde)) ||
+            (MI_IS_INSTRUCTION_FETCH(FaultCode) && !MI_IS_PAGE_EXECUTABLE(PointerPde)))
+        {
+            Status = STATUS_ACCESS_VIOLATION;
+        }
+
+        MiUnlockProcessWorkingSet(CurrentProcess, CurrentThread);
+        return Status;
     }
 
     /* Now capture the PTE. */
@@ -60,6 +60,8 @@ PMMPFNLIST MmPageLocationList[] =
     NULL
 };
 
+MI_PAGE_CACHE MiPageCache[MAXIMUM_PROCESSORS];
+
 ULONG MI_PFN_CURRENT_USAGE;
 CHAR MI_PFN_CURRENT_PROCESS_NAME[16] = "None yet";
 
@@ -106,13 +108,14 @@ MiDecrementAvailablePages(
 
     /* One less page */
     MmAvailablePages--;
-    if (MmAvailablePages < MmMinimumFreePages)
+    if (MmAvailablePages < MiBalancerLowWatermark)
     {
         /* FIXME: Should wake up the MPW and working set manager, if we had one */
 
-        DPRINT1("Running low on pages: %lu remaining\n", MmAvailablePages);
+        if (MmAvailablePages < MmMinimumFreePages)
+            DPRINT1("Running low on pages: %lu remaining\n", MmAvailablePages);
 
-        /* Call RosMm and see if it can release any pages for us */
+        /* Call RosMm and see if it can release any pages for us, before we run out */
         MmRebalanceMemoryConsumers();
     }
 }
@@ -1036,6 +1039,198 @@ MiInitializePfn(IN PFN_NUMBER PageFrameIndex,
     Pfn1->u2.ShareCount++;
 }
 
+VOID
+NTAPI
+MiInitializeCachedPfn(IN PFN_NUMBER PageFrameIndex,
+                      IN PMMPTE PointerPte,
+                      IN BOOLEAN Modified)
+{
+    PMMPFN Pfn1;
+    PMMPTE PointerPtePte;
+    PFN_NUMBER PageTableIndex;
+
+    /* Only user PTEs, whose page table the working set lock keeps valid */
+    ASSERT(KeGetCurrentIrql() == DISPATCH_LEVEL);
+    ASSERT(PointerPte <= MiHighestUserPte);
+    ASSERT(PsGetCurrentThread()->OwnsProcessWorkingSetExclusive);
+    ASSERT(PointerPte->u.Hard.Valid == 0);
+
+    /* The page came from our processor cache, nobody else knows about it */
+    Pfn1 = MI_PFN_ELEMENT(PageFrameIndex);
+    Pfn1->PteAddress = PointerPte;
+    Pfn1->OriginalPte = *PointerPte;
+    ASSERT(!((Pfn1->OriginalPte.u.Soft.Prototype == 0) &&
+             (Pfn1->OriginalPte.u.Soft.Transition == 1)));
+    ASSERT(Pfn1->u3.e2.ReferenceCount == 0);
+    Pfn1->u3.e2.ReferenceCount = 1;
+    Pfn1->u2.ShareCount = 1;
+    Pfn1->u3.e1.PageLocation = ActiveAndValid;
+    ASSERT(Pfn1->u3.e1.Rom == 0);
+    Pfn1->u3.e1.Modified = Modified;
+
+    /* Get the PFN for the page table */
+    PointerPtePte = MiAddressToPte(PointerPte);
+    ASSERT(PointerPtePte->u.Hard.Valid == 1);
+    PageTableIndex = PFN_FROM_PTE(PointerPtePte);
+    ASSERT(PageTableIndex != 0);
+    Pfn1->u4.PteFrame = PageTableIndex;
+
+    /*
+     * Every other change to a user page table's share count is made with the
+     * owning process' working set lock held exclusively, like we hold it. So
+     * nothing can race with this update or drop the count to zero under us,
+     * and it doesn't need the PFN lock. Keep it atomic for lock-free readers.
+     */
+    ASSERT(MI_PFN_ELEMENT(PageTableIndex)->u2.ShareCount != 0);
+    InterlockedIncrementSizeT(&MI_PFN_ELEMENT(PageTableIndex)->u2.ShareCount);
+}
+
+static
+VOID
+MiEmptyPageCache(IN PMI_PAGE_CACHE PageCache)
+{
+    /* The pages are still zeroed, put them back where they came from */
+    MI_ASSERT_PFN_LOCK_HELD();
+    while (PageCache->Count != 0)
+    {
+        MiInsertPageInList(&MmZeroedPageListHead, PageCache->Pages[--PageCache->Count]);
+    }
+}
+
+static
+VOID
+NTAPI
+MiFlushPageCacheTarget(IN PKDPC Dpc,
+                       IN PVOID DeferredContext,
+                       IN PVOID SystemArgument1,
+                       IN PVOID SystemArgument2)
+{
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(DeferredContext);
+    ASSERT(KeGetCurrentIrql() == DISPATCH_LEVEL);
+
+    /* Each processor empties its own cache, so the fault path needs no lock for it */
+    if (MiPageCache[KeGetCurrentProcessorNumber()].Count != 0)
+    {
+        MiAcquirePfnLockAtDpcLevel();
+        MiEmptyPageCache(&MiPageCache[KeGetCurrentProcessorNumber()]);
+        MiReleasePfnLockFromDpcLevel();
+    }
+
+    KeSignalCallDpcSynchronize(SystemArgument2);
+    KeSignalCallDpcDone(SystemArgument1);
+}
+
+VOID
+NTAPI
+MiFlushPageCaches(VOID)
+{
+    ULONG i;
+    BOOLEAN Cached = FALSE;
+
+    /* Don't bother every processor if there's nothing to give back */
+    for (i = 0; i < (ULONG)KeNumberProcessors; i++)
+    {
+        if (MiPageCache[i].Count != 0) Cached = TRUE;
+    }
+    if (!Cached) return;
+
+    /* Idle processors won't fault again any time soon, so reach out to them */
+    KeGenericCallDpc(MiFlushPageCacheTarget, NULL);
+}
+
+PFN_NUMBER
+NTAPI
+MiGetCachedPageCount(VOID)
+{
+    PFN_NUMBER Count = 0;
+    ULONG i;
+
+    /* Only statistics, no need to look at the caches atomically */
+    for (i = 0; i < (ULONG)KeNumberProcessors; i++)
+    {
+        Count += MiPageCache[i].Count;
+    }
+
+    return Count;
+}
+
+PFN_NUMBER
+NTAPI
+MiRemovePageFromCache(IN ULONG Color)
+{
+    PMI_PAGE_CACHE PageCache;
+    PFN_NUMBER PageIndex;
+    ULONG i;
+
+    /* We must stay on this processor while we look at its cache */
+    ASSERT(KeGetCurrentIrql() == DISPATCH_LEVEL);
+    PageCache = &MiPageCache[KeGetCurrentProcessorNumber()];
+
+    if (PageCache->Count == 0)
+    {
+        return 0;
+    }
+
+    /* Prefer a page of the wanted color, otherwise take the last one */
+    i = PageCache->Count - 1;
+    while ((i != 0) && ((PageCache->Pages[i] & MmSecondaryColorMask) != Color))
+    {
+        i--;
+    }
+    if ((PageCache->Pages[i] & MmSecondaryColorMask) == Color)
+    {
+        PageCache->Hits++;
+    }
+    else
+    {
+        PageCache->ColorMisses++;
+        i = PageCache->Count - 1;
+    }
+
+    PageIndex = PageCache->Pages[i];
+    PageCache->Pages[i] = PageCache->Pages[--PageCache->Count];
+
+    ASSERT(MI_PFN_ELEMENT(PageIndex)->u3.e2.ReferenceCount == 0);
+    return PageIndex;
+}
+
+VOID
+NTAPI
+MiRefillPageCache(VOID)
+{
+    PMI_PAGE_CACHE PageCache;
+    PFN_NUMBER PageIndex;
+
+    MI_ASSERT_PFN_LOCK_HELD();
+    PageCache = &MiPageCache[KeGetCurrentProcessorNumber()];
+
+    /* Give the pages back if memory is getting tight */
+    if (MmAvailablePages < MmLowMemoryThreshold)
+    {
+        MiEmptyPageCache(PageCache);
+        return;
+    }
+
+    /* Only cache pages we know are already zeroed, and when there is plenty */
+    if (MmAvailablePages < MmPlentyFreePages)
+    {
+        return;
+    }
+
+    PageCache->Refills++;
+    while (PageCache->Count < MI_PAGE_CACHE_DEPTH)
+    {
+        PageIndex = MiRemoveZeroPageSafe(MI_GET_NEXT_COLOR());
+        if (PageIndex == 0)
+        {
+            break;
+        }
+
+        PageCache->Pages[PageCache->Count++] = PageIndex;
+    }
+}
+
 VOID
 NTAPI
 MiInitializePfnAndMakePteValid(IN PFN_NUMBER PageFrameIndex,
@@ -1310,8 +1310,10 @@ MmCleanProcessAddressSpace(IN PEPROCESS Process)
         ASSERT(VadTree->NumberGenericTableElements >= 1);
         MiRemoveNode((PMMADDRESS_NODE)Vad, VadTree);
 
-        /* Only regular VADs supported for now */
-        ASSERT(Vad->u.VadFlags.VadType == VadNone);
+        /* Only regular and large page VADs supported for now */
+        ASSERT((Vad->u.VadFlags.VadType == VadNone) ||
+               (Vad->u.VadFlags.VadType == VadLargePages) ||
+               (Vad->u.VadFlags.VadType == VadLargePageSection));
 
         /* Check if this is a section VAD */
         if (!(Vad->u.VadFlags.PrivateMemory) && (Vad->ControlArea))
@@ -1319,6 +1321,14 @@ MmCleanProcessAddressSpace(IN PEPROCESS Process)
             /* Remove the view */
             MiRemoveMappedView(Process, Vad);
         }
+        else if (Vad->u.VadFlags.VadType == VadLargePages)
+        {
+            /* Unmap and free the physical runs */
+            MiDeleteLargePages(Process, Vad);
+
+            /* Release the working set */
+            MiUnlockProcessWorkingSetUnsafe(Process, Thread);
+        }
         else
         {
             /* Delete the addresses */
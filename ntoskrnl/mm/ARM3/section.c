@@ -613,6 +613,15 @@ MiSegmentDelete(IN PSEGMENT Segment)
     ASSERT(ControlArea->u.Flags.GlobalOnlyPerSession == 0);
     ASSERT(ControlArea->u.Flags.Rom == 0);
 
+    /* Large page segments own whole physical runs instead of single pages */
+    if (SegmentFlags.LargePages)
+    {
+        MiDeleteLargePageSegment(Segment);
+        ExFreePool(ControlArea);
+        ExFreePool(Segment);
+        return;
+    }
+
     /* Get the subsection and PTEs for this segment */
     Subsection = (PSUBSECTION)(ControlArea + 1);
     PointerPte = Subsection->SubsectionBase;
@@ -774,16 +783,24 @@ MiRemoveMappedView(IN PEPROCESS CurrentProcess,
     ControlArea = Vad->ControlArea;
 
     /* We only support non-extendable, non-image, pagefile-backed regular sections */
-    ASSERT(Vad->u.VadFlags.VadType == VadNone);
+    ASSERT((Vad->u.VadFlags.VadType == VadNone) ||
+           (Vad->u.VadFlags.VadType == VadLargePageSection));
     ASSERT(Vad->u2.VadFlags2.ExtendableFile == FALSE);
     ASSERT(ControlArea);
     ASSERT(ControlArea->FilePointer == NULL);
     ASSERT(!MI_IS_MEMORY_AREA_VAD(Vad));
 
     /* Delete the actual virtual memory pages */
-    MiDeleteVirtualAddresses(Vad->StartingVpn << PAGE_SHIFT,
-                             (Vad->EndingVpn << PAGE_SHIFT) | (PAGE_SIZE - 1),
-                             Vad);
+    if (Vad->u.VadFlags.VadType == VadLargePageSection)
+    {
+        MiDeleteLargePages(CurrentProcess, Vad);
+    }
+    else
+    {
+        MiDeleteVirtualAddresses(Vad->StartingVpn << PAGE_SHIFT,
+                                 (Vad->EndingVpn << PAGE_SHIFT) | (PAGE_SIZE - 1),
+                                 Vad);
+    }
 
     /* Release the working set */
     MiUnlockProcessWorkingSetUnsafe(CurrentProcess, CurrentThread);
@@ -888,6 +905,15 @@ MiUnmapViewOfSection(IN PEPROCESS Process,
     /* Not currently supported */
     ASSERT(Vad->u.VadFlags.VadType != VadRotatePhysical);
 
+    /* A large page view can't go away while its PDEs are still being written */
+    if ((Vad->u.VadFlags.VadType == VadLargePageSection) && !(Vad->u.VadFlags.MemCommit))
+    {
+        DPRINT1("Large page view is still being created\n");
+        if (!Flags) MmUnlockAddressSpace(&Process->Vm);
+        Status = STATUS_NOT_MAPPED_VIEW;
+        goto Quickie;
+    }
+
     /* FIXME: Remove VAD charges */
 
     /* Lock the working set */
@@ -1058,6 +1084,9 @@ MiMapViewInSystemSpace(
     ASSERT(ControlArea->u.Flags.Rom == 0);
     ASSERT(ControlArea->u.Flags.WasPurged == 0);
 
+    /* Large page sections can only be mapped into processes, using large PDEs */
+    if (ControlArea->Segment->SegmentFlags.LargePages) return STATUS_NOT_SUPPORTED;
+
     /* Increase the reference and map count on the control area, no purges yet */
     Status = MiCheckPurgeAndUpMapCount(ControlArea, FALSE);
     ASSERT(NT_SUCCESS(Status));
@@ -1261,8 +1290,28 @@ MiMapViewOfDataSection(IN PCONTROL_AREA ControlArea,
         QuotaCharge = BYTES_TO_PAGES(CommitSize);
     }
 
-    /* ARM3 does not currently support large pages */
-    ASSERT(Segment->SegmentFlags.LargePages == 0);
+    /* Large page views must line up with the physical runs of the segment */
+    if (Segment->SegmentFlags.LargePages)
+    {
+        if ((PteOffset % PTE_PER_PAGE) ||
+            ((ULONG_PTR)*BaseAddress & (MmLargePageMinimum - 1)))
+        {
+            DPRINT1("Large page view is not large page aligned\n");
+            MiDereferenceControlArea(ControlArea);
+            return STATUS_MAPPED_ALIGNMENT;
+        }
+
+        if (!MiIsLargePageProtection(ProtectionMask))
+        {
+            DPRINT1("Invalid protection for a large page view\n");
+            MiDereferenceControlArea(ControlArea);
+            return STATUS_INVALID_PAGE_PROTECTION;
+        }
+
+        /* The segment is made of whole large pages, so this still fits */
+        *ViewSize = ALIGN_UP_BY(*ViewSize, MmLargePageMinimum);
+        Granularity = MmLargePageMinimum;
+    }
 
     /* Calculate how many pages the region spans */
     ViewSizeInPages = BYTES_TO_PAGES(*ViewSize);
@@ -1286,6 +1335,7 @@ MiMapViewOfDataSection(IN PCONTROL_AREA ControlArea,
     Vad->u.VadFlags.Protection = ProtectionMask;
     Vad->u2.VadFlags2.FileOffset = (ULONG)(SectionOffset->QuadPart >> 16);
     Vad->u2.VadFlags2.Inherit = (InheritDisposition == ViewShare);
+    if (Segment->SegmentFlags.LargePages) Vad->u.VadFlags.VadType = VadLargePageSection;
     if ((AllocationType & SEC_NO_CHANGE) || (Section->u.Flags.NoChange))
     {
         /* This isn't really implemented yet, but handle setting the flag */
@@ -1391,6 +1441,15 @@ MiMapViewOfDataSection(IN PCONTROL_AREA ControlArea,
         return Status;
     }
 
+    /* Large page views point their PDEs straight at the segment's runs */
+    if (Segment->SegmentFlags.LargePages)
+    {
+        MmLockAddressSpace(&Process->Vm);
+        Status = MiMapLargePages(Process, (PMMVAD)Vad);
+        MmUnlockAddressSpace(&Process->Vm);
+        ASSERT(NT_SUCCESS(Status));
+    }
+
     /* Windows stores this for accounting purposes, do so as well */
     if (!Segment->u2.FirstMappedVa) Segment->u2.FirstMappedVa = (PVOID)StartAddress;
 
@@ -1430,15 +1489,20 @@ MiCreatePagingFileMap(OUT PSEGMENT *Segment,
     PCONTROL_AREA ControlArea;
     PSEGMENT NewSegment;
     PSUBSECTION Subsection;
+    NTSTATUS Status;
     PAGED_CODE();
 
-    /* No large pages in ARM3 yet */
-    ASSERT((AllocationAttributes & SEC_LARGE_PAGES) == 0);
-
     /* Pagefile-backed sections need a known size */
     if (MaximumSize == 0)
         return STATUS_INVALID_PARAMETER_4;
 
+    /* Large page sections are made of whole large pages */
+    if (AllocationAttributes & SEC_LARGE_PAGES)
+    {
+        ASSERT(AllocationAttributes & SEC_COMMIT);
+        MaximumSize = ALIGN_UP_BY(MaximumSize, MmLargePageMinimum);
+    }
+
     /* Calculate the maximum size possible, given the Prototype PTEs we'll need */
     SizeLimit = MmSizeOfPagedPoolInBytes - sizeof(SEGMENT);
     SizeLimit /= sizeof(MMPTE);
@@ -1532,6 +1596,19 @@ MiCreatePagingFileMap(OUT PSEGMENT *Segment,
 #else
     RtlFillMemoryUlong(PointerPte, PteCount * sizeof(MMPTE), TempPte.u.Long);
 #endif
+
+    /* Large page sections get their physical runs right away */
+    if (AllocationAttributes & SEC_LARGE_PAGES)
+    {
+        Status = MiAllocateLargePageSegment(NewSegment, ProtectionMask);
+        if (!NT_SUCCESS(Status))
+        {
+            ExFreePoolWithTag(ControlArea, 'tCmM');
+            ExFreePoolWithTag(NewSegment, 'tSmM');
+            return Status;
+        }
+    }
+
     return STATUS_SUCCESS;
 }
 
@@ -2302,8 +2379,18 @@ MmCreateArm3Section(OUT PVOID *SectionObject,
         /* A handle must be supplied with SEC_IMAGE, as this is the no-handle path */
         if (AllocationAttributes & SEC_IMAGE) return STATUS_INVALID_FILE_FOR_SECTION;
 
-        /* Not yet supported */
-        ASSERT((AllocationAttributes & SEC_LARGE_PAGES) == 0);
+        /* Large page sections are committed up front and need the privilege */
+        if (AllocationAttributes & SEC_LARGE_PAGES)
+        {
+            if (!MmLargePageMinimum) return STATUS_NOT_SUPPORTED;
+            if (!(AllocationAttributes & SEC_COMMIT)) return STATUS_INVALID_PARAMETER_6;
+            if (!MiIsLargePageProtection(ProtectionMask)) return STATUS_INVALID_PAGE_PROTECTION;
+            if (!SeSinglePrivilegeCheck(SeLockMemoryPrivilege, PreviousMode))
+            {
+                DPRINT1("Privilege not held for SEC_LARGE_PAGES\n");
+                return STATUS_PRIVILEGE_NOT_HELD;
+            }
+        }
 
         /* So this must be a pagefile-backed section, create the mappings needed */
         Status = MiCreatePagingFileMap(&NewSegment,
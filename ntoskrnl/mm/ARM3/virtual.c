@@ -1489,6 +1489,15 @@ MiQueryAddressState(IN PVOID Va,
     ASSERT((Vad->StartingVpn <= ((ULONG_PTR)Va >> PAGE_SHIFT)) &&
            (Vad->EndingVpn >= ((ULONG_PTR)Va >> PAGE_SHIFT)));
 
+    /* Large pages are committed as a whole for the lifetime of the VAD */
+    if ((Vad->u.VadFlags.VadType == VadLargePages) ||
+        (Vad->u.VadFlags.VadType == VadLargePageSection))
+    {
+        *ReturnedProtect = MmProtectToValue[Vad->u.VadFlags.Protection];
+        *NextVa = (PVOID)((Vad->EndingVpn + 1) << PAGE_SHIFT);
+        return MEM_COMMIT;
+    }
+
     /* Only normal VADs supported */
     ASSERT(Vad->u.VadFlags.VadType == VadNone);
 
@@ -4511,7 +4520,7 @@ NtAllocateVirtualMemory(IN HANDLE ProcessHandle,
         if (!(AllocationType & MEM_COMMIT))
         {
             DPRINT1("Must supply MEM_COMMIT with MEM_LARGE_PAGES\n");
-            return STATUS_INVALID_PARAMETER_5;
+            return STATUS_INVALID_PARAMETER;
         }
 
         /* These flags are not allowed with large page allocations */
@@ -4651,14 +4660,43 @@ NtAllocateVirtualMemory(IN HANDLE ProcessHandle,
     }
 
     //
-    // Fail on the things we don't yet support
+    // Large pages are reserved and committed in one go, in whole large pages
     //
-    if ((AllocationType & MEM_LARGE_PAGES) == MEM_LARGE_PAGES)
+    if (AllocationType & MEM_LARGE_PAGES)
     {
-        DPRINT1("MEM_LARGE_PAGES not supported\n");
-        Status = STATUS_INVALID_PARAMETER;
-        goto FailPathNoLock;
+        if (!MmLargePageMinimum)
+        {
+            DPRINT1("MEM_LARGE_PAGES not supported on this processor\n");
+            Status = STATUS_NOT_SUPPORTED;
+            goto FailPathNoLock;
+        }
+
+        if ((PBaseAddress) && !(AllocationType & MEM_RESERVE))
+        {
+            DPRINT1("Cannot commit large pages in an existing reservation\n");
+            Status = STATUS_INVALID_PARAMETER_5;
+            goto FailPathNoLock;
+        }
+
+        if (((ULONG_PTR)PBaseAddress & (MmLargePageMinimum - 1)) ||
+            (PRegionSize & (MmLargePageMinimum - 1)))
+        {
+            DPRINT1("Large page allocation is not large page aligned\n");
+            Status = STATUS_INVALID_PARAMETER;
+            goto FailPathNoLock;
+        }
+
+        if (!MiIsLargePageProtection(ProtectionMask))
+        {
+            DPRINT1("Invalid protection for large pages\n");
+            Status = STATUS_INVALID_PAGE_PROTECTION;
+            goto FailPathNoLock;
+        }
     }
+
+    //
+    // Fail on the things we don't yet support
+    //
     if ((AllocationType & MEM_PHYSICAL) == MEM_PHYSICAL)
     {
         DPRINT1("MEM_PHYSICAL not supported\n");
@@ -4750,11 +4788,22 @@ NtAllocateVirtualMemory(IN HANDLE ProcessHandle,
         }
 
         RtlZeroMemory(Vad, sizeof(MMVAD_LONG));
-        if (AllocationType & MEM_COMMIT) Vad->u.VadFlags.MemCommit = 1;
         Vad->u.VadFlags.Protection = ProtectionMask;
         Vad->u.VadFlags.PrivateMemory = 1;
         Vad->ControlArea = NULL; // For Memory-Area hack
 
+        //
+        // Large page VADs only become committed once their PDEs are written
+        //
+        if (AllocationType & MEM_LARGE_PAGES)
+        {
+            Vad->u.VadFlags.VadType = VadLargePages;
+        }
+        else if (AllocationType & MEM_COMMIT)
+        {
+            Vad->u.VadFlags.MemCommit = 1;
+        }
+
         //
         // Insert the VAD
         //
@@ -4762,7 +4811,8 @@ NtAllocateVirtualMemory(IN HANDLE ProcessHandle,
                                &StartingAddress,
                                PRegionSize,
                                HighestAddress,
-                               MM_VIRTMEM_GRANULARITY,
+                               (AllocationType & MEM_LARGE_PAGES) ?
+                               MmLargePageMinimum : MM_VIRTMEM_GRANULARITY,
                                AllocationType);
         if (!NT_SUCCESS(Status))
         {
@@ -4771,6 +4821,29 @@ NtAllocateVirtualMemory(IN HANDLE ProcessHandle,
             goto FailPathNoLock;
         }
 
+        //
+        // Back large page VADs with physical runs right away. Nobody can free
+        // the VAD until MemCommit is set, so only we can take it out again
+        //
+        if (AllocationType & MEM_LARGE_PAGES)
+        {
+            MmLockAddressSpace(&Process->Vm);
+            Status = MiMapLargePages(Process, Vad);
+            if (!NT_SUCCESS(Status))
+            {
+                MiLockProcessWorkingSetUnsafe(Process, PsGetCurrentThread());
+                MiRemoveNode((PMMADDRESS_NODE)Vad, &Process->VadRoot);
+                MiUnlockProcessWorkingSetUnsafe(Process, PsGetCurrentThread());
+            }
+            MmUnlockAddressSpace(&Process->Vm);
+
+            if (!NT_SUCCESS(Status))
+            {
+                ExFreePoolWithTag(Vad, 'SdaV');
+                goto FailPathNoLock;
+            }
+        }
+
         //
         // Detach and dereference the target process if
         // it was different from the current process
@@ -5355,9 +5428,32 @@ NtFreeVirtualMemory(IN HANDLE ProcessHandle,
     if (FreeType & MEM_RELEASE)
     {
         //
-        // ARM3 only supports this VAD in this path
+        // Large page VADs go away as a whole, and only once they are mapped
+        //
+        if (Vad->u.VadFlags.VadType == VadLargePages)
+        {
+            if (!Vad->u.VadFlags.MemCommit)
+            {
+                DPRINT1("Large page VAD is still being created\n");
+                Status = STATUS_MEMORY_NOT_ALLOCATED;
+                goto FailPath;
+            }
+
+            if ((PRegionSize) &&
+                (((StartingAddress >> PAGE_SHIFT) != Vad->StartingVpn) ||
+                 ((EndingAddress >> PAGE_SHIFT) != Vad->EndingVpn)))
+            {
+                DPRINT1("Cannot release part of a large page allocation\n");
+                Status = STATUS_UNABLE_TO_FREE_VM;
+                goto FailPath;
+            }
+        }
+
         //
-        ASSERT(Vad->u.VadFlags.VadType == VadNone);
+        // ARM3 only supports these VADs in this path
+        //
+        ASSERT((Vad->u.VadFlags.VadType == VadNone) ||
+               (Vad->u.VadFlags.VadType == VadLargePages));
 
         //
         // Is the caller trying to remove the whole VAD, or remove only a portion
@@ -5559,7 +5655,14 @@ NtFreeVirtualMemory(IN HANDLE ProcessHandle,
         // to do that and then release the working set, since we're done messing
         // around with process pages.
         //
-        MiDeleteVirtualAddresses(StartingAddress, EndingAddress, NULL);
+        if ((Vad) && (Vad->u.VadFlags.VadType == VadLargePages))
+        {
+            MiDeleteLargePages(Process, Vad);
+        }
+        else
+        {
+            MiDeleteVirtualAddresses(StartingAddress, EndingAddress, NULL);
+        }
         MiUnlockProcessWorkingSetUnsafe(Process, CurrentThread);
         Status = STATUS_SUCCESS;
 
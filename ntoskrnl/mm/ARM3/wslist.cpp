@@ -15,6 +15,17 @@
 #define MODULE_INVOLVED_IN_ARM3
 #include "miarm.h"
 
+/* TYPES **********************************************************************/
+
+/* Per-process trimming statistics, kept in hyperspace right after the working set list header */
+typedef struct _MI_WS_TRIM_COUNTS
+{
+    ULONG TrimmedPageCount;
+    ULONG TrimmedPageFaultCount;
+} MI_WS_TRIM_COUNTS, *PMI_WS_TRIM_COUNTS;
+
+#define MI_WS_TRIM_COUNTS_OF(WsList) (reinterpret_cast<PMI_WS_TRIM_COUNTS>((WsList) + 1))
+
 /* GLOBALS ********************************************************************/
 PMMWSL MmWorkingSetList;
 KEVENT MmWorkingSetManagerEvent;
@@ -215,17 +226,27 @@ RemoveFromWsList(PMMWSL WsList, PVOID Address)
     FreeWsleIndex(WsList, Pfn1->u1.WsIndex);
 }
 
+/* Number of working set manager passes a page must go unaccessed before being trimmed */
+#define MI_WSLE_MAX_AGE 3
+
+/* Number of entries aged on each working set manager pass */
+#define MI_WSLE_AGING_BATCH 1024
+
 static
-ULONG
-TrimWsList(PMMWSL WsList)
+VOID
+AgeWsList(PMMSUPPORT Vm)
 {
+    PMMWSL WsList = Vm->VmWorkingSetList;
+
     /* This should be done under WS lock */
-    ASSERT(MM_ANY_WS_LOCK_HELD(PsGetCurrentThread()));
+    ASSERT(MM_ANY_WS_LOCK_HELD_EXCLUSIVE(PsGetCurrentThread()));
 
-    ULONG Ret = 0;
+    /* Carry on from where the previous pass stopped, and start over once we are past the end */
+    ULONG i = Vm->NextAgingSlot;
+    if ((i < WsList->FirstDynamic) || (i >= WsList->LastEntry))
+        i = WsList->FirstDynamic;
 
-    /* Walk the array */
-    for (ULONG i = WsList->FirstDynamic; i < WsList->LastEntry; i++)
+    for (ULONG Count = 0; (Count < MI_WSLE_AGING_BATCH) && (i < WsList->LastEntry); Count++, i++)
     {
         MMWSLE& Entry = WsList->Wsle[i];
         if (!Entry.u1.e1.Valid)
@@ -240,21 +261,41 @@ TrimWsList(PMMWSL WsList)
         /* This must be valid */
         ASSERT(PointerPte->u.Hard.Valid);
 
-        /* If the PTE was accessed, simply reset and that's the end of it */
         if (PointerPte->u.Hard.Accessed)
         {
+            /* Accessed since this entry was last aged: young again */
             Entry.u1.e1.Age = 0;
             PointerPte->u.Hard.Accessed = 0;
             KeInvalidateTlbEntry(Entry.u1.VirtualAddress);
-            continue;
         }
-
-        /* If the entry is not so old, just age it */
-        if (Entry.u1.e1.Age < 3)
+        else if (Entry.u1.e1.Age < MI_WSLE_MAX_AGE)
         {
             Entry.u1.e1.Age++;
-            continue;
         }
+    }
+
+    Vm->NextAgingSlot = i;
+}
+
+static
+ULONG
+TrimWsList(PMMWSL WsList, ULONG Target, ULONG MinimumAge)
+{
+    /* This should be done under WS lock */
+    ASSERT(MM_ANY_WS_LOCK_HELD_EXCLUSIVE(PsGetCurrentThread()));
+
+    ULONG Ret = 0;
+
+    /* Walk the array */
+    for (ULONG i = WsList->FirstDynamic; (i < WsList->LastEntry) && (Ret < Target); i++)
+    {
+        MMWSLE& Entry = WsList->Wsle[i];
+        if (!Entry.u1.e1.Valid)
+            continue;
+
+        /* Only take the pages which are old enough */
+        if (Entry.u1.e1.Age < MinimumAge)
+            continue;
 
         if ((Entry.u1.e1.LockedInMemory) || (Entry.u1.e1.LockedInWs))
         {
@@ -266,6 +307,13 @@ TrimWsList(PMMWSL WsList)
         if (MI_IS_PAGE_TABLE_ADDRESS(Entry.u1.VirtualAddress))
             continue;
 
+        PMMPTE PointerPte = MiAddressToPte(Entry.u1.VirtualAddress);
+        ASSERT(PointerPte->u.Hard.Valid);
+
+        /* Aging is incremental, so the entry may have been used since it was last aged */
+        if (PointerPte->u.Hard.Accessed)
+            continue;
+
         /* Please put yourself aside and make place for the younger ones */
         PFN_NUMBER Page = PFN_FROM_PTE(PointerPte);
         {
@@ -372,10 +420,11 @@ MiInitializeWorkingSetList(_Inout_ PMMSUPPORT WorkingSet)
 
     /* Initialize some fields */
     WsList->FirstFree = ULONG_MAX;
-    WsList->Wsle = reinterpret_cast<PMMWSLE>(WsList + 1);
+    WsList->Wsle = reinterpret_cast<PMMWSLE>(MI_WS_TRIM_COUNTS_OF(WsList) + 1);
     WsList->LastEntry = 0;
     /* The first page is already allocated */
-    WsList->LastInitializedWsle = (PAGE_SIZE - sizeof(*WsList)) / sizeof(MMWSLE);
+    WsList->LastInitializedWsle = (PAGE_SIZE - sizeof(*WsList) - sizeof(MI_WS_TRIM_COUNTS)) / sizeof(MMWSLE);
+    RtlZeroMemory(MI_WS_TRIM_COUNTS_OF(WsList), sizeof(MI_WS_TRIM_COUNTS));
 
     /* Insert the address we already know: our PDE base and the Working Set List */
     if (MI_IS_PROCESS_WORKING_SET(WorkingSet))
@@ -406,6 +455,32 @@ MiInitializeWorkingSetList(_Inout_ PMMSUPPORT WorkingSet)
     ExInterlockedInsertTailList(&MmWorkingSetExpansionHead, &WorkingSet->WorkingSetExpansionLinks, &MmExpansionLock);
 }
 
+_Use_decl_annotations_
+VOID
+NTAPI
+MiCountTrimmedPages(ULONG PageCount)
+{
+    /* The counters live in the hyperspace of the process we are attached to */
+    InterlockedExchangeAdd(reinterpret_cast<PLONG>(&MI_WS_TRIM_COUNTS_OF(MmWorkingSetList)->TrimmedPageCount),
+                           PageCount);
+}
+
+VOID
+NTAPI
+MiCountTrimmedPageFault(VOID)
+{
+    InterlockedIncrement(reinterpret_cast<PLONG>(&MI_WS_TRIM_COUNTS_OF(MmWorkingSetList)->TrimmedPageFaultCount));
+}
+
+_Use_decl_annotations_
+VOID
+NTAPI
+MmQueryWorkingSetTrimCounts(PULONG TrimmedPageCount, PULONG TrimmedPageFaultCount)
+{
+    *TrimmedPageCount = MI_WS_TRIM_COUNTS_OF(MmWorkingSetList)->TrimmedPageCount;
+    *TrimmedPageFaultCount = MI_WS_TRIM_COUNTS_OF(MmWorkingSetList)->TrimmedPageFaultCount;
+}
+
 VOID
 NTAPI
 MmWorkingSetManager(VOID)
@@ -423,10 +498,6 @@ MmWorkingSetManager(VOID)
         BOOLEAN TrimHard = MmAvailablePages < MmMinimumFreePages;
         PEPROCESS Process = NULL;
 
-        /* Don't do anything if we have plenty of free pages. */
-        if ((MmAvailablePages + MmModifiedPageListHead.Total) >= MmPlentyFreePages)
-            break;
-
         Vm = CONTAINING_RECORD(VmListEntry, MMSUPPORT, WorkingSetExpansionLinks);
 
         /* Let the legacy Mm System space alone */
@@ -451,28 +522,36 @@ MmWorkingSetManager(VOID)
 
         MiReleaseExpansionLock(OldIrql);
 
-        /* Share-lock for now, we're only reading */
-        MiLockWorkingSetShared(PsGetCurrentThread(), Vm);
+        /* Aging touches the PTEs and the list entries, so take it exclusively */
+        MiLockWorkingSet(PsGetCurrentThread(), Vm);
+
+        /* Sample the accessed bits of the next slice of the list */
+        AgeWsList(Vm);
+
+        /* Trim down to the maximum, or to the minimum when we are short on memory */
+        ULONG WorkingSetPages = Vm->WorkingSetSize >> PAGE_SHIFT;
+        ULONG Target = 0;
+        if ((Vm->MaximumWorkingSetSize != 0) && (WorkingSetPages > Vm->MaximumWorkingSetSize))
+            Target = WorkingSetPages - Vm->MaximumWorkingSetSize;
+        if (TrimHard && (WorkingSetPages > Vm->MinimumWorkingSetSize))
+            Target = max(Target, WorkingSetPages - Vm->MinimumWorkingSetSize);
 
-        if (((Vm->WorkingSetSize > Vm->MaximumWorkingSetSize) ||
-            (TrimHard && (Vm->WorkingSetSize > Vm->MinimumWorkingSetSize))) &&
-            MiConvertSharedWorkingSetLockToExclusive(PsGetCurrentThread(), Vm))
+        if (Target != 0)
         {
-            /* We're done */
             Vm->Flags.BeingTrimmed = 1;
 
-            ULONG Trimmed = TrimWsList(Vm->VmWorkingSetList);
+            /* Oldest first. Pages which were just accessed are never taken. */
+            ULONG Trimmed = 0;
+            for (ULONG Age = MI_WSLE_MAX_AGE; (Age > 0) && (Trimmed < Target); Age--)
+                Trimmed += TrimWsList(Vm->VmWorkingSetList, Target - Trimmed, Age);
 
-            /* We're done */
             Vm->WorkingSetSize -= Trimmed * PAGE_SIZE;
+            MiCountTrimmedPages(Trimmed);
             Vm->Flags.BeingTrimmed = 0;
-            MiUnlockWorkingSet(PsGetCurrentThread(), Vm);
-        }
-        else
-        {
-            MiUnlockWorkingSetShared(PsGetCurrentThread(), Vm);
         }
 
+        MiUnlockWorkingSet(PsGetCurrentThread(), Vm);
+
         /* Lock again */
         OldIrql = MiAcquireExpansionLock();
 
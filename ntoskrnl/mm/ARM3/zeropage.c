@@ -19,6 +19,9 @@
 
 KEVENT MmZeroingPageEvent;
 
+/* Number of pages zeroed by the zeroing threads */
+ULONG MiZeroedPageCount;
+
 /* PRIVATE FUNCTIONS **********************************************************/
 
 VOID
@@ -31,22 +34,15 @@ NTAPI
 MiFreeInitializationCode(IN PVOID StartVa,
 IN PVOID EndVa);
 
+static
 VOID
-NTAPI
-MmZeroPageThread(VOID)
+MiZeroFreePages(IN PMMPTE ZeroingPte)
 {
-    PKTHREAD Thread = KeGetCurrentThread();
-    PVOID StartAddress, EndAddress;
     PVOID WaitObjects[2];
+    ULONG Color;
 
-    /* Get the discardable sections to free them */
-    MiFindInitializationCode(&StartAddress, &EndAddress);
-    if (StartAddress) MiFreeInitializationCode(StartAddress, EndAddress);
-    DPRINT("Free pages: %lx\n", MmAvailablePages);
-
-    /* Set our priority to 0 */
-    Thread->BasePriority = 0;
-    KeSetPriorityThread(Thread, 0);
+    /* Each processor starts on its own color, we are pinned to it */
+    Color = KeGetCurrentProcessorNumber() & MmSecondaryColorMask;
 
     /* Setup the wait objects */
     WaitObjects[0] = &MmZeroingPageEvent;
@@ -71,7 +67,8 @@ MmZeroPageThread(VOID)
             ULONG PageCount = 0;
             PMMPFN Pfn1 = (PMMPFN)LIST_HEAD;
             PVOID ZeroAddress;
-            PFN_NUMBER PageIndex, FreePage;
+            PFN_NUMBER PageIndex = LIST_HEAD;
+            ULONG i;
 
             while (PageCount < MI_ZERO_PTES)
             {
@@ -80,22 +77,32 @@ MmZeroPageThread(VOID)
                 if (!MmFreePageListHead.Total)
                     break;
 
-                PageIndex = MmFreePageListHead.Flink;
-                ASSERT(PageIndex != LIST_HEAD);
-                MI_SET_USAGE(MI_USAGE_ZERO_LOOP);
-                MI_SET_PROCESS2("Kernel 0 Loop");
-                FreePage = MiRemoveAnyPage(MI_GET_PAGE_COLOR(PageIndex));
+                /*
+                 * Take the free pages one color after the other, so that the
+                 * zeroed list of every color refills evenly. Each page goes
+                 * back on the zeroed list of its own color once it is zeroed.
+                 */
+                for (i = 0; i < MmSecondaryColors; i++)
+                {
+                    Color = (Color + 1) & MmSecondaryColorMask;
+                    PageIndex = MmFreePagesByColor[FreePageList][Color].Flink;
+                    if (PageIndex != LIST_HEAD) break;
+                }
 
-                /* The first global free page should also be the first on its own list */
-                if (FreePage != PageIndex)
+                /* Free pages are always on the list of their color */
+                if (PageIndex == LIST_HEAD)
                 {
                     KeBugCheckEx(PFN_LIST_CORRUPT,
                                 0x8F,
-                                FreePage,
-                                PageIndex,
+                                MmFreePageListHead.Total,
+                                Color,
                                 0);
                 }
 
+                MI_SET_USAGE(MI_USAGE_ZERO_LOOP);
+                MI_SET_PROCESS2("Kernel 0 Loop");
+                MiRemovePageByColor(PageIndex, Color);
+
                 Pfn2 = MiGetPfnEntry(PageIndex);
                 Pfn2->u1.Flink = (PFN_NUMBER)Pfn1;
                 Pfn1 = Pfn2;
@@ -109,11 +116,13 @@ MmZeroPageThread(VOID)
                 break;
             }
 
-            ZeroAddress = MiMapPagesInZeroSpace(Pfn1, PageCount);
+            ZeroAddress = MiMapPagesInZeroSpace(ZeroingPte, Pfn1, PageCount);
             ASSERT(ZeroAddress);
             KeZeroPages(ZeroAddress, PageCount * PAGE_SIZE);
             MiUnmapPagesInZeroSpace(ZeroAddress, PageCount);
 
+            InterlockedExchangeAddUL(&MiZeroedPageCount, PageCount);
+
             OldIrql = MiAcquirePfnLock();
 
             while (Pfn1 != (PMMPFN)LIST_HEAD)
@@ -126,4 +135,82 @@ MmZeroPageThread(VOID)
     }
 }
 
+static
+VOID
+NTAPI
+MiZeroPageWorkerThread(IN PVOID Context)
+{
+    PKTHREAD Thread = KeGetCurrentThread();
+    CCHAR Processor = (CCHAR)(ULONG_PTR)Context;
+    PMMPTE ZeroingPte;
+
+    /*
+     * Stay on our processor: the zeroing PTEs are private to this thread,
+     * so flushing the local TB is enough when they get recycled.
+     */
+    KeSetSystemAffinityThread(AFFINITY_MASK(Processor));
+
+    /* Only run when the processor has nothing better to do */
+    Thread->BasePriority = 0;
+    KeSetPriorityThread(Thread, 0);
+
+    /* Reserve our own zeroing PTEs and set the counter to maximum */
+    ZeroingPte = MiReserveSystemPtes(MI_ZERO_PTES + 1, SystemPteSpace);
+    if (ZeroingPte == NULL)
+    {
+        DPRINT1("Failed to reserve zeroing PTEs for processor %d\n", Processor);
+        PsTerminateSystemThread(STATUS_INSUFFICIENT_RESOURCES);
+    }
+    RtlZeroMemory(ZeroingPte, (MI_ZERO_PTES + 1) * sizeof(MMPTE));
+    ZeroingPte->u.Hard.PageFrameNumber = MI_ZERO_PTES;
+
+    MiZeroFreePages(ZeroingPte);
+}
+
+VOID
+NTAPI
+MmZeroPageThread(VOID)
+{
+    PKTHREAD Thread = KeGetCurrentThread();
+    PVOID StartAddress, EndAddress;
+    HANDLE ThreadHandle;
+    NTSTATUS Status;
+    CCHAR i;
+
+    /* Get the discardable sections to free them */
+    MiFindInitializationCode(&StartAddress, &EndAddress);
+    if (StartAddress) MiFreeInitializationCode(StartAddress, EndAddress);
+    DPRINT("Free pages: %lx\n", MmAvailablePages);
+
+    /* We are the zeroing thread of the boot processor */
+    KeSetSystemAffinityThread(AFFINITY_MASK(KeGetCurrentProcessorNumber()));
+
+    /* Set our priority to 0 */
+    Thread->BasePriority = 0;
+    KeSetPriorityThread(Thread, 0);
+
+    /* Start a zeroing thread for each other processor */
+    for (i = 0; i < KeNumberProcessors; i++)
+    {
+        if (i == KeGetCurrentProcessorNumber()) continue;
+
+        Status = PsCreateSystemThread(&ThreadHandle,
+                                      THREAD_ALL_ACCESS,
+                                      NULL,
+                                      NULL,
+                                      NULL,
+                                      MiZeroPageWorkerThread,
+                                      (PVOID)(ULONG_PTR)i);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("Failed to create zeroing thread for processor %d: 0x%lx\n", i, Status);
+            continue;
+        }
+
+        ZwClose(ThreadHandle);
+    }
+
+    MiZeroFreePages(MiFirstReservedZeroingPte);
+}
+
 /* EOF */
@@ -26,8 +26,21 @@ MM_ALLOCATION_REQUEST, *PMM_ALLOCATION_REQUEST;
 /* GLOBALS ******************************************************************/
 
 MM_MEMORY_CONSUMER MiMemoryConsumers[MC_MAXIMUM];
-static ULONG MiMinimumAvailablePages;
 static ULONG MiMinimumPagesPerRun;
+
+/*
+ * The balancer is woken up as soon as the available pages drop below the low
+ * watermark, and then reclaims pages until they are back above the high one,
+ * so that allocating threads don't have to wait for it. Both watermarks sit
+ * on top of a reserve which can be set in the registry.
+ */
+ULONG MmBalancerReservePages;
+ULONG MiBalancerLowWatermark;
+ULONG MiBalancerHighWatermark;
+
+/* Time spent by faulting threads waiting for the balancer, in 100ns units */
+ULONG MiBalancerStallCount;
+LONGLONG MiBalancerStallTime;
 static CLIENT_ID MiBalancerThreadId;
 static HANDLE MiBalancerThreadHandle = NULL;
 static KEVENT MiBalancerEvent;
@@ -36,6 +49,9 @@ static KTIMER MiBalancerTimer;
 
 static LONG PageOutThreadActive;
 
+/* Set when a pass got nothing back, low memory then only wakes the balancer on the next tick */
+static LONG MiBalancerBackoff;
+
 /* FUNCTIONS ****************************************************************/
 
 CODE_SEG("INIT")
@@ -46,9 +62,15 @@ MmInitializeBalancer(ULONG NrAvailablePages, ULONG NrSystemPages)
     memset(MiMemoryConsumers, 0, sizeof(MiMemoryConsumers));
 
     /* Set up targets. */
-    MiMinimumAvailablePages = 256;
     MiMinimumPagesPerRun = 256;
     MiMemoryConsumers[MC_USER].PagesTarget = NrAvailablePages / 2;
+
+    /* Use the reserve from the registry, if it is sane */
+    if ((MmBalancerReservePages == 0) || (MmBalancerReservePages > NrAvailablePages / 8))
+        MmBalancerReservePages = 256;
+
+    MiBalancerLowWatermark = MmBalancerReservePages + max(256, NrAvailablePages / 64);
+    MiBalancerHighWatermark = MiBalancerLowWatermark + max(256, NrAvailablePages / 64);
 }
 
 CODE_SEG("INIT")
@@ -97,6 +119,7 @@ MiTrimMemoryConsumer(ULONG Consumer, ULONG InitialTarget)
 {
     ULONG Target = InitialTarget;
     ULONG NrFreedPages = 0;
+    BOOLEAN Priority;
     NTSTATUS Status;
 
     /* Make sure we can trim this consumer */
@@ -106,10 +129,11 @@ MiTrimMemoryConsumer(ULONG Consumer, ULONG InitialTarget)
         return InitialTarget;
     }
 
-    if (MmAvailablePages < MiMinimumAvailablePages)
+    Priority = MmAvailablePages < MiBalancerLowWatermark;
+    if (Priority)
     {
-        /* Global page limit exceeded */
-        Target = (ULONG)max(Target, MiMinimumAvailablePages - MmAvailablePages);
+        /* Below the low watermark, get back to the high one */
+        Target = (ULONG)max(Target, MiBalancerHighWatermark - MmAvailablePages);
     }
     else if (MiMemoryConsumers[Consumer].PagesUsed > MiMemoryConsumers[Consumer].PagesTarget)
     {
@@ -120,7 +144,7 @@ MiTrimMemoryConsumer(ULONG Consumer, ULONG InitialTarget)
     if (Target)
     {
         /* Now swap the pages out */
-        Status = MiMemoryConsumers[Consumer].Trim(Target, MmAvailablePages < MiMinimumAvailablePages, &NrFreedPages);
+        Status = MiMemoryConsumers[Consumer].Trim(Target, Priority, &NrFreedPages);
 
         DPRINT("Trimming consumer %lu: Freed %lu pages with a target of %lu pages\n", Consumer, NrFreedPages, Target);
 
@@ -134,121 +158,173 @@ MiTrimMemoryConsumer(ULONG Consumer, ULONG InitialTarget)
     return (InitialTarget > NrFreedPages) ? (InitialTarget - NrFreedPages) : 0;
 }
 
-NTSTATUS
-MmTrimUserMemory(ULONG Target, ULONG Priority, PULONG NrFreedPages)
-{
-    PFN_NUMBER FirstPage, CurrentPage;
-    NTSTATUS Status;
-
-    (*NrFreedPages) = 0;
+/* Number of balancer passes a user page must go unaccessed before we page it out */
+#define MI_USER_PAGE_MAX_AGE 3
 
-    DPRINT("MM BALANCER: %s\n", Priority ? "Paging out!" : "Removing access bit!");
+/*
+ * Clears the accessed bit in every process mapping this page, and updates
+ * the page age accordingly. Returns the new age.
+ */
+static
+ULONG
+MiAgeUserPage(PFN_NUMBER CurrentPage)
+{
+    PEPROCESS Process = NULL;
+    PVOID Address = NULL;
+    BOOLEAN Accessed = FALSE;
+    PMMPFN Pfn1;
+    ULONG Age;
 
-    FirstPage = MmGetLRUFirstUserPage();
-    CurrentPage = FirstPage;
-    while (CurrentPage != 0 && Target > 0)
+    /*
+     * We have a lock-ordering problem here. We cant lock the rmap list before the Process address space.
+     * So we must use circonvoluted loops, visiting the mappings in (Address, Process) order
+     * so that each of them is handled exactly once even if the list changes in between.
+     * Well...
+     */
+    while (TRUE)
     {
-        if (Priority)
+        KAPC_STATE ApcState;
+        KIRQL OldIrql = MiAcquireRmapLock(CurrentPage);
+        PMM_RMAP_ENTRY Entry, Next = NULL;
+
+        for (Entry = MmGetRmapListHeadPage(CurrentPage); Entry; Entry = Entry->Next)
         {
-            Status = MmPageOutPhysicalAddress(CurrentPage);
-            if (NT_SUCCESS(Status))
+            if (RMAP_IS_SEGMENT(Entry->Address))
+                continue;
+
+            /* Check that we didn't treat this entry before */
+            if ((Entry->Address < Address) ||
+                ((Entry->Address == Address) && (Entry->Process <= Process)))
             {
-                DPRINT("Succeeded\n");
-                Target--;
-                (*NrFreedPages)++;
-                if (CurrentPage == FirstPage)
-                {
-                    FirstPage = 0;
-                }
+                continue;
+            }
+
+            /* Keep the smallest of the remaining ones */
+            if (!Next ||
+                (Entry->Address < Next->Address) ||
+                ((Entry->Address == Next->Address) && (Entry->Process < Next->Process)))
+            {
+                Next = Entry;
             }
         }
-        else
+
+        if (!Next)
         {
-            /* When not paging-out agressively, just reset the accessed bit */
-            PEPROCESS Process = NULL;
-            PVOID Address = NULL;
-            BOOLEAN Accessed = FALSE;
+            MiReleaseRmapLock(CurrentPage, OldIrql);
+            break;
+        }
 
-            /*
-             * We have a lock-ordering problem here. We cant lock the PFN DB before the Process address space.
-             * So we must use circonvoluted loops.
-             * Well...
-             */
-            while (TRUE)
-            {
-                KAPC_STATE ApcState;
-                KIRQL OldIrql = MiAcquirePfnLock();
-                PMM_RMAP_ENTRY Entry = MmGetRmapListHeadPage(CurrentPage);
-                while (Entry)
-                {
-                    if (RMAP_IS_SEGMENT(Entry->Address))
-                    {
-                        Entry = Entry->Next;
-                        continue;
-                    }
+        Process = Next->Process;
+        Address = Next->Address;
 
-                    /* Check that we didn't treat this entry before */
-                    if (Entry->Address < Address)
-                    {
-                        Entry = Entry->Next;
-                        continue;
-                    }
+        ObReferenceObject(Process);
 
-                    if ((Entry->Address == Address) && (Entry->Process <= Process))
-                    {
-                        Entry = Entry->Next;
-                        continue;
-                    }
+        if (!ExAcquireRundownProtection(&Process->RundownProtect))
+        {
+            ObDereferenceObject(Process);
+            MiReleaseRmapLock(CurrentPage, OldIrql);
+            continue;
+        }
 
-                    break;
-                }
+        MiReleaseRmapLock(CurrentPage, OldIrql);
 
-                if (!Entry)
-                {
-                    MiReleasePfnLock(OldIrql);
-                    break;
-                }
+        KeStackAttachProcess(&Process->Pcb, &ApcState);
+        MiLockProcessWorkingSet(Process, PsGetCurrentThread());
+
+        /* Be sure this is still valid. */
+        if (MmIsAddressValid(Address))
+        {
+            PMMPTE Pte = MiAddressToPte(Address);
+            Accessed = Accessed || Pte->u.Hard.Accessed;
+            Pte->u.Hard.Accessed = 0;
 
-                Process = Entry->Process;
-                Address = Entry->Address;
+            /* There is no need to invalidate, the balancer thread is never on a user process */
+            //KeInvalidateTlbEntry(Address);
+        }
 
-                ObReferenceObject(Process);
+        MiUnlockProcessWorkingSet(Process, PsGetCurrentThread());
 
-                if (!ExAcquireRundownProtection(&Process->RundownProtect))
-                {
-                    ObDereferenceObject(Process);
-                    MiReleasePfnLock(OldIrql);
-                    continue;
-                }
+        KeUnstackDetachProcess(&ApcState);
+        ExReleaseRundownProtection(&Process->RundownProtect);
+        ObDereferenceObject(Process);
+    }
 
-                MiReleasePfnLock(OldIrql);
+    /* ROS PFNs keep their age in the working set entry hack of the PFN */
+    KIRQL OldIrql = MiAcquirePfnLock();
+    Pfn1 = MiGetPfnEntry(CurrentPage);
+    if (Accessed)
+        Pfn1->Wsle.u1.e1.Age = 0;
+    else if (Pfn1->Wsle.u1.e1.Age < MI_USER_PAGE_MAX_AGE)
+        Pfn1->Wsle.u1.e1.Age++;
+    Age = Pfn1->Wsle.u1.e1.Age;
+    MiReleasePfnLock(OldIrql);
 
-                KeStackAttachProcess(&Process->Pcb, &ApcState);
-                MiLockProcessWorkingSet(Process, PsGetCurrentThread());
+    return Age;
+}
 
-                /* Be sure this is still valid. */
-                if (MmIsAddressValid(Address))
-                {
-                    PMMPTE Pte = MiAddressToPte(Address);
-                    Accessed = Accessed || Pte->u.Hard.Accessed;
-                    Pte->u.Hard.Accessed = 0;
+static
+ULONG
+MiGetUserPageAge(PFN_NUMBER Page)
+{
+    KIRQL OldIrql = MiAcquirePfnLock();
+    ULONG Age = MiGetPfnEntry(Page)->Wsle.u1.e1.Age;
+    MiReleasePfnLock(OldIrql);
+    return Age;
+}
 
-                    /* There is no need to invalidate, the balancer thread is never on a user process */
-                    //KeInvalidateTlbEntry(Address);
-                }
+NTSTATUS
+MmTrimUserMemory(ULONG Target, ULONG Priority, PULONG NrFreedPages)
+{
+    PFN_NUMBER FirstPage, CurrentPage;
+    NTSTATUS Status;
+    MM_PAGEOUT_CLUSTER Cluster;
+    ULONG MinimumAge;
 
-                MiUnlockProcessWorkingSet(Process, PsGetCurrentThread());
+    (*NrFreedPages) = 0;
+    Cluster.Count = 0;
+    Cluster.FreedCount = 0;
 
-                KeUnstackDetachProcess(&ApcState);
-                ExReleaseRundownProtection(&Process->RundownProtect);
-                ObDereferenceObject(Process);
-            }
+    DPRINT("MM BALANCER: %s\n", Priority ? "Paging out!" : "Removing access bit!");
 
-            if (!Accessed)
+    /*
+     * When we are short on memory, page out the oldest pages first, using the
+     * ages computed by the previous passes, and lower the bar on each round
+     * over the list until the target is met.
+     */
+    MinimumAge = MI_USER_PAGE_MAX_AGE;
+
+    FirstPage = MmGetLRUFirstUserPage();
+    CurrentPage = FirstPage;
+    while (CurrentPage != 0 && Target > 0)
+    {
+        if (Priority)
+        {
+            if (MiGetUserPageAge(CurrentPage) >= MinimumAge)
             {
-                /* Nobody accessed this page since the last time we check. Time to clean up */
+                Status = MmPageOutPhysicalAddressEx(CurrentPage, &Cluster);
+                if (NT_SUCCESS(Status))
+                {
+                    DPRINT("Succeeded\n");
+                    Target--;
 
-                Status = MmPageOutPhysicalAddress(CurrentPage);
+                    /* Clustered pages are only freed once their write is done */
+                    if (Status != STATUS_PENDING)
+                        (*NrFreedPages)++;
+                    if (CurrentPage == FirstPage)
+                    {
+                        FirstPage = 0;
+                    }
+                }
+            }
+        }
+        else
+        {
+            /* When not paging-out agressively, just age the page */
+            if (MiAgeUserPage(CurrentPage) == MI_USER_PAGE_MAX_AGE)
+            {
+                /* Nobody accessed this page for a while. Time to clean up */
+
+                Status = MmPageOutPhysicalAddressEx(CurrentPage, &Cluster);
                 if (NT_SUCCESS(Status))
                 {
                     if (CurrentPage == FirstPage)
@@ -270,11 +346,26 @@ MmTrimUserMemory(ULONG Target, ULONG Priority, PULONG NrFreedPages)
         }
         else if (CurrentPage == FirstPage)
         {
+            if (Priority && (MinimumAge > 0))
+            {
+                /* Go for younger pages */
+                MinimumAge--;
+                continue;
+            }
+
             DPRINT1("We are back at the start, abort!\n");
-            return STATUS_SUCCESS;
+            break;
         }
     }
 
+    /* Write out whatever is left in the page-out cluster */
+    if (Cluster.Count != 0)
+        MmFlushPageOutCluster(&Cluster);
+
+    /* And count the clustered pages which really went to the free list */
+    if (Priority)
+        (*NrFreedPages) += Cluster.FreedCount;
+
     if (CurrentPage)
     {
         KIRQL OldIrql = MiAcquirePfnLock();
@@ -289,6 +380,10 @@ VOID
 NTAPI
 MmRebalanceMemoryConsumers(VOID)
 {
+    /* The last pass was fruitless, leave it to the timer */
+    if (MiBalancerBackoff)
+        return;
+
     if (InterlockedCompareExchange(&PageOutThreadActive, 1, 0) == 0)
     {
         KeSetEvent(&MiBalancerEvent, IO_NO_INCREMENT, FALSE);
@@ -299,13 +394,25 @@ VOID
 NTAPI
 MmRebalanceMemoryConsumersAndWait(VOID)
 {
+    ULONGLONG StartTime;
+
     ASSERT(PsGetCurrentProcess()->AddressCreationLock.Owner != KeGetCurrentThread());
     ASSERT(!MM_ANY_WS_LOCK_HELD(PsGetCurrentThread()));
     ASSERT(KeGetCurrentIrql() < DISPATCH_LEVEL);
 
+    StartTime = KeQueryInterruptTime();
+
+    /* Someone is really waiting for pages, so ignore any backoff */
     KeResetEvent(&MiBalancerDoneEvent);
-    MmRebalanceMemoryConsumers();
+    if (InterlockedCompareExchange(&PageOutThreadActive, 1, 0) == 0)
+    {
+        KeSetEvent(&MiBalancerEvent, IO_NO_INCREMENT, FALSE);
+    }
     KeWaitForSingleObject(&MiBalancerDoneEvent, Executive, KernelMode, FALSE, NULL);
+
+    /* Account for the time this thread was stalled */
+    InterlockedIncrementUL(&MiBalancerStallCount);
+    InterlockedExchangeAdd64(&MiBalancerStallTime, KeQueryInterruptTime() - StartTime);
 }
 
 NTSTATUS
@@ -315,17 +422,6 @@ MmRequestPageMemoryConsumer(ULONG Consumer, BOOLEAN CanWait,
 {
     PFN_NUMBER Page;
 
-    /* Delay some requests for the Memory Manager to recover pages (CORE-17624).
-     * FIXME: This is suboptimal.
-     */
-    static INT i = 0;
-    static LARGE_INTEGER TinyTime = {{-1L, -1L}};
-    if (i++ >= 100)
-    {
-        KeDelayExecutionThread(KernelMode, FALSE, &TinyTime);
-        i = 0;
-    }
-
     /*
      * Actually allocate the page.
      */
@@ -337,6 +433,10 @@ MmRequestPageMemoryConsumer(ULONG Consumer, BOOLEAN CanWait,
     }
     *AllocatedPage = Page;
 
+    /* Let the balancer catch up before we run out of pages (CORE-17624) */
+    if (MmAvailablePages < MiBalancerLowWatermark)
+        MmRebalanceMemoryConsumers();
+
     /* Update the target */
     InterlockedIncrementUL(&MiMemoryConsumers[Consumer].PagesUsed);
     UpdateTotalCommittedPages(1);
@@ -361,7 +461,6 @@ MiBalancerThread(PVOID Unused)
 
     while (TRUE)
     {
-        KeSetEvent(&MiBalancerDoneEvent, IO_NO_INCREMENT, FALSE);
         Status = KeWaitForMultipleObjects(_countof(WaitObjects),
                                           WaitObjects,
                                           WaitAny,
@@ -376,25 +475,36 @@ MiBalancerThread(PVOID Unused)
             ULONG InitialTarget = 0;
             ULONG Target;
             ULONG NrFreedPages;
+            PFN_NUMBER AvailablePages = MmAvailablePages;
+
+            /* A new tick, give low memory notifications another chance */
+            if (Status == STATUS_WAIT_1)
+                InterlockedExchange(&MiBalancerBackoff, FALSE);
+
+            /* Zeroed pages cached by processors that stopped faulting would be stranded there */
+            if (MmAvailablePages < MiBalancerHighWatermark)
+                MiFlushPageCaches();
 
             do
             {
                 ULONG OldTarget = InitialTarget;
 
-                /* Trim each consumer */
-                for (ULONG i = 0; i < MC_MAXIMUM; i++)
-                {
-                    InitialTarget = MiTrimMemoryConsumer(i, InitialTarget);
-                }
-
-                /* Trim cache */
-                Target = max(InitialTarget, abs(MiMinimumAvailablePages - MmAvailablePages));
+                /* Unused cache views are the cheapest pages to get back, start with them */
+                Target = InitialTarget;
+                if (MmAvailablePages < MiBalancerHighWatermark)
+                    Target = max(Target, MiBalancerHighWatermark - MmAvailablePages);
                 if (Target)
                 {
                     CcRosTrimCache(Target, &NrFreedPages);
                     InitialTarget -= min(NrFreedPages, InitialTarget);
                 }
 
+                /* Trim each consumer */
+                for (ULONG i = 0; i < MC_MAXIMUM; i++)
+                {
+                    InitialTarget = MiTrimMemoryConsumer(i, InitialTarget);
+                }
+
                 /* No pages left to swap! */
                 if (InitialTarget != 0 &&
                     InitialTarget == OldTarget)
@@ -405,12 +515,25 @@ MiBalancerThread(PVOID Unused)
             }
             while (InitialTarget != 0);
 
+            /*
+             * If we couldn't get anything back, don't let each allocation
+             * below the low watermark wake us up again before the next tick.
+             */
+            if ((MmAvailablePages < MiBalancerLowWatermark) &&
+                (MmAvailablePages <= AvailablePages))
+            {
+                InterlockedExchange(&MiBalancerBackoff, TRUE);
+            }
+
             if (Status == STATUS_WAIT_0)
             {
                 LONG Active = InterlockedExchange(&PageOutThreadActive, 0);
                 ASSERT(Active == 1);
                 DBG_UNREFERENCED_LOCAL_VARIABLE(Active);
             }
+
+            /* The pass is over, don't keep the waiters any longer */
+            KeSetEvent(&MiBalancerDoneEvent, IO_NO_INCREMENT, FALSE);
         }
         else
         {
@@ -459,5 +582,30 @@ MiInitBalancerThread(VOID)
 
 }
 
+#if DBG && defined(KDBG)
+
+#include <kdbg/kdb.h>
+
+BOOLEAN
+ExpKdbgExtBalancer(ULONG Argc, PCHAR Argv[])
+{
+    KdbpPrint("MmAvailablePages:\t%lu (%lu Kb)\n", MmAvailablePages,
+              (MmAvailablePages * PAGE_SIZE) / 1024);
+    KdbpPrint("Reserve:\t\t%lu (%lu Kb)\n", MmBalancerReservePages,
+              (MmBalancerReservePages * PAGE_SIZE) / 1024);
+    KdbpPrint("Low watermark:\t\t%lu (%lu Kb)\n", MiBalancerLowWatermark,
+              (MiBalancerLowWatermark * PAGE_SIZE) / 1024);
+    KdbpPrint("High watermark:\t\t%lu (%lu Kb)\n", MiBalancerHighWatermark,
+              (MiBalancerHighWatermark * PAGE_SIZE) / 1024);
+    KdbpPrint("MC_USER pages used:\t%lu (target %lu)\n",
+              MiMemoryConsumers[MC_USER].PagesUsed,
+              MiMemoryConsumers[MC_USER].PagesTarget);
+    KdbpPrint("Stalled allocations:\t%lu (%I64u ms total)\n",
+              MiBalancerStallCount, MiBalancerStallTime / 10000);
+
+    return TRUE;
+}
+
+#endif // DBG && defined(KDBG)
 
 /* EOF */
@@ -427,8 +427,8 @@ MmSetRmapListHeadPage(PFN_NUMBER Pfn, PMM_RMAP_ENTRY ListHead)
 {
     PMMPFN Pfn1;
 
-    /* PFN database must be locked */
-    MI_ASSERT_PFN_LOCK_HELD();
+    /* The rmap list of this page must be locked */
+    MI_ASSERT_RMAP_LOCK_HELD(Pfn);
 
     Pfn1 = MiGetPfnEntry(Pfn);
     ASSERT(Pfn1);
@@ -460,8 +460,8 @@ MmGetRmapListHeadPage(PFN_NUMBER Pfn)
 {
     PMMPFN Pfn1;
 
-    /* PFN database must be locked */
-    MI_ASSERT_PFN_LOCK_HELD();
+    /* The rmap list of this page must be locked */
+    MI_ASSERT_RMAP_LOCK_HELD(Pfn);
 
     /* Get the entry */
     Pfn1 = MiGetPfnEntry(Pfn);
@@ -642,6 +642,7 @@ MmAllocPage(ULONG Type)
 
     Pfn1->NextLRU = NULL;
     Pfn1->PreviousLRU = NULL;
+    Pfn1->Wsle.u1.e1.Age = 0;
 
     if (Type == MC_USER)
     {
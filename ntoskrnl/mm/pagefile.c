@@ -70,6 +70,17 @@ PFN_COUNT MiUsedSwapPages;
 
 BOOLEAN MmZeroPageFile;
 
+/* Number of paging writes issued, and number of pages they carried */
+ULONG MiPageFileWriteIoCount;
+ULONG MiPageFileWritePageCount;
+
+/* Number of paging reads issued, and number of pages they brought in */
+ULONG MiPageFileReadIoCount;
+ULONG MiPageFileReadPageCount;
+
+/* Number of pages read at once when resolving a fault on a swapped out page */
+ULONG MmPageFileReadCluster = 8;
+
 /*
  * Number of pages that have been reserved for swapping but not yet allocated
  */
@@ -144,7 +155,10 @@ MmShowOutOfSpaceMessagePagingFile(VOID)
 
 NTSTATUS
 NTAPI
-MmWriteToSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
+MmWriteToSwapPages(
+    _In_ SWAPENTRY SwapEntry,
+    _In_reads_(PageCount) PPFN_NUMBER Pages,
+    _In_ ULONG PageCount)
 {
     ULONG i;
     ULONG_PTR offset;
@@ -152,12 +166,12 @@ MmWriteToSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
     IO_STATUS_BLOCK Iosb;
     NTSTATUS Status;
     KEVENT Event;
-    UCHAR MdlBase[sizeof(MDL) + sizeof(PFN_NUMBER)];
+    UCHAR MdlBase[sizeof(MDL) + MI_PAGE_FILE_WRITE_CLUSTER * sizeof(PFN_NUMBER)];
     PMDL Mdl = (PMDL)MdlBase;
 
-    DPRINT("MmWriteToSwapPage\n");
+    DPRINT("MmWriteToSwapPages(%Ix, %lu)\n", SwapEntry, PageCount);
 
-    if (SwapEntry == 0)
+    if (SwapEntry == 0 || PageCount == 0 || PageCount > MI_PAGE_FILE_WRITE_CLUSTER)
     {
         KeBugCheck(MEMORY_MANAGEMENT);
         return(STATUS_UNSUCCESSFUL);
@@ -173,8 +187,9 @@ MmWriteToSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
         KeBugCheck(MEMORY_MANAGEMENT);
     }
 
-    MmInitializeMdl(Mdl, NULL, PAGE_SIZE);
-    MmBuildMdlFromPages(Mdl, &Page);
+    /* The whole cluster goes out with a single paging I/O */
+    MmInitializeMdl(Mdl, NULL, PageCount * PAGE_SIZE);
+    MmBuildMdlFromPages(Mdl, Pages);
     Mdl->MdlFlags |= MDL_PAGES_LOCKED;
 
     file_offset.QuadPart = offset * PAGE_SIZE;
@@ -195,21 +210,26 @@ MmWriteToSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
     {
         MmUnmapLockedPages (Mdl->MappedSystemVa, Mdl);
     }
+
+    /* Account for it, the average cluster size is pages / writes */
+    InterlockedIncrementUL(&MiPageFileWriteIoCount);
+    InterlockedExchangeAddUL(&MiPageFileWritePageCount, PageCount);
+
     return(Status);
 }
 
-
 NTSTATUS
 NTAPI
-MmReadFromSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
+MmWriteToSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
 {
-    return MiReadPageFile(Page, FILE_FROM_ENTRY(SwapEntry), OFFSET_FROM_ENTRY(SwapEntry));
+    return MmWriteToSwapPages(SwapEntry, &Page, 1);
 }
 
+static
 NTSTATUS
-NTAPI
-MiReadPageFile(
-    _In_ PFN_NUMBER Page,
+MiReadPageFilePages(
+    _In_reads_(PageCount) PPFN_NUMBER Pages,
+    _In_ ULONG PageCount,
     _In_ ULONG PageFileIndex,
     _In_ ULONG_PTR PageFileOffset)
 {
@@ -217,13 +237,13 @@ MiReadPageFile(
     IO_STATUS_BLOCK Iosb;
     NTSTATUS Status;
     KEVENT Event;
-    UCHAR MdlBase[sizeof(MDL) + sizeof(PFN_NUMBER)];
+    UCHAR MdlBase[sizeof(MDL) + MI_PAGE_FILE_READ_CLUSTER * sizeof(PFN_NUMBER)];
     PMDL Mdl = (PMDL)MdlBase;
     PMMPAGING_FILE PagingFile;
 
     DPRINT("MiReadSwapFile\n");
 
-    if (PageFileOffset == 0)
+    if (PageFileOffset == 0 || PageCount == 0 || PageCount > MI_PAGE_FILE_READ_CLUSTER)
     {
         KeBugCheck(MEMORY_MANAGEMENT);
         return(STATUS_UNSUCCESSFUL);
@@ -242,8 +262,8 @@ MiReadPageFile(
         KeBugCheck(MEMORY_MANAGEMENT);
     }
 
-    MmInitializeMdl(Mdl, NULL, PAGE_SIZE);
-    MmBuildMdlFromPages(Mdl, &Page);
+    MmInitializeMdl(Mdl, NULL, PageCount * PAGE_SIZE);
+    MmBuildMdlFromPages(Mdl, Pages);
     Mdl->MdlFlags |= MDL_PAGES_LOCKED | MDL_IO_PAGE_READ;
 
     file_offset.QuadPart = PageFileOffset * PAGE_SIZE;
@@ -263,9 +283,50 @@ MiReadPageFile(
     {
         MmUnmapLockedPages (Mdl->MappedSystemVa, Mdl);
     }
+
+    /* Account for it, pages beyond the first one were read ahead */
+    InterlockedIncrementUL(&MiPageFileReadIoCount);
+    InterlockedExchangeAddUL(&MiPageFileReadPageCount, PageCount);
+
     return(Status);
 }
 
+NTSTATUS
+NTAPI
+MmReadFromSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
+{
+    return MiReadPageFilePages(&Page, 1, FILE_FROM_ENTRY(SwapEntry), OFFSET_FROM_ENTRY(SwapEntry));
+}
+
+NTSTATUS
+NTAPI
+MmReadFromSwapPages(
+    _In_ SWAPENTRY SwapEntry,
+    _In_reads_(PageCount) PPFN_NUMBER Pages,
+    _In_ ULONG PageCount)
+{
+    return MiReadPageFilePages(Pages, PageCount, FILE_FROM_ENTRY(SwapEntry), OFFSET_FROM_ENTRY(SwapEntry));
+}
+
+SWAPENTRY
+NTAPI
+MmOffsetSwapEntry(
+    _In_ SWAPENTRY SwapEntry,
+    _In_ ULONG PageCount)
+{
+    return ENTRY_FROM_FILE_OFFSET(FILE_FROM_ENTRY(SwapEntry), OFFSET_FROM_ENTRY(SwapEntry) + PageCount);
+}
+
+NTSTATUS
+NTAPI
+MiReadPageFile(
+    _In_ PFN_NUMBER Page,
+    _In_ ULONG PageFileIndex,
+    _In_ ULONG_PTR PageFileOffset)
+{
+    return MiReadPageFilePages(&Page, 1, PageFileIndex, PageFileOffset);
+}
+
 CODE_SEG("INIT")
 VOID
 NTAPI
@@ -275,6 +336,12 @@ MmInitPagingFile(VOID)
 
     KeInitializeGuardedMutex(&MmPageFileCreationLock);
 
+    /* Sanitize the read-ahead setting coming from the registry */
+    if (MmPageFileReadCluster == 0)
+        MmPageFileReadCluster = 1;
+    else if (MmPageFileReadCluster > MI_PAGE_FILE_READ_CLUSTER)
+        MmPageFileReadCluster = MI_PAGE_FILE_READ_CLUSTER;
+
     MiFreeSwapPages = 0;
     MiUsedSwapPages = 0;
     MiReservedSwapPages = 0;
@@ -305,7 +372,7 @@ MmFreeSwapPage(SWAPENTRY Entry)
         KeBugCheck(MEMORY_MANAGEMENT);
     }
 
-    RtlClearBit(PagingFile->Bitmap, off >> 5);
+    RtlClearBit(PagingFile->Bitmap, (ULONG)off);
 
     PagingFile->FreeSpace++;
     PagingFile->CurrentUsage--;
@@ -317,48 +384,78 @@ MmFreeSwapPage(SWAPENTRY Entry)
     KeReleaseGuardedMutex(&MmPageFileCreationLock);
 }
 
-SWAPENTRY
+ULONG
 NTAPI
-MmAllocSwapPage(VOID)
+MmAllocSwapPages(
+    _In_ ULONG Count,
+    _Out_writes_to_(Count, return) PSWAPENTRY SwapEntries)
 {
-    ULONG i;
+    ULONG i, j;
     ULONG off;
-    SWAPENTRY entry;
+    ULONG RunLength;
+
+    ASSERT(Count != 0);
 
     KeAcquireGuardedMutex(&MmPageFileCreationLock);
 
     if (MiFreeSwapPages == 0)
     {
         KeReleaseGuardedMutex(&MmPageFileCreationLock);
-        return(0);
+        return 0;
     }
 
-    for (i = 0; i < MAX_PAGING_FILES; i++)
+    /*
+     * Look for the longest contiguous run we can get, so that the caller
+     * can write all the pages with a single I/O. Fall back to shorter runs
+     * when the paging files are too fragmented.
+     */
+    for (RunLength = min(Count, MiFreeSwapPages); RunLength != 0; RunLength /= 2)
     {
-        if (MmPagingFile[i] != NULL &&
-                MmPagingFile[i]->FreeSpace >= 1)
+        for (i = 0; i < MAX_PAGING_FILES; i++)
         {
-            off = RtlFindClearBitsAndSet(MmPagingFile[i]->Bitmap, 1, 0);
-            if (off == 0xFFFFFFFF)
+            if (MmPagingFile[i] == NULL ||
+                MmPagingFile[i]->FreeSpace < RunLength)
             {
-                KeBugCheck(MEMORY_MANAGEMENT);
-                KeReleaseGuardedMutex(&MmPageFileCreationLock);
-                return(STATUS_UNSUCCESSFUL);
+                continue;
             }
-            MiUsedSwapPages++;
-            MiFreeSwapPages--;
-            UpdateTotalCommittedPages(1);
+
+            off = RtlFindClearBitsAndSet(MmPagingFile[i]->Bitmap, RunLength, 0);
+            if (off == 0xFFFFFFFF)
+                continue;
+
+            MmPagingFile[i]->FreeSpace -= RunLength;
+            MmPagingFile[i]->CurrentUsage += RunLength;
+
+            MiUsedSwapPages += RunLength;
+            MiFreeSwapPages -= RunLength;
+            UpdateTotalCommittedPages(RunLength);
 
             KeReleaseGuardedMutex(&MmPageFileCreationLock);
 
-            entry = ENTRY_FROM_FILE_OFFSET(i, off + 1);
-            return(entry);
+            for (j = 0; j < RunLength; j++)
+            {
+                SwapEntries[j] = ENTRY_FROM_FILE_OFFSET(i, off + j + 1);
+            }
+            return RunLength;
         }
     }
 
+    /* We have free space, yet not a single slot is available */
     KeReleaseGuardedMutex(&MmPageFileCreationLock);
     KeBugCheck(MEMORY_MANAGEMENT);
-    return(0);
+    return 0;
+}
+
+SWAPENTRY
+NTAPI
+MmAllocSwapPage(VOID)
+{
+    SWAPENTRY entry;
+
+    if (MmAllocSwapPages(1, &entry) == 0)
+        return 0;
+
+    return entry;
 }
 
 NTSTATUS
@@ -792,6 +889,14 @@ EarlyQuit:
                         (ULONG)(PagingFile->MaximumSize));
     RtlClearAllBits(PagingFile->Bitmap);
 
+    /* Slots past the current end of file cannot be handed out */
+    if (PagingFile->MaximumSize > PagingFile->FreeSpace)
+    {
+        RtlSetBits(PagingFile->Bitmap,
+                   (ULONG)PagingFile->FreeSpace,
+                   (ULONG)(PagingFile->MaximumSize - PagingFile->FreeSpace));
+    }
+
     /* Insert the new paging file information into the list */
     KeAcquireGuardedMutex(&MmPageFileCreationLock);
     /* Ensure the corresponding slot is empty yet */
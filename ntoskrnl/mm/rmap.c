@@ -19,6 +19,18 @@
 /* GLOBALS ******************************************************************/
 
 static NPAGED_LOOKASIDE_LIST RmapLookasideList;
+MM_RMAP_LOCK MmRmapLockTable[MI_RMAP_LOCK_COUNT];
+
+/*
+ * Every rmap entry is also linked in a hash table keyed on the page, process
+ * and address, so that an entry can be found and removed without walking the
+ * rmap list of a page shared by many processes. The low bits of the bucket
+ * index are the low bits of the page frame number, which means that a bucket
+ * is always covered by the same lock as the rmap lists of its pages.
+ */
+static PMM_RMAP_ENTRY MiRmapStaticHashTable[MI_RMAP_LOCK_COUNT];
+static PMM_RMAP_ENTRY* MiRmapHashTable = MiRmapStaticHashTable;
+static ULONG_PTR MiRmapHashMask = MI_RMAP_LOCK_COUNT - 1;
 
 /* FUNCTIONS ****************************************************************/
 
@@ -37,6 +49,10 @@ VOID
 NTAPI
 MmInitializeRmapList(VOID)
 {
+    PMM_RMAP_ENTRY* HashTable;
+    ULONG_PTR BucketCount;
+    ULONG i;
+
     ExInitializeNPagedLookasideList (&RmapLookasideList,
                                      NULL,
                                      RmapListFree,
@@ -44,11 +60,240 @@ MmInitializeRmapList(VOID)
                                      sizeof(MM_RMAP_ENTRY),
                                      TAG_RMAP,
                                      50);
+
+    for (i = 0; i < MI_RMAP_LOCK_COUNT; i++)
+        KeInitializeSpinLock(&MmRmapLockTable[i].SpinLock);
+
+    /* Size the hash table for about one bucket per four physical pages */
+    BucketCount = MI_RMAP_LOCK_COUNT;
+    while ((BucketCount < 0x10000) && (BucketCount * 4 < MmNumberOfPhysicalPages))
+        BucketCount <<= 1;
+
+    HashTable = ExAllocatePoolWithTag(NonPagedPool,
+                                      BucketCount * sizeof(PMM_RMAP_ENTRY),
+                                      TAG_RMAP);
+    if (HashTable)
+    {
+        RtlZeroMemory(HashTable, BucketCount * sizeof(PMM_RMAP_ENTRY));
+        MiRmapHashTable = HashTable;
+        MiRmapHashMask = BucketCount - 1;
+    }
+    else
+    {
+        /* We can live with the small table, it is just slower */
+        DPRINT1("Failed to allocate the rmap hash table\n");
+    }
+}
+
+FORCEINLINE
+PMM_RMAP_ENTRY*
+MiGetRmapHashBucket(
+    _In_ PFN_NUMBER Page,
+    _In_ PEPROCESS Process,
+    _In_ PVOID Address)
+{
+    ULONG_PTR Hash;
+
+    Hash = ((ULONG_PTR)Address >> PAGE_SHIFT) ^ ((ULONG_PTR)Process >> 4);
+    Hash ^= Hash >> 11;
+    Hash = (Hash * MI_RMAP_LOCK_COUNT) | (Page & (MI_RMAP_LOCK_COUNT - 1));
+
+    return &MiRmapHashTable[Hash & MiRmapHashMask];
+}
+
+/* Returns the hash link pointing to the entry, or to the NULL ending the chain */
+static
+PMM_RMAP_ENTRY*
+MiLookupRmapEntry(
+    _In_ PFN_NUMBER Page,
+    _In_ PEPROCESS Process,
+    _In_ PVOID Address)
+{
+    PMM_RMAP_ENTRY* Link;
+
+    MI_ASSERT_RMAP_LOCK_HELD(Page);
+
+    Link = MiGetRmapHashBucket(Page, Process, Address);
+    while (*Link != NULL)
+    {
+        if (((*Link)->Page == Page) &&
+            ((*Link)->Process == Process) &&
+            ((*Link)->Address == Address))
+        {
+            break;
+        }
+        Link = &(*Link)->HashNext;
+    }
+
+    return Link;
+}
+
+static
+VOID
+MiLinkRmapEntry(
+    _In_ PMM_RMAP_ENTRY Entry,
+    _In_ PMM_RMAP_ENTRY* HashLink)
+{
+    PMM_RMAP_ENTRY Head = MmGetRmapListHeadPage(Entry->Page);
+
+    if (!RMAP_IS_SEGMENT(Entry->Address) && Head && RMAP_IS_SEGMENT(Head->Address))
+    {
+        /* The segment rmap is always kept in front of the list */
+        Entry->Previous = Head;
+        Entry->Next = Head->Next;
+        if (Entry->Next)
+            Entry->Next->Previous = Entry;
+        Head->Next = Entry;
+    }
+    else
+    {
+        Entry->Previous = NULL;
+        Entry->Next = Head;
+        if (Head)
+            Head->Previous = Entry;
+        MmSetRmapListHeadPage(Entry->Page, Entry);
+    }
+
+    Entry->HashNext = *HashLink;
+    *HashLink = Entry;
+}
+
+static
+VOID
+MiUnlinkRmapEntry(
+    _In_ PMM_RMAP_ENTRY Entry,
+    _In_ PMM_RMAP_ENTRY* HashLink)
+{
+    ASSERT(*HashLink == Entry);
+    *HashLink = Entry->HashNext;
+
+    if (Entry->Next)
+        Entry->Next->Previous = Entry->Previous;
+    if (Entry->Previous)
+        Entry->Previous->Next = Entry->Next;
+    else
+        MmSetRmapListHeadPage(Entry->Page, Entry->Next);
+}
+
+static
+VOID
+MiCompleteClusteredPageOut(
+    _In_ PMM_PAGEOUT_CLUSTER_ENTRY ClusterEntry,
+    _In_ SWAPENTRY SwapEntry)
+{
+    PEPROCESS Process = ClusterEntry->Process;
+    PVOID Address = ClusterEntry->Address;
+    PFN_NUMBER Page = ClusterEntry->Page;
+    PMMSUPPORT AddressSpace = &Process->Vm;
+    SWAPENTRY Dummy;
+
+    MmLockAddressSpace(AddressSpace);
+    if (Process != PsInitialSystemProcess)
+        KeAttachProcess(&Process->Pcb);
+
+    MmDeletePageFileMapping(Process, Address, &Dummy);
+    ASSERT(Dummy == MM_WAIT_ENTRY);
+
+    if (SwapEntry == 0)
+    {
+        /* We failed at saving the content of this page. Keep it in */
+        PMEMORY_AREA MemoryArea = MmLocateMemoryAreaByAddress(AddressSpace, Address);
+        PMM_REGION Region;
+
+        ASSERT(MemoryArea != NULL);
+        Region = MmFindRegion((PVOID)MA_GetStartingAddress(MemoryArea),
+                              &MemoryArea->SectionData.RegionListHead,
+                              Address, NULL);
+
+        MmCreateVirtualMapping(Process, Address, Region->Protect, Page);
+        MmInsertRmap(Page, Process, Address);
+        MmSetDirtyPage(Process, Address);
+    }
+    else
+    {
+        /* Keep this in the process VM */
+        MmCreatePageFileMapping(Process, Address, SwapEntry);
+        MmSetSavedSwapEntryPage(Page, 0);
+    }
+
+    MmUnlockAddressSpace(AddressSpace);
+    if (Process != PsInitialSystemProcess)
+        KeDetachProcess();
+
+    /* We can finally let this page go */
+    if (SwapEntry != 0)
+        MmReleasePageMemoryConsumer(MC_USER, Page);
+
+    ExReleaseRundownProtection(&Process->RundownProtect);
+    ObDereferenceObject(Process);
+}
+
+VOID
+NTAPI
+MmFlushPageOutCluster(
+    _Inout_ PMM_PAGEOUT_CLUSTER Cluster)
+{
+    SWAPENTRY SwapEntries[MI_PAGE_FILE_WRITE_CLUSTER];
+    PFN_NUMBER Pages[MI_PAGE_FILE_WRITE_CLUSTER];
+    ULONG Done, Count, i;
+    NTSTATUS Status;
+
+    ASSERT(Cluster->Count <= MI_PAGE_FILE_WRITE_CLUSTER);
+
+    Done = 0;
+    while (Done < Cluster->Count)
+    {
+        /* Get as many contiguous slots as we can for the remaining pages */
+        Count = MmAllocSwapPages(Cluster->Count - Done, SwapEntries);
+        if (Count == 0)
+        {
+            /* Out of swap space: all the remaining pages stay in memory */
+            MmShowOutOfSpaceMessagePagingFile();
+            for (i = Done; i < Cluster->Count; i++)
+            {
+                MiCompleteClusteredPageOut(&Cluster->Entries[i], 0);
+            }
+            break;
+        }
+
+        for (i = 0; i < Count; i++)
+        {
+            Pages[i] = Cluster->Entries[Done + i].Page;
+        }
+
+        Status = MmWriteToSwapPages(SwapEntries[0], Pages, Count);
+
+        for (i = 0; i < Count; i++)
+        {
+            if (!NT_SUCCESS(Status))
+            {
+                /* This Swap Entry is useless to us */
+                MmFreeSwapPage(SwapEntries[i]);
+                SwapEntries[i] = 0;
+            }
+
+            MiCompleteClusteredPageOut(&Cluster->Entries[Done + i], SwapEntries[i]);
+            if (SwapEntries[i] != 0) Cluster->FreedCount++;
+        }
+
+        Done += Count;
+    }
+
+    Cluster->Count = 0;
 }
 
 NTSTATUS
 NTAPI
 MmPageOutPhysicalAddress(PFN_NUMBER Page)
+{
+    return MmPageOutPhysicalAddressEx(Page, NULL);
+}
+
+NTSTATUS
+NTAPI
+MmPageOutPhysicalAddressEx(
+    _In_ PFN_NUMBER Page,
+    _Inout_opt_ PMM_PAGEOUT_CLUSTER Cluster)
 {
     PMM_RMAP_ENTRY entry;
     PMEMORY_AREA MemoryArea;
@@ -61,16 +306,17 @@ MmPageOutPhysicalAddress(PFN_NUMBER Page)
     KIRQL OldIrql;
 
 GetEntry:
-    OldIrql = MiAcquirePfnLock();
+    OldIrql = MiAcquireRmapLock(Page);
 
     entry = MmGetRmapListHeadPage(Page);
 
-    while (entry && RMAP_IS_SEGMENT(entry->Address))
+    /* Skip the segment rmap, which is always first */
+    if (entry && RMAP_IS_SEGMENT(entry->Address))
         entry = entry->Next;
 
     if (entry == NULL)
     {
-        MiReleasePfnLock(OldIrql);
+        MiReleaseRmapLock(Page, OldIrql);
         goto WriteSegment;
     }
 
@@ -87,12 +333,12 @@ GetEntry:
 
     if (!ExAcquireRundownProtection(&Process->RundownProtect))
     {
-        MiReleasePfnLock(OldIrql);
+        MiReleaseRmapLock(Page, OldIrql);
         return STATUS_PROCESS_IS_TERMINATING;
     }
 
     Status = ObReferenceObjectByPointer(Process, PROCESS_ALL_ACCESS, NULL, KernelMode);
-    MiReleasePfnLock(OldIrql);
+    MiReleaseRmapLock(Page, OldIrql);
     if (!NT_SUCCESS(Status))
     {
         ExReleaseRundownProtection(&Process->RundownProtect);
@@ -173,6 +419,9 @@ GetEntry:
                          __LINE__);
         }
 
+        /* One more page trimmed from this process, which we are attached to */
+        MiCountTrimmedPages(1);
+
         if (Page != PFN_FROM_SSE(Entry))
         {
             SWAPENTRY SwapEntry;
@@ -183,6 +432,32 @@ GetEntry:
             /* Check if we should write it back to the page file */
             SwapEntry = MmGetSavedSwapEntryPage(Page);
 
+            if ((SwapEntry == 0) && Dirty && (Cluster != NULL))
+            {
+                PMM_PAGEOUT_CLUSTER_ENTRY ClusterEntry;
+
+                /*
+                 * Defer the write: the page gets its swap slot when the
+                 * cluster is flushed, together with its neighbours.
+                 * Keep our references until then. The page is not free
+                 * yet, the flush counts it in FreedCount once it is.
+                 */
+                MmCreatePageFileMapping(Process, Address, MM_WAIT_ENTRY);
+                MmUnlockAddressSpace(AddressSpace);
+                if (Process != PsInitialSystemProcess)
+                    KeDetachProcess();
+
+                ClusterEntry = &Cluster->Entries[Cluster->Count++];
+                ClusterEntry->Page = Page;
+                ClusterEntry->Process = Process;
+                ClusterEntry->Address = Address;
+
+                if (Cluster->Count == MI_PAGE_FILE_WRITE_CLUSTER)
+                    MmFlushPageOutCluster(Cluster);
+
+                return STATUS_PENDING;
+            }
+
             if ((SwapEntry == 0) && Dirty)
             {
                 /* We don't have a Swap entry, yet the page is dirty. Get one */
@@ -260,9 +535,9 @@ GetEntry:
             if (Process != PsInitialSystemProcess)
                 KeDetachProcess();
 #if DBG
-            OldIrql = MiAcquirePfnLock();
+            OldIrql = MiAcquireRmapLock(Page);
             ASSERT(MmGetRmapListHeadPage(Page) == NULL);
-            MiReleasePfnLock(OldIrql);
+            MiReleaseRmapLock(Page, OldIrql);
 #endif
             MmReleasePageMemoryConsumer(MC_USER, Page);
 
@@ -327,7 +602,7 @@ NTAPI
 MmInsertRmap(PFN_NUMBER Page, PEPROCESS Process,
              PVOID Address)
 {
-    PMM_RMAP_ENTRY current_entry;
+    PMM_RMAP_ENTRY* HashLink;
     PMM_RMAP_ENTRY new_entry;
     ULONG PrevSize;
     KIRQL OldIrql;
@@ -340,6 +615,7 @@ MmInsertRmap(PFN_NUMBER Page, PEPROCESS Process,
     {
         KeBugCheck(MEMORY_MANAGEMENT);
     }
+    new_entry->Page = Page;
     new_entry->Address = Address;
     new_entry->Process = (PEPROCESS)Process;
 #if DBG
@@ -358,44 +634,22 @@ MmInsertRmap(PFN_NUMBER Page, PEPROCESS Process,
         KeBugCheck(MEMORY_MANAGEMENT);
     }
 
-    OldIrql = MiAcquirePfnLock();
-    current_entry = MmGetRmapListHeadPage(Page);
-
-    PMM_RMAP_ENTRY previous_entry = NULL;
-    /* Keep the list sorted */
-    while (current_entry && (current_entry->Address < Address))
-    {
-        previous_entry = current_entry;
-        current_entry = current_entry->Next;
-    }
-
-    /* In case of clash in the address, sort by process */
-    if (current_entry && (current_entry->Address == Address))
-    {
-        while (current_entry && (current_entry->Process < Process))
-        {
-            previous_entry = current_entry;
-            current_entry = current_entry->Next;
-        }
-    }
+    OldIrql = MiAcquireRmapLock(Page);
 
-    if (current_entry && (current_entry->Address == Address) && (current_entry->Process == Process))
+    HashLink = MiLookupRmapEntry(Page, Process, Address);
+    if (*HashLink != NULL)
     {
 #if DBG
-        DbgPrint("MmInsertRmap tries to add a second rmap entry for address %p\n", current_entry->Address);
+        DbgPrint("MmInsertRmap tries to add a second rmap entry for address %p\n", Address);
         DbgPrint("    current caller  %p\n", new_entry->Caller);
-        DbgPrint("    previous caller %p\n", current_entry->Caller);
+        DbgPrint("    previous caller %p\n", (*HashLink)->Caller);
 #endif
         KeBugCheck(MEMORY_MANAGEMENT);
     }
 
-    new_entry->Next = current_entry;
-    if (previous_entry)
-        previous_entry->Next = new_entry;
-    else
-        MmSetRmapListHeadPage(Page, new_entry);
+    MiLinkRmapEntry(new_entry, HashLink);
 
-    MiReleasePfnLock(OldIrql);
+    MiReleaseRmapLock(Page, OldIrql);
 
     if (!RMAP_IS_SEGMENT(Address))
     {
@@ -413,40 +667,29 @@ NTAPI
 MmDeleteRmap(PFN_NUMBER Page, PEPROCESS Process,
              PVOID Address)
 {
-    PMM_RMAP_ENTRY current_entry, previous_entry;
+    PMM_RMAP_ENTRY* HashLink;
+    PMM_RMAP_ENTRY current_entry;
     KIRQL OldIrql;
 
-    OldIrql = MiAcquirePfnLock();
-    previous_entry = NULL;
-    current_entry = MmGetRmapListHeadPage(Page);
+    OldIrql = MiAcquireRmapLock(Page);
 
-    while (current_entry != NULL)
+    HashLink = MiLookupRmapEntry(Page, Process, Address);
+    current_entry = *HashLink;
+    if (current_entry == NULL)
     {
-        if (current_entry->Process == (PEPROCESS)Process &&
-                current_entry->Address == Address)
-        {
-            if (previous_entry == NULL)
-            {
-                MmSetRmapListHeadPage(Page, current_entry->Next);
-            }
-            else
-            {
-                previous_entry->Next = current_entry->Next;
-            }
-            MiReleasePfnLock(OldIrql);
+        KeBugCheck(MEMORY_MANAGEMENT);
+    }
 
-            ExFreeToNPagedLookasideList(&RmapLookasideList, current_entry);
-            if (!RMAP_IS_SEGMENT(Address))
-            {
-                ASSERT(Process != NULL);
-                (void)InterlockedExchangeAddUL(&Process->Vm.WorkingSetSize, -PAGE_SIZE);
-            }
-            return;
-        }
-        previous_entry = current_entry;
-        current_entry = current_entry->Next;
+    MiUnlinkRmapEntry(current_entry, HashLink);
+
+    MiReleaseRmapLock(Page, OldIrql);
+
+    ExFreeToNPagedLookasideList(&RmapLookasideList, current_entry);
+    if (!RMAP_IS_SEGMENT(Address))
+    {
+        ASSERT(Process != NULL);
+        (void)InterlockedExchangeAddUL(&Process->Vm.WorkingSetSize, -PAGE_SIZE);
     }
-    KeBugCheck(MEMORY_MANAGEMENT);
 }
 
 /*
@@ -467,32 +710,25 @@ PVOID
 NTAPI
 MmGetSegmentRmap(PFN_NUMBER Page, PULONG RawOffset)
 {
-    PCACHE_SECTION_PAGE_TABLE Result = NULL;
-    PMM_RMAP_ENTRY current_entry;//, previous_entry;
+    PCACHE_SECTION_PAGE_TABLE Result;
+    PMM_RMAP_ENTRY current_entry;
 
-    /* Must hold the PFN lock */
-    ASSERT(KeGetCurrentIrql() == DISPATCH_LEVEL);
+    /* Must hold the rmap lock of the page */
+    MI_ASSERT_RMAP_LOCK_HELD(Page);
 
-    //previous_entry = NULL;
+    /* The segment rmap, if any, is always first */
     current_entry = MmGetRmapListHeadPage(Page);
-    while (current_entry != NULL)
-    {
-        if (RMAP_IS_SEGMENT(current_entry->Address))
-        {
-            Result = (PCACHE_SECTION_PAGE_TABLE)current_entry->Process;
-            *RawOffset = (ULONG_PTR)current_entry->Address & ~RMAP_SEGMENT_MASK;
-            if (*Result->Segment->Flags & MM_SEGMENT_INDELETE)
-            {
-                return NULL;
-            }
+    if ((current_entry == NULL) || !RMAP_IS_SEGMENT(current_entry->Address))
+        return NULL;
 
-            return Result;
-        }
-        //previous_entry = current_entry;
-        current_entry = current_entry->Next;
+    Result = (PCACHE_SECTION_PAGE_TABLE)current_entry->Process;
+    *RawOffset = (ULONG_PTR)current_entry->Address & ~RMAP_SEGMENT_MASK;
+    if (*Result->Segment->Flags & MM_SEGMENT_INDELETE)
+    {
+        return NULL;
     }
 
-    return NULL;
+    return Result;
 }
 
 /*
@@ -505,29 +741,20 @@ VOID
 NTAPI
 MmDeleteSectionAssociation(PFN_NUMBER Page)
 {
-    PMM_RMAP_ENTRY current_entry, previous_entry;
-    KIRQL OldIrql = MiAcquirePfnLock();
+    PMM_RMAP_ENTRY current_entry;
+    KIRQL OldIrql = MiAcquireRmapLock(Page);
 
-    previous_entry = NULL;
     current_entry = MmGetRmapListHeadPage(Page);
-    while (current_entry != NULL)
+    if ((current_entry == NULL) || !RMAP_IS_SEGMENT(current_entry->Address))
     {
-        if (RMAP_IS_SEGMENT(current_entry->Address))
-        {
-            if (previous_entry == NULL)
-            {
-                MmSetRmapListHeadPage(Page, current_entry->Next);
-            }
-            else
-            {
-                previous_entry->Next = current_entry->Next;
-            }
-            MiReleasePfnLock(OldIrql);
-            ExFreeToNPagedLookasideList(&RmapLookasideList, current_entry);
-            return;
-        }
-        previous_entry = current_entry;
-        current_entry = current_entry->Next;
+        MiReleaseRmapLock(Page, OldIrql);
+        return;
     }
-    MiReleasePfnLock(OldIrql);
+
+    MiUnlinkRmapEntry(current_entry,
+                      MiLookupRmapEntry(Page,
+                                        current_entry->Process,
+                                        current_entry->Address));
+    MiReleaseRmapLock(Page, OldIrql);
+    ExFreeToNPagedLookasideList(&RmapLookasideList, current_entry);
 }
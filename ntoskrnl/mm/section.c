@@ -1634,6 +1634,8 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
     if (HasSwapEntry)
     {
         SWAPENTRY DummyEntry;
+        PFN_NUMBER ClusterPages[MI_PAGE_FILE_READ_CLUSTER];
+        ULONG ClusterSize, i;
 
         MmGetPageFileMapping(Process, Address, &SwapEntry);
         if (SwapEntry == MM_WAIT_ENTRY)
@@ -1666,39 +1668,95 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
         /* Tell everyone else we are serving the fault. */
         MmCreatePageFileMapping(Process, Address, MM_WAIT_ENTRY);
 
+        /* The balancer took this page away from us earlier */
+        if (Process)
+        {
+            ASSERT(Process == PsGetCurrentProcess());
+            MiCountTrimmedPageFault();
+        }
+
+        /*
+         * Read ahead: the following pages of this view were likely paged out
+         * together with this one. Bring in those sitting in the next slots of
+         * the paging file with the same I/O, as long as memory is not tight.
+         */
+        ClusterPages[0] = Page;
+        ClusterSize = 1;
+        while ((ClusterSize < MmPageFileReadCluster) &&
+               (MmAvailablePages > MmLowMemoryThreshold))
+        {
+            PVOID NextAddress = (PVOID)((ULONG_PTR)PAddress + ClusterSize * PAGE_SIZE);
+            SWAPENTRY NextEntry;
+
+            if ((ULONG_PTR)NextAddress >= MA_GetEndingAddress(MemoryArea))
+                break;
+
+            if (!MmIsPageSwapEntry(Process, NextAddress))
+                break;
+
+            MmGetPageFileMapping(Process, NextAddress, &NextEntry);
+            if (NextEntry != MmOffsetSwapEntry(SwapEntry, ClusterSize))
+                break;
+
+            /* The page must end up with the same protection */
+            if (MmFindRegion((PVOID)MA_GetStartingAddress(MemoryArea),
+                             &MemoryArea->SectionData.RegionListHead,
+                             NextAddress, NULL) != Region)
+            {
+                break;
+            }
+
+            Status = MmRequestPageMemoryConsumer(MC_USER, FALSE, &ClusterPages[ClusterSize]);
+            if (!NT_SUCCESS(Status))
+                break;
+
+            MmDeletePageFileMapping(Process, NextAddress, &DummyEntry);
+            ASSERT(DummyEntry == NextEntry);
+            MmCreatePageFileMapping(Process, NextAddress, MM_WAIT_ENTRY);
+
+            ClusterSize++;
+        }
+
         MmUnlockAddressSpace(AddressSpace);
 
-        Status = MmReadFromSwapPage(SwapEntry, Page);
+        Status = MmReadFromSwapPages(SwapEntry, ClusterPages, ClusterSize);
         if (!NT_SUCCESS(Status))
         {
-            DPRINT1("MmReadFromSwapPage failed, status = %x\n", Status);
+            DPRINT1("MmReadFromSwapPages failed, status = %x\n", Status);
             KeBugCheck(MEMORY_MANAGEMENT);
         }
 
         MmLockAddressSpace(AddressSpace);
-        MmDeletePageFileMapping(Process, PAddress, &DummyEntry);
-        ASSERT(DummyEntry == MM_WAIT_ENTRY);
 
-        Status = MmCreateVirtualMapping(Process,
-                                        PAddress,
-                                        Region->Protect,
-                                        Page);
-        if (!NT_SUCCESS(Status))
+        for (i = 0; i < ClusterSize; i++)
         {
-            DPRINT("MmCreateVirtualMapping failed, not out of memory\n");
-            KeBugCheck(MEMORY_MANAGEMENT);
-            return Status;
-        }
+            PVOID ClusterAddress = (PVOID)((ULONG_PTR)PAddress + i * PAGE_SIZE);
 
-        /*
-         * Store the swap entry for later use.
-         */
-        MmSetSavedSwapEntryPage(Page, SwapEntry);
+            MmDeletePageFileMapping(Process, ClusterAddress, &DummyEntry);
+            ASSERT(DummyEntry == MM_WAIT_ENTRY);
+
+            Status = MmCreateVirtualMapping(Process,
+                                            ClusterAddress,
+                                            Region->Protect,
+                                            ClusterPages[i]);
+            if (!NT_SUCCESS(Status))
+            {
+                DPRINT("MmCreateVirtualMapping failed, not out of memory\n");
+                KeBugCheck(MEMORY_MANAGEMENT);
+                return Status;
+            }
+
+            /*
+             * Store the swap entry for later use.
+             */
+            MmSetSavedSwapEntryPage(ClusterPages[i], MmOffsetSwapEntry(SwapEntry, i));
+
+            /*
+             * Add the page to the process's working set
+             */
+            if (Process) MmInsertRmap(ClusterPages[i], Process, ClusterAddress);
+        }
 
-        /*
-         * Add the page to the process's working set
-         */
-        if (Process) MmInsertRmap(Page, Process, Address);
         /*
          * Finish the operation
          */
@@ -4686,13 +4744,6 @@ MmCreateSection (OUT PVOID  * Section,
     BOOLEAN FileLock = FALSE;
     BOOLEAN HaveFileObject = FALSE;
 
-    // FIXME: Implement support for large pages
-    if (AllocationAttributes & SEC_LARGE_PAGES)
-    {
-        DPRINT1("SEC_LARGE_PAGES is not supported\n");
-        return STATUS_INVALID_PARAMETER_6;
-    }
-
     /* Check if an ARM3 section is being created instead */
     if (!(AllocationAttributes & SEC_IMAGE))
     {
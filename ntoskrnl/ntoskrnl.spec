@@ -675,6 +675,7 @@
 @ stdcall KeRemoveDeviceQueue(ptr)
 @ stdcall KeRemoveEntryDeviceQueue(ptr ptr)
 @ stdcall KeRemoveQueue(ptr long ptr)
+@ stdcall -version=0x600+ KeRemoveQueueEx(ptr long long ptr ptr long)
 @ stdcall KeRemoveQueueDpc(ptr)
 @ stdcall KeRemoveSystemServiceTable(long)
 @ stdcall KeResetEvent(ptr)
@@ -688,6 +689,7 @@
 @ extern KeServiceDescriptorTable
 @ stdcall KeSetAffinityThread(ptr long)
 @ stdcall KeSetBasePriorityThread(ptr long)
+@ stdcall -version=0x601+ KeSetCoalescableTimer(ptr long long long long ptr)
 @ stdcall KeSetDmaIoCoherency(long)
 @ stdcall KeSetEvent(ptr long long)
 @ stdcall KeSetEventBoostPriority(ptr ptr)
@@ -19,8 +19,120 @@
 
 POBJECT_TYPE ObpDirectoryObjectType = NULL;
 
+/* Bucket counts a directory grows through once its chains get too long */
+static const ULONG ObpDirectoryBucketCounts[] = { 149, 599, 2399, 9601, 38393 };
+
 /* PRIVATE FUNCTIONS ******************************************************/
 
+FORCEINLINE
+POBJECT_DIRECTORY_ENTRY *
+ObpGetDirectoryBuckets(IN POBJECT_DIRECTORY Directory,
+                       OUT PULONG BucketCount)
+{
+    POBP_DIRECTORY PrivateDirectory = ObpGetPrivateDirectory(Directory);
+
+    /* Use the extended table once the directory has grown one */
+    if (PrivateDirectory->ExtendedHashBuckets)
+    {
+        *BucketCount = PrivateDirectory->ExtendedBucketCount;
+        return PrivateDirectory->ExtendedHashBuckets;
+    }
+
+    /* Otherwise use the buckets embedded in the directory */
+    *BucketCount = NUMBER_HASH_BUCKETS;
+    return Directory->HashBuckets;
+}
+
+/*++
+* @name ObpExpandDirectory
+*
+*     The ObpExpandDirectory routine moves the entries of a directory into
+*     a larger hash table, so that its chains stay short as it fills up.
+*
+* @param Directory
+*        Directory to expand. Must be locked exclusively.
+*
+* @return None.
+*
+* @remarks If the directory is already at its largest size, or the new
+*          table can't be allocated, the directory is left as it is.
+*
+*--*/
+static
+VOID
+ObpExpandDirectory(IN POBJECT_DIRECTORY Directory)
+{
+    POBP_DIRECTORY PrivateDirectory = ObpGetPrivateDirectory(Directory);
+    POBJECT_DIRECTORY_ENTRY *OldBuckets, *NewBuckets, *Bucket;
+    POBJECT_DIRECTORY_ENTRY Entry, NextEntry;
+    ULONG OldCount, NewCount, i;
+
+    /* Find the next size up */
+    OldBuckets = ObpGetDirectoryBuckets(Directory, &OldCount);
+    for (i = 0; i < RTL_NUMBER_OF(ObpDirectoryBucketCounts); i++)
+    {
+        if (ObpDirectoryBucketCounts[i] > OldCount) break;
+    }
+    if (i == RTL_NUMBER_OF(ObpDirectoryBucketCounts)) return;
+    NewCount = ObpDirectoryBucketCounts[i];
+
+    /* Allocate the new table */
+    NewBuckets = ExAllocatePoolWithTag(PagedPool,
+                                       NewCount * sizeof(POBJECT_DIRECTORY_ENTRY),
+                                       OB_DIR_TAG);
+    if (!NewBuckets) return;
+    RtlZeroMemory(NewBuckets, NewCount * sizeof(POBJECT_DIRECTORY_ENTRY));
+
+    /* Rehash every entry into it */
+    for (i = 0; i < OldCount; i++)
+    {
+        for (Entry = OldBuckets[i]; Entry; Entry = NextEntry)
+        {
+            NextEntry = Entry->ChainLink;
+            Bucket = &NewBuckets[Entry->HashValue % NewCount];
+            Entry->ChainLink = *Bucket;
+            *Bucket = Entry;
+        }
+        OldBuckets[i] = NULL;
+    }
+
+    /* Free the previous extended table, if there was one, and switch over */
+    if (PrivateDirectory->ExtendedHashBuckets)
+    {
+        ExFreePoolWithTag(PrivateDirectory->ExtendedHashBuckets, OB_DIR_TAG);
+    }
+    PrivateDirectory->ExtendedHashBuckets = NewBuckets;
+    PrivateDirectory->ExtendedBucketCount = NewCount;
+}
+
+/*++
+* @name ObpDeleteDirectory
+*
+*     The ObpDeleteDirectory routine frees the extended hash table of a
+*     directory object when it is deleted.
+*
+* @param ObjectBody
+*        Directory object being deleted.
+*
+* @return None.
+*
+* @remarks None.
+*
+*--*/
+VOID
+NTAPI
+ObpDeleteDirectory(IN PVOID ObjectBody)
+{
+    POBP_DIRECTORY PrivateDirectory = ObpGetPrivateDirectory(ObjectBody);
+
+    /* Free the extended table if the directory ever grew one */
+    if (PrivateDirectory->ExtendedHashBuckets)
+    {
+        ExFreePoolWithTag(PrivateDirectory->ExtendedHashBuckets, OB_DIR_TAG);
+        PrivateDirectory->ExtendedHashBuckets = NULL;
+    }
+}
+
 /*++
 * @name ObpInsertEntryDirectory
 *
@@ -49,6 +161,7 @@ ObpInsertEntryDirectory(IN POBJECT_DIRECTORY Parent,
     POBJECT_DIRECTORY_ENTRY *AllocatedEntry;
     POBJECT_DIRECTORY_ENTRY NewEntry;
     POBJECT_HEADER_NAME_INFO HeaderNameInfo;
+    ULONG BucketCount;
 
     /* Make sure we have a name */
     ASSERT(ObjectHeader->NameInfoOffset != 0);
@@ -78,7 +191,7 @@ ObpInsertEntryDirectory(IN POBJECT_DIRECTORY Parent,
     HeaderNameInfo = OBJECT_HEADER_TO_NAME_INFO(ObjectHeader);
 
     /* Get the Allocated entry */
-    AllocatedEntry = &Parent->HashBuckets[Context->HashIndex];
+    AllocatedEntry = &ObpGetDirectoryBuckets(Parent, &BucketCount)[Context->HashIndex];
 
     /* Set it */
     NewEntry->ChainLink = *AllocatedEntry;
@@ -89,6 +202,14 @@ ObpInsertEntryDirectory(IN POBJECT_DIRECTORY Parent,
 
     /* Associate the Directory */
     HeaderNameInfo->Directory = Parent;
+
+    /* Grow the hash table once the chains average more than two entries */
+    if (++ObpGetPrivateDirectory(Parent)->EntryCount > (2 * BucketCount))
+    {
+        ObpExpandDirectory(Parent);
+        ObpGetDirectoryBuckets(Parent, &BucketCount);
+        Context->HashIndex = (USHORT)(Context->HashValue % BucketCount);
+    }
     return TRUE;
 }
 
@@ -166,14 +287,16 @@ ObpLookupEntryDirectory(IN POBJECT_DIRECTORY Directory,
     POBJECT_HEADER ObjectHeader;
     ULONG HashValue;
     ULONG HashIndex;
+    ULONG BucketCount;
     LONG TotalChars;
     WCHAR CurrentChar;
+    POBJECT_DIRECTORY_ENTRY *Buckets;
     POBJECT_DIRECTORY_ENTRY *AllocatedEntry;
     POBJECT_DIRECTORY_ENTRY *LookupBucket;
     POBJECT_DIRECTORY_ENTRY CurrentEntry;
     PVOID FoundObject = NULL;
     PWSTR Buffer;
-    POBJECT_DIRECTORY ShadowDirectory;
+    POBJECT_DIRECTORY ShadowDirectory = NULL;
 
     PAGED_CODE();
 
@@ -208,18 +331,10 @@ ObpLookupEntryDirectory(IN POBJECT_DIRECTORY Directory,
         else HashValue += (CurrentChar - ('a'-'A'));
     }
 
-    /* Merge it with our number of hash buckets */
-    HashIndex = HashValue % 37;
-
     /* Save the result */
     Context->HashValue = HashValue;
-    Context->HashIndex = (USHORT)HashIndex;
 
 DoItAgain:
-    /* Get the root entry and set it as our lookup bucket */
-    AllocatedEntry = &Directory->HashBuckets[HashIndex];
-    LookupBucket = AllocatedEntry;
-
     /* Check if the directory is already locked */
     if (!Context->DirectoryLocked)
     {
@@ -227,6 +342,17 @@ DoItAgain:
         ObpAcquireDirectoryLockShared(Directory, Context);
     }
 
+    /* Merge it with our number of hash buckets, which only changes under the lock */
+    Buckets = ObpGetDirectoryBuckets(Directory, &BucketCount);
+    HashIndex = HashValue % BucketCount;
+
+    /* Save the index for insertion or deletion, unless this is the shadow directory */
+    if (!ShadowDirectory) Context->HashIndex = (USHORT)HashIndex;
+
+    /* Get the root entry and set it as our lookup bucket */
+    AllocatedEntry = &Buckets[HashIndex];
+    LookupBucket = AllocatedEntry;
+
     /* Start looping */
     while ((CurrentEntry = *AllocatedEntry))
     {
@@ -255,12 +381,16 @@ DoItAgain:
     /* Check if we still have an entry */
     if (CurrentEntry)
     {
-        /* Set this entry as the first, to speed up incoming insertion */
+        /*
+         * Set this entry as the first, to speed up incoming deletion. Only do
+         * it if the caller holds the directory exclusively: plain lookups
+         * stay shared, so that concurrent opens by name don't serialize on
+         * the directory lock.
+         */
         if (AllocatedEntry != LookupBucket)
         {
-            /* Check if the directory was locked or convert the lock */
-            if ((Context->DirectoryLocked) ||
-                (ExConvertPushLockSharedToExclusive(&Directory->Lock)))
+            /* Check if the directory was locked */
+            if (Context->DirectoryLocked)
             {
                 /* Set the Current Entry */
                 *AllocatedEntry = CurrentEntry->ChainLink;
@@ -346,18 +476,20 @@ ObpDeleteEntryDirectory(POBP_LOOKUP_CONTEXT Context)
     POBJECT_DIRECTORY Directory;
     POBJECT_DIRECTORY_ENTRY *AllocatedEntry;
     POBJECT_DIRECTORY_ENTRY CurrentEntry;
+    ULONG BucketCount;
 
     /* Get the Directory */
     Directory = Context->Directory;
     if (!Directory) return FALSE;
 
     /* Get the Entry */
-    AllocatedEntry = &Directory->HashBuckets[Context->HashIndex];
+    AllocatedEntry = &ObpGetDirectoryBuckets(Directory, &BucketCount)[Context->HashIndex];
     CurrentEntry = *AllocatedEntry;
 
     /* Unlink the Entry */
     *AllocatedEntry = CurrentEntry->ChainLink;
     CurrentEntry->ChainLink = NULL;
+    ObpGetPrivateDirectory(Directory)->EntryCount--;
 
     /* Free it */
     ExFreePoolWithTag(CurrentEntry, OB_DIR_TAG);
@@ -503,7 +635,8 @@ NtQueryDirectoryObject(IN HANDLE DirectoryHandle,
     POBJECT_DIRECTORY_INFORMATION DirectoryInfo;
     ULONG Length, TotalLength;
     ULONG Count, CurrentEntry;
-    ULONG Hash;
+    ULONG Hash, BucketCount;
+    POBJECT_DIRECTORY_ENTRY *Buckets;
     POBJECT_DIRECTORY_ENTRY Entry;
     POBJECT_HEADER ObjectHeader;
     POBJECT_HEADER_NAME_INFO ObjectNameInfo;
@@ -578,10 +711,11 @@ NtQueryDirectoryObject(IN HANDLE DirectoryHandle,
 
     /* Set default status and start looping */
     Status = STATUS_NO_MORE_ENTRIES;
-    for (Hash = 0; Hash < 37; Hash++)
+    Buckets = ObpGetDirectoryBuckets(Directory, &BucketCount);
+    for (Hash = 0; Hash < BucketCount; Hash++)
     {
         /* Get this entry and loop all of them */
-        Entry = Directory->HashBuckets[Hash];
+        Entry = Buckets[Hash];
         while (Entry)
         {
             /* Check if we should process this entry */
@@ -794,14 +928,14 @@ NtCreateDirectoryObject(OUT PHANDLE DirectoryHandle,
                             ObjectAttributes,
                             PreviousMode,
                             NULL,
-                            sizeof(OBJECT_DIRECTORY),
+                            sizeof(OBP_DIRECTORY),
                             0,
                             0,
                             (PVOID*)&Directory);
     if (!NT_SUCCESS(Status)) return Status;
 
     /* Setup the object */
-    RtlZeroMemory(Directory, sizeof(OBJECT_DIRECTORY));
+    RtlZeroMemory(Directory, sizeof(OBP_DIRECTORY));
     ExInitializePushLock(&Directory->Lock);
     Directory->SessionId = -1;
 
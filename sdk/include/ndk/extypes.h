@@ -1752,6 +1752,17 @@ typedef struct _SYSTEM_MEMORY_LIST_INFORMATION
     SIZE_T ModifiedPageCountPageFile;
 } SYSTEM_MEMORY_LIST_INFORMATION, *PSYSTEM_MEMORY_LIST_INFORMATION;
 
+#ifdef __REACTOS__
+//
+// Class 80 with the ReactOS specific tail, returned when the buffer has room for it
+//
+typedef struct _SYSTEM_MEMORY_LIST_INFORMATION_EX
+{
+    SYSTEM_MEMORY_LIST_INFORMATION Lists;
+    SIZE_T BackgroundZeroedPageCount;
+} SYSTEM_MEMORY_LIST_INFORMATION_EX, *PSYSTEM_MEMORY_LIST_INFORMATION_EX;
+#endif
+
 //
 // Firmware variable attributes
 //
@@ -114,6 +114,12 @@
         IN ULONG NumberToFind,
         IN ULONG HintIndex);
 
+    ULONG NTAPI
+    RtlFindNextForwardRunSet(
+        IN PRTL_BITMAP BitMapHeader,
+        IN ULONG FromIndex,
+        OUT PULONG StartingRunIndex);
+
     VOID NTAPI
     RtlSetBits(
         IN PRTL_BITMAP BitMapHeader,
@@ -374,6 +380,22 @@ typedef struct _HV_TRACK_CELL_REF
     USHORT StaticCount;
 } HV_TRACK_CELL_REF, *PHV_TRACK_CELL_REF;
 
+//
+// Copy of the dirty data of a hive, written out without holding off writers
+//
+typedef struct _HV_FLUSH_SNAPSHOT
+{
+    PHBASE_BLOCK BaseBlock;
+    RTL_BITMAP DirtyVector;
+    ULONG Length;
+    ULONG DirtyCount;
+    ULONG DirtyBlocks;
+    PUCHAR DirtyData;
+    PUCHAR Buffer;
+    ULONG BufferSize;
+    ULONG BytesWritten;
+} HV_FLUSH_SNAPSHOT, *PHV_FLUSH_SNAPSHOT;
+
 extern ULONG CmlibTraceLevel;
 
 //
@@ -514,6 +536,25 @@ BOOLEAN CMAPI
 HvSyncHive(
    PHHIVE RegistryHive);
 
+BOOLEAN
+CMAPI
+HvCaptureDirtyData(
+    _In_ PHHIVE RegistryHive,
+    _Out_ PHV_FLUSH_SNAPSHOT Snapshot);
+
+BOOLEAN
+CMAPI
+HvWriteDirtyData(
+    _In_ PHHIVE RegistryHive,
+    _Inout_ PHV_FLUSH_SNAPSHOT Snapshot);
+
+VOID
+CMAPI
+HvReleaseDirtyData(
+    _In_ PHHIVE RegistryHive,
+    _Inout_ PHV_FLUSH_SNAPSHOT Snapshot,
+    _In_ BOOLEAN Written);
+
 BOOLEAN CMAPI
 HvWriteHive(
    PHHIVE RegistryHive);
@@ -63,6 +63,8 @@ HvpAddBin(
         RegistryHive->Storage[Storage].BlockList[OldBlockListSize + i].BlockAddress =
             ((ULONG_PTR)Bin + (i * HBLOCK_SIZE));
         RegistryHive->Storage[Storage].BlockList[OldBlockListSize + i].BinAddress = (ULONG_PTR)Bin;
+        RegistryHive->Storage[Storage].BlockList[OldBlockListSize + i].CmView = NULL;
+        RegistryHive->Storage[Storage].BlockList[OldBlockListSize + i].MemAlloc = BinSize;
     }
 
     /* Initialize a free block in this heap. */
@@ -104,7 +104,10 @@ HvpFreeHiveBins(
             if (Hive->Storage[Storage].BlockList[i].BinAddress != (ULONG_PTR)Bin)
             {
                 Bin = (PHBIN)Hive->Storage[Storage].BlockList[i].BinAddress;
-                Hive->Free((PHBIN)Hive->Storage[Storage].BlockList[i].BinAddress, 0);
+
+                /* Bins used in place are freed along with the first one */
+                if (Hive->Storage[Storage].BlockList[i].MemAlloc)
+                    Hive->Free(Bin, 0);
             }
             Hive->Storage[Storage].BlockList[i].BinAddress = (ULONG_PTR)NULL;
             Hive->Storage[Storage].BlockList[i].BlockAddress = (ULONG_PTR)NULL;
@@ -290,7 +293,8 @@ HvpCreateHive(
  * @brief
  * Initializes a hive descriptor from an already loaded
  * registry hive stored in memory. The data of the hive is
- * copied and it is prepared for read/write access.
+ * copied, unless it was read for the hive, and it is
+ * prepared for read/write access.
  *
  * @param[in] Hive
  * A pointer to a registry hive descriptor where
@@ -301,6 +305,13 @@ HvpCreateHive(
  * A pointer to a valid base block header containing
  * registry header data for initialization.
  *
+ * @param[in] BinData
+ * A pointer to the bins of the hive, read into a buffer
+ * of ChunkBase->Length bytes that the hive takes over on
+ * success. The bins are used in place and the buffer is
+ * freed along with them. If this argument is NULL, the
+ * bins follow the base block and they are copied.
+ *
  * @param[in] FileName
  * A pointer to a Unicode string structure containing
  * the hive file name to be copied from. If this argument
@@ -318,11 +329,14 @@ CMAPI
 HvpInitializeMemoryHive(
     _In_ PHHIVE Hive,
     _In_ PHBASE_BLOCK ChunkBase,
+    _In_opt_ PVOID BinData,
     _In_opt_ PCUNICODE_STRING FileName)
 {
     SIZE_T BlockIndex;
     PHBIN Bin, NewBin;
+    ULONG_PTR BinBase;
     ULONG i;
+    ULONG MemAlloc;
     ULONG BitmapSize;
     PULONG BitmapBuffer;
     SIZE_T ChunkSize;
@@ -350,8 +364,9 @@ HvpInitializeMemoryHive(
 
     /*
      * Build a block list from the in-memory chunk and copy the data as
-     * we go.
+     * we go, unless the bins were read for us.
      */
+    BinBase = BinData ? (ULONG_PTR)BinData : (ULONG_PTR)ChunkBase + HBLOCK_SIZE;
 
     Hive->Storage[Stable].Length = (ULONG)(ChunkSize / HBLOCK_SIZE);
     Hive->Storage[Stable].BlockList =
@@ -366,9 +381,11 @@ HvpInitializeMemoryHive(
 
     for (BlockIndex = 0; BlockIndex < Hive->Storage[Stable].Length; )
     {
-        Bin = (PHBIN)((ULONG_PTR)ChunkBase + (BlockIndex + 1) * HBLOCK_SIZE);
+        Bin = (PHBIN)(BinBase + BlockIndex * HBLOCK_SIZE);
         if (Bin->Signature != HV_HBIN_SIGNATURE ||
            (Bin->Size % HBLOCK_SIZE) != 0 ||
+            Bin->Size == 0 ||
+           (Bin->Size / HBLOCK_SIZE) > (Hive->Storage[Stable].Length - BlockIndex) ||
            (Bin->FileOffset / HBLOCK_SIZE) != BlockIndex)
         {
             /*
@@ -395,27 +412,33 @@ HvpInitializeMemoryHive(
             DPRINT1("Bin at index %lu is corrupt and it has been repaired!\n", (unsigned long)BlockIndex);
         }
 
-        NewBin = Hive->Allocate(Bin->Size, TRUE, TAG_CM);
-        if (NewBin == NULL)
+        if (BinData)
         {
-            Hive->Free(Hive->Storage[Stable].BlockList, 0);
-            Hive->Free(Hive->BaseBlock, Hive->BaseBlockAlloc);
-            return STATUS_NO_MEMORY;
+            /* Use the bin where it is, the whole buffer is given to the first one below */
+            NewBin = Bin;
+            MemAlloc = 0;
         }
-
-        Hive->Storage[Stable].BlockList[BlockIndex].BinAddress = (ULONG_PTR)NewBin;
-        Hive->Storage[Stable].BlockList[BlockIndex].BlockAddress = (ULONG_PTR)NewBin;
-
-        RtlCopyMemory(NewBin, Bin, Bin->Size);
-
-        if (Bin->Size > HBLOCK_SIZE)
+        else
         {
-            for (i = 1; i < Bin->Size / HBLOCK_SIZE; i++)
+            NewBin = Hive->Allocate(Bin->Size, TRUE, TAG_CM);
+            if (NewBin == NULL)
             {
-                Hive->Storage[Stable].BlockList[BlockIndex + i].BinAddress = (ULONG_PTR)NewBin;
-                Hive->Storage[Stable].BlockList[BlockIndex + i].BlockAddress =
-                    ((ULONG_PTR)NewBin + (i * HBLOCK_SIZE));
+                Hive->Free(Hive->Storage[Stable].BlockList, 0);
+                Hive->Free(Hive->BaseBlock, Hive->BaseBlockAlloc);
+                return STATUS_NO_MEMORY;
             }
+
+            RtlCopyMemory(NewBin, Bin, Bin->Size);
+            MemAlloc = Bin->Size;
+        }
+
+        for (i = 0; i < Bin->Size / HBLOCK_SIZE; i++)
+        {
+            Hive->Storage[Stable].BlockList[BlockIndex + i].BinAddress = (ULONG_PTR)NewBin;
+            Hive->Storage[Stable].BlockList[BlockIndex + i].BlockAddress =
+                ((ULONG_PTR)NewBin + (i * HBLOCK_SIZE));
+            Hive->Storage[Stable].BlockList[BlockIndex + i].CmView = NULL;
+            Hive->Storage[Stable].BlockList[BlockIndex + i].MemAlloc = MemAlloc;
         }
 
         BlockIndex += Bin->Size / HBLOCK_SIZE;
@@ -455,6 +478,10 @@ HvpInitializeMemoryHive(
 
     HvpInitFileName(Hive->BaseBlock, FileName);
 
+    /* The hive owns the bins buffer now, it's freed with the first bin */
+    if (BinData)
+        Hive->Storage[Stable].BlockList[0].MemAlloc = (ULONG)ChunkSize;
+
     return STATUS_SUCCESS;
 }
 
@@ -1041,9 +1068,9 @@ HvLoadHive(
     ULONG Result, Result2;
 #endif
     LARGE_INTEGER TimeStamp;
-    ULONG Offset = 0;
-    PVOID HiveData;
-    ULONG FileSize;
+    ULONG Offset;
+    PVOID BinData;
+    ULONG BinSize;
     BOOLEAN HiveSelfHeal = FALSE;
 
     /* Get the hive header */
@@ -1149,52 +1176,47 @@ HvLoadHive(
     Hive->BaseBlock = BaseBlock;
     Hive->Version = BaseBlock->Minor;
 
-    /* Allocate a buffer large enough to hold the hive */
-    FileSize = HBLOCK_SIZE + BaseBlock->Length; // == sizeof(HBASE_BLOCK) + BaseBlock->Length;
-    HiveData = Hive->Allocate(FileSize, TRUE, TAG_CM);
-    if (!HiveData)
+    /*
+     * Read all the bins into one buffer right after the header. The hive
+     * uses them in place and takes the buffer over, so the hive costs its
+     * size in paged pool once rather than a read buffer plus a copy of
+     * every bin.
+     *
+     * FIXME: We should be reading the hive block by block instead,
+     * deconstruct the block buffer and enlist the bins and prepare
+     * the storage for the hive, rather than going through
+     * HvpInitializeMemoryHive as HINIT_MEMORY does.
+     */
+    BinSize = BaseBlock->Length;
+    BinData = Hive->Allocate(BinSize, TRUE, TAG_CM);
+    if (!BinData)
     {
         Hive->Free(BaseBlock, Hive->BaseBlockAlloc);
         DPRINT1("There's no enough memory to allocate hive data\n");
         return STATUS_INSUFFICIENT_RESOURCES;
     }
 
-    /* HACK (see explanation below): Now read the whole hive */
+    Offset = HBLOCK_SIZE;
     Success = Hive->FileRead(Hive,
                              HFILE_TYPE_PRIMARY,
                              &Offset,
-                             HiveData,
-                             FileSize);
+                             BinData,
+                             BinSize);
     if (!Success)
     {
-        DPRINT1("Failed to read the whole hive\n");
-        Hive->Free(HiveData, FileSize);
+        DPRINT1("Failed to read the hive bins\n");
+        Hive->Free(BinData, BinSize);
         Hive->Free(BaseBlock, Hive->BaseBlockAlloc);
         return STATUS_NOT_REGISTRY_FILE;
     }
 
-    /*
-     * HACK (FIXME): Free our base block... it's useless in
-     * this implementation.
-     *
-     * And it's useless because while the idea of reading the
-     * hive from physical file is correct, the implementation
-     * is hacky and incorrect. Instead of reading the whole hive,
-     * we should be instead reading the hive block by block,
-     * deconstruct the block buffer and enlist the bins and
-     * prepare the storage for the hive. What we currently do
-     * is we try to initialize the hive storage and bins enlistment
-     * by calling HvpInitializeMemoryHive below. This mixes
-     * HINIT_FILE and HINIT_MEMORY together which is disgusting
-     * because HINIT_FILE implementation shouldn't be calling
-     * HvpInitializeMemoryHive.
-     */
+    /* The header we already have is copied into a new base block */
+    Status = HvpInitializeMemoryHive(Hive, BaseBlock, BinData, FileName);
     Hive->Free(BaseBlock, Hive->BaseBlockAlloc);
-    Status = HvpInitializeMemoryHive(Hive, HiveData, FileName);
     if (!NT_SUCCESS(Status))
     {
         DPRINT1("Failed to initialize hive from memory\n");
-        Hive->Free(HiveData, FileSize);
+        Hive->Free(BinData, BinSize);
         return Status;
     }
 
@@ -1410,7 +1432,7 @@ HvInitialize(
         case HINIT_MEMORY:
         {
             /* Initialize a hive from memory */
-            Status = HvpInitializeMemoryHive(Hive, HiveData, FileName);
+            Status = HvpInitializeMemoryHive(Hive, HiveData, NULL, FileName);
             break;
         }
 
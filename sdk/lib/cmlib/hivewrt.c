@@ -30,19 +30,17 @@ IoSetThreadHardErrorMode(
  * Validates the base block header of a primary
  * hive for consistency.
  *
- * @param[in] RegistryHive
- * A pointer to a hive descriptor to look
- * for the header block.
+ * @param[in] BaseBlock
+ * A pointer to the base block header to
+ * validate.
  */
 static
 VOID
 HvpValidateBaseHeader(
-    _In_ PHHIVE RegistryHive)
+    _In_ PHBASE_BLOCK BaseBlock)
 {
-    PHBASE_BLOCK BaseBlock;
-
     /*
-     * Cache the base block and validate it.
+     * Validate the base block.
      * Especially...
      *
      * 1. It must must have a valid signature.
@@ -50,12 +48,193 @@ HvpValidateBaseHeader(
      * 3. It must be of an adequate major version,
      *    not anything else.
      */
-    BaseBlock = RegistryHive->BaseBlock;
     ASSERT(BaseBlock->Signature == HV_HBLOCK_SIGNATURE);
     ASSERT(BaseBlock->Format == HBASE_FORMAT_MEMORY);
     ASSERT(BaseBlock->Major == HSYS_MAJOR);
 }
 
+/**
+ * @brief
+ * Describes the dirty data of a hive in place,
+ * without copying it, for writing it out while
+ * the caller keeps the hive locked.
+ *
+ * @param[in] RegistryHive
+ * A pointer to a hive descriptor of which the
+ * dirty data is to be described.
+ *
+ * @param[out] Snapshot
+ * A pointer to a snapshot that receives the
+ * description.
+ */
+static
+VOID
+HvpReferenceDirtyData(
+    _In_ PHHIVE RegistryHive,
+    _Out_ PHV_FLUSH_SNAPSHOT Snapshot)
+{
+    RtlZeroMemory(Snapshot, sizeof(*Snapshot));
+    Snapshot->BaseBlock = RegistryHive->BaseBlock;
+    Snapshot->DirtyVector = RegistryHive->DirtyVector;
+    Snapshot->Length = RegistryHive->Storage[Stable].Length;
+}
+
+/**
+ * @brief
+ * Finds the next run of blocks to be written
+ * out, starting at a given block.
+ *
+ * @param[in] RegistryHive
+ * A pointer to a hive descriptor where the
+ * blocks belong to.
+ *
+ * @param[in] Snapshot
+ * A pointer to the snapshot whose dirty blocks
+ * are to be written. If NULL, every block of
+ * the hive is written.
+ *
+ * @param[in] FromIndex
+ * The block to start looking from.
+ *
+ * @param[out] RunIndex
+ * Receives the first block of the run.
+ *
+ * @return
+ * Returns the number of blocks in the run, or 0
+ * if there are no more blocks to be written.
+ */
+static
+ULONG
+HvpFindDirtyRun(
+    _In_ PHHIVE RegistryHive,
+    _In_opt_ PHV_FLUSH_SNAPSHOT Snapshot,
+    _In_ ULONG FromIndex,
+    _Out_ PULONG RunIndex)
+{
+    ULONG Length, RunLength;
+
+    Length = Snapshot ? Snapshot->Length : RegistryHive->Storage[Stable].Length;
+    if (FromIndex >= Length)
+    {
+        return 0;
+    }
+
+    /* Without a snapshot the whole hive gets written */
+    if (!Snapshot)
+    {
+        *RunIndex = FromIndex;
+        return Length - FromIndex;
+    }
+
+    /* The vector can have bits set past the end of the hive, ignore those */
+    RunLength = RtlFindNextForwardRunSet(&Snapshot->DirtyVector, FromIndex, RunIndex);
+    if (!RunLength || *RunIndex >= Length)
+    {
+        return 0;
+    }
+
+    return min(RunLength, Length - *RunIndex);
+}
+
+/**
+ * @brief
+ * Writes the blocks of a hive to one of its
+ * files, coalescing runs of consecutive blocks
+ * into single writes.
+ *
+ * @param[in] RegistryHive
+ * A pointer to a hive descriptor where the
+ * blocks belong to.
+ *
+ * @param[in] Snapshot
+ * A pointer to the snapshot whose dirty blocks
+ * are to be written. If NULL, every block of
+ * the hive is written.
+ *
+ * @param[in] FileType
+ * The file type of a registry hive to write
+ * the blocks into.
+ *
+ * @param[in] FileOffset
+ * The file offset where the blocks start.
+ *
+ * @param[in] Packed
+ * If set to TRUE, the blocks are written back to back
+ * from FileOffset on, as the log stores them. Otherwise
+ * each block is written at its own position in the hive.
+ *
+ * @return
+ * Returns TRUE if all the blocks were written,
+ * FALSE otherwise.
+ */
+static
+BOOLEAN
+HvpWriteBlocks(
+    _In_ PHHIVE RegistryHive,
+    _In_opt_ PHV_FLUSH_SNAPSHOT Snapshot,
+    _In_ ULONG FileType,
+    _In_ ULONG FileOffset,
+    _In_ BOOLEAN Packed)
+{
+    BOOLEAN Success;
+    ULONG BlockIndex;
+    ULONG RunLength;
+    ULONG Count;
+    ULONG Written;
+    ULONG Offset;
+    PHMAP_ENTRY BlockList;
+    ULONG_PTR Block;
+
+    BlockIndex = 0;
+    Written = 0;
+    while ((RunLength = HvpFindDirtyRun(RegistryHive, Snapshot, BlockIndex, &BlockIndex)))
+    {
+        while (RunLength)
+        {
+            if (Snapshot && Snapshot->DirtyData)
+            {
+                /* Captured blocks are packed, the whole run is contiguous */
+                Block = (ULONG_PTR)Snapshot->DirtyData + Written * HBLOCK_SIZE;
+                Count = RunLength;
+            }
+            else
+            {
+                /* Blocks of the same bin, or of a mapped hive, are contiguous */
+                BlockList = RegistryHive->Storage[Stable].BlockList;
+                Block = BlockList[BlockIndex].BlockAddress;
+                for (Count = 1; Count < RunLength; Count++)
+                {
+                    if (BlockList[BlockIndex + Count].BlockAddress != Block + Count * HBLOCK_SIZE)
+                        break;
+                }
+            }
+
+            /* Write the whole run at once */
+            Offset = FileOffset + (Packed ? Written : BlockIndex) * HBLOCK_SIZE;
+            Success = RegistryHive->FileWrite(RegistryHive, FileType,
+                                              &Offset, (PVOID)Block,
+                                              Count * HBLOCK_SIZE);
+            if (!Success)
+            {
+                DPRINT1("Failed to write hive blocks (block index 0x%x, count %u, file type %u)\n",
+                        BlockIndex, Count, FileType);
+                return FALSE;
+            }
+
+            if (Snapshot)
+            {
+                Snapshot->BytesWritten += Count * HBLOCK_SIZE;
+            }
+
+            BlockIndex += Count;
+            Written += Count;
+            RunLength -= Count;
+        }
+    }
+
+    return TRUE;
+}
+
 /**
  * @unimplemented
  * @brief
@@ -70,6 +249,10 @@ HvpValidateBaseHeader(
  * belongs to and of which we write data into the
  * said log.
  *
+ * @param[in] Snapshot
+ * A pointer to the snapshot of dirty data to
+ * be written into the log.
+ *
  * @return
  * Returns TRUE if log transaction writing has succeeded,
  * FALSE otherwise.
@@ -78,31 +261,35 @@ HvpValidateBaseHeader(
  * The function is not completely implemented, that is,
  * it lacks the implementation for growing the log file size.
  * See the FIXME comment below for further details.
+ *
+ * When the snapshot holds a copy of the dirty blocks, the
+ * header and the blocks are written with a single write.
  */
 static
 BOOLEAN
 CMAPI
 HvpWriteLog(
-    _In_ PHHIVE RegistryHive)
+    _In_ PHHIVE RegistryHive,
+    _In_ PHV_FLUSH_SNAPSHOT Snapshot)
 {
     BOOLEAN Success;
     ULONG FileOffset;
     ULONG BlockIndex;
-    ULONG LastIndex;
-    PVOID Block;
+    ULONG RunLength;
     UINT32 BitmapSize, BufferSize;
+    PHBASE_BLOCK BaseBlock;
     PUCHAR HeaderBuffer, Ptr;
 
     /*
      * The hive log we are going to write data into
      * has to be writable and with a sane storage.
      */
+    BaseBlock = Snapshot->BaseBlock;
     ASSERT(!RegistryHive->ReadOnly);
-    ASSERT(RegistryHive->BaseBlock->Length ==
-           RegistryHive->Storage[Stable].Length * HBLOCK_SIZE);
+    ASSERT(BaseBlock->Length == Snapshot->Length * HBLOCK_SIZE);
 
     /* Validate the base header before we go further */
-    HvpValidateBaseHeader(RegistryHive);
+    HvpValidateBaseHeader(BaseBlock);
 
     /*
      * The sequences can diverge during a forced system shutdown
@@ -111,11 +298,10 @@ HvpWriteLog(
      * sequences have been modified during writing into the log
      * or hive. In such cases the hive needs a repair.
      */
-    if (RegistryHive->BaseBlock->Sequence1 !=
-        RegistryHive->BaseBlock->Sequence2)
+    if (BaseBlock->Sequence1 != BaseBlock->Sequence2)
     {
         DPRINT1("The sequences DO NOT MATCH (Sequence1 == 0x%x, Sequence2 == 0x%x)\n",
-                RegistryHive->BaseBlock->Sequence1, RegistryHive->BaseBlock->Sequence2);
+                BaseBlock->Sequence1, BaseBlock->Sequence2);
         return FALSE;
     }
 
@@ -130,15 +316,25 @@ HvpWriteLog(
      * Now calculate the bitmap and buffer sizes to hold up our
      * contents in a buffer.
      */
-    BitmapSize = ROUND_UP(sizeof(ULONG) + RegistryHive->DirtyVector.SizeOfBitMap, HSECTOR_SIZE);
+    BitmapSize = ROUND_UP(sizeof(ULONG) + Snapshot->DirtyVector.SizeOfBitMap, HSECTOR_SIZE);
     BufferSize = HV_LOG_HEADER_SIZE + BitmapSize;
 
-    /* Now allocate the base header block buffer */
-    HeaderBuffer = RegistryHive->Allocate(BufferSize, TRUE, TAG_CM);
-    if (!HeaderBuffer)
+    /*
+     * A captured snapshot reserves room for the header right
+     * in front of the dirty blocks, otherwise allocate it.
+     */
+    if (Snapshot->DirtyData)
     {
-        DPRINT1("Couldn't allocate buffer for base header block\n");
-        return FALSE;
+        HeaderBuffer = Snapshot->DirtyData - BufferSize;
+    }
+    else
+    {
+        HeaderBuffer = RegistryHive->Allocate(BufferSize, TRUE, TAG_CM);
+        if (!HeaderBuffer)
+        {
+            DPRINT1("Couldn't allocate buffer for base header block\n");
+            return FALSE;
+        }
     }
 
     /* Great, now zero out the buffer */
@@ -149,12 +345,12 @@ HvpWriteLog(
      * increment the primary sequence number
      * as we are at the half of the work.
      */
-    RegistryHive->BaseBlock->Type = HFILE_TYPE_LOG;
-    RegistryHive->BaseBlock->Sequence1++;
-    RegistryHive->BaseBlock->CheckSum = HvpHiveHeaderChecksum(RegistryHive->BaseBlock);
+    BaseBlock->Type = HFILE_TYPE_LOG;
+    BaseBlock->Sequence1++;
+    BaseBlock->CheckSum = HvpHiveHeaderChecksum(BaseBlock);
 
     /* Copy the base block header */
-    RtlCopyMemory(HeaderBuffer, RegistryHive->BaseBlock, HV_LOG_HEADER_SIZE);
+    RtlCopyMemory(HeaderBuffer, BaseBlock, HV_LOG_HEADER_SIZE);
     Ptr = HeaderBuffer + HV_LOG_HEADER_SIZE;
 
     /* Copy the dirty vector */
@@ -164,74 +360,50 @@ HvpWriteLog(
     /*
      * FIXME: In ReactOS a vector contains one bit per block
      * whereas in Windows each bit within a vector is per
-     * sector. Furthermore, the dirty blocks within a respective
-     * hive has to be marked as such in an appropriate function
-     * for this purpose (probably HvMarkDirty or similar).
-     *
-     * For the moment being, mark the relevant dirty blocks
-     * here.
+     * sector. The log keeps one byte per block, mark the
+     * dirty ones a run at a time.
      */
     BlockIndex = 0;
-    while (BlockIndex < RegistryHive->Storage[Stable].Length)
+    while ((RunLength = HvpFindDirtyRun(RegistryHive, Snapshot, BlockIndex, &BlockIndex)))
     {
-        /* Check if the block is clean or we're past the last block */
-        LastIndex = BlockIndex;
-        BlockIndex = RtlFindSetBits(&RegistryHive->DirtyVector, 1, BlockIndex);
-        if (BlockIndex == ~HV_CLEAN_BLOCK || BlockIndex < LastIndex)
-        {
-            break;
-        }
-
-        /*
-         * Mark this block as dirty and go to the next one.
-         *
-         * FIXME: We should rather use RtlSetBits but that crashes
-         * the system with a bugckeck. So for now mark blocks manually
-         * by hand.
-         */
-        Ptr[BlockIndex] = HV_LOG_DIRTY_BLOCK;
-        BlockIndex++;
+        RtlFillMemory(&Ptr[BlockIndex], RunLength, HV_LOG_DIRTY_BLOCK);
+        BlockIndex += RunLength;
     }
 
-    /* Now write the hive header and block bitmap into the log */
+    /* Now write the hive header, block bitmap and dirty data into the log */
     FileOffset = 0;
-    Success = RegistryHive->FileWrite(RegistryHive, HFILE_TYPE_LOG,
-                                      &FileOffset, HeaderBuffer, BufferSize);
-    RegistryHive->Free(HeaderBuffer, 0);
-    if (!Success)
-    {
-        DPRINT1("Failed to write the hive header block to log (primary sequence)\n");
-        return FALSE;
-    }
-
-    /* Now write the actual dirty data to log */
-    FileOffset = BufferSize;
-    BlockIndex = 0;
-    while (BlockIndex < RegistryHive->Storage[Stable].Length)
+    if (Snapshot->DirtyData)
     {
-        /* Check if the block is clean or we're past the last block */
-        LastIndex = BlockIndex;
-        BlockIndex = RtlFindSetBits(&RegistryHive->DirtyVector, 1, BlockIndex);
-        if (BlockIndex == ~HV_CLEAN_BLOCK || BlockIndex < LastIndex)
+        Success = RegistryHive->FileWrite(RegistryHive, HFILE_TYPE_LOG,
+                                          &FileOffset, HeaderBuffer,
+                                          BufferSize + Snapshot->DirtyBlocks * HBLOCK_SIZE);
+        if (!Success)
         {
-            break;
+            DPRINT1("Failed to write the dirty data to log (primary sequence)\n");
+            return FALSE;
         }
 
-        /* Get the block */
-        Block = (PVOID)RegistryHive->Storage[Stable].BlockList[BlockIndex].BlockAddress;
-
-        /* Write it to log */
+        Snapshot->BytesWritten += BufferSize + Snapshot->DirtyBlocks * HBLOCK_SIZE;
+    }
+    else
+    {
         Success = RegistryHive->FileWrite(RegistryHive, HFILE_TYPE_LOG,
-                                          &FileOffset, Block, HBLOCK_SIZE);
+                                          &FileOffset, HeaderBuffer, BufferSize);
+        RegistryHive->Free(HeaderBuffer, 0);
         if (!Success)
         {
-            DPRINT1("Failed to write dirty block to log (block 0x%p, block index 0x%x)\n", Block, BlockIndex);
+            DPRINT1("Failed to write the hive header block to log (primary sequence)\n");
             return FALSE;
         }
 
-        /* Grow up the file offset as we go to the next block */
-        BlockIndex++;
-        FileOffset += HBLOCK_SIZE;
+        Snapshot->BytesWritten += BufferSize;
+
+        /* Now write the actual dirty data to log */
+        if (!HvpWriteBlocks(RegistryHive, Snapshot, HFILE_TYPE_LOG, BufferSize, TRUE))
+        {
+            DPRINT1("Failed to write the dirty data to log\n");
+            return FALSE;
+        }
     }
 
     /*
@@ -252,13 +424,13 @@ HvpWriteLog(
      * transacted write of a log if the sequences
      * are synced up properly.
      */
-    RegistryHive->BaseBlock->Sequence2++;
-    RegistryHive->BaseBlock->CheckSum = HvpHiveHeaderChecksum(RegistryHive->BaseBlock);
+    BaseBlock->Sequence2++;
+    BaseBlock->CheckSum = HvpHiveHeaderChecksum(BaseBlock);
 
     /* Write new stuff into log first */
     FileOffset = 0;
     Success = RegistryHive->FileWrite(RegistryHive, HFILE_TYPE_LOG,
-                                      &FileOffset, RegistryHive->BaseBlock,
+                                      &FileOffset, BaseBlock,
                                       HV_LOG_HEADER_SIZE);
     if (!Success)
     {
@@ -266,6 +438,8 @@ HvpWriteLog(
         return FALSE;
     }
 
+    Snapshot->BytesWritten += HV_LOG_HEADER_SIZE;
+
     /* Flush it finally */
     Success = RegistryHive->FileFlush(RegistryHive, HFILE_TYPE_LOG, NULL, 0);
     if (!Success)
@@ -287,10 +461,10 @@ HvpWriteLog(
  * A pointer to a hive descriptor where the data is
  * to be written to that hive.
  *
- * @param[in] OnlyDirty
- * If set to TRUE, the function only looks for dirty
- * data to be written to the primary hive, otherwise if
- * it's set to FALSE then the function writes all the data.
+ * @param[in] Snapshot
+ * A pointer to the snapshot of dirty data to be written
+ * to the primary hive. If NULL, the function writes all
+ * the data of the hive.
  *
  * @param[in] FileType
  * The file type of a registry hive. This can be HFILE_TYPE_PRIMARY
@@ -310,22 +484,21 @@ BOOLEAN
 CMAPI
 HvpWriteHive(
     _In_ PHHIVE RegistryHive,
-    _In_ BOOLEAN OnlyDirty,
+    _In_opt_ PHV_FLUSH_SNAPSHOT Snapshot,
     _In_ ULONG FileType)
 {
     BOOLEAN Success;
     ULONG FileOffset;
-    ULONG BlockIndex;
-    ULONG LastIndex;
-    PVOID Block;
+    PHBASE_BLOCK BaseBlock;
 
+    BaseBlock = Snapshot ? Snapshot->BaseBlock : RegistryHive->BaseBlock;
     ASSERT(!RegistryHive->ReadOnly);
-    ASSERT(RegistryHive->BaseBlock->Length ==
-           RegistryHive->Storage[Stable].Length * HBLOCK_SIZE);
-    ASSERT(RegistryHive->BaseBlock->RootCell != HCELL_NIL);
+    ASSERT(BaseBlock->Length ==
+           (Snapshot ? Snapshot->Length : RegistryHive->Storage[Stable].Length) * HBLOCK_SIZE);
+    ASSERT(BaseBlock->RootCell != HCELL_NIL);
 
     /* Validate the base header before we go further */
-    HvpValidateBaseHeader(RegistryHive);
+    HvpValidateBaseHeader(BaseBlock);
 
     /*
      * The sequences can diverge during a forced system shutdown
@@ -334,11 +507,10 @@ HvpWriteHive(
      * sequences have been modified during writing into the log
      * or hive. In such cases the hive needs a repair.
      */
-    if (RegistryHive->BaseBlock->Sequence1 !=
-        RegistryHive->BaseBlock->Sequence2)
+    if (BaseBlock->Sequence1 != BaseBlock->Sequence2)
     {
         DPRINT1("The sequences DO NOT MATCH (Sequence1 == 0x%x, Sequence2 == 0x%x)\n",
-                RegistryHive->BaseBlock->Sequence1, RegistryHive->BaseBlock->Sequence2);
+                BaseBlock->Sequence1, BaseBlock->Sequence2);
         return FALSE;
     }
 
@@ -346,14 +518,14 @@ HvpWriteHive(
      * Update the primary sequence number and write
      * the base block to hive.
      */
-    RegistryHive->BaseBlock->Type = HFILE_TYPE_PRIMARY;
-    RegistryHive->BaseBlock->Sequence1++;
-    RegistryHive->BaseBlock->CheckSum = HvpHiveHeaderChecksum(RegistryHive->BaseBlock);
+    BaseBlock->Type = HFILE_TYPE_PRIMARY;
+    BaseBlock->Sequence1++;
+    BaseBlock->CheckSum = HvpHiveHeaderChecksum(BaseBlock);
 
     /* Write hive block */
     FileOffset = 0;
     Success = RegistryHive->FileWrite(RegistryHive, FileType,
-                                      &FileOffset, RegistryHive->BaseBlock,
+                                      &FileOffset, BaseBlock,
                                       sizeof(HBASE_BLOCK));
     if (!Success)
     {
@@ -361,44 +533,17 @@ HvpWriteHive(
         return FALSE;
     }
 
-    /* Write the whole primary hive, block by block */
-    BlockIndex = 0;
-    while (BlockIndex < RegistryHive->Storage[Stable].Length)
-    {
-        /*
-         * If we have to synchronize the registry hive we
-         * want to look for dirty blocks to reflect the new
-         * updates done to the hive. Otherwise just write
-         * all the blocks as if we were doing a regular
-         * hive write.
-         */
-        if (OnlyDirty)
-        {
-            /* Check if the block is clean or we're past the last block */
-            LastIndex = BlockIndex;
-            BlockIndex = RtlFindSetBits(&RegistryHive->DirtyVector, 1, BlockIndex);
-            if (BlockIndex == ~HV_CLEAN_BLOCK || BlockIndex < LastIndex)
-            {
-                break;
-            }
-        }
-
-        /* Get the block and offset position */
-        Block = (PVOID)RegistryHive->Storage[Stable].BlockList[BlockIndex].BlockAddress;
-        FileOffset = (BlockIndex + 1) * HBLOCK_SIZE;
-
-        /* Now write this block to primary hive file */
-        Success = RegistryHive->FileWrite(RegistryHive, FileType,
-                                          &FileOffset, Block, HBLOCK_SIZE);
-        if (!Success)
-        {
-            DPRINT1("Failed to write hive block to primary hive file (block 0x%p, block index 0x%x)\n",
-                    Block, BlockIndex);
-            return FALSE;
-        }
-
-        /* Go to the next block */
-        BlockIndex++;
+    /*
+     * If we have to synchronize the registry hive we
+     * want to write the dirty blocks to reflect the new
+     * updates done to the hive. Otherwise just write
+     * all the blocks as if we were doing a regular
+     * hive write.
+     */
+    if (!HvpWriteBlocks(RegistryHive, Snapshot, FileType, HBLOCK_SIZE, FALSE))
+    {
+        DPRINT1("Failed to write hive blocks to primary hive file\n");
+        return FALSE;
     }
 
     /*
@@ -419,13 +564,13 @@ HvpWriteHive(
      * same, indicating the write operation didn't
      * fail.
      */
-    RegistryHive->BaseBlock->Sequence2++;
-    RegistryHive->BaseBlock->CheckSum = HvpHiveHeaderChecksum(RegistryHive->BaseBlock);
+    BaseBlock->Sequence2++;
+    BaseBlock->CheckSum = HvpHiveHeaderChecksum(BaseBlock);
 
     /* Write hive block */
     FileOffset = 0;
     Success = RegistryHive->FileWrite(RegistryHive, FileType,
-                                      &FileOffset, RegistryHive->BaseBlock,
+                                      &FileOffset, BaseBlock,
                                       sizeof(HBASE_BLOCK));
     if (!Success)
     {
@@ -433,6 +578,11 @@ HvpWriteHive(
         return FALSE;
     }
 
+    if (Snapshot)
+    {
+        Snapshot->BytesWritten += 2 * sizeof(HBASE_BLOCK);
+    }
+
     /* Flush the hive immediately */
     Success = RegistryHive->FileFlush(RegistryHive, FileType, NULL, 0);
     if (!Success)
@@ -444,6 +594,72 @@ HvpWriteHive(
     return TRUE;
 }
 
+/**
+ * @brief
+ * Writes a snapshot of dirty data to the log,
+ * the primary hive and the alternate hive.
+ *
+ * @param[in] RegistryHive
+ * A pointer to a hive descriptor where the
+ * snapshot was taken from.
+ *
+ * @param[in] Snapshot
+ * A pointer to the snapshot to be written.
+ *
+ * @return
+ * Returns TRUE if all the writes succeeded,
+ * FALSE otherwise.
+ */
+static
+BOOLEAN
+HvpWriteDirtyData(
+    _In_ PHHIVE RegistryHive,
+    _In_ PHV_FLUSH_SNAPSHOT Snapshot)
+{
+    BOOLEAN Success = FALSE;
+#if !defined(CMLIB_HOST) && !defined(_BLDR_)
+    BOOLEAN HardErrors;
+
+    /* Disable hard errors before syncing the hive */
+    HardErrors = IoSetThreadHardErrorMode(FALSE);
+#endif
+
+#if !defined(_BLDR_)
+    /* Update hive header modification time */
+    KeQuerySystemTime(&Snapshot->BaseBlock->TimeStamp);
+#endif
+
+    /* Update the hive log file if present */
+    if (RegistryHive->Log && !HvpWriteLog(RegistryHive, Snapshot))
+    {
+        DPRINT1("Failed to write a log whilst syncing the hive\n");
+        goto Quit;
+    }
+
+    /* Update the primary hive file */
+    if (!HvpWriteHive(RegistryHive, Snapshot, HFILE_TYPE_PRIMARY))
+    {
+        DPRINT1("Failed to write the primary hive\n");
+        goto Quit;
+    }
+
+    /* Update the alternate hive file if present */
+    if (RegistryHive->Alternate &&
+        !HvpWriteHive(RegistryHive, Snapshot, HFILE_TYPE_ALTERNATE))
+    {
+        DPRINT1("Failed to write the alternate hive\n");
+        goto Quit;
+    }
+
+    Success = TRUE;
+
+Quit:
+#if !defined(CMLIB_HOST) && !defined(_BLDR_)
+    IoSetThreadHardErrorMode(HardErrors);
+#endif
+    return Success;
+}
+
 /* PUBLIC FUNCTIONS ***********************************************************/
 
 /**
@@ -460,15 +676,18 @@ HvpWriteHive(
  *
  * @return
  * Returns TRUE if syncing has succeeded, FALSE otherwise.
+ *
+ * @remarks
+ * The dirty data is written in place, so the caller has
+ * to keep the hive locked against writers until it returns.
+ * See HvCaptureDirtyData for flushing without doing so.
  */
 BOOLEAN
 CMAPI
 HvSyncHive(
     _In_ PHHIVE RegistryHive)
 {
-#if !defined(CMLIB_HOST) && !defined(_BLDR_)
-    BOOLEAN HardErrors;
-#endif
+    HV_FLUSH_SNAPSHOT Snapshot;
 
     ASSERT(!RegistryHive->ReadOnly);
     ASSERT(RegistryHive->Signature == HV_HHIVE_SIGNATURE);
@@ -493,62 +712,244 @@ HvSyncHive(
         return TRUE;
     }
 
-#if !defined(CMLIB_HOST) && !defined(_BLDR_)
-    /* Disable hard errors before syncing the hive */
-    HardErrors = IoSetThreadHardErrorMode(FALSE);
-#endif
+    /* Write the dirty data straight from the hive */
+    HvpReferenceDirtyData(RegistryHive, &Snapshot);
+    if (!HvpWriteDirtyData(RegistryHive, &Snapshot))
+    {
+        return FALSE;
+    }
 
-#if !defined(_BLDR_)
-    /* Update hive header modification time */
-    KeQuerySystemTime(&RegistryHive->BaseBlock->TimeStamp);
-#endif
+    /* Clear dirty bitmap. */
+    RtlClearAllBits(&RegistryHive->DirtyVector);
+    RegistryHive->DirtyCount = 0;
+    return TRUE;
+}
 
-    /* Update the hive log file if present */
-    if (RegistryHive->Log)
+/**
+ * @brief
+ * Copies the dirty data of a registry hive into a
+ * snapshot and marks the hive clean, so that the
+ * snapshot can be written out with HvWriteDirtyData
+ * while writers keep modifying the hive.
+ *
+ * @param[in] RegistryHive
+ * A pointer to a hive descriptor of which the
+ * dirty data is to be captured.
+ *
+ * @param[out] Snapshot
+ * A pointer to a snapshot that receives a copy
+ * of the base block, the dirty vector and the
+ * dirty blocks.
+ *
+ * @return
+ * Returns TRUE if the dirty data has been captured,
+ * FALSE if there wasn't enough memory for a copy,
+ * in which case the hive is left untouched.
+ *
+ * @remarks
+ * The caller has to keep the hive locked against
+ * writers while capturing, and must hand the snapshot
+ * to HvReleaseDirtyData once it's done with it.
+ * Snapshots of a hive have to be written out in the
+ * order they were captured.
+ */
+BOOLEAN
+CMAPI
+HvCaptureDirtyData(
+    _In_ PHHIVE RegistryHive,
+    _Out_ PHV_FLUSH_SNAPSHOT Snapshot)
+{
+    ULONG BlockIndex;
+    ULONG RunLength;
+    ULONG DirtyBlocks;
+    ULONG BitmapSize;
+    ULONG LogHeaderSize;
+    ULONG i;
+    PUCHAR Ptr;
+
+    ASSERT(!RegistryHive->ReadOnly);
+    ASSERT(RegistryHive->Signature == HV_HHIVE_SIGNATURE);
+
+    /* Volatile hives never get written, there's nothing to capture */
+    HvpReferenceDirtyData(RegistryHive, Snapshot);
+    if (RegistryHive->HiveFlags & HIVE_VOLATILE)
     {
-        if (!HvpWriteLog(RegistryHive))
-        {
-            DPRINT1("Failed to write a log whilst syncing the hive\n");
-#if !defined(CMLIB_HOST) && !defined(_BLDR_)
-            IoSetThreadHardErrorMode(HardErrors);
-#endif
-            return FALSE;
-        }
+        Snapshot->Length = 0;
+        return TRUE;
     }
 
-    /* Update the primary hive file */
-    if (!HvpWriteHive(RegistryHive, TRUE, HFILE_TYPE_PRIMARY))
+    /* Count the dirty blocks */
+    DirtyBlocks = 0;
+    BlockIndex = 0;
+    while ((RunLength = HvpFindDirtyRun(RegistryHive, Snapshot, BlockIndex, &BlockIndex)))
     {
-        DPRINT1("Failed to write the primary hive\n");
-#if !defined(CMLIB_HOST) && !defined(_BLDR_)
-        IoSetThreadHardErrorMode(HardErrors);
-#endif
+        DirtyBlocks += RunLength;
+        BlockIndex += RunLength;
+    }
+
+    if (!DirtyBlocks)
+    {
+        DPRINT("The dirty vector has clean data, nothing to do\n");
+        Snapshot->Length = 0;
+        RtlClearAllBits(&RegistryHive->DirtyVector);
+        RegistryHive->DirtyCount = 0;
+        return TRUE;
+    }
+
+    /*
+     * Allocate room for the base block, the dirty vector,
+     * the log header and the dirty blocks, in this order.
+     * The log header sits right in front of the blocks so
+     * that the log can be written in one go.
+     */
+    BitmapSize = ROUND_UP(Snapshot->DirtyVector.SizeOfBitMap, sizeof(ULONG) * 8) / 8;
+    LogHeaderSize = HV_LOG_HEADER_SIZE +
+                    ROUND_UP(sizeof(ULONG) + Snapshot->DirtyVector.SizeOfBitMap, HSECTOR_SIZE);
+    Snapshot->BufferSize = sizeof(HBASE_BLOCK) + BitmapSize + LogHeaderSize +
+                           DirtyBlocks * HBLOCK_SIZE;
+    Snapshot->Buffer = RegistryHive->Allocate(Snapshot->BufferSize, TRUE, TAG_CM);
+    if (!Snapshot->Buffer)
+    {
+        DPRINT1("Couldn't allocate a snapshot of %u dirty blocks\n", DirtyBlocks);
         return FALSE;
     }
 
-    /* Update the alternate hive file if present */
-    if (RegistryHive->Alternate)
+    /* Copy the base block and the dirty vector */
+    Ptr = Snapshot->Buffer;
+    Snapshot->BaseBlock = (PHBASE_BLOCK)Ptr;
+    RtlCopyMemory(Ptr, RegistryHive->BaseBlock, sizeof(HBASE_BLOCK));
+    Ptr += sizeof(HBASE_BLOCK);
+
+    RtlCopyMemory(Ptr, RegistryHive->DirtyVector.Buffer, BitmapSize);
+    RtlInitializeBitMap(&Snapshot->DirtyVector, (PULONG)Ptr,
+                        RegistryHive->DirtyVector.SizeOfBitMap);
+    Ptr += BitmapSize + LogHeaderSize;
+
+    /* Copy the dirty blocks back to back */
+    Snapshot->DirtyData = Ptr;
+    Snapshot->DirtyBlocks = DirtyBlocks;
+    BlockIndex = 0;
+    while ((RunLength = HvpFindDirtyRun(RegistryHive, Snapshot, BlockIndex, &BlockIndex)))
     {
-        if (!HvpWriteHive(RegistryHive, TRUE, HFILE_TYPE_ALTERNATE))
+        for (i = 0; i < RunLength; i++)
         {
-            DPRINT1("Failed to write the alternate hive\n");
-#if !defined(CMLIB_HOST) && !defined(_BLDR_)
-            IoSetThreadHardErrorMode(HardErrors);
-#endif
-            return FALSE;
+            RtlCopyMemory(Ptr,
+                          (PVOID)RegistryHive->Storage[Stable].BlockList[BlockIndex + i].BlockAddress,
+                          HBLOCK_SIZE);
+            Ptr += HBLOCK_SIZE;
         }
+
+        BlockIndex += RunLength;
     }
 
-    /* Clear dirty bitmap. */
+    /* The hive is clean now, as far as writers are concerned */
+    Snapshot->DirtyCount = RegistryHive->DirtyCount;
     RtlClearAllBits(&RegistryHive->DirtyVector);
     RegistryHive->DirtyCount = 0;
-
-#if !defined(CMLIB_HOST) && !defined(_BLDR_)
-    IoSetThreadHardErrorMode(HardErrors);
-#endif
     return TRUE;
 }
 
+/**
+ * @brief
+ * Writes a snapshot of dirty data, taken with
+ * HvCaptureDirtyData, to the hive log and the
+ * corresponding primary hive.
+ *
+ * @param[in] RegistryHive
+ * A pointer to a hive descriptor where the
+ * snapshot was taken from.
+ *
+ * @param[in] Snapshot
+ * A pointer to the snapshot to be written.
+ *
+ * @return
+ * Returns TRUE if writing has succeeded,
+ * FALSE otherwise.
+ *
+ * @remarks
+ * The hive doesn't need to be locked against
+ * writers, only the snapshot gets read.
+ */
+BOOLEAN
+CMAPI
+HvWriteDirtyData(
+    _In_ PHHIVE RegistryHive,
+    _Inout_ PHV_FLUSH_SNAPSHOT Snapshot)
+{
+    ASSERT(!RegistryHive->ReadOnly);
+    ASSERT(RegistryHive->Signature == HV_HHIVE_SIGNATURE);
+
+    /* Nothing was captured, nothing to write */
+    if (!Snapshot->DirtyBlocks)
+    {
+        return TRUE;
+    }
+
+    return HvpWriteDirtyData(RegistryHive, Snapshot);
+}
+
+/**
+ * @brief
+ * Releases a snapshot of dirty data, taken with
+ * HvCaptureDirtyData.
+ *
+ * @param[in] RegistryHive
+ * A pointer to a hive descriptor where the
+ * snapshot was taken from.
+ *
+ * @param[in] Snapshot
+ * A pointer to the snapshot to be released.
+ *
+ * @param[in] Written
+ * If set to TRUE, the snapshot has been written and the
+ * hive takes over its sequence numbers. Otherwise its
+ * blocks are marked dirty again, to be written later.
+ *
+ * @remarks
+ * The caller has to keep the hive locked against
+ * writers while releasing.
+ */
+VOID
+CMAPI
+HvReleaseDirtyData(
+    _In_ PHHIVE RegistryHive,
+    _Inout_ PHV_FLUSH_SNAPSHOT Snapshot,
+    _In_ BOOLEAN Written)
+{
+    ULONG BlockIndex;
+    ULONG RunLength;
+
+    if (!Snapshot->Buffer)
+    {
+        return;
+    }
+
+    if (Written)
+    {
+        /* The hive is in sync with what went to disk */
+        RegistryHive->BaseBlock->Type = Snapshot->BaseBlock->Type;
+        RegistryHive->BaseBlock->Sequence1 = Snapshot->BaseBlock->Sequence1;
+        RegistryHive->BaseBlock->Sequence2 = Snapshot->BaseBlock->Sequence2;
+        RegistryHive->BaseBlock->TimeStamp = Snapshot->BaseBlock->TimeStamp;
+        RegistryHive->BaseBlock->CheckSum = HvpHiveHeaderChecksum(RegistryHive->BaseBlock);
+    }
+    else
+    {
+        /* Whatever was captured is dirty again */
+        BlockIndex = 0;
+        while ((RunLength = HvpFindDirtyRun(RegistryHive, Snapshot, BlockIndex, &BlockIndex)))
+        {
+            RtlSetBits(&RegistryHive->DirtyVector, BlockIndex, RunLength);
+            BlockIndex += RunLength;
+        }
+
+        RegistryHive->DirtyCount += Snapshot->DirtyCount;
+    }
+
+    RegistryHive->Free(Snapshot->Buffer, 0);
+    Snapshot->Buffer = NULL;
+}
+
 /**
  * @unimplemented
  * @brief
@@ -605,7 +1006,7 @@ HvWriteHive(
 #endif
 
     /* Update hive file */
-    if (!HvpWriteHive(RegistryHive, FALSE, HFILE_TYPE_PRIMARY))
+    if (!HvpWriteHive(RegistryHive, NULL, HFILE_TYPE_PRIMARY))
     {
         DPRINT1("Failed to write the hive\n");
         return FALSE;
@@ -644,7 +1045,7 @@ HvWriteAlternateHive(
 #endif
 
     /* Update hive file */
-    if (!HvpWriteHive(RegistryHive, FALSE, HFILE_TYPE_ALTERNATE))
+    if (!HvpWriteHive(RegistryHive, NULL, HFILE_TYPE_ALTERNATE))
     {
         DPRINT1("Failed to write the alternate hive\n");
         return FALSE;
@@ -672,11 +1073,14 @@ CMAPI
 HvSyncHiveFromRecover(
     _In_ PHHIVE RegistryHive)
 {
+    HV_FLUSH_SNAPSHOT Snapshot;
+
     ASSERT(!RegistryHive->ReadOnly);
     ASSERT(RegistryHive->Signature == HV_HHIVE_SIGNATURE);
 
     /* Call the private API call to do the deed for us */
-    return HvpWriteHive(RegistryHive, TRUE, HFILE_TYPE_PRIMARY);
+    HvpReferenceDirtyData(RegistryHive, &Snapshot);
+    return HvpWriteHive(RegistryHive, &Snapshot, HFILE_TYPE_PRIMARY);
 }
 
 /* EOF */
@@ -1771,6 +1771,9 @@ RtlDestroyHeap(HANDLE HeapPtr) /* [in] Handle of heap */
     if (RtlpGetMode() == UserMode &&
         HeapPtr == NtCurrentPeb()->ProcessHeap) return HeapPtr;
 
+    /* Free the front end heap, its blocks live in the segments */
+    RtlpDestroyLowFragHeap(Heap);
+
     /* Free up all big allocations */
     Current = Heap->VirtualAllocdBlocks.Flink;
     while (Current != &Heap->VirtualAllocdBlocks)
@@ -2125,10 +2128,30 @@ RtlAllocateHeap(IN PVOID HeapPtr,
 
     Index = AllocationSize >> HEAP_ENTRY_SHIFT;
 
+    /* Small plain blocks come from the front end heap without taking the lock */
+    if (Heap->FrontEndHeap &&
+        (Index < HEAP_LFH_BUCKETS) &&
+        !(EntryFlags & HEAP_ENTRY_EXTRA_PRESENT) &&
+        !(Flags & HEAP_NO_SERIALIZE))
+    {
+        PVOID Block = RtlpLowFragHeapAllocate(Heap, Flags, Size, Index, EntryFlags);
+        if (Block) return Block;
+    }
+
     /* Acquire the lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
-        RtlEnterHeapLock(Heap->LockVariable, TRUE);
+        /* Keep track of contention, and bring in the front end once it gets heavy */
+        if (!RtlTryEnterHeapLock(Heap->LockVariable, TRUE))
+        {
+            RtlEnterHeapLock(Heap->LockVariable, TRUE);
+            if ((++Heap->Counters.LockCollisions == HEAP_LFH_CONTENTION_THRESHOLD) &&
+                !Heap->FrontEndHeap)
+            {
+                RtlpActivateLowFragHeap(Heap);
+            }
+        }
+        Heap->Counters.LockAcquires++;
         HeapLocked = TRUE;
     }
 
@@ -2317,7 +2340,8 @@ BOOLEAN NTAPI RtlFreeHeap(
         /* Check this entry, fail if it's invalid */
         if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY) ||
             (((ULONG_PTR)Ptr & 0x7) != 0) ||
-            (HeapEntry->SegmentOffset >= HEAP_SEGMENTS))
+            ((HeapEntry->SegmentOffset >= HEAP_SEGMENTS) &&
+             ((HeapEntry->SegmentOffset != HEAP_LFH_BLOCK) || !Heap->FrontEndHeap)))
         {
             /* This is an invalid block */
             DPRINT1("HEAP: Trying to free an invalid address %p!\n", Ptr);
@@ -2334,6 +2358,13 @@ BOOLEAN NTAPI RtlFreeHeap(
     }
     _SEH2_END;
 
+    /* Front end blocks go back to it without taking the lock */
+    if (HeapEntry->SegmentOffset == HEAP_LFH_BLOCK)
+    {
+        RtlpLowFragHeapFree(Heap, HeapEntry);
+        return TRUE;
+    }
+
     /* Lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
@@ -2725,6 +2756,13 @@ RtlReAllocateHeap(HANDLE HeapPtr,
         return NULL;
     }
 
+    /* Front end blocks are handled by the front end */
+    if (Heap->FrontEndHeap &&
+        ((((PHEAP_ENTRY)Ptr)-1)->SegmentOffset == HEAP_LFH_BLOCK))
+    {
+        return RtlpLowFragHeapReAllocate(Heap, Flags, Ptr, Size);
+    }
+
     /* Calculate allocation size and index */
     if (Size)
         AllocationSize = Size;
@@ -3298,6 +3336,13 @@ RtlpValidateHeapEntry(
     if ((ULONG_PTR)HeapEntry & (HEAP_ENTRY_SIZE - 1)) goto invalid_entry;
     if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY)) goto invalid_entry;
 
+    /* Front end blocks live inside busy blocks of the back end */
+    if (HeapEntry->SegmentOffset == HEAP_LFH_BLOCK)
+    {
+        if (!RtlpValidateLowFragHeapEntry(Heap, HeapEntry)) goto invalid_entry;
+        return TRUE;
+    }
+
     BigAllocation = HeapEntry->Flags & HEAP_ENTRY_VIRTUAL_ALLOC;
     Segment = Heap->Segments[HeapEntry->SegmentOffset];
 
@@ -4044,6 +4089,13 @@ RtlCreateTagHeap(_In_ HANDLE HeapHandle,
     return 0;
 }
 
+/*
+ * @unimplemented
+ *
+ * When this gets implemented, keep in mind that the low fragmentation front
+ * end carves its blocks out of busy back end blocks. Walking the segments
+ * reports each of those subsegments as a single busy block.
+ */
 NTSTATUS
 NTAPI
 RtlWalkHeap(IN HANDLE HeapHandle,
@@ -4069,6 +4121,8 @@ RtlSetHeapInformation(IN HANDLE HeapHandle OPTIONAL,
                       IN PVOID HeapInformation,
                       IN SIZE_T HeapInformationLength)
 {
+    PHEAP Heap = (PHEAP)HeapHandle;
+
     /* Setting heap information is not really supported except for enabling LFH */
     if (HeapInformationClass == HeapCompatibilityInformation)
     {
@@ -4080,13 +4134,19 @@ RtlSetHeapInformation(IN HANDLE HeapHandle OPTIONAL,
         }
 
         /* Check for a special magic value for enabling LFH */
-        if (*(PULONG)HeapInformation != 2)
+        if (*(PULONG)HeapInformation != HEAP_FRONT_END_LOW_FRAG)
         {
             return STATUS_UNSUCCESSFUL;
         }
 
-        DPRINT1("RtlSetHeapInformation() needs to enable LFH\n");
-        return STATUS_SUCCESS;
+        /* The page heap has no front end */
+        if (!Heap || (Heap->ForceFlags & HEAP_FLAG_PAGE_ALLOCS))
+        {
+            return STATUS_UNSUCCESSFUL;
+        }
+
+        /* Turn on the front end */
+        return RtlpActivateLowFragHeap(Heap);
     }
 
     return STATUS_SUCCESS;
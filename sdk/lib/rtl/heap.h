@@ -54,6 +54,15 @@
 /* Segment flags */
 #define HEAP_USER_ALLOCATED    0x1
 
+/* Low fragmentation front end heap */
+#define HEAP_FRONT_END_LOW_FRAG        2
+#define HEAP_LFH_BLOCK                 0xFF /* SegmentOffset of a front end block */
+#define HEAP_LFH_BUCKETS               128  /* Block sizes served, in heap entries */
+#define HEAP_LFH_MAX_AFFINITY          16
+#define HEAP_LFH_SUBSEGMENT_SIZE       PAGE_SIZE
+#define HEAP_LFH_MIN_BLOCKS            8
+#define HEAP_LFH_CONTENTION_THRESHOLD  64   /* Lock collisions before it turns on by itself */
+
 /* A handy inline to distinguis normal heap, special "debug heap" and special "page heap" */
 FORCEINLINE BOOLEAN
 RtlpHeapIsSpecial(ULONG Flags)
@@ -304,6 +313,19 @@ typedef struct _HEAP_ENTRY_EXTRA
 
 typedef HEAP_ENTRY_EXTRA HEAP_FREE_ENTRY_EXTRA, *PHEAP_FREE_ENTRY_EXTRA;
 
+/* One set of free lists per affinity slot, so threads in different slots don't share lines */
+typedef struct _HEAP_LFH_AFFINITY_SLOT
+{
+    SLIST_HEADER Buckets[HEAP_LFH_BUCKETS];
+} HEAP_LFH_AFFINITY_SLOT, *PHEAP_LFH_AFFINITY_SLOT;
+
+typedef struct _HEAP_LFH
+{
+    ULONG AffinitySlots;
+    LONG SubsegmentCount;
+    HEAP_LFH_AFFINITY_SLOT Slots[ANYSIZE_ARRAY];
+} HEAP_LFH, *PHEAP_LFH;
+
 typedef struct _HEAP_VIRTUAL_ALLOC_ENTRY
 {
     LIST_ENTRY Entry;
@@ -338,6 +360,34 @@ RtlpValidateHeapEntry(PHEAP Heap, PHEAP_ENTRY HeapEntry);
 BOOLEAN NTAPI
 RtlpValidateHeapHeaders(PHEAP Heap, BOOLEAN Recalculate);
 
+/* heaplfh.c */
+NTSTATUS NTAPI
+RtlpActivateLowFragHeap(PHEAP Heap);
+
+VOID NTAPI
+RtlpDestroyLowFragHeap(PHEAP Heap);
+
+PVOID NTAPI
+RtlpLowFragHeapAllocate(PHEAP Heap,
+                        ULONG Flags,
+                        SIZE_T Size,
+                        SIZE_T Index,
+                        UCHAR EntryFlags);
+
+VOID NTAPI
+RtlpLowFragHeapFree(PHEAP Heap,
+                    PHEAP_ENTRY HeapEntry);
+
+BOOLEAN NTAPI
+RtlpValidateLowFragHeapEntry(PHEAP Heap,
+                             PHEAP_ENTRY HeapEntry);
+
+PVOID NTAPI
+RtlpLowFragHeapReAllocate(PHEAP Heap,
+                          ULONG Flags,
+                          PVOID Ptr,
+                          SIZE_T Size);
+
 /* heapdbg.c */
 NTSYSAPI
 HANDLE NTAPI
@@ -0,0 +1,337 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS system libraries
+ * FILE:            lib/rtl/heaplfh.c
+ * PURPOSE:         RTL Low Fragmentation Heap front end
+ */
+
+/* Useful references:
+   http://illmatics.com/Understanding_the_LFH.pdf
+*/
+
+/* INCLUDES *****************************************************************/
+
+#include <rtl.h>
+#include <heap.h>
+
+#define NDEBUG
+#include <debug.h>
+
+/*
+ * The front end serves small blocks from subsegments, which are ordinary busy
+ * blocks of the back end carved into blocks of one size. Every block keeps a
+ * regular HEAP_ENTRY header with SegmentOffset set to HEAP_LFH_BLOCK, so size
+ * and user flag queries work on it unchanged. Free blocks of each size sit on
+ * a lock-free list per affinity slot, and subsegments are only given back when
+ * the heap is destroyed. Anything walking the back end, like heap validation,
+ * sees each subsegment as one busy block, however many of its blocks are free.
+ */
+
+/* The subsegments themselves must come from the back end */
+C_ASSERT((HEAP_LFH_SUBSEGMENT_SIZE >> HEAP_ENTRY_SHIFT) >= HEAP_LFH_BUCKETS);
+
+/* FUNCTIONS *****************************************************************/
+
+FORCEINLINE
+PHEAP_LFH_AFFINITY_SLOT
+RtlpGetLowFragHeapSlot(PHEAP_LFH FrontEnd)
+{
+    ULONG_PTR ThreadId = (ULONG_PTR)NtCurrentTeb()->ClientId.UniqueThread;
+
+    /* Thread IDs are multiples of four, spread them over the slots */
+    return &FrontEnd->Slots[(ThreadId >> 2) & (FrontEnd->AffinitySlots - 1)];
+}
+
+NTSTATUS NTAPI
+RtlpActivateLowFragHeap(PHEAP Heap)
+{
+    PHEAP_LFH FrontEnd = NULL;
+    SIZE_T Size;
+    ULONG MaxSlots, Slots, i, j;
+    NTSTATUS Status;
+
+    /* Nothing to do if it's already on */
+    if (Heap->FrontEndHeap) return STATUS_SUCCESS;
+
+    /* Only plain, growable, serialized user mode heaps get a front end */
+    if ((RtlpGetMode() != UserMode) ||
+        RtlpHeapIsSpecial(Heap->Flags) ||
+        !(Heap->Flags & HEAP_GROWABLE) ||
+        (Heap->Flags & (HEAP_NO_SERIALIZE |
+                        HEAP_TAIL_CHECKING_ENABLED |
+                        HEAP_FREE_CHECKING_ENABLED |
+                        HEAP_CREATE_ALIGN_16)) ||
+        Heap->PseudoTagEntries)
+    {
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    /* One affinity slot per processor, rounded up to a power of two */
+    MaxSlots = min(RtlGetCurrentPeb()->NumberOfProcessors, HEAP_LFH_MAX_AFFINITY);
+    for (Slots = 1; Slots < MaxSlots; Slots <<= 1);
+
+    /* Allocate the front end */
+    Size = FIELD_OFFSET(HEAP_LFH, Slots[Slots]);
+    Status = ZwAllocateVirtualMemory(NtCurrentProcess(),
+                                     (PVOID *)&FrontEnd,
+                                     0,
+                                     &Size,
+                                     MEM_RESERVE | MEM_COMMIT,
+                                     PAGE_READWRITE);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("HEAP: Failed to allocate the front end heap, Status 0x%08X\n", Status);
+        return Status;
+    }
+
+    /* Initialize the free lists */
+    FrontEnd->AffinitySlots = Slots;
+    for (i = 0; i < Slots; i++)
+    {
+        for (j = 0; j < HEAP_LFH_BUCKETS; j++)
+        {
+            RtlInitializeSListHead(&FrontEnd->Slots[i].Buckets[j]);
+        }
+    }
+
+    /* Publish it, unless another thread beat us to it */
+    if (InterlockedCompareExchangePointer(&Heap->FrontEndHeap, FrontEnd, NULL))
+    {
+        Size = 0;
+        ZwFreeVirtualMemory(NtCurrentProcess(), (PVOID *)&FrontEnd, &Size, MEM_RELEASE);
+        return STATUS_SUCCESS;
+    }
+
+    Heap->FrontEndHeapType = HEAP_FRONT_END_LOW_FRAG;
+    DPRINT("HEAP: Front end heap %p with %lu slots enabled for heap %p\n", FrontEnd, Slots, Heap);
+    return STATUS_SUCCESS;
+}
+
+VOID NTAPI
+RtlpDestroyLowFragHeap(PHEAP Heap)
+{
+    PVOID FrontEnd = Heap->FrontEndHeap;
+    SIZE_T Size = 0;
+
+    /* The subsegments go away with the heap segments, only free the lists */
+    if (!FrontEnd) return;
+
+    Heap->FrontEndHeap = NULL;
+    Heap->FrontEndHeapType = 0;
+    ZwFreeVirtualMemory(NtCurrentProcess(), &FrontEnd, &Size, MEM_RELEASE);
+}
+
+static
+PHEAP_ENTRY
+RtlpLowFragHeapRefill(PHEAP Heap,
+                      PSLIST_HEADER FreeBlocks,
+                      SIZE_T Index)
+{
+    PHEAP_LFH FrontEnd = Heap->FrontEndHeap;
+    SIZE_T BlockSize = Index << HEAP_ENTRY_SHIFT;
+    ULONG BlockCount, i;
+    PUCHAR Subsegment;
+    PHEAP_ENTRY Block;
+
+    /* Get a subsegment from the back end */
+    BlockCount = max((ULONG)(HEAP_LFH_SUBSEGMENT_SIZE / BlockSize), HEAP_LFH_MIN_BLOCKS);
+    Subsegment = RtlAllocateHeap(Heap, 0, BlockCount * BlockSize);
+    if (!Subsegment) return NULL;
+    InterlockedIncrement(&FrontEnd->SubsegmentCount);
+
+    /* Carve it into free blocks, keeping the first one for the caller */
+    for (i = 0; i < BlockCount; i++)
+    {
+        Block = (PHEAP_ENTRY)(Subsegment + i * BlockSize);
+        Block->Size = (USHORT)Index;
+        Block->Flags = 0;
+        Block->SmallTagIndex = 0;
+        Block->PreviousSize = 0;
+        Block->SegmentOffset = HEAP_LFH_BLOCK;
+        Block->UnusedBytes = 0;
+
+        if (i) RtlInterlockedPushEntrySList(FreeBlocks, (PSLIST_ENTRY)(Block + 1));
+    }
+
+    return (PHEAP_ENTRY)Subsegment;
+}
+
+PVOID NTAPI
+RtlpLowFragHeapAllocate(PHEAP Heap,
+                        ULONG Flags,
+                        SIZE_T Size,
+                        SIZE_T Index,
+                        UCHAR EntryFlags)
+{
+    PSLIST_HEADER FreeBlocks;
+    PSLIST_ENTRY FreeEntry;
+    PHEAP_ENTRY HeapEntry;
+
+    ASSERT(Index < HEAP_LFH_BUCKETS);
+
+    /* Pop a free block of this size, or carve a new subsegment if there's none */
+    FreeBlocks = &RtlpGetLowFragHeapSlot(Heap->FrontEndHeap)->Buckets[Index];
+    FreeEntry = RtlInterlockedPopEntrySList(FreeBlocks);
+    if (FreeEntry)
+    {
+        HeapEntry = (PHEAP_ENTRY)FreeEntry - 1;
+    }
+    else
+    {
+        HeapEntry = RtlpLowFragHeapRefill(Heap, FreeBlocks, Index);
+        if (!HeapEntry) return NULL;
+    }
+
+    ASSERT(HeapEntry->SegmentOffset == HEAP_LFH_BLOCK);
+    ASSERT(HeapEntry->Size == Index);
+
+    /* Mark it busy, with the same unused byte count the back end would use */
+    HeapEntry->Flags = EntryFlags;
+    HeapEntry->UnusedBytes = (UCHAR)((Index << HEAP_ENTRY_SHIFT) - Size);
+
+    /* Zero memory if that was requested */
+    if (Flags & HEAP_ZERO_MEMORY)
+        RtlZeroMemory(HeapEntry + 1, Size);
+
+    return HeapEntry + 1;
+}
+
+VOID NTAPI
+RtlpLowFragHeapFree(PHEAP Heap,
+                    PHEAP_ENTRY HeapEntry)
+{
+    ASSERT(HeapEntry->SegmentOffset == HEAP_LFH_BLOCK);
+    ASSERT(HeapEntry->Size < HEAP_LFH_BUCKETS);
+
+    /* Mark it free and put it on this thread's list */
+    HeapEntry->Flags = 0;
+    RtlInterlockedPushEntrySList(&RtlpGetLowFragHeapSlot(Heap->FrontEndHeap)->Buckets[HeapEntry->Size],
+                                 (PSLIST_ENTRY)(HeapEntry + 1));
+}
+
+BOOLEAN NTAPI
+RtlpValidateLowFragHeapEntry(PHEAP Heap,
+                             PHEAP_ENTRY HeapEntry)
+{
+    PHEAP_SEGMENT Segment;
+    PHEAP_ENTRY Entry, Subsegment;
+    PHEAP_UCR_DESCRIPTOR UcrDescriptor;
+    PLIST_ENTRY UcrEntry;
+    SIZE_T BlockSize;
+    ULONG SegmentOffset;
+
+    ASSERT(HeapEntry->SegmentOffset == HEAP_LFH_BLOCK);
+
+    /* Only a heap with a front end has its blocks, and only of the sizes it serves */
+    if (!Heap->FrontEndHeap || !HeapEntry->Size || (HeapEntry->Size >= HEAP_LFH_BUCKETS))
+        return FALSE;
+    BlockSize = HeapEntry->Size << HEAP_ENTRY_SHIFT;
+
+    for (SegmentOffset = 0; SegmentOffset < HEAP_SEGMENTS; SegmentOffset++)
+    {
+        Segment = Heap->Segments[SegmentOffset];
+        if (!Segment ||
+            (HeapEntry < Segment->FirstEntry) ||
+            (HeapEntry >= Segment->LastValidEntry))
+        {
+            continue;
+        }
+
+        /* Find the back end block the entry lies in */
+        Entry = (Segment->BaseAddress == Heap) ? &Heap->Entry : &Segment->Entry;
+        while ((Entry <= HeapEntry) && (Entry < Segment->LastValidEntry) && Entry->Size)
+        {
+            if (HeapEntry < Entry + Entry->Size)
+            {
+                /* It must be a busy subsegment, with the entry on a block boundary */
+                Subsegment = Entry + 1;
+                return (Entry->Flags & HEAP_ENTRY_BUSY) &&
+                       (HeapEntry >= Subsegment) &&
+                       ((((ULONG_PTR)HeapEntry - (ULONG_PTR)Subsegment) % BlockSize) == 0) &&
+                       ((PCHAR)HeapEntry + BlockSize <= (PCHAR)(Entry + Entry->Size));
+            }
+
+            if (!(Entry->Flags & HEAP_ENTRY_LAST_ENTRY))
+            {
+                Entry += Entry->Size;
+                continue;
+            }
+
+            /* Skip the uncommitted range that follows, if there's one */
+            Entry += Entry->Size;
+            for (UcrEntry = Segment->UCRSegmentList.Flink;
+                 UcrEntry != &Segment->UCRSegmentList;
+                 UcrEntry = UcrEntry->Flink)
+            {
+                UcrDescriptor = CONTAINING_RECORD(UcrEntry, HEAP_UCR_DESCRIPTOR, SegmentEntry);
+                if (UcrDescriptor->Address == Entry)
+                {
+                    Entry = (PHEAP_ENTRY)((PCHAR)UcrDescriptor->Address + UcrDescriptor->Size);
+                    break;
+                }
+            }
+            if (UcrEntry == &Segment->UCRSegmentList) break;
+        }
+
+        break;
+    }
+
+    return FALSE;
+}
+
+PVOID NTAPI
+RtlpLowFragHeapReAllocate(PHEAP Heap,
+                          ULONG Flags,
+                          PVOID Ptr,
+                          SIZE_T Size)
+{
+    PHEAP_ENTRY HeapEntry = (PHEAP_ENTRY)Ptr - 1;
+    PHEAP_ENTRY NewEntry;
+    SIZE_T OldSize, AllocationSize;
+    PVOID NewPtr;
+
+    /* If that entry is not really in-use, we have a problem */
+    if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY))
+    {
+        RtlSetLastWin32ErrorAndNtStatusFromNtStatus(STATUS_INVALID_PARAMETER);
+        return NULL;
+    }
+
+    OldSize = (HeapEntry->Size << HEAP_ENTRY_SHIFT) - HeapEntry->UnusedBytes;
+    AllocationSize = ((Size ? Size : 1) + Heap->AlignRound) & Heap->AlignMask;
+
+    /* If it stays in the same size class, only the unused byte count changes */
+    if (!(Flags & HEAP_EXTRA_FLAGS_MASK) &&
+        ((AllocationSize >> HEAP_ENTRY_SHIFT) == HeapEntry->Size))
+    {
+        if ((Flags & HEAP_ZERO_MEMORY) && (Size > OldSize))
+            RtlZeroMemory((PCHAR)Ptr + OldSize, Size - OldSize);
+
+        HeapEntry->UnusedBytes = (UCHAR)((HeapEntry->Size << HEAP_ENTRY_SHIFT) - Size);
+        return Ptr;
+    }
+
+    /* Front end blocks never grow in place */
+    if (Flags & HEAP_REALLOC_IN_PLACE_ONLY)
+    {
+        DPRINT1("Realloc in place failed, but it was the only option\n");
+        return NULL;
+    }
+
+    /* Move it to a block of the right size */
+    NewPtr = RtlAllocateHeap(Heap, Flags & ~HEAP_ZERO_MEMORY, Size);
+    if (!NewPtr) return NULL;
+
+    RtlCopyMemory(NewPtr, Ptr, min(OldSize, Size));
+    if ((Flags & HEAP_ZERO_MEMORY) && (Size > OldSize))
+        RtlZeroMemory((PCHAR)NewPtr + OldSize, Size - OldSize);
+
+    /* Keep the user flags */
+    NewEntry = (PHEAP_ENTRY)NewPtr - 1;
+    NewEntry->Flags |= HeapEntry->Flags & HEAP_ENTRY_SETTABLE_FLAGS;
+
+    RtlpLowFragHeapFree(Heap, HeapEntry);
+    return NewPtr;
+}
+
+/* EOF */
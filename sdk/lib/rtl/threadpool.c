@@ -142,8 +142,37 @@ struct timer_queue
  */
 
 #define THREADPOOL_WORKER_TIMEOUT 5000
+#ifdef __REACTOS__
+#define THREADPOOL_INJECTION_DELAY 50
+#define THREADPOOL_GATE_ROUNDS 20
+#define THREADPOOL_MAX_QUEUES 64
+#endif
 #define MAXIMUM_WAITQUEUE_OBJECTS (MAXIMUM_WAIT_OBJECTS - 1)
 
+#ifdef __REACTOS__
+/* queued callback of a threadpool object */
+struct threadpool_item
+{
+    union
+    {
+        SLIST_ENTRY         free_entry;
+        struct list         entry;
+    } u;
+    struct threadpool_object *object;
+};
+
+/* work queue, threads are assigned to one by their thread id */
+struct threadpool_queue
+{
+    RTL_SRWLOCK             lock;
+    /* Queued items, locked via .lock, order matches TP_CALLBACK_PRIORITY - high, normal, low. */
+    struct list             items[3];
+    LONG                    count;
+    /* number of items processed by workers of this queue */
+    LONG                    completed;
+};
+#endif
+
 /* internal threadpool representation */
 struct threadpool
 {
@@ -151,16 +180,30 @@ struct threadpool
     LONG                    objcount;
     BOOL                    shutdown;
     CRITICAL_SECTION        cs;
+#ifndef __REACTOS__
     /* Pools of work items, locked via .cs, order matches TP_CALLBACK_PRIORITY - high, normal, low. */
     struct list             pools[3];
+#endif
     RTL_CONDITION_VARIABLE  update_event;
     /* information about worker threads, locked via .cs */
     int                     max_workers;
     int                     min_workers;
     int                     num_workers;
     int                     num_busy_workers;
+#ifdef __REACTOS__
+    int                     concurrency;
+    BOOL                    gate_running;
+    /* workers waiting for .update_event, modified via .cs but read without it */
+    LONG                    num_idle_workers;
+#endif
     HANDLE                  compl_port;
     TP_POOL_STACK_INFORMATION stack_info;
+#ifdef __REACTOS__
+    /* unused items, to keep allocations off the submit path */
+    SLIST_HEADER            free_items;
+    unsigned int            num_queues;
+    struct threadpool_queue queues[1];
+#endif
 };
 
 enum threadpool_objtype
@@ -197,14 +240,25 @@ struct threadpool_object
     /* information about the group, locked via .group->cs */
     struct list             group_entry;
     BOOL                    is_group_member;
+#ifdef __REACTOS__
+    /* information about the pool, locked via .pool->cs. num_pending_callbacks
+     * and u.wait.signaled are also increased without it when submitting. */
+#else
     /* information about the pool, locked via .pool->cs */
     struct list             pool_entry;
+#endif
     RTL_CONDITION_VARIABLE  finished_event;
     RTL_CONDITION_VARIABLE  group_finished_event;
     HANDLE                  completed_event;
     LONG                    num_pending_callbacks;
     LONG                    num_running_callbacks;
     LONG                    num_associated_callbacks;
+#ifdef __REACTOS__
+    /* item queued for the callbacks submitted while no item could be allocated */
+    struct threadpool_item  fallback_item;
+    LONG                    fallback_queued;
+    LONG                    fallback_callbacks;
+#endif
     /* arguments for callback */
     union
     {
@@ -434,6 +488,7 @@ static inline struct threadpool_instance *impl_from_TP_CALLBACK_INSTANCE( TP_CAL
 
 #ifdef __REACTOS__
 ULONG NTAPI threadpool_worker_proc(PVOID param );
+ULONG NTAPI threadpool_gate_proc(PVOID param );
 #else
 static void CALLBACK threadpool_worker_proc( void *param );
 #endif
@@ -1261,6 +1316,92 @@ static NTSTATUS tp_new_worker_thread( struct threadpool *pool )
     return status;
 }
 
+#ifdef __REACTOS__
+/***********************************************************************
+ *           tp_new_gate_thread    (internal)
+ *
+ * Starts the gate thread of a pool if it isn't running yet, pool->cs
+ * has to be held.
+ */
+static void tp_new_gate_thread( struct threadpool *pool )
+{
+    HANDLE thread;
+    NTSTATUS status;
+
+    if (pool->gate_running)
+        return;
+
+    status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, 0, 0, 0,
+                                  threadpool_gate_proc, pool, &thread, NULL );
+    if (status == STATUS_SUCCESS)
+    {
+        InterlockedIncrement( &pool->refcount );
+        pool->gate_running = TRUE;
+        NtClose( thread );
+    }
+}
+
+static inline struct threadpool_queue *threadpool_get_queue( struct threadpool *pool )
+{
+    ULONG_PTR tid = (ULONG_PTR)NtCurrentTeb()->ClientId.UniqueThread;
+
+    /* Thread ids are multiples of four, spread them over the queues. */
+    return &pool->queues[(tid >> 2) & (pool->num_queues - 1)];
+}
+
+static BOOL threadpool_has_items( const struct threadpool *pool )
+{
+    unsigned int i;
+
+    for (i = 0; i < pool->num_queues; ++i)
+    {
+        if (pool->queues[i].count)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static LONG threadpool_get_completed( const struct threadpool *pool )
+{
+    LONG completed = 0;
+    unsigned int i;
+
+    for (i = 0; i < pool->num_queues; ++i)
+        completed += pool->queues[i].completed;
+
+    return completed;
+}
+
+/***********************************************************************
+ *           tp_threadpool_grow    (internal)
+ *
+ * Called when work is queued. Starts a new worker thread right away while
+ * there are fewer workers than processors, otherwise leaves it to the gate
+ * thread to add workers when queued work stops making progress.
+ */
+static void tp_threadpool_grow( struct threadpool *pool )
+{
+    /* Check without the lock first, a saturated pool shouldn't touch it. */
+    if (pool->num_workers >= pool->max_workers)
+        return;
+    if (pool->num_workers >= pool->concurrency && pool->gate_running)
+        return;
+    if (pool->num_idle_workers || !threadpool_has_items( pool ))
+        return;
+
+    RtlEnterCriticalSection( &pool->cs );
+    if (!pool->num_idle_workers && pool->num_workers < pool->max_workers)
+    {
+        if (pool->num_workers < pool->concurrency)
+            tp_new_worker_thread( pool );
+        else
+            tp_new_gate_thread( pool );
+    }
+    RtlLeaveCriticalSection( &pool->cs );
+}
+#endif
+
 /***********************************************************************
  *           tp_timerqueue_lock    (internal)
  *
@@ -1378,8 +1519,13 @@ static void CALLBACK waitqueue_thread_proc( void *param )
                 if ((wait->u.wait.flags & (WT_EXECUTEINWAITTHREAD | WT_EXECUTEINIOTHREAD)))
                 {
                     InterlockedIncrement( &wait->refcount );
+#ifdef __REACTOS__
+                    RtlEnterCriticalSection( &wait->pool->cs );
+                    InterlockedIncrement( &wait->num_pending_callbacks );
+#else
                     wait->num_pending_callbacks++;
                     RtlEnterCriticalSection( &wait->pool->cs );
+#endif
                     tp_object_execute( wait, TRUE );
                     RtlLeaveCriticalSection( &wait->pool->cs );
                     tp_object_release( wait );
@@ -1434,9 +1580,15 @@ static void CALLBACK waitqueue_thread_proc( void *param )
                     }
                     if ((wait->u.wait.flags & (WT_EXECUTEINWAITTHREAD | WT_EXECUTEINIOTHREAD)))
                     {
+#ifdef __REACTOS__
+                        RtlEnterCriticalSection( &wait->pool->cs );
+                        InterlockedIncrement( &wait->u.wait.signaled );
+                        InterlockedIncrement( &wait->num_pending_callbacks );
+#else
                         wait->u.wait.signaled++;
                         wait->num_pending_callbacks++;
                         RtlEnterCriticalSection( &wait->pool->cs );
+#endif
                         tp_object_execute( wait, TRUE );
                         RtlLeaveCriticalSection( &wait->pool->cs );
                     }
@@ -1787,14 +1939,22 @@ static NTSTATUS tp_ioqueue_lock( struct threadpool_object *io, HANDLE file )
 static NTSTATUS tp_threadpool_alloc( struct threadpool **out )
 {
 #ifdef __REACTOS__
-    IMAGE_NT_HEADERS *nt = RtlImageNtHeader( NtCurrentTeb()->ProcessEnvironmentBlock->ImageBaseAddress );
+    PEB *peb = NtCurrentTeb()->ProcessEnvironmentBlock;
+    IMAGE_NT_HEADERS *nt = RtlImageNtHeader( peb->ImageBaseAddress );
+    struct threadpool *pool;
+    unsigned int num_queues, i, j;
+
+    /* One queue per processor, rounded up to a power of two. */
+    for (num_queues = 1; num_queues < min( peb->NumberOfProcessors, THREADPOOL_MAX_QUEUES ); num_queues <<= 1);
+
+    pool = RtlAllocateHeap( GetProcessHeap(), 0, FIELD_OFFSET( struct threadpool, queues[num_queues] ) );
 #else
     IMAGE_NT_HEADERS *nt = RtlImageNtHeader( NtCurrentTeb()->Peb->ImageBaseAddress );
-#endif
     struct threadpool *pool;
     unsigned int i;
 
     pool = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*pool) );
+#endif
     if (!pool)
         return STATUS_NO_MEMORY;
 
@@ -1810,17 +1970,37 @@ static NTSTATUS tp_threadpool_alloc( struct threadpool **out )
     pool->cs.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": threadpool.cs");
 #endif
 
+#ifndef __REACTOS__
     for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
         list_init( &pool->pools[i] );
+#endif
     RtlInitializeConditionVariable( &pool->update_event );
 
     pool->max_workers             = 500;
     pool->min_workers             = 0;
     pool->num_workers             = 0;
     pool->num_busy_workers        = 0;
+#ifdef __REACTOS__
+    pool->concurrency             = max( peb->NumberOfProcessors, 1 );
+    pool->gate_running            = FALSE;
+    pool->num_idle_workers        = 0;
+#endif
     pool->stack_info.StackReserve = nt->OptionalHeader.SizeOfStackReserve;
     pool->stack_info.StackCommit  = nt->OptionalHeader.SizeOfStackCommit;
 
+#ifdef __REACTOS__
+    RtlInitializeSListHead( &pool->free_items );
+    pool->num_queues = num_queues;
+    for (i = 0; i < num_queues; ++i)
+    {
+        RtlInitializeSRWLock( &pool->queues[i].lock );
+        for (j = 0; j < ARRAY_SIZE(pool->queues[i].items); ++j)
+            list_init( &pool->queues[i].items[j] );
+        pool->queues[i].count     = 0;
+        pool->queues[i].completed = 0;
+    }
+
+#endif
     TRACE( "allocated threadpool %p\n", pool );
 
     *out = pool;
@@ -1849,7 +2029,12 @@ static void tp_threadpool_shutdown( struct threadpool *pool )
  */
 static BOOL tp_threadpool_release( struct threadpool *pool )
 {
+#ifdef __REACTOS__
+    SLIST_ENTRY *entry;
+    unsigned int i, j;
+#else
     unsigned int i;
+#endif
 
     if (InterlockedDecrement( &pool->refcount ))
         return FALSE;
@@ -1858,8 +2043,20 @@ static BOOL tp_threadpool_release( struct threadpool *pool )
 
     assert( pool->shutdown );
     assert( !pool->objcount );
+#ifdef __REACTOS__
+    assert( !pool->gate_running );
+    for (i = 0; i < pool->num_queues; ++i)
+    {
+        for (j = 0; j < ARRAY_SIZE(pool->queues[i].items); ++j)
+            assert( list_empty( &pool->queues[i].items[j] ) );
+    }
+
+    while ((entry = RtlInterlockedPopEntrySList( &pool->free_items )))
+        RtlFreeHeap( GetProcessHeap(), 0, CONTAINING_RECORD( entry, struct threadpool_item, u.free_entry ) );
+#else
     for (i = 0; i < ARRAY_SIZE(pool->pools); ++i)
         assert( list_empty( &pool->pools[i] ) );
+#endif
 #ifndef __REACTOS__
     pool->cs.DebugInfo->Spare[0] = 0;
 #endif
@@ -2048,13 +2245,20 @@ static void tp_object_initialize( struct threadpool_object *object, struct threa
     memset( &object->group_entry, 0, sizeof(object->group_entry) );
     object->is_group_member         = FALSE;
 
+#ifndef __REACTOS__
     memset( &object->pool_entry, 0, sizeof(object->pool_entry) );
+#endif
     RtlInitializeConditionVariable( &object->finished_event );
     RtlInitializeConditionVariable( &object->group_finished_event );
     object->completed_event         = NULL;
     object->num_pending_callbacks   = 0;
     object->num_running_callbacks   = 0;
     object->num_associated_callbacks = 0;
+#ifdef __REACTOS__
+    object->fallback_item.object    = object;
+    object->fallback_queued         = FALSE;
+    object->fallback_callbacks      = 0;
+#endif
 
     if (environment)
     {
@@ -2109,12 +2313,79 @@ static void tp_object_initialize( struct threadpool_object *object, struct threa
         tp_object_release( object );
 }
 
+#ifndef __REACTOS__
 static void tp_object_prio_queue( struct threadpool_object *object )
 {
     ++object->pool->num_busy_workers;
     list_add_tail( &object->pool->pools[object->priority], &object->pool_entry );
 }
+#endif
 
+#ifdef __REACTOS__
+/***********************************************************************
+ *           tp_object_submit    (internal)
+ *
+ * Submits a threadpool object to the associated threadpool. This
+ * function has to be VOID because TpPostWork can never fail on Windows.
+ *
+ * Every submission queues its own item on the queue of the calling thread,
+ * so posting doesn't need pool->cs unless a worker has to be woken up or
+ * started.
+ */
+static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
+{
+    struct threadpool *pool = object->pool;
+    struct threadpool_queue *queue;
+    struct threadpool_item *item;
+    SLIST_ENTRY *entry;
+
+    assert( !object->shutdown );
+    assert( !pool->shutdown );
+
+    if ((entry = RtlInterlockedPopEntrySList( &pool->free_items )))
+        item = CONTAINING_RECORD( entry, struct threadpool_item, u.free_entry );
+    else
+        item = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*item) );
+
+    /* Count how often the object was signaled. */
+    if (object->type == TP_OBJECT_TYPE_WAIT && signaled)
+        InterlockedIncrement( &object->u.wait.signaled );
+
+    /* Increment refcount, it is released once the callback was processed. */
+    InterlockedIncrement( &object->refcount );
+    InterlockedIncrement( &object->num_pending_callbacks );
+
+    if (!item)
+    {
+        /* Leave the callback to the item embedded in the object, which holds
+         * a reference of its own while it is queued. If it is queued already,
+         * the worker picking it up will see this callback too. */
+        InterlockedIncrement( &object->fallback_callbacks );
+        if (InterlockedCompareExchange( &object->fallback_queued, TRUE, FALSE ))
+            return;
+        InterlockedIncrement( &object->refcount );
+        item = &object->fallback_item;
+    }
+    item->object = object;
+
+    queue = threadpool_get_queue( pool );
+    RtlAcquireSRWLockExclusive( &queue->lock );
+    list_add_tail( &queue->items[object->priority], &item->u.entry );
+    InterlockedIncrement( &queue->count );
+    RtlReleaseSRWLockExclusive( &queue->lock );
+
+    /* Wake up an idle worker, or see if the pool should grow. Workers
+     * announce they're idle before checking the queues a last time. */
+    if (pool->num_idle_workers)
+    {
+        RtlEnterCriticalSection( &pool->cs );
+        assert( pool->num_workers > 0 );
+        RtlWakeConditionVariable( &pool->update_event );
+        RtlLeaveCriticalSection( &pool->cs );
+    }
+    else tp_threadpool_grow( pool );
+}
+#else
 /***********************************************************************
  *           tp_object_submit    (internal)
  *
@@ -2154,7 +2425,33 @@ static void tp_object_submit( struct threadpool_object *object, BOOL signaled )
 
     RtlLeaveCriticalSection( &pool->cs );
 }
+#endif
+
+#ifdef __REACTOS__
+/***********************************************************************
+ *           tp_object_cancel    (internal)
+ *
+ * Cancels all currently pending callbacks for a specific object. Their
+ * queued items stay where they are, and are dropped by the workers.
+ */
+static void tp_object_cancel( struct threadpool_object *object )
+{
+    struct threadpool *pool = object->pool;
 
+    RtlEnterCriticalSection( &pool->cs );
+    if (InterlockedExchange( &object->num_pending_callbacks, 0 ))
+    {
+        if (object->type == TP_OBJECT_TYPE_WAIT)
+            InterlockedExchange( &object->u.wait.signaled, 0 );
+    }
+    if (object->type == TP_OBJECT_TYPE_IO)
+    {
+        object->u.io.skipped_count += object->u.io.pending_count;
+        object->u.io.pending_count = 0;
+    }
+    RtlLeaveCriticalSection( &pool->cs );
+}
+#else
 /***********************************************************************
  *           tp_object_cancel    (internal)
  *
@@ -2185,6 +2482,7 @@ static void tp_object_cancel( struct threadpool_object *object )
     while (pending_callbacks--)
         tp_object_release( object );
 }
+#endif
 
 static BOOL object_is_finished( struct threadpool_object *object, BOOL group )
 {
@@ -2294,6 +2592,45 @@ static BOOL tp_object_release( struct threadpool_object *object )
     return TRUE;
 }
 
+#ifdef __REACTOS__
+/***********************************************************************
+ *           threadpool_get_next_item    (internal)
+ *
+ * Takes the next item from the queue of the worker, or steals one from
+ * the other queues when it is empty.
+ */
+static struct threadpool_item *threadpool_get_next_item( struct threadpool *pool,
+                                                         struct threadpool_queue *home )
+{
+    struct threadpool_queue *queue;
+    struct list *ptr = NULL;
+    unsigned int i, j, index = home - pool->queues;
+
+    for (i = 0; i < pool->num_queues; ++i)
+    {
+        queue = &pool->queues[(index + i) & (pool->num_queues - 1)];
+        if (!queue->count)
+            continue;
+
+        RtlAcquireSRWLockExclusive( &queue->lock );
+        for (j = 0; j < ARRAY_SIZE(queue->items); ++j)
+        {
+            if ((ptr = list_head( &queue->items[j] )))
+            {
+                list_remove( ptr );
+                InterlockedDecrement( &queue->count );
+                break;
+            }
+        }
+        RtlReleaseSRWLockExclusive( &queue->lock );
+
+        if (ptr)
+            return LIST_ENTRY( ptr, struct threadpool_item, u.entry );
+    }
+
+    return NULL;
+}
+#else
 static struct list *threadpool_get_next_item( const struct threadpool *pool )
 {
     struct list *ptr;
@@ -2307,6 +2644,7 @@ static struct list *threadpool_get_next_item( const struct threadpool *pool )
 
     return ptr;
 }
+#endif
 
 /***********************************************************************
  *           tp_object_execute    (internal)
@@ -2323,13 +2661,23 @@ static void tp_object_execute( struct threadpool_object *object, BOOL wait_threa
     TP_WAIT_RESULT wait_result = 0;
     NTSTATUS status;
 
+#ifdef __REACTOS__
+    /* Counters are only decreased with pool->cs held. */
+    assert( object->num_pending_callbacks > 0 );
+    InterlockedDecrement( &object->num_pending_callbacks );
+#else
     object->num_pending_callbacks--;
+#endif
 
     /* For wait objects check if they were signaled or have timed out. */
     if (object->type == TP_OBJECT_TYPE_WAIT)
     {
         wait_result = object->u.wait.signaled ? WAIT_OBJECT_0 : WAIT_TIMEOUT;
+#ifdef __REACTOS__
+        if (wait_result == WAIT_OBJECT_0) InterlockedDecrement( &object->u.wait.signaled );
+#else
         if (wait_result == WAIT_OBJECT_0) object->u.wait.signaled--;
+#endif
     }
     else if (object->type == TP_OBJECT_TYPE_IO)
     {
@@ -2477,6 +2825,93 @@ static void CALLBACK threadpool_worker_proc( void *param )
 #endif
 {
     struct threadpool *pool = param;
+#ifdef __REACTOS__
+    struct threadpool_queue *queue = threadpool_get_queue( pool );
+    struct threadpool_object *object;
+    struct threadpool_item *item;
+    LARGE_INTEGER timeout;
+    NTSTATUS status;
+    BOOL fallback;
+    LONG count;
+
+    TRACE( "starting worker thread for pool %p\n", pool );
+    set_thread_name(L"wine_threadpool_worker");
+
+    for (;;)
+    {
+        while ((item = threadpool_get_next_item( pool, queue )))
+        {
+            object = item->object;
+            if ((fallback = (item == &object->fallback_item)))
+            {
+                /* Unqueue it first, so that later submissions queue it again. */
+                InterlockedExchange( &object->fallback_queued, FALSE );
+                count = InterlockedExchange( &object->fallback_callbacks, 0 );
+            }
+            else
+            {
+                RtlInterlockedPushEntrySList( &pool->free_items, &item->u.free_entry );
+                count = 1;
+            }
+
+            /* Let the pool grow if more work is waiting behind this item. */
+            tp_threadpool_grow( pool );
+
+            while (count--)
+            {
+                /* The callback is stale if it was cancelled meanwhile. */
+                RtlEnterCriticalSection( &pool->cs );
+                if (object->num_pending_callbacks)
+                {
+                    pool->num_busy_workers++;
+                    tp_object_execute( object, FALSE );
+                    assert(pool->num_busy_workers);
+                    pool->num_busy_workers--;
+                }
+                RtlLeaveCriticalSection( &pool->cs );
+                tp_object_release( object );
+            }
+
+            InterlockedIncrement( &queue->completed );
+            if (fallback)
+                tp_object_release( object );
+        }
+
+        /* Announce that this thread is idle before checking the queues again,
+         * so that submitters either see it or their item is found here. */
+        RtlEnterCriticalSection( &pool->cs );
+        InterlockedIncrement( &pool->num_idle_workers );
+        if (threadpool_has_items( pool ))
+        {
+            InterlockedDecrement( &pool->num_idle_workers );
+            RtlLeaveCriticalSection( &pool->cs );
+            continue;
+        }
+
+        /* Shutdown worker thread if requested. */
+        if (pool->shutdown)
+        {
+            InterlockedDecrement( &pool->num_idle_workers );
+            break;
+        }
+
+        /* Wait for new tasks or until the timeout expires. A thread only terminates
+         * when no new tasks are available, and the number of threads can be
+         * decreased without violating the min_workers limit. An exception is when
+         * min_workers == 0, then objcount is used to detect if the last thread
+         * can be terminated. */
+        timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
+        status = RtlSleepConditionVariableCS( &pool->update_event, &pool->cs, &timeout );
+        InterlockedDecrement( &pool->num_idle_workers );
+        if (status == STATUS_TIMEOUT && !threadpool_has_items( pool ) &&
+            (pool->num_workers > max( pool->min_workers, 1 ) ||
+            (!pool->min_workers && !pool->objcount)))
+        {
+            break;
+        }
+        RtlLeaveCriticalSection( &pool->cs );
+    }
+#else
     LARGE_INTEGER timeout;
     struct list *ptr;
 
@@ -2522,6 +2957,7 @@ static void CALLBACK threadpool_worker_proc( void *param )
             break;
         }
     }
+#endif
     pool->num_workers--;
     RtlLeaveCriticalSection( &pool->cs );
 
@@ -2533,6 +2969,57 @@ static void CALLBACK threadpool_worker_proc( void *param )
 #endif
 }
 
+#ifdef __REACTOS__
+/***********************************************************************
+ *           threadpool_gate_proc    (internal)
+ *
+ * Adds worker threads while queued work isn't making progress, for
+ * example because all workers are blocked in their callbacks. The thread
+ * exits after the pool has not been starved for a while.
+ */
+ULONG NTAPI threadpool_gate_proc(PVOID param )
+{
+    struct threadpool *pool = param;
+    LONG completed, last_completed;
+    LARGE_INTEGER delay;
+    int quiet_rounds = 0;
+
+    TRACE( "starting gate thread for pool %p\n", pool );
+    set_thread_name(L"wine_threadpool_gate");
+
+    delay.QuadPart = (ULONGLONG)THREADPOOL_INJECTION_DELAY * -10000;
+    last_completed = threadpool_get_completed( pool );
+
+    RtlEnterCriticalSection( &pool->cs );
+    while (!pool->shutdown)
+    {
+        RtlLeaveCriticalSection( &pool->cs );
+        NtDelayExecution( FALSE, &delay );
+        RtlEnterCriticalSection( &pool->cs );
+
+        completed = threadpool_get_completed( pool );
+        if (!pool->num_idle_workers && threadpool_has_items( pool ))
+        {
+            /* Nothing was processed during the last interval, add a worker. */
+            if (completed == last_completed && pool->num_workers < pool->max_workers)
+                tp_new_worker_thread( pool );
+            quiet_rounds = 0;
+        }
+        else if (++quiet_rounds >= THREADPOOL_GATE_ROUNDS)
+            break;
+
+        last_completed = completed;
+    }
+    pool->gate_running = FALSE;
+    RtlLeaveCriticalSection( &pool->cs );
+
+    TRACE( "terminating gate thread for pool %p\n", pool );
+    tp_threadpool_release( pool );
+    RtlExitUserThread( 0 );
+    return STATUS_SUCCESS;
+}
+#endif
+
 /***********************************************************************
  *           TpAllocCleanupGroup    (NTDLL.@)
  */